@@ -0,0 +1,713 @@
+#define _GNU_SOURCE
+#include "async_runtime.h"
+#include "runtime/gc.h"
+#include "runtime/interpreter.h"
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+/* The sanitizers must be told whenever the stack changes under them */
+#if defined(__has_feature)
+#  if __has_feature(address_sanitizer)
+#    define ASYNC_ASAN 1
+#  endif
+#  if __has_feature(thread_sanitizer)
+#    define ASYNC_TSAN 1
+#  endif
+#endif
+#if defined(__SANITIZE_ADDRESS__)
+#  define ASYNC_ASAN 1
+#endif
+#if defined(__SANITIZE_THREAD__)
+#  define ASYNC_TSAN 1
+#endif
+#ifdef ASYNC_ASAN
+#include <sanitizer/common_interface_defs.h>
+#endif
+#ifdef ASYNC_TSAN
+#include <sanitizer/tsan_interface.h>
+#endif
+
+/* Stacks are reserved, not committed: a coroutine only pays for the pages
+   it touches.  The tree-walker recurses on the C stack, hence the size. */
+#define COROUTINE_STACK_SIZE (1u << 20)
+#define STACK_CACHE 16
+#define MAX_EVENTS 64
+
+/* ========================================================================= */
+/* Stack switching                                                           */
+/* ========================================================================= */
+
+/* swapcontext also saves and restores the signal mask, a system call each
+   way.  Nothing here changes signal masks, so on x86-64 a switch just
+   pushes the callee-saved registers and swaps stack pointers; other
+   targets fall back to ucontext. */
+#if defined(__x86_64__) && defined(__ELF__)
+
+typedef struct {
+    void *sp;
+} StackContext;
+
+void lilith_stack_switch(void **save, void *load);
+__asm__(
+    ".text\n"
+    ".globl lilith_stack_switch\n"
+    ".hidden lilith_stack_switch\n"
+    ".type lilith_stack_switch, @function\n"
+    ".p2align 4\n"
+    "lilith_stack_switch:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq %rsi, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+    ".size lilith_stack_switch, .-lilith_stack_switch\n");
+
+/* The first switch pops six zeroed registers and returns into `entry`,
+   aligned as if called; it must never return */
+static void context_make(StackContext *ctx, char *stack, size_t size, void (*entry)(void)) {
+    uintptr_t *sp = (uintptr_t *)((uintptr_t)(stack + size) & ~(uintptr_t)15);
+    *--sp = 0;
+    *--sp = (uintptr_t)entry;
+    for (int i = 0; i < 6; i++) *--sp = 0;
+    ctx->sp = sp;
+}
+
+static void context_switch(StackContext *from, StackContext *to) {
+    lilith_stack_switch(&from->sp, to->sp);
+}
+
+#else
+
+typedef struct {
+    ucontext_t uc;
+} StackContext;
+
+static void context_make(StackContext *ctx, char *stack, size_t size, void (*entry)(void)) {
+    getcontext(&ctx->uc);
+    ctx->uc.uc_stack.ss_sp = stack;
+    ctx->uc.uc_stack.ss_size = size;
+    ctx->uc.uc_link = NULL;
+    makecontext(&ctx->uc, entry, 0);
+}
+
+static void context_switch(StackContext *from, StackContext *to) {
+    swapcontext(&from->uc, &to->uc);
+}
+
+#endif
+
+struct Coroutine {
+    StackContext context;
+    char *stack;                    /* mapping, guard page lowest */
+    CoroutineFn fn;
+    void *arg;
+    GcRootStack roots;              /* its own, or the loop's while it runs */
+    int pins;
+    Interpreter *interp;
+    int finished;
+    Fiber *in_fiber;                /* the fiber it parked in, if any */
+    Coroutine *next;                /* inbox or run queue */
+#ifdef ASYNC_ASAN
+    const void *stack_bottom;       /* of the stack it parked on */
+    size_t stack_size;
+#endif
+#ifdef ASYNC_TSAN
+    void *fiber;
+    void *parked_fiber;
+#endif
+};
+
+struct Fiber {
+    StackContext context;
+    StackContext caller;            /* where the resuming thread left off */
+    char *stack;                    /* mapped on first resume */
+    CoroutineFn fn;
+    void *arg;
+    GcRootStack roots;              /* its own, or the resumer's while it runs */
+    int pins;
+    Interpreter *interp;
+    int finished;
+#ifdef ASYNC_ASAN
+    const void *caller_bottom;
+    size_t caller_size;
+#endif
+#ifdef ASYNC_TSAN
+    void *fiber;
+    void *caller_fiber;
+#endif
+};
+
+typedef struct {
+    uint64_t deadline;              /* CLOCK_MONOTONIC, nanoseconds */
+    Coroutine *co;
+} Timer;
+
+/* ========================================================================= */
+/* Loop state                                                                */
+/* ========================================================================= */
+
+/* Shared with other threads, under loop_lock: coroutines to start or
+   resume, and the loop's lifecycle */
+static pthread_mutex_t loop_lock = PTHREAD_MUTEX_INITIALIZER;
+static Coroutine *inbox_head = NULL;
+static Coroutine *inbox_tail = NULL;
+static pthread_t loop_thread;
+static int loop_running = 0;
+static int loop_stopping = 0;
+static int epoll_fd = -1;
+static int wake_fd = -1;
+
+/* Loop thread only */
+static Coroutine *ready_head = NULL;
+static Coroutine *ready_tail = NULL;
+static size_t live = 0;
+static Timer *timers = NULL;        /* binary min-heap on deadline */
+static size_t timer_count = 0;
+static size_t timer_capacity = 0;
+static StackContext loop_context;
+static _Thread_local Coroutine *current = NULL;
+static _Thread_local Fiber *running_fiber = NULL;
+
+/* Stacks freed by coroutines and fibers, for either to reuse */
+static pthread_mutex_t stack_lock = PTHREAD_MUTEX_INITIALIZER;
+static char *stack_cache[STACK_CACHE];
+static size_t stack_cache_count = 0;
+#ifdef ASYNC_ASAN
+static const void *loop_stack_bottom = NULL;
+static size_t loop_stack_size = 0;
+#endif
+#ifdef ASYNC_TSAN
+static void *loop_fiber = NULL;
+#endif
+
+static void out_of_memory(void) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static size_t page_size(void) {
+    static size_t size = 0;
+    if (!size) size = (size_t)sysconf(_SC_PAGESIZE);
+    return size;
+}
+
+/* ========================================================================= */
+/* Switching                                                                 */
+/* ========================================================================= */
+
+/* Coroutine to loop.  `exiting` when the coroutine will never run again. */
+static void switch_to_loop(Coroutine *co, int exiting) {
+    (void)exiting;
+#ifdef ASYNC_ASAN
+    void *fake_stack = NULL;
+    __sanitizer_start_switch_fiber(exiting ? NULL : &fake_stack, loop_stack_bottom, loop_stack_size);
+#endif
+#ifdef ASYNC_TSAN
+    /* Parking inside a fiber resumes there */
+    co->parked_fiber = __tsan_get_current_fiber();
+    __tsan_switch_to_fiber(loop_fiber, 0);
+#endif
+    /* An exiting coroutine's context is saved but never resumed */
+    context_switch(&co->context, &loop_context);
+#ifdef ASYNC_ASAN
+    __sanitizer_finish_switch_fiber(fake_stack, &loop_stack_bottom, &loop_stack_size);
+#endif
+}
+
+static void coroutine_main(void) {
+    Coroutine *co = current;
+#ifdef ASYNC_ASAN
+    __sanitizer_finish_switch_fiber(NULL, &loop_stack_bottom, &loop_stack_size);
+#endif
+    co->fn(co->arg);
+    co->finished = 1;
+    switch_to_loop(co, 1);
+}
+
+/* Loop to coroutine, until it parks or finishes.  Its roots, pins,
+   interpreter and fiber go in with it and come back out: a coroutine may
+   park inside a fiber it resumed, on that fiber's stack. */
+static void switch_to(Coroutine *co) {
+    int pins = gc_pin_suspend();
+    gc_pin_resume(co->pins);
+    gc_swap_roots(&co->roots);
+    Interpreter *interp = interpreter_current();
+    interpreter_set_current(co->interp);
+    Fiber *fiber = running_fiber;
+    running_fiber = co->in_fiber;
+    current = co;
+
+#ifdef ASYNC_ASAN
+    void *fake_stack = NULL;
+    __sanitizer_start_switch_fiber(&fake_stack, co->stack_bottom, co->stack_size);
+#endif
+#ifdef ASYNC_TSAN
+    __tsan_switch_to_fiber(co->parked_fiber, 0);
+#endif
+    context_switch(&loop_context, &co->context);
+#ifdef ASYNC_ASAN
+    __sanitizer_finish_switch_fiber(fake_stack, &co->stack_bottom, &co->stack_size);
+#endif
+
+    current = NULL;
+    co->in_fiber = running_fiber;
+    running_fiber = fiber;
+    co->interp = interpreter_current();
+    interpreter_set_current(interp);
+    gc_swap_roots(&co->roots);
+    co->pins = gc_pin_suspend();
+    gc_pin_resume(pins);
+}
+
+/* ========================================================================= */
+/* Coroutine lifecycle                                                       */
+/* ========================================================================= */
+
+static char *take_stack(void) {
+#ifndef ASYNC_ASAN
+    /* ASan keeps poisoning from the previous owner, so no reuse there */
+    pthread_mutex_lock(&stack_lock);
+    char *cached = stack_cache_count > 0 ? stack_cache[--stack_cache_count] : NULL;
+    pthread_mutex_unlock(&stack_lock);
+    if (cached) return cached;
+#endif
+    char *stack = (char *)mmap(NULL, COROUTINE_STACK_SIZE, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+    if (stack == MAP_FAILED) out_of_memory();
+    mprotect(stack, page_size(), PROT_NONE);
+    return stack;
+}
+
+static void release_stack(char *stack) {
+#ifndef ASYNC_ASAN
+    pthread_mutex_lock(&stack_lock);
+    int cached = stack_cache_count < STACK_CACHE;
+    if (cached) stack_cache[stack_cache_count++] = stack;
+    pthread_mutex_unlock(&stack_lock);
+    if (cached) return;
+#endif
+    munmap(stack, COROUTINE_STACK_SIZE);
+}
+
+static void start(Coroutine *co) {
+    size_t guard = page_size();
+    co->stack = take_stack();
+    context_make(&co->context, co->stack + guard, COROUTINE_STACK_SIZE - guard, coroutine_main);
+#ifdef ASYNC_ASAN
+    co->stack_bottom = co->stack + guard;
+    co->stack_size = COROUTINE_STACK_SIZE - guard;
+#endif
+#ifdef ASYNC_TSAN
+    co->fiber = __tsan_create_fiber(0);
+    co->parked_fiber = co->fiber;
+#endif
+    gc_register_root_stack(&co->roots);
+    live++;
+}
+
+static void finish(Coroutine *co) {
+    gc_unregister_root_stack(&co->roots);
+    free(co->roots.values);
+#ifdef ASYNC_TSAN
+    __tsan_destroy_fiber(co->fiber);
+#endif
+    release_stack(co->stack);
+    free(co);
+    live--;
+}
+
+static void make_ready(Coroutine *co) {
+    co->next = NULL;
+    if (ready_tail) ready_tail->next = co;
+    else ready_head = co;
+    ready_tail = co;
+}
+
+/* Run what is runnable now; what becomes runnable meanwhile waits for the
+   next round, so timers and sockets are polled in between */
+static void run_ready(void) {
+    Coroutine *co = ready_head;
+    ready_head = ready_tail = NULL;
+    while (co) {
+        Coroutine *next = co->next;
+        if (!co->stack) start(co);
+        switch_to(co);
+        if (co->finished) finish(co);
+        co = next;
+    }
+}
+
+/* ========================================================================= */
+/* Timers                                                                    */
+/* ========================================================================= */
+
+static void timer_push(uint64_t deadline, Coroutine *co) {
+    if (timer_count == timer_capacity) {
+        timer_capacity = timer_capacity ? timer_capacity * 2 : 64;
+        timers = (Timer *)realloc(timers, sizeof(Timer) * timer_capacity);
+        if (!timers) out_of_memory();
+    }
+    size_t i = timer_count++;
+    while (i > 0 && timers[(i - 1) / 2].deadline > deadline) {
+        timers[i] = timers[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    timers[i].deadline = deadline;
+    timers[i].co = co;
+}
+
+static Coroutine *timer_pop(void) {
+    Coroutine *co = timers[0].co;
+    Timer last = timers[--timer_count];
+    size_t i = 0;
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= timer_count) break;
+        if (child + 1 < timer_count && timers[child + 1].deadline < timers[child].deadline) child++;
+        if (timers[child].deadline >= last.deadline) break;
+        timers[i] = timers[child];
+        i = child;
+    }
+    if (timer_count > 0) timers[i] = last;
+    return co;
+}
+
+/* Ready the coroutines whose timers expired; returns the epoll timeout */
+static int expire_timers(void) {
+    if (timer_count == 0) return -1;
+    uint64_t now = now_ns();
+    while (timer_count > 0 && timers[0].deadline <= now) make_ready(timer_pop());
+    if (timer_count == 0) return -1;
+    uint64_t wait = (timers[0].deadline - now + 999999) / 1000000;
+    return wait > 60000 ? 60000 : (int)wait;
+}
+
+/* ========================================================================= */
+/* The loop thread                                                           */
+/* ========================================================================= */
+
+static void notify_loop(void) {
+    uint64_t one = 1;
+    ssize_t written;
+    do {
+        written = write(wake_fd, &one, sizeof(one));
+    } while (written < 0 && errno == EINTR);
+}
+
+/* Returns 0 once the loop should stop */
+static int take_inbox(void) {
+    pthread_mutex_lock(&loop_lock);
+    Coroutine *co = inbox_head;
+    inbox_head = inbox_tail = NULL;
+    int keep_going = co || live > 0 || !loop_stopping;
+    pthread_mutex_unlock(&loop_lock);
+    while (co) {
+        Coroutine *next = co->next;
+        make_ready(co);
+        co = next;
+    }
+    return keep_going;
+}
+
+static void *loop_main(void *arg) {
+    (void)arg;
+    gc_thread_attach();
+#ifdef ASYNC_TSAN
+    loop_fiber = __tsan_get_current_fiber();
+#endif
+    struct epoll_event events[MAX_EVENTS];
+    while (take_inbox()) {
+        run_ready();
+        int timeout = expire_timers();
+        if (ready_head) continue;
+
+        /* Nothing to run until an event arrives, and no objects held */
+        gc_safe_enter();
+        int count = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout);
+        gc_safe_leave();
+        for (int i = 0; i < count; i++) {
+            Coroutine *co = (Coroutine *)events[i].data.ptr;
+            if (co) {
+                make_ready(co);
+            } else {
+                uint64_t wakes;
+                if (read(wake_fd, &wakes, sizeof(wakes)) < 0 && errno != EAGAIN) perror("eventfd");
+            }
+        }
+        expire_timers();
+    }
+
+    free(timers);
+    timers = NULL;
+    timer_count = timer_capacity = 0;
+    gc_thread_detach(0);
+    return NULL;
+}
+
+/* Under loop_lock */
+static void start_loop_locked(void) {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd < 0 || wake_fd < 0) {
+        perror("async runtime");
+        exit(1);
+    }
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev);
+    if (pthread_create(&loop_thread, NULL, loop_main, NULL) != 0) {
+        perror("async runtime");
+        exit(1);
+    }
+    loop_running = 1;
+}
+
+static void enqueue(Coroutine *co) {
+    co->next = NULL;
+    pthread_mutex_lock(&loop_lock);
+    if (!loop_running) start_loop_locked();
+    if (inbox_tail) inbox_tail->next = co;
+    else inbox_head = co;
+    inbox_tail = co;
+    pthread_mutex_unlock(&loop_lock);
+    notify_loop();
+}
+
+/* ========================================================================= */
+/* Public API                                                                */
+/* ========================================================================= */
+
+void async_spawn(CoroutineFn fn, void *arg) {
+    Coroutine *co = (Coroutine *)calloc(1, sizeof(Coroutine));
+    if (!co) out_of_memory();
+    co->fn = fn;
+    co->arg = arg;
+    enqueue(co);
+}
+
+Coroutine *async_current(void) {
+    return current;
+}
+
+void async_park(void) {
+    switch_to_loop(current, 0);
+}
+
+void async_wake(Coroutine *co) {
+    enqueue(co);
+}
+
+/* Outside a coroutine the waits below block the calling thread, which
+   holds no objects meanwhile */
+int async_wait_fd(int fd, unsigned events) {
+    if (!current) {
+        struct pollfd pfd = { .fd = fd, .events = (short)((events & EPOLLIN ? POLLIN : 0) |
+                                                          (events & EPOLLOUT ? POLLOUT : 0)) };
+        int ready;
+        gc_safe_enter();
+        do {
+            ready = poll(&pfd, 1, -1);
+        } while (ready < 0 && errno == EINTR);
+        gc_safe_leave();
+        return ready < 0 ? -1 : 0;
+    }
+    struct epoll_event ev = { .events = events | EPOLLONESHOT, .data.ptr = current };
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) return -1;
+    async_park();
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    return 0;
+}
+
+int async_sleep(double seconds) {
+    if (!(seconds > 0)) seconds = 0;
+    if (!current) {
+        struct timespec ts;
+        ts.tv_sec = (time_t)seconds;
+        ts.tv_nsec = (long)((seconds - (double)ts.tv_sec) * 1e9);
+        gc_safe_enter();
+        while (nanosleep(&ts, &ts) < 0 && errno == EINTR) {}
+        gc_safe_leave();
+        return 0;
+    }
+    timer_push(now_ns() + (uint64_t)(seconds * 1e9), current);
+    async_park();
+    return 0;
+}
+
+int async_wait_child(pid_t pid, int *status) {
+    if (current) {
+#ifdef SYS_pidfd_open
+        int fd = (int)syscall(SYS_pidfd_open, pid, 0);
+        if (fd >= 0) {
+            async_wait_fd(fd, EPOLLIN);
+            close(fd);
+        }
+#endif
+        /* Without pidfds, poll for the exit */
+        pid_t done;
+        while ((done = waitpid(pid, status, WNOHANG)) == 0) async_sleep(0.01);
+        return done < 0 ? -1 : 0;
+    }
+    pid_t done;
+    gc_safe_enter();
+    do {
+        done = waitpid(pid, status, 0);
+    } while (done < 0 && errno == EINTR);
+    gc_safe_leave();
+    return done < 0 ? -1 : 0;
+}
+
+void async_shutdown(void) {
+    pthread_mutex_lock(&loop_lock);
+    if (!loop_running) {
+        pthread_mutex_unlock(&loop_lock);
+        return;
+    }
+    loop_stopping = 1;
+    pthread_mutex_unlock(&loop_lock);
+    notify_loop();
+
+    gc_safe_enter();
+    pthread_join(loop_thread, NULL);
+    gc_safe_leave();
+
+    pthread_mutex_lock(&stack_lock);
+    while (stack_cache_count > 0) munmap(stack_cache[--stack_cache_count], COROUTINE_STACK_SIZE);
+    pthread_mutex_unlock(&stack_lock);
+
+    pthread_mutex_lock(&loop_lock);
+    close(epoll_fd);
+    close(wake_fd);
+    epoll_fd = wake_fd = -1;
+    loop_running = 0;
+    loop_stopping = 0;
+    pthread_mutex_unlock(&loop_lock);
+}
+
+/* ========================================================================= */
+/* Fibers                                                                    */
+/* ========================================================================= */
+
+/* Fiber to the thread that resumed it */
+static void fiber_switch_out(Fiber *fiber, int exiting) {
+    (void)exiting;
+#ifdef ASYNC_ASAN
+    void *fake_stack = NULL;
+    __sanitizer_start_switch_fiber(exiting ? NULL : &fake_stack, fiber->caller_bottom, fiber->caller_size);
+#endif
+#ifdef ASYNC_TSAN
+    __tsan_switch_to_fiber(fiber->caller_fiber, 0);
+#endif
+    context_switch(&fiber->context, &fiber->caller);
+#ifdef ASYNC_ASAN
+    /* The next resume may come from another stack */
+    __sanitizer_finish_switch_fiber(fake_stack, &fiber->caller_bottom, &fiber->caller_size);
+#endif
+}
+
+static void fiber_main(void) {
+    Fiber *fiber = running_fiber;
+#ifdef ASYNC_ASAN
+    __sanitizer_finish_switch_fiber(NULL, &fiber->caller_bottom, &fiber->caller_size);
+#endif
+    fiber->fn(fiber->arg);
+    fiber->finished = 1;
+    fiber_switch_out(fiber, 1);
+}
+
+Fiber *fiber_new(CoroutineFn fn, void *arg) {
+    Fiber *fiber = (Fiber *)calloc(1, sizeof(Fiber));
+    if (!fiber) out_of_memory();
+    fiber->fn = fn;
+    fiber->arg = arg;
+    gc_register_root_stack(&fiber->roots);
+    return fiber;
+}
+
+int fiber_resume(Fiber *fiber) {
+    if (!fiber->stack) {
+        size_t guard = page_size();
+        fiber->stack = take_stack();
+        context_make(&fiber->context, fiber->stack + guard, COROUTINE_STACK_SIZE - guard, fiber_main);
+#ifdef ASYNC_TSAN
+        fiber->fiber = __tsan_create_fiber(0);
+#endif
+    }
+
+    int pins = gc_pin_suspend();
+    gc_pin_resume(fiber->pins);
+    gc_swap_roots(&fiber->roots);
+    Interpreter *interp = interpreter_current();
+    interpreter_set_current(fiber->interp);
+    Fiber *outer = running_fiber;
+    running_fiber = fiber;
+
+#ifdef ASYNC_ASAN
+    void *fake_stack = NULL;
+    size_t guard = page_size();
+    __sanitizer_start_switch_fiber(&fake_stack, fiber->stack + guard, COROUTINE_STACK_SIZE - guard);
+#endif
+#ifdef ASYNC_TSAN
+    fiber->caller_fiber = __tsan_get_current_fiber();
+    __tsan_switch_to_fiber(fiber->fiber, 0);
+#endif
+    context_switch(&fiber->caller, &fiber->context);
+#ifdef ASYNC_ASAN
+    __sanitizer_finish_switch_fiber(fake_stack, NULL, NULL);
+#endif
+
+    running_fiber = outer;
+    fiber->interp = interpreter_current();
+    interpreter_set_current(interp);
+    gc_swap_roots(&fiber->roots);
+    fiber->pins = gc_pin_suspend();
+    gc_pin_resume(pins);
+    return fiber->finished;
+}
+
+void *fiber_current_arg(void) {
+    return running_fiber ? running_fiber->arg : NULL;
+}
+
+void fiber_suspend(void) {
+    fiber_switch_out(running_fiber, 0);
+}
+
+void fiber_free(Fiber *fiber) {
+    gc_unregister_root_stack(&fiber->roots);
+    free(fiber->roots.values);
+    if (fiber->stack) {
+#ifdef ASYNC_TSAN
+        __tsan_destroy_fiber(fiber->fiber);
+#endif
+        release_stack(fiber->stack);
+    }
+    free(fiber);
+}
@@ -0,0 +1,79 @@
+#ifndef LILITH_ASYNC_RUNTIME_H
+#define LILITH_ASYNC_RUNTIME_H
+
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Event loop                                                                 */
+/* -------------------------------------------------------------------------- */
+
+/* One thread, started on first use, runs every coroutine.  A coroutine
+   has a C stack of its own, so it can be suspended anywhere, natives
+   included: waiting for a socket, a timer or a child process parks it and
+   the loop runs others until epoll reports the event.  Coroutines never
+   run in parallel with each other, only with the rest of the program.
+
+   Each coroutine also has its own temporary roots and pins (see gc.h) and
+   current interpreter, switched along with its stack. */
+
+typedef struct Coroutine Coroutine;
+typedef void (*CoroutineFn)(void *arg);
+
+/* Run fn(arg) as a new coroutine; from any thread */
+void async_spawn(CoroutineFn fn, void *arg);
+
+/* The coroutine running on the calling thread, NULL outside one */
+Coroutine *async_current(void);
+
+/* Suspend the running coroutine until async_wake is called on it */
+void async_park(void);
+
+/* Make a parked coroutine runnable; from any thread */
+void async_wake(Coroutine *co);
+
+/* Inside a coroutine, park it until `fd` is ready for `events` (EPOLLIN,
+   EPOLLOUT), `seconds` have passed, or child `pid` has exited.  They
+   return -1 with errno set on failure. */
+int async_wait_fd(int fd, unsigned events);
+int async_sleep(double seconds);
+int async_wait_child(pid_t pid, int *status);
+
+/* Stop the loop thread once every coroutine has finished */
+void async_shutdown(void);
+
+/* -------------------------------------------------------------------------- */
+/* Fibers                                                                     */
+/* -------------------------------------------------------------------------- */
+
+/* A fiber is a stack of the same kind, run by whichever thread resumes it
+   rather than by the loop, until it suspends or returns.  Generators use
+   them.  Like a coroutine it brings its roots, pins and interpreter along.
+   Creating and freeing one are safepoints. */
+
+typedef struct Fiber Fiber;
+
+Fiber *fiber_new(CoroutineFn fn, void *arg);
+
+/* Run the fiber until it suspends or returns; returns 1 once it returned.
+   A fiber must not be resumed while it runs, nor after it returned. */
+int fiber_resume(Fiber *fiber);
+
+/* The argument of the fiber running on the calling thread, NULL outside
+   one */
+void *fiber_current_arg(void);
+
+/* Inside a fiber, go back to the thread that resumed it */
+void fiber_suspend(void);
+
+/* Free a fiber, abandoning its stack if it is suspended */
+void fiber_free(Fiber *fiber);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,83 @@
+#include "scheduler.h"
+#include <pthread.h>
+
+/* Pieces per worker when parallel_for picks the grain */
+#define PIECES_PER_WORKER 8
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static ThreadPool *shared_pool = NULL;
+static size_t requested_workers = 0;
+
+ThreadPool *scheduler_pool(void) {
+    pthread_mutex_lock(&pool_lock);
+    if (!shared_pool) shared_pool = thread_pool_create(requested_workers);
+    ThreadPool *pool = shared_pool;
+    pthread_mutex_unlock(&pool_lock);
+    return pool;
+}
+
+/* Takes effect when the pool next starts */
+void scheduler_set_workers(size_t workers) {
+    pthread_mutex_lock(&pool_lock);
+    requested_workers = workers;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+void scheduler_shutdown(void) {
+    pthread_mutex_lock(&pool_lock);
+    thread_pool_destroy(shared_pool);
+    shared_pool = NULL;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+/* ========================================================================= */
+/* Parallel loops                                                            */
+/* ========================================================================= */
+
+typedef struct {
+    ThreadPool *pool;
+    size_t begin;
+    size_t end;
+    size_t grain;
+    RangeFn fn;
+    void *context;
+} RangeTask;
+
+static void run_range(void *arg) {
+    RangeTask *range = (RangeTask *)arg;
+    if (range->end - range->begin <= range->grain) {
+        range->fn(range->begin, range->end, range->context);
+        return;
+    }
+    size_t mid = range->begin + (range->end - range->begin) / 2;
+    RangeTask upper = *range;
+    upper.begin = mid;
+    Task task;
+    task_init(&task, run_range, &upper);
+    thread_pool_spawn(range->pool, &task);
+
+    RangeTask lower = *range;
+    lower.end = mid;
+    run_range(&lower);
+    thread_pool_join(range->pool, &task);
+}
+
+void parallel_for(ThreadPool *pool, size_t begin, size_t end, size_t grain,
+                  RangeFn fn, void *context) {
+    if (end <= begin) return;
+    if (grain == 0) {
+        grain = (end - begin) / (thread_pool_size(pool) * PIECES_PER_WORKER);
+        if (grain == 0) grain = 1;
+    }
+    RangeTask range = { pool, begin, end, grain, fn, context };
+    if (end - begin <= grain) {
+        fn(begin, end, context);
+        return;
+    }
+    /* Hand the whole range to the pool so the caller's thread, which may
+       not be a worker, only waits */
+    Task task;
+    task_init(&task, run_range, &range);
+    thread_pool_spawn(pool, &task);
+    thread_pool_join(pool, &task);
+}
@@ -0,0 +1,34 @@
+#ifndef LILITH_SCHEDULER_H
+#define LILITH_SCHEDULER_H
+
+#include "thread_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Scheduler                                                                  */
+/* -------------------------------------------------------------------------- */
+
+/* The runtime shares one work-stealing pool, started on first use with
+   one worker per CPU unless scheduler_set_workers said otherwise. */
+ThreadPool *scheduler_pool(void);
+void        scheduler_set_workers(size_t workers);
+void        scheduler_shutdown(void);
+
+/* Run fn over [begin, end) in pieces of at most `grain` items (0 picks a
+   grain that gives each worker several pieces).  The range is halved
+   recursively, one half spawned and the other run in place, so idle
+   workers steal the largest pieces first.  Returns once every piece has
+   run. */
+typedef void (*RangeFn)(size_t begin, size_t end, void *context);
+
+void parallel_for(ThreadPool *pool, size_t begin, size_t end, size_t grain,
+                  RangeFn fn, void *context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,355 @@
+#define _GNU_SOURCE
+#include "thread_pool.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define DEQUE_INITIAL_CAPACITY 256
+#define CACHE_LINE             64
+
+/* Failed searches for work before a worker parks, yielding in between */
+#define IDLE_SPINS             64
+
+/* ========================================================================= */
+/* Chase-Lev deque                                                           */
+/* ========================================================================= */
+
+/* After Le, Pop, Cohen and Zappa Nardelli, "Correct and Efficient
+   Work-Stealing for Weak Memory Models" (PPoPP 2013).  The owner pushes and
+   takes at the bottom; thieves steal at the top.  Buffers replaced by a
+   resize may still be read by a thief, so they are kept until the deque
+   is freed. */
+
+typedef struct DequeBuffer {
+    int64_t mask;                   /* capacity - 1, capacity a power of two */
+    struct DequeBuffer *retired;    /* previous, smaller buffers */
+    _Atomic(Task *) items[];
+} DequeBuffer;
+
+typedef struct {
+    _Alignas(CACHE_LINE) atomic_int_fast64_t top;
+    _Alignas(CACHE_LINE) atomic_int_fast64_t bottom;
+    _Atomic(DequeBuffer *) buffer;
+} Deque;
+
+static void *checked(void *ptr) {
+    if (!ptr) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    return ptr;
+}
+
+static DequeBuffer *buffer_new(int64_t capacity, DequeBuffer *retired) {
+    DequeBuffer *buffer = (DequeBuffer *)checked(malloc(sizeof(DequeBuffer) + sizeof(Task *) * (size_t)capacity));
+    buffer->mask = capacity - 1;
+    buffer->retired = retired;
+    return buffer;
+}
+
+static void deque_init(Deque *deque) {
+    atomic_init(&deque->top, 0);
+    atomic_init(&deque->bottom, 0);
+    atomic_init(&deque->buffer, buffer_new(DEQUE_INITIAL_CAPACITY, NULL));
+}
+
+static void deque_free(Deque *deque) {
+    DequeBuffer *buffer = atomic_load_explicit(&deque->buffer, memory_order_relaxed);
+    while (buffer) {
+        DequeBuffer *retired = buffer->retired;
+        free(buffer);
+        buffer = retired;
+    }
+}
+
+static DequeBuffer *deque_grow(Deque *deque, DequeBuffer *old, int64_t top, int64_t bottom) {
+    DequeBuffer *buffer = buffer_new((old->mask + 1) * 2, old);
+    for (int64_t i = top; i < bottom; i++) {
+        Task *task = atomic_load_explicit(&old->items[i & old->mask], memory_order_relaxed);
+        atomic_store_explicit(&buffer->items[i & buffer->mask], task, memory_order_relaxed);
+    }
+    atomic_store_explicit(&deque->buffer, buffer, memory_order_release);
+    return buffer;
+}
+
+/* Owner only */
+static void deque_push(Deque *deque, Task *task) {
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    DequeBuffer *buffer = atomic_load_explicit(&deque->buffer, memory_order_relaxed);
+    if (bottom - top > buffer->mask) buffer = deque_grow(deque, buffer, top, bottom);
+    atomic_store_explicit(&buffer->items[bottom & buffer->mask], task, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+}
+
+/* Owner only; NULL when empty */
+static Task *deque_take(Deque *deque) {
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    DequeBuffer *buffer = atomic_load_explicit(&deque->buffer, memory_order_relaxed);
+    atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+    if (top > bottom) {
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+        return NULL;
+    }
+    Task *task = atomic_load_explicit(&buffer->items[bottom & buffer->mask], memory_order_relaxed);
+    if (top == bottom) {
+        /* Last one: race the thieves for it */
+        if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                                                     memory_order_seq_cst, memory_order_relaxed))
+            task = NULL;
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    }
+    return task;
+}
+
+/* Any thread; NULL when empty or when another thief won */
+static Task *deque_steal(Deque *deque) {
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+    if (top >= bottom) return NULL;
+
+    DequeBuffer *buffer = atomic_load_explicit(&deque->buffer, memory_order_acquire);
+    Task *task = atomic_load_explicit(&buffer->items[top & buffer->mask], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                                                 memory_order_seq_cst, memory_order_relaxed))
+        return NULL;
+    return task;
+}
+
+/* ========================================================================= */
+/* Pool                                                                      */
+/* ========================================================================= */
+
+typedef struct Worker {
+    Deque deque;
+    ThreadPool *pool;
+    pthread_t thread;
+    uint64_t rng;                   /* victim selection */
+    int index;
+} Worker;
+
+struct ThreadPool {
+    Worker *workers;
+    size_t count;
+
+    pthread_mutex_t lock;           /* guards the injection queue and parking */
+    pthread_cond_t work_ready;      /* parked workers */
+    pthread_cond_t task_done;       /* blocked outside joiners */
+    Task *inject_head;
+    Task *inject_tail;
+
+    atomic_size_t pending;          /* spawned, not yet picked up */
+    atomic_size_t injected;         /* in the injection queue */
+    atomic_int sleepers;
+    atomic_int waiters;
+    atomic_int shutdown;
+};
+
+static _Thread_local Worker *current_worker = NULL;
+
+size_t thread_pool_cpu_count(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (size_t)count : 1;
+}
+
+int thread_pool_worker_index(void) {
+    return current_worker ? current_worker->index : -1;
+}
+
+size_t thread_pool_size(const ThreadPool *pool) {
+    return pool->count;
+}
+
+static Worker *worker_of(ThreadPool *pool) {
+    return current_worker && current_worker->pool == pool ? current_worker : NULL;
+}
+
+/* xorshift64 */
+static uint64_t next_random(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+static Task *take_injected(ThreadPool *pool) {
+    if (atomic_load_explicit(&pool->injected, memory_order_relaxed) == 0) return NULL;
+    pthread_mutex_lock(&pool->lock);
+    Task *task = pool->inject_head;
+    if (task) {
+        pool->inject_head = task->next;
+        if (!pool->inject_head) pool->inject_tail = NULL;
+        atomic_fetch_sub(&pool->injected, 1);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return task;
+}
+
+/* Own deque first, then the injection queue, then a sweep of victims
+   starting at a random one. */
+static Task *find_task(ThreadPool *pool, Worker *self) {
+    Task *task = self ? deque_take(&self->deque) : NULL;
+    if (!task) task = take_injected(pool);
+    if (!task) {
+        uint64_t seed = (uint64_t)(uintptr_t)&task | 1;
+        uint64_t *rng = self ? &self->rng : &seed;
+        size_t start = (size_t)(next_random(rng) % pool->count);
+        for (size_t i = 0; i < pool->count && !task; i++) {
+            Worker *victim = &pool->workers[(start + i) % pool->count];
+            if (victim != self) task = deque_steal(&victim->deque);
+        }
+    }
+    if (task) atomic_fetch_sub(&pool->pending, 1);
+    return task;
+}
+
+/* The task may be freed as soon as it is marked done */
+static void run_task(ThreadPool *pool, Task *task) {
+    task->fn(task->arg);
+    atomic_store(&task->done, 1);
+    if (atomic_load(&pool->waiters) > 0) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_broadcast(&pool->task_done);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+/* Sleep until something is spawned.  Spawners bump `pending` before
+   looking at `sleepers` and sleepers do the reverse, so one of the two
+   always sees the other. */
+static void park(ThreadPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    atomic_fetch_add(&pool->sleepers, 1);
+    while (atomic_load(&pool->pending) == 0 && !atomic_load(&pool->shutdown))
+        pthread_cond_wait(&pool->work_ready, &pool->lock);
+    atomic_fetch_sub(&pool->sleepers, 1);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void *worker_main(void *arg) {
+    Worker *self = (Worker *)arg;
+    ThreadPool *pool = self->pool;
+    current_worker = self;
+
+    unsigned idle = 0;
+    while (!atomic_load_explicit(&pool->shutdown, memory_order_acquire)) {
+        Task *task = find_task(pool, self);
+        if (task) {
+            run_task(pool, task);
+            idle = 0;
+        } else if (++idle < IDLE_SPINS) {
+            sched_yield();
+        } else {
+            park(pool);
+            idle = 0;
+        }
+    }
+    current_worker = NULL;
+    return NULL;
+}
+
+ThreadPool *thread_pool_create(size_t workers) {
+    if (workers == 0) workers = thread_pool_cpu_count();
+
+    ThreadPool *pool = (ThreadPool *)checked(calloc(1, sizeof(ThreadPool)));
+    size_t size = (sizeof(Worker) * workers + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1);
+    pool->workers = (Worker *)checked(aligned_alloc(CACHE_LINE, size));
+    pool->count = workers;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->task_done, NULL);
+    atomic_init(&pool->pending, 0);
+    atomic_init(&pool->injected, 0);
+    atomic_init(&pool->sleepers, 0);
+    atomic_init(&pool->waiters, 0);
+    atomic_init(&pool->shutdown, 0);
+
+    for (size_t i = 0; i < workers; i++) {
+        Worker *worker = &pool->workers[i];
+        deque_init(&worker->deque);
+        worker->pool = pool;
+        worker->rng = 0x9E3779B97F4A7C15ull * (i + 1);
+        worker->index = (int)i;
+    }
+    for (size_t i = 0; i < workers; i++) {
+        if (pthread_create(&pool->workers[i].thread, NULL, worker_main, &pool->workers[i]) != 0) {
+            fprintf(stderr, "Could not start worker thread\n");
+            exit(1);
+        }
+    }
+    return pool;
+}
+
+/* Outstanding tasks must have been joined */
+void thread_pool_destroy(ThreadPool *pool) {
+    if (!pool) return;
+    pthread_mutex_lock(&pool->lock);
+    atomic_store(&pool->shutdown, 1);
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (size_t i = 0; i < pool->count; i++) pthread_join(pool->workers[i].thread, NULL);
+    for (size_t i = 0; i < pool->count; i++) deque_free(&pool->workers[i].deque);
+    pthread_cond_destroy(&pool->task_done);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->workers);
+    free(pool);
+}
+
+/* ========================================================================= */
+/* Fork / join                                                               */
+/* ========================================================================= */
+
+void thread_pool_spawn(ThreadPool *pool, Task *task) {
+    Worker *self = worker_of(pool);
+    atomic_fetch_add(&pool->pending, 1);
+    if (self) {
+        deque_push(&self->deque, task);
+    } else {
+        pthread_mutex_lock(&pool->lock);
+        task->next = NULL;
+        if (pool->inject_tail) pool->inject_tail->next = task;
+        else pool->inject_head = task;
+        pool->inject_tail = task;
+        atomic_fetch_add(&pool->injected, 1);
+        pthread_mutex_unlock(&pool->lock);
+    }
+    if (atomic_load(&pool->sleepers) > 0) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_signal(&pool->work_ready);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+/* Workers keep running tasks until `task` is done.  Other threads help
+   for a while, then block. */
+void thread_pool_join(ThreadPool *pool, Task *task) {
+    Worker *self = worker_of(pool);
+    unsigned idle = 0;
+    while (!atomic_load_explicit(&task->done, memory_order_acquire)) {
+        Task *other = find_task(pool, self);
+        if (other) {
+            run_task(pool, other);
+            idle = 0;
+            continue;
+        }
+        if (self || ++idle < IDLE_SPINS) {
+            sched_yield();
+            continue;
+        }
+        pthread_mutex_lock(&pool->lock);
+        atomic_fetch_add(&pool->waiters, 1);
+        while (!atomic_load(&task->done)) pthread_cond_wait(&pool->task_done, &pool->lock);
+        atomic_fetch_sub(&pool->waiters, 1);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
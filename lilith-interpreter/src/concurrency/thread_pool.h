@@ -0,0 +1,63 @@
+#ifndef LILITH_THREAD_POOL_H
+#define LILITH_THREAD_POOL_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Work-stealing thread pool                                                  */
+/* -------------------------------------------------------------------------- */
+
+/* Each worker owns a Chase-Lev deque: it pushes and pops tasks at the
+   bottom, and idle workers steal from the top of a randomly chosen
+   victim's deque.  Tasks submitted from outside the pool go through a
+   shared injection queue.  Workers that find nothing to do park on a
+   condition variable until new work arrives.
+
+   Tasks are fork/join: thread_pool_spawn makes a task runnable and
+   thread_pool_join waits for it.  A joining thread runs other tasks while
+   it waits, so tasks may spawn and join subtasks to any depth without
+   tying up workers.  The pool never allocates or frees tasks; they
+   usually live on the spawning thread's stack. */
+
+typedef void (*TaskFn)(void *arg);
+
+typedef struct Task {
+    TaskFn fn;
+    void *arg;
+    atomic_int done;
+    struct Task *next;              /* injection queue link */
+} Task;
+
+typedef struct ThreadPool ThreadPool;
+
+/* `workers` of 0 means one per online CPU */
+ThreadPool *thread_pool_create(size_t workers);
+void        thread_pool_destroy(ThreadPool *pool);
+size_t      thread_pool_size(const ThreadPool *pool);
+
+static inline void task_init(Task *task, TaskFn fn, void *arg) {
+    task->fn = fn;
+    task->arg = arg;
+    atomic_init(&task->done, 0);
+    task->next = NULL;
+}
+
+void thread_pool_spawn(ThreadPool *pool, Task *task);
+void thread_pool_join(ThreadPool *pool, Task *task);
+
+/* Index of the calling worker in its pool, or -1 outside any pool */
+int thread_pool_worker_index(void);
+
+size_t thread_pool_cpu_count(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -4,6 +4,8 @@
 #include "lexer/lexer.h"
 #include "parser/parser.h"
 #include "runtime/interpreter.h"
+#include "runtime/gc.h"
+#include "concurrency/scheduler.h"
 
 static char *read_file(const char *path) {
     FILE *f = fopen(path, "rb");
@@ -25,16 +27,51 @@ static char *read_file(const char *path) {
     return buf;
 }
 
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--engine=ast|vm] [--gc-pause=<microseconds>] [--workers=<n>] <file.lilith>\n", prog);
+}
+
 int main(int argc, char **argv) {
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s <file.lilith>\n", argv[0]);
+    const char *path = NULL;
+    Engine engine = ENGINE_AST;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--engine=ast") == 0) {
+            engine = ENGINE_AST;
+        } else if (strcmp(argv[i], "--engine=vm") == 0) {
+            engine = ENGINE_VM;
+        } else if (strncmp(argv[i], "--gc-pause=", 11) == 0) {
+            char *end;
+            unsigned long us = strtoul(argv[i] + 11, &end, 10);
+            if (end == argv[i] + 11 || *end || us == 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            gc_set_pause_target((unsigned)us);
+        } else if (strncmp(argv[i], "--workers=", 10) == 0) {
+            char *end;
+            unsigned long workers = strtoul(argv[i] + 10, &end, 10);
+            if (end == argv[i] + 10 || *end || workers == 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            scheduler_set_workers((size_t)workers);
+        } else if (strncmp(argv[i], "--", 2) == 0 || path) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            path = argv[i];
+        }
+    }
+    if (!path) {
+        usage(argv[0]);
         return 1;
     }
 
-    char *source = read_file(argv[1]);
+    char *source = read_file(path);
     if (!source) return 1;
 
-    Lexer *lexer = lexer_create(source, argv[1]);
+    Lexer *lexer = lexer_create(source, path);
     AstNode *ast = parser_parse(lexer);
 
     if (!ast) {
@@ -46,6 +83,7 @@ int main(int argc, char **argv) {
 
     Interpreter interp;
     interpreter_init(&interp);
+    interp.engine = engine;
     Value result = interpreter_run(&interp, ast);
 
     if (interp.throw_flag) {
@@ -263,6 +263,100 @@ AstNode *ast_comprehension(AstNode *expr, AstNode **clauses, size_t clause_count
     return n;
 }
 
+typedef struct {
+    const char *var;
+    AstNode **callees;
+    size_t count;
+    size_t capacity;
+} PurityCheck;
+
+static void add_callee(PurityCheck *check, AstNode *callee) {
+    if (check->count + 1 > check->capacity) {
+        check->capacity = check->capacity < 4 ? 4 : check->capacity * 2;
+        check->callees = (AstNode **)realloc(check->callees, sizeof(AstNode *) * check->capacity);
+        if (!check->callees) {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+    }
+    check->callees[check->count++] = callee;
+}
+
+static int pure_expr(PurityCheck *check, AstNode *node) {
+    if (!node) return 1;
+    switch (node->type) {
+        case AST_NUMBER:
+        case AST_STRING:
+        case AST_BOOL:
+        case AST_NIL:
+        case AST_IDENTIFIER:
+            return 1;
+        case AST_BINARY:
+            return pure_expr(check, node->as.binary.left) && pure_expr(check, node->as.binary.right);
+        case AST_UNARY:
+            return pure_expr(check, node->as.unary.operand);
+        case AST_CALL: {
+            AstNode *callee = node->as.call.callee;
+            if (callee->type != AST_IDENTIFIER || strcmp(callee->as.identifier.name, check->var) == 0) return 0;
+            add_callee(check, callee);
+            for (size_t i = 0; i < node->as.call.arg_count; i++) {
+                if (!pure_expr(check, node->as.call.args[i])) return 0;
+            }
+            return 1;
+        }
+        case AST_MEMBER:
+            return pure_expr(check, node->as.member.object);
+        case AST_INDEX:
+            return pure_expr(check, node->as.index.object) && pure_expr(check, node->as.index.index);
+        case AST_CONDITIONAL:
+            return pure_expr(check, node->as.conditional.cond) && pure_expr(check, node->as.conditional.then_branch) &&
+                   pure_expr(check, node->as.conditional.else_branch);
+        case AST_LIST:
+            for (size_t i = 0; i < node->as.list.count; i++) {
+                if (!pure_expr(check, node->as.list.elements[i])) return 0;
+            }
+            return 1;
+        case AST_TUPLE:
+            for (size_t i = 0; i < node->as.tuple.count; i++) {
+                if (!pure_expr(check, node->as.tuple.elements[i])) return 0;
+            }
+            return 1;
+        case AST_DICT:
+            for (size_t i = 0; i < node->as.dict.count; i++) {
+                AstNode *entry = node->as.dict.entries[i];
+                if (!pure_expr(check, entry->as.dict_entry.key) || !pure_expr(check, entry->as.dict_entry.value)) return 0;
+            }
+            return 1;
+        default:
+            /* Lambdas, awaits and nested comprehensions */
+            return 0;
+    }
+}
+
+void ast_analyze_comprehension(AstNode *node) {
+    free(node->as.comprehension.callees);
+    node->as.comprehension.callees = NULL;
+    node->as.comprehension.callee_count = 0;
+    node->as.comprehension.pure = 0;
+    if (node->as.comprehension.clause_count == 0) return;
+    AstNode *first = node->as.comprehension.clauses[0];
+    if (first->type != AST_FOR_CLAUSE) return;
+
+    PurityCheck check = { first->as.for_clause.var, NULL, 0, 0 };
+    int pure = pure_expr(&check, node->as.comprehension.expr);
+    for (size_t i = 1; pure && i < node->as.comprehension.clause_count; i++) {
+        AstNode *clause = node->as.comprehension.clauses[i];
+        pure = clause->type == AST_IF_CLAUSE && pure_expr(&check, clause->as.if_clause.cond);
+    }
+    if (!pure) {
+        free(check.callees);
+        return;
+    }
+    node->as.comprehension.pure = 1;
+    node->as.comprehension.callees = check.callees;
+    node->as.comprehension.callee_count = check.count;
+}
+
 AstNode *ast_dict_comprehension(AstNode *key, AstNode *value, AstNode **clauses, size_t clause_count, size_t line, size_t column) {
     AstNode *n = ast_create(AST_DICT_COMPREHENSION, line, column);
     n->as.dict_comprehension.key = key;
@@ -348,6 +442,7 @@ void ast_free(AstNode *node) {
             free(node->as.function.params);
             free(node->as.function.param_types);
             free(node->as.function.return_type);
+            free(node->as.function.scope.names);
             ast_free(node->as.function.body);
             break;
         case AST_CLASS:
@@ -361,6 +456,7 @@ void ast_free(AstNode *node) {
             free(node->as.try_stmt.catch_var);
             ast_free(node->as.try_stmt.catch_body);
             ast_free(node->as.try_stmt.finally_body);
+            free(node->as.try_stmt.catch_scope.names);
             break;
         case AST_MATCH:
             ast_free(node->as.match_stmt.expr);
@@ -413,6 +509,7 @@ void ast_free(AstNode *node) {
         case AST_LAMBDA:
             for (size_t i = 0; i < node->as.lambda.param_count; i++) free(node->as.lambda.params[i]);
             free(node->as.lambda.params);
+            free(node->as.lambda.scope.names);
             ast_free(node->as.lambda.body);
             break;
         case AST_LIST:
@@ -435,6 +532,7 @@ void ast_free(AstNode *node) {
             ast_free(node->as.comprehension.expr);
             for (size_t i = 0; i < node->as.comprehension.clause_count; i++) ast_free(node->as.comprehension.clauses[i]);
             free(node->as.comprehension.clauses);
+            free(node->as.comprehension.callees);
             break;
         case AST_DICT_COMPREHENSION:
             ast_free(node->as.dict_comprehension.key);
@@ -454,6 +552,7 @@ void ast_free(AstNode *node) {
             for (size_t i = 0; i < node->as.hpc.spec_count; i++) ast_free(node->as.hpc.specs[i]);
             free(node->as.hpc.specs);
             ast_free(node->as.hpc.body);
+            free(node->as.hpc.scope.names);
             break;
     }
     free(node);
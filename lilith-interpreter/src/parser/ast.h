@@ -2,6 +2,7 @@
 #define LILITH_AST_H
 
 #include <stddef.h>
+#include <string.h>
 
 /* -------------------------------------------------------------------------- */
 /* Node Types                                                                 */
@@ -65,6 +66,31 @@ typedef enum {
     OP_NEG,    /* :-: */
 } UnaryOp;
 
+/* -------------------------------------------------------------------------- */
+/* Resolved variables (filled in by the resolver, see runtime/resolver.h)     */
+/* -------------------------------------------------------------------------- */
+
+#define VAR_GLOBAL (-1)
+
+/* Names and string literals are interned by the resolver too; the node
+   keeps the canonical string so nothing is hashed again at run time. */
+struct ObjString;
+
+/* Where a name lives: `slot` in the environment `depth` hops out from the
+   current one, or global slot `slot` when depth is VAR_GLOBAL. */
+typedef struct {
+    int depth;
+    int slot;
+} VarRef;
+
+/* The slot layout of a function, lambda or catch scope. */
+typedef struct AstScope {
+    char **names;      /* borrowed from the AST; parameters come first */
+    size_t count;
+    int captured;      /* a closure may outlive the scope's environment */
+    int generator;     /* a function body that yields */
+} AstScope;
+
 /* -------------------------------------------------------------------------- */
 /* Node Structure                                                             */
 /* -------------------------------------------------------------------------- */
@@ -78,42 +104,42 @@ struct AstNode {
     const char *filename;
 
     union {
-        struct { AstNode *body; } program;
+        struct { AstNode *body; int resolved; } program;
         struct { AstNode **stmts; size_t count; } block;
         struct { AstNode *expr; } expression_stmt;
         struct { AstNode *target; AstNode *value; } assign;
         struct { AstNode *cond; AstNode *then_branch; AstNode *else_branch; } if_stmt;
         struct { AstNode *cond; AstNode *body; } while_stmt;
-        struct { char *var; AstNode *iter; AstNode *body; } for_stmt;
+        struct { char *var; VarRef var_ref; AstNode *iter; AstNode *body; } for_stmt;
         struct { AstNode *value; } return_stmt;
         struct { AstNode *value; } yield_stmt;
-        struct { char *name; char **params; char **param_types; size_t param_count; AstNode *body; char *return_type; int is_async; } function;
-        struct { char *name; char *superclass; AstNode **methods; size_t method_count; } class_def;
-        struct { AstNode *try_body; char *catch_var; AstNode *catch_body; AstNode *finally_body; } try_stmt;
+        struct { char *name; char **params; char **param_types; size_t param_count; AstNode *body; char *return_type; int is_async; VarRef name_ref; AstScope scope; } function;
+        struct { char *name; char *superclass; AstNode **methods; size_t method_count; VarRef name_ref; struct ObjString *super_key; } class_def;
+        struct { AstNode *try_body; char *catch_var; AstNode *catch_body; AstNode *finally_body; AstScope catch_scope; } try_stmt;
         struct { AstNode *expr; AstNode **cases; size_t case_count; } match_stmt;
         struct { char **names; size_t count; } import;
 
         struct { double value; } number;
-        struct { char *value; } string;
+        struct { char *value; struct ObjString *key; } string;
         struct { int value; } boolean;
-        struct { char *name; } identifier;
+        struct { char *name; VarRef ref; struct ObjString *key; } identifier;
         struct { int op; AstNode *left; AstNode *right; } binary;
         struct { int op; AstNode *operand; } unary;
         struct { AstNode *callee; AstNode **args; size_t arg_count; } call;
-        struct { AstNode *object; char *name; } member;
+        struct { AstNode *object; char *name; struct ObjString *key; } member;
         struct { AstNode *object; AstNode *index; } index;
         struct { AstNode *cond; AstNode *then_branch; AstNode *else_branch; } conditional;
         struct { AstNode *value; } await_expr;
-        struct { char **params; size_t param_count; AstNode *body; } lambda;
+        struct { char **params; size_t param_count; AstNode *body; AstScope scope; } lambda;
         struct { AstNode **elements; size_t count; } list;
         struct { AstNode **elements; size_t count; } tuple;
         struct { AstNode **entries; size_t count; } dict;
         struct { AstNode *key; AstNode *value; } dict_entry;
-        struct { AstNode *expr; AstNode **clauses; size_t clause_count; int container; } comprehension;
+        struct { AstNode *expr; AstNode **clauses; size_t clause_count; int container; int pure; AstNode **callees; size_t callee_count; } comprehension;
         struct { AstNode *key; AstNode *value; AstNode **clauses; size_t clause_count; } dict_comprehension;
-        struct { char *var; AstNode *iter; } for_clause;
+        struct { char *var; VarRef var_ref; AstNode *iter; } for_clause;
         struct { AstNode *cond; } if_clause;
-        struct { char *kind; AstNode **specs; size_t spec_count; AstNode *body; } hpc;
+        struct { char *kind; AstNode **specs; size_t spec_count; AstNode *body; AstScope scope; } hpc;
     } as;
 };
 
@@ -161,6 +187,18 @@ AstNode *ast_for_clause(const char *var, AstNode *iter, size_t line, size_t colu
 AstNode *ast_if_clause(AstNode *cond, size_t line, size_t column);
 AstNode *ast_hpc(const char *kind, AstNode **specs, size_t spec_count, AstNode *body, size_t line, size_t column);
 
+/* `<| ((workers)) [[ ... ]] |>`, run on worker threads */
+static inline int ast_is_parallel(const AstNode *node) {
+    return node->type == AST_HPC && node->as.hpc.kind && strcmp(node->as.hpc.kind, "parallel") == 0;
+}
+
+/* Mark a list, tuple or set comprehension pure when it has one for-clause,
+   then only if-clauses, and its expression and conditions assign nothing,
+   create no functions and call nothing but plain names other than the loop
+   variable.  Those callee identifiers are collected in `callees`: whether
+   they name side-effect free natives is for the runtime to check. */
+void ast_analyze_comprehension(AstNode *node);
+
 /* -------------------------------------------------------------------------- */
 /* Memory Management                                                          */
 /* -------------------------------------------------------------------------- */
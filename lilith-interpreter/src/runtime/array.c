@@ -0,0 +1,59 @@
+#include "array.h"
+#include <math.h>
+#include <string.h>
+
+static const char *type_names[] = {
+    [ARRAY_FLOAT64] = "float64",
+    [ARRAY_FLOAT32] = "float32",
+    [ARRAY_INT32] = "int32",
+    [ARRAY_INT8] = "int8",
+};
+
+size_t array_elem_size(ArrayType type) {
+    switch (type) {
+        case ARRAY_FLOAT64: return sizeof(double);
+        case ARRAY_FLOAT32: return sizeof(float);
+        case ARRAY_INT32:   return sizeof(int32_t);
+        case ARRAY_INT8:    return sizeof(int8_t);
+    }
+    return 0;
+}
+
+const char *array_type_name(ArrayType type) {
+    return type_names[type];
+}
+
+bool array_type_parse(const char *name, ArrayType *type) {
+    for (size_t i = 0; i < sizeof(type_names) / sizeof(type_names[0]); i++) {
+        if (strcmp(name, type_names[i]) == 0) {
+            *type = (ArrayType)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* A whole number in [min, max]; NaN fails both comparisons */
+static bool fits(double value, double min, double max) {
+    return value >= min && value <= max && value == floor(value);
+}
+
+bool array_set(ObjArray *array, size_t index, double value) {
+    switch (array->type) {
+        case ARRAY_FLOAT64:
+            ((double *)array->data)[index] = value;
+            return true;
+        case ARRAY_FLOAT32:
+            ((float *)array->data)[index] = (float)value;
+            return true;
+        case ARRAY_INT32:
+            if (!fits(value, INT32_MIN, INT32_MAX)) return false;
+            ((int32_t *)array->data)[index] = (int32_t)value;
+            return true;
+        case ARRAY_INT8:
+            if (!fits(value, INT8_MIN, INT8_MAX)) return false;
+            ((int8_t *)array->data)[index] = (int8_t)value;
+            return true;
+    }
+    return false;
+}
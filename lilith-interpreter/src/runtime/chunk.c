@@ -0,0 +1,89 @@
+#define _GNU_SOURCE
+#include "chunk.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void *grow_array(void *array, size_t *capacity, size_t elem_size) {
+    size_t cap = *capacity < 8 ? 8 : *capacity * 2;
+    void *grown = realloc(array, elem_size * cap);
+    if (!grown) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    *capacity = cap;
+    return grown;
+}
+
+Chunk *chunk_new(AstNode *fn_node) {
+    Chunk *chunk = (Chunk *)calloc(1, sizeof(Chunk));
+    if (!chunk) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    chunk->fn_node = fn_node;
+    return chunk;
+}
+
+void chunk_free(Chunk *chunk) {
+    if (!chunk) return;
+    for (size_t i = 0; i < chunk->proto_count; i++) chunk_free(chunk->protos[i]);
+    free(chunk->code);
+    free(chunk->lines);
+    free(chunk->constants);
+    free(chunk->names);
+    free(chunk->protos);
+    free(chunk->nodes);
+    free(chunk);
+}
+
+void chunk_write(Chunk *chunk, uint8_t byte, size_t line) {
+    if (chunk->count + 1 > chunk->capacity) {
+        size_t cap = chunk->capacity;
+        chunk->code = (uint8_t *)grow_array(chunk->code, &cap, sizeof(uint8_t));
+        chunk->lines = (size_t *)realloc(chunk->lines, sizeof(size_t) * cap);
+        if (!chunk->lines) {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+        chunk->capacity = cap;
+    }
+    chunk->code[chunk->count] = byte;
+    chunk->lines[chunk->count] = line;
+    chunk->count++;
+}
+
+size_t chunk_add_constant(Chunk *chunk, Value value) {
+    if (chunk->constant_count + 1 > chunk->constant_capacity) {
+        chunk->constants = (Value *)grow_array(chunk->constants, &chunk->constant_capacity, sizeof(Value));
+    }
+    chunk->constants[chunk->constant_count] = value;
+    return chunk->constant_count++;
+}
+
+size_t chunk_add_name(Chunk *chunk, ObjString *name) {
+    for (size_t i = 0; i < chunk->name_count; i++) {
+        if (chunk->names[i] == name) return i;
+    }
+    if (chunk->name_count + 1 > chunk->name_capacity) {
+        chunk->names = (ObjString **)grow_array(chunk->names, &chunk->name_capacity, sizeof(ObjString *));
+    }
+    chunk->names[chunk->name_count] = name;
+    return chunk->name_count++;
+}
+
+size_t chunk_add_proto(Chunk *chunk, Chunk *proto) {
+    if (chunk->proto_count + 1 > chunk->proto_capacity) {
+        chunk->protos = (Chunk **)grow_array(chunk->protos, &chunk->proto_capacity, sizeof(Chunk *));
+    }
+    chunk->protos[chunk->proto_count] = proto;
+    return chunk->proto_count++;
+}
+
+size_t chunk_add_node(Chunk *chunk, AstNode *node) {
+    if (chunk->node_count + 1 > chunk->node_capacity) {
+        chunk->nodes = (AstNode **)grow_array(chunk->nodes, &chunk->node_capacity, sizeof(AstNode *));
+    }
+    chunk->nodes[chunk->node_count] = node;
+    return chunk->node_count++;
+}
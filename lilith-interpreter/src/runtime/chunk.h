@@ -0,0 +1,117 @@
+#ifndef LILITH_CHUNK_H
+#define LILITH_CHUNK_H
+
+#include "value.h"
+#include "parser/ast.h"
+
+/* -------------------------------------------------------------------------- */
+/* Bytecode                                                                   */
+/* -------------------------------------------------------------------------- */
+
+/* Operands follow the opcode inline.  u8 operands are one byte, u16 operands
+   are two bytes, big-endian.  Jump offsets are unsigned and relative to the
+   byte following the operand. */
+typedef enum {
+    OP_CONSTANT,        /* u16 constant       -> value                        */
+    OP_NIL,
+    OP_TRUE,
+    OP_FALSE,
+    OP_POP,
+
+    OP_GET_LOCAL,       /* u16 slot, u16 name -> value                        */
+    OP_SET_LOCAL,       /* u16 slot           value -> value                  */
+    OP_GET_ENCLOSING,   /* u8 depth, u16 slot, u16 name -> value              */
+    OP_SET_ENCLOSING,   /* u8 depth, u16 slot value -> value                  */
+    OP_GET_GLOBAL,      /* u16 slot, u16 name -> value                        */
+    OP_SET_GLOBAL,      /* u16 slot           value -> value                  */
+    OP_GET_MEMBER,      /* u16 name           obj -> value                    */
+    OP_SET_MEMBER,      /* u16 name           value obj -> value              */
+    OP_GET_INDEX,       /*                    obj idx -> value                */
+    OP_SET_INDEX,       /*                    value obj idx -> value          */
+
+    OP_PLUS,            /* Named apart from the AST's BinaryOp so both can be */
+    OP_MINUS,           /* in scope at once.                                  */
+    OP_TIMES,
+    OP_DIVIDE,
+    OP_MODULO,
+    OP_EQUAL,
+    OP_NOT_EQUAL,
+    OP_LESS,
+    OP_GREATER,
+    OP_NEGATE,
+
+    OP_JUMP,            /* u16 forward offset                                 */
+    OP_JUMP_IF_FALSE,   /* u16 forward offset, pops the condition             */
+    OP_LOOP,            /* u16 backward offset                                */
+
+    OP_CALL,            /* u8 argc            callee args... -> result        */
+    OP_INVOKE,          /* u16 name, u8 argc  obj args... -> result           */
+    OP_CLOSURE,         /* u16 proto          -> function                     */
+    OP_CLASS,           /* u16 name, u16 superclass name (0xFFFF = none)      */
+    OP_METHOD,          /* u16 proto          class -> class                  */
+    OP_RETURN,          /* explicit )- ... -( with return-type check          */
+    OP_END,             /* implicit end of body, no type check                */
+
+    OP_BUILD_LIST,      /* u16 count                                          */
+    OP_BUILD_TUPLE,     /* u16 count                                          */
+    OP_BUILD_DICT,      /* u16 pair count                                     */
+    OP_LIST_APPEND,     /* u8 depth           value -> (append to list)       */
+    OP_DICT_INSERT,     /* u8 depth           key value -> (insert into dict) */
+    OP_TO_TUPLE,
+    OP_TO_SET,
+
+    OP_ITER_INIT,       /* u8 in_comprehension   iterable -> iter index end   */
+    OP_ITER_NEXT,       /* u16 exit offset       -> item, or pop 3 and jump   */
+    OP_UNPACK,          /* u16 count          value -> value item[n-1]..item0 */
+    OP_MATCH,           /* u16 pattern node   value -> value bool             */
+
+    OP_TRY,             /* u16 catch offset                                   */
+    OP_END_TRY,
+    OP_RETHROW,         /*                    message ->                      */
+    OP_PUSH_SCOPE,      /* u16 try node: enter its catch scope                */
+    OP_POP_SCOPE,
+    OP_ERROR,           /* u16 message constant                               */
+    OP_PARALLEL,        /* u16 proto          workers -> (run the block)      */
+    OP_PAR_COMPREHENSION, /* u16 proto, u16 done offset  list iterable ->
+                           list iterable, or list and jump once run in parallel */
+    OP_AWAIT,           /*                       value -> result if a future  */
+    OP_YIELD,           /*                       value -> (suspend with it)   */
+} OpCode;
+
+/* A compiled unit: the program body, a function body or a lambda body. */
+typedef struct Chunk {
+    uint8_t *code;
+    size_t *lines;
+    size_t count;
+    size_t capacity;
+
+    Value *constants;
+    size_t constant_count;
+    size_t constant_capacity;
+
+    ObjString **names;           /* interned; marked with the constants */
+    size_t name_count;
+    size_t name_capacity;
+
+    struct Chunk **protos;       /* nested functions, lambdas and methods */
+    size_t proto_count;
+    size_t proto_capacity;
+
+    AstNode **nodes;             /* match patterns evaluated by the runtime */
+    size_t node_count;
+    size_t node_capacity;
+
+    AstNode *fn_node;            /* AST_FUNCTION / AST_LAMBDA, NULL for the program */
+    size_t max_stack;            /* deepest operand stack use, checked on entry */
+} Chunk;
+
+Chunk *chunk_new(AstNode *fn_node);
+void   chunk_free(Chunk *chunk);
+
+void   chunk_write(Chunk *chunk, uint8_t byte, size_t line);
+size_t chunk_add_constant(Chunk *chunk, Value value);
+size_t chunk_add_name(Chunk *chunk, ObjString *name);
+size_t chunk_add_proto(Chunk *chunk, Chunk *proto);
+size_t chunk_add_node(Chunk *chunk, AstNode *node);
+
+#endif
@@ -0,0 +1,808 @@
+#define _GNU_SOURCE
+#include "compiler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ========================================================================= */
+/* Compiler state                                                            */
+/* ========================================================================= */
+
+#define MAX_CONTROL 256
+#define NO_SUPERCLASS 0xFFFF
+
+/* Enclosing constructs that a break, continue or return has to unwind. */
+typedef enum {
+    CTRL_LOOP,
+    CTRL_TRY,        /* a handler installed by OP_TRY */
+    CTRL_SCOPE,      /* an environment pushed by OP_PUSH_SCOPE */
+    CTRL_FINALLY,    /* a finally body to run on the way out */
+    CTRL_SKIP,       /* hides entries down to `skip_to` while a finally is inlined */
+} ControlKind;
+
+typedef struct {
+    ControlKind kind;
+    AstNode *finally_body;
+    size_t continue_target;
+    int iter_slots;          /* for-loops keep iterable, index and end on the stack */
+    int skip_to;
+    size_t *breaks;
+    size_t break_count;
+    size_t break_capacity;
+} Control;
+
+typedef struct {
+    Chunk *chunk;
+    Control controls[MAX_CONTROL];
+    int control_count;
+    int depth;               /* operand stack depth at the current instruction */
+    char *error;
+    size_t error_size;
+    int had_error;
+} Compiler;
+
+static void compile_expr(Compiler *c, AstNode *node);
+static void compile_stmt(Compiler *c, AstNode *node, int keep);
+static Chunk *compile_function(Compiler *parent, AstNode *fn_node);
+static void compile_clauses(Compiler *c, AstNode *comp, int is_dict, size_t index, int slots);
+static void compiler_init(Compiler *c, Chunk *chunk, char *error, size_t error_size);
+
+static void compile_error(Compiler *c, size_t line, const char *msg) {
+    if (c->had_error) return;
+    c->had_error = 1;
+    snprintf(c->error, c->error_size, "[line %zu] %s", line, msg);
+}
+
+/* ========================================================================= */
+/* Emitters                                                                  */
+/* ========================================================================= */
+
+static void emit_byte(Compiler *c, uint8_t byte, size_t line) {
+    chunk_write(c->chunk, byte, line);
+}
+
+static void emit_u16(Compiler *c, size_t value, size_t line) {
+    if (value > 0xFFFF) {
+        compile_error(c, line, "Too many constants, names or nodes in one function.");
+        value = 0;
+    }
+    emit_byte(c, (uint8_t)((value >> 8) & 0xFF), line);
+    emit_byte(c, (uint8_t)(value & 0xFF), line);
+}
+
+/* Emit an opcode and record its effect on the operand stack. */
+static void emit_op(Compiler *c, OpCode op, int effect, size_t line) {
+    emit_byte(c, (uint8_t)op, line);
+    c->depth += effect;
+    if (c->depth > 0 && (size_t)c->depth > c->chunk->max_stack) c->chunk->max_stack = (size_t)c->depth;
+}
+
+static void emit_constant(Compiler *c, Value value, size_t line) {
+    emit_op(c, OP_CONSTANT, 1, line);
+    emit_u16(c, chunk_add_constant(c->chunk, value), line);
+}
+
+static void emit_named(Compiler *c, OpCode op, int effect, ObjString *name, size_t line) {
+    emit_op(c, op, effect, line);
+    emit_u16(c, chunk_add_name(c->chunk, name), line);
+}
+
+/* Resolved variable access; see resolver.h. */
+static void emit_get_var(Compiler *c, AstNode *ident, size_t line) {
+    VarRef ref = ident->as.identifier.ref;
+    if (ref.depth == VAR_GLOBAL) {
+        emit_op(c, OP_GET_GLOBAL, 1, line);
+    } else if (ref.depth == 0) {
+        emit_op(c, OP_GET_LOCAL, 1, line);
+    } else {
+        if (ref.depth > 0xFF) compile_error(c, line, "Variable captured from too many scopes out.");
+        emit_op(c, OP_GET_ENCLOSING, 1, line);
+        emit_byte(c, (uint8_t)ref.depth, line);
+    }
+    emit_u16(c, (size_t)ref.slot, line);
+    emit_u16(c, chunk_add_name(c->chunk, ident->as.identifier.key), line);
+}
+
+static void emit_set_var(Compiler *c, VarRef ref, size_t line) {
+    if (ref.depth == VAR_GLOBAL) {
+        emit_op(c, OP_SET_GLOBAL, 0, line);
+    } else if (ref.depth == 0) {
+        emit_op(c, OP_SET_LOCAL, 0, line);
+    } else {
+        if (ref.depth > 0xFF) compile_error(c, line, "Variable captured from too many scopes out.");
+        emit_op(c, OP_SET_ENCLOSING, 0, line);
+        emit_byte(c, (uint8_t)ref.depth, line);
+    }
+    emit_u16(c, (size_t)ref.slot, line);
+}
+
+static void emit_error(Compiler *c, const char *msg, size_t line) {
+    size_t idx = chunk_add_constant(c->chunk, OBJ_VAL(obj_string_copy(msg, strlen(msg))));
+    emit_op(c, OP_ERROR, 0, line);
+    emit_u16(c, idx, line);
+}
+
+/* Emit a forward jump and return the offset of its operand for patching. */
+static size_t emit_jump(Compiler *c, OpCode op, int effect, size_t line) {
+    emit_op(c, op, effect, line);
+    emit_byte(c, 0xFF, line);
+    emit_byte(c, 0xFF, line);
+    return c->chunk->count - 2;
+}
+
+static void patch_jump(Compiler *c, size_t operand) {
+    size_t jump = c->chunk->count - operand - 2;
+    if (jump > 0xFFFF) {
+        compile_error(c, c->chunk->lines[operand], "Too much code to jump over.");
+        return;
+    }
+    c->chunk->code[operand] = (uint8_t)((jump >> 8) & 0xFF);
+    c->chunk->code[operand + 1] = (uint8_t)(jump & 0xFF);
+}
+
+static void emit_loop(Compiler *c, size_t target, size_t line) {
+    emit_op(c, OP_LOOP, 0, line);
+    size_t offset = c->chunk->count - target + 2;
+    if (offset > 0xFFFF) compile_error(c, line, "Loop body too large.");
+    emit_u16(c, offset & 0xFFFF, line);
+}
+
+/* ========================================================================= */
+/* Control stack                                                             */
+/* ========================================================================= */
+
+static Control *push_control(Compiler *c, ControlKind kind, size_t line) {
+    if (c->control_count >= MAX_CONTROL) {
+        compile_error(c, line, "Too many nested blocks.");
+        c->control_count--;
+    }
+    Control *ctl = &c->controls[c->control_count++];
+    memset(ctl, 0, sizeof(Control));
+    ctl->kind = kind;
+    return ctl;
+}
+
+static void pop_control(Compiler *c) {
+    Control *ctl = &c->controls[--c->control_count];
+    free(ctl->breaks);
+}
+
+static int innermost_loop(Compiler *c) {
+    for (int i = c->control_count - 1; i >= 0; i--) {
+        if (c->controls[i].kind == CTRL_SKIP) i = c->controls[i].skip_to;
+        else if (c->controls[i].kind == CTRL_LOOP) return i;
+    }
+    return -1;
+}
+
+/* Emit the cleanup for every construct above `target`: close handlers and
+   scopes, and inline finally bodies.  Loop iterator slots are left to the
+   caller since a return discards the whole frame anyway. */
+static void emit_unwind(Compiler *c, int target, size_t line) {
+    for (int i = c->control_count - 1; i > target; i--) {
+        Control *ctl = &c->controls[i];
+        switch (ctl->kind) {
+            case CTRL_TRY:   emit_op(c, OP_END_TRY, 0, line); break;
+            case CTRL_SCOPE: emit_op(c, OP_POP_SCOPE, 0, line); break;
+            case CTRL_FINALLY: {
+                /* The finally body must not see itself (or anything above it)
+                   as an enclosing construct. */
+                AstNode *finally_body = ctl->finally_body;
+                push_control(c, CTRL_SKIP, line)->skip_to = i;
+                compile_stmt(c, finally_body, 0);
+                pop_control(c);
+                break;
+            }
+            case CTRL_SKIP:
+                i = ctl->skip_to;
+                break;
+            case CTRL_LOOP:
+                break;
+        }
+    }
+}
+
+static void emit_return(Compiler *c, AstNode *value, OpCode op, size_t line) {
+    if (value) compile_expr(c, value);
+    else emit_op(c, OP_NIL, 1, line);
+    emit_unwind(c, -1, line);
+    emit_op(c, op, -1, line);
+}
+
+/* ========================================================================= */
+/* Expressions                                                               */
+/* ========================================================================= */
+
+static OpCode binary_opcode(int op) {
+    switch (op) {
+        case OP_ADD: return OP_PLUS;
+        case OP_SUB: return OP_MINUS;
+        case OP_MUL: return OP_TIMES;
+        case OP_DIV: return OP_DIVIDE;
+        case OP_MOD: return OP_MODULO;
+        case OP_EQ:  return OP_EQUAL;
+        case OP_NE:  return OP_NOT_EQUAL;
+        case OP_LT:  return OP_LESS;
+        default:     return OP_GREATER;
+    }
+}
+
+static void compile_args(Compiler *c, AstNode *call) {
+    if (call->as.call.arg_count > 255) compile_error(c, call->line, "Too many arguments.");
+    for (size_t i = 0; i < call->as.call.arg_count; i++) compile_expr(c, call->as.call.args[i]);
+}
+
+/* The clauses after a pure comprehension's first for-clause, run once per
+   item on a pool worker with the accumulator on the stack beneath it (see
+   vm_run_comprehension).  Returns the operand to patch with the offset
+   that skips the sequential loop. */
+static size_t emit_par_comprehension(Compiler *c, AstNode *comp) {
+    Compiler rest;
+    compiler_init(&rest, chunk_new(comp), c->error, c->error_size);
+    rest.had_error = c->had_error;
+    compile_clauses(&rest, comp, 0, 1, 0);
+    emit_op(&rest, OP_NIL, 1, comp->line);
+    emit_op(&rest, OP_END, -1, comp->line);
+    c->had_error = rest.had_error;
+
+    emit_op(c, OP_PAR_COMPREHENSION, 0, comp->line);
+    emit_u16(c, chunk_add_proto(c->chunk, rest.chunk), comp->line);
+    emit_byte(c, 0xFF, comp->line);
+    emit_byte(c, 0xFF, comp->line);
+    return c->chunk->count - 2;
+}
+
+/* Nested for/if clauses of a comprehension.  `slots` counts the iterator
+   slots sitting between the accumulator and the top of the stack. */
+static void compile_clauses(Compiler *c, AstNode *comp, int is_dict, size_t index, int slots) {
+    AstNode **clauses = is_dict ? comp->as.dict_comprehension.clauses : comp->as.comprehension.clauses;
+    size_t clause_count = is_dict ? comp->as.dict_comprehension.clause_count : comp->as.comprehension.clause_count;
+
+    if (index >= clause_count) {
+        if (slots > 255) compile_error(c, comp->line, "Comprehension nested too deeply.");
+        if (is_dict) {
+            compile_expr(c, comp->as.dict_comprehension.key);
+            compile_expr(c, comp->as.dict_comprehension.value);
+            emit_op(c, OP_DICT_INSERT, -2, comp->line);
+        } else {
+            compile_expr(c, comp->as.comprehension.expr);
+            emit_op(c, OP_LIST_APPEND, -1, comp->line);
+        }
+        emit_byte(c, (uint8_t)slots, comp->line);
+        return;
+    }
+
+    AstNode *clause = clauses[index];
+    if (clause->type == AST_FOR_CLAUSE) {
+        compile_expr(c, clause->as.for_clause.iter);
+        size_t parallel = !is_dict && index == 0 && comp->as.comprehension.pure ? emit_par_comprehension(c, comp) : 0;
+        emit_op(c, OP_ITER_INIT, 2, clause->line);
+        emit_byte(c, 1, clause->line);
+        size_t loop_start = c->chunk->count;
+        size_t exit = emit_jump(c, OP_ITER_NEXT, 1, clause->line);
+        emit_set_var(c, clause->as.for_clause.var_ref, clause->line);
+        emit_op(c, OP_POP, -1, clause->line);
+        compile_clauses(c, comp, is_dict, index + 1, slots + 3);
+        emit_loop(c, loop_start, clause->line);
+        patch_jump(c, exit);
+        c->depth -= 3;
+        if (parallel) patch_jump(c, parallel);
+    } else if (clause->type == AST_IF_CLAUSE) {
+        compile_expr(c, clause->as.if_clause.cond);
+        size_t skip = emit_jump(c, OP_JUMP_IF_FALSE, -1, clause->line);
+        compile_clauses(c, comp, is_dict, index + 1, slots);
+        patch_jump(c, skip);
+    } else {
+        compile_clauses(c, comp, is_dict, index + 1, slots);
+    }
+}
+
+static void compile_expr(Compiler *c, AstNode *node) {
+    if (!node) {
+        emit_op(c, OP_NIL, 1, 0);
+        return;
+    }
+    size_t line = node->line;
+
+    switch (node->type) {
+        case AST_NUMBER:
+            emit_constant(c, NUMBER_VAL(node->as.number.value), line);
+            return;
+        case AST_STRING:
+            emit_constant(c, OBJ_VAL(node->as.string.key), line);
+            return;
+        case AST_BOOL:
+            emit_op(c, node->as.boolean.value ? OP_TRUE : OP_FALSE, 1, line);
+            return;
+        case AST_NIL:
+            emit_op(c, OP_NIL, 1, line);
+            return;
+
+        case AST_IDENTIFIER:
+            emit_get_var(c, node, line);
+            return;
+
+        case AST_BINARY:
+            compile_expr(c, node->as.binary.left);
+            compile_expr(c, node->as.binary.right);
+            emit_op(c, binary_opcode(node->as.binary.op), -1, line);
+            return;
+
+        case AST_UNARY:
+            compile_expr(c, node->as.unary.operand);
+            emit_op(c, OP_NEGATE, 0, line);
+            return;
+
+        case AST_CALL: {
+            int argc = (int)node->as.call.arg_count;
+            AstNode *callee = node->as.call.callee;
+            if (callee->type == AST_MEMBER) {
+                compile_expr(c, callee->as.member.object);
+                compile_args(c, node);
+                emit_named(c, OP_INVOKE, -argc, callee->as.member.key, line);
+                emit_byte(c, (uint8_t)argc, line);
+                return;
+            }
+            compile_expr(c, callee);
+            compile_args(c, node);
+            emit_op(c, OP_CALL, -argc, line);
+            emit_byte(c, (uint8_t)argc, line);
+            return;
+        }
+
+        case AST_MEMBER:
+            compile_expr(c, node->as.member.object);
+            emit_named(c, OP_GET_MEMBER, 0, node->as.member.key, line);
+            return;
+
+        case AST_INDEX:
+            compile_expr(c, node->as.index.object);
+            compile_expr(c, node->as.index.index);
+            emit_op(c, OP_GET_INDEX, -1, line);
+            return;
+
+        case AST_CONDITIONAL: {
+            compile_expr(c, node->as.conditional.cond);
+            size_t else_jump = emit_jump(c, OP_JUMP_IF_FALSE, -1, line);
+            compile_expr(c, node->as.conditional.then_branch);
+            size_t end_jump = emit_jump(c, OP_JUMP, 0, line);
+            c->depth--;
+            patch_jump(c, else_jump);
+            compile_expr(c, node->as.conditional.else_branch);
+            patch_jump(c, end_jump);
+            return;
+        }
+
+        case AST_AWAIT:
+            compile_expr(c, node->as.await_expr.value);
+            emit_op(c, OP_AWAIT, 0, line);
+            return;
+
+        case AST_LAMBDA: {
+            Chunk *proto = compile_function(c, node);
+            emit_op(c, OP_CLOSURE, 1, line);
+            emit_u16(c, chunk_add_proto(c->chunk, proto), line);
+            return;
+        }
+
+        case AST_LIST:
+            for (size_t i = 0; i < node->as.list.count; i++) compile_expr(c, node->as.list.elements[i]);
+            emit_op(c, OP_BUILD_LIST, 1 - (int)node->as.list.count, line);
+            emit_u16(c, node->as.list.count, line);
+            return;
+
+        case AST_TUPLE:
+            for (size_t i = 0; i < node->as.tuple.count; i++) compile_expr(c, node->as.tuple.elements[i]);
+            emit_op(c, OP_BUILD_TUPLE, 1 - (int)node->as.tuple.count, line);
+            emit_u16(c, node->as.tuple.count, line);
+            return;
+
+        case AST_DICT:
+            for (size_t i = 0; i < node->as.dict.count; i++) {
+                AstNode *entry = node->as.dict.entries[i];
+                compile_expr(c, entry->as.dict_entry.key);
+                compile_expr(c, entry->as.dict_entry.value);
+            }
+            emit_op(c, OP_BUILD_DICT, 1 - 2 * (int)node->as.dict.count, line);
+            emit_u16(c, node->as.dict.count, line);
+            return;
+
+        case AST_COMPREHENSION:
+            emit_op(c, OP_BUILD_LIST, 1, line);
+            emit_u16(c, 0, line);
+            compile_clauses(c, node, 0, 0, 0);
+            if (node->as.comprehension.container == 1) emit_op(c, OP_TO_TUPLE, 0, line);
+            else if (node->as.comprehension.container == 2) emit_op(c, OP_TO_SET, 0, line);
+            return;
+
+        case AST_DICT_COMPREHENSION:
+            emit_op(c, OP_BUILD_DICT, 1, line);
+            emit_u16(c, 0, line);
+            compile_clauses(c, node, 1, 0, 0);
+            return;
+
+        default:
+            emit_error(c, "Unsupported expression node type.", line);
+            emit_op(c, OP_NIL, 1, line);
+            return;
+    }
+}
+
+/* ========================================================================= */
+/* Statements                                                                */
+/* ========================================================================= */
+
+/* Statements are stack-neutral.  With `keep` set they leave their value on
+   the stack instead, which is how a lambda body yields its implicit result. */
+
+static void compile_block(Compiler *c, AstNode *block, int keep) {
+    if (block->type != AST_BLOCK) {
+        compile_stmt(c, block, keep);
+        return;
+    }
+    if (block->as.block.count == 0) {
+        if (keep) emit_op(c, OP_NIL, 1, block->line);
+        return;
+    }
+    for (size_t i = 0; i < block->as.block.count; i++) {
+        compile_stmt(c, block->as.block.stmts[i], keep && i + 1 == block->as.block.count);
+    }
+}
+
+static void finish_value(Compiler *c, int keep, size_t line) {
+    if (!keep) emit_op(c, OP_POP, -1, line);
+}
+
+static void nil_value(Compiler *c, int keep, size_t line) {
+    if (keep) emit_op(c, OP_NIL, 1, line);
+}
+
+static void compile_assign(Compiler *c, AstNode *node, int keep) {
+    AstNode *target = node->as.assign.target;
+    size_t line = node->line;
+    compile_expr(c, node->as.assign.value);
+
+    switch (target->type) {
+        case AST_IDENTIFIER:
+            emit_set_var(c, target->as.identifier.ref, line);
+            break;
+        case AST_MEMBER:
+            compile_expr(c, target->as.member.object);
+            emit_named(c, OP_SET_MEMBER, -1, target->as.member.key, line);
+            break;
+        case AST_INDEX:
+            compile_expr(c, target->as.index.object);
+            compile_expr(c, target->as.index.index);
+            emit_op(c, OP_SET_INDEX, -2, line);
+            break;
+        case AST_TUPLE: {
+            size_t count = target->as.tuple.count;
+            emit_op(c, OP_UNPACK, (int)count, line);
+            emit_u16(c, count, line);
+            for (size_t i = 0; i < count; i++) {
+                AstNode *var = target->as.tuple.elements[i];
+                if (var->type != AST_IDENTIFIER) {
+                    emit_error(c, "Destructuring target must be an identifier.", line);
+                    emit_op(c, OP_POP, -1, line);
+                    continue;
+                }
+                emit_set_var(c, var->as.identifier.ref, line);
+                emit_op(c, OP_POP, -1, line);
+            }
+            break;
+        }
+        default:
+            emit_error(c, "Invalid assignment target.", line);
+            break;
+    }
+    finish_value(c, keep, line);
+}
+
+static void compile_loop_jump(Compiler *c, AstNode *node, int is_break) {
+    size_t line = node->line;
+    int loop = innermost_loop(c);
+    int saved_depth = c->depth;
+    if (loop < 0) {
+        /* Outside any loop the tree-walker simply stops executing the
+           current body, which is an early return of nil. */
+        emit_unwind(c, -1, line);
+        emit_op(c, OP_NIL, 1, line);
+        emit_op(c, OP_END, -1, line);
+        c->depth = saved_depth;
+        return;
+    }
+    emit_unwind(c, loop, line);
+    Control *ctl = &c->controls[loop];
+    if (is_break) {
+        for (int i = 0; i < ctl->iter_slots; i++) emit_op(c, OP_POP, -1, line);
+        size_t jump = emit_jump(c, OP_JUMP, 0, line);
+        if (ctl->break_count + 1 > ctl->break_capacity) {
+            ctl->break_capacity = ctl->break_capacity < 4 ? 4 : ctl->break_capacity * 2;
+            ctl->breaks = (size_t *)realloc(ctl->breaks, sizeof(size_t) * ctl->break_capacity);
+        }
+        ctl->breaks[ctl->break_count++] = jump;
+    } else {
+        emit_loop(c, ctl->continue_target, line);
+    }
+    c->depth = saved_depth;
+}
+
+static void end_loop(Compiler *c) {
+    Control *ctl = &c->controls[c->control_count - 1];
+    for (size_t i = 0; i < ctl->break_count; i++) patch_jump(c, ctl->breaks[i]);
+    pop_control(c);
+}
+
+static void compile_try(Compiler *c, AstNode *node) {
+    size_t line = node->line;
+    AstNode *finally_body = node->as.try_stmt.finally_body;
+    AstNode *catch_body = node->as.try_stmt.catch_body;
+
+    if (finally_body) push_control(c, CTRL_FINALLY, line)->finally_body = finally_body;
+
+    size_t handler = emit_jump(c, OP_TRY, 0, line);
+    push_control(c, CTRL_TRY, line);
+    compile_stmt(c, node->as.try_stmt.try_body, 0);
+    pop_control(c);
+    emit_op(c, OP_END_TRY, 0, line);
+    size_t done = emit_jump(c, OP_JUMP, 0, line);
+
+    /* The handler lands here with the error message pushed. */
+    patch_jump(c, handler);
+    c->depth++;
+    if (catch_body) {
+        emit_op(c, OP_PUSH_SCOPE, 0, line);
+        emit_u16(c, chunk_add_node(c->chunk, node), line);
+        if (node->as.try_stmt.catch_var) {
+            VarRef catch_ref = { 0, 0 };
+            emit_set_var(c, catch_ref, line);
+        }
+        emit_op(c, OP_POP, -1, line);
+
+        size_t catch_handler = emit_jump(c, OP_TRY, 0, line);
+        push_control(c, CTRL_SCOPE, line);
+        push_control(c, CTRL_TRY, line);
+        compile_stmt(c, catch_body, 0);
+        pop_control(c);
+        pop_control(c);
+        emit_op(c, OP_END_TRY, 0, line);
+        emit_op(c, OP_POP_SCOPE, 0, line);
+        size_t catch_done = emit_jump(c, OP_JUMP, 0, line);
+
+        /* An error inside the catch body runs finally, then propagates. */
+        patch_jump(c, catch_handler);
+        c->depth++;
+        emit_op(c, OP_POP_SCOPE, 0, line);
+        if (finally_body) {
+            pop_control(c);
+            compile_stmt(c, finally_body, 0);
+            push_control(c, CTRL_FINALLY, line)->finally_body = finally_body;
+        }
+        emit_op(c, OP_RETHROW, -1, line);
+        patch_jump(c, catch_done);
+    } else {
+        emit_op(c, OP_POP, -1, line);
+    }
+
+    patch_jump(c, done);
+    if (finally_body) {
+        pop_control(c);
+        compile_stmt(c, finally_body, 0);
+    }
+}
+
+static void compile_stmt(Compiler *c, AstNode *node, int keep) {
+    if (!node) {
+        nil_value(c, keep, 0);
+        return;
+    }
+    size_t line = node->line;
+
+    switch (node->type) {
+        case AST_PROGRAM:
+            compile_stmt(c, node->as.program.body, keep);
+            return;
+
+        case AST_BLOCK:
+            compile_block(c, node, keep);
+            return;
+
+        case AST_EXPRESSION_STMT:
+            compile_expr(c, node->as.expression_stmt.expr);
+            finish_value(c, keep, line);
+            return;
+
+        case AST_ASSIGN:
+            compile_assign(c, node, keep);
+            return;
+
+        case AST_IF: {
+            compile_expr(c, node->as.if_stmt.cond);
+            size_t else_jump = emit_jump(c, OP_JUMP_IF_FALSE, -1, line);
+            compile_stmt(c, node->as.if_stmt.then_branch, 0);
+            if (node->as.if_stmt.else_branch) {
+                size_t end_jump = emit_jump(c, OP_JUMP, 0, line);
+                patch_jump(c, else_jump);
+                compile_stmt(c, node->as.if_stmt.else_branch, 0);
+                patch_jump(c, end_jump);
+            } else {
+                patch_jump(c, else_jump);
+            }
+            nil_value(c, keep, line);
+            return;
+        }
+
+        case AST_WHILE: {
+            size_t loop_start = c->chunk->count;
+            compile_expr(c, node->as.while_stmt.cond);
+            size_t exit = emit_jump(c, OP_JUMP_IF_FALSE, -1, line);
+            push_control(c, CTRL_LOOP, line)->continue_target = loop_start;
+            compile_stmt(c, node->as.while_stmt.body, 0);
+            emit_loop(c, loop_start, line);
+            patch_jump(c, exit);
+            end_loop(c);
+            nil_value(c, keep, line);
+            return;
+        }
+
+        case AST_FOR: {
+            compile_expr(c, node->as.for_stmt.iter);
+            emit_op(c, OP_ITER_INIT, 2, line);
+            emit_byte(c, 0, line);
+            size_t loop_start = c->chunk->count;
+            size_t exit = emit_jump(c, OP_ITER_NEXT, 1, line);
+            emit_set_var(c, node->as.for_stmt.var_ref, line);
+            emit_op(c, OP_POP, -1, line);
+            Control *loop = push_control(c, CTRL_LOOP, line);
+            loop->continue_target = loop_start;
+            loop->iter_slots = 3;
+            compile_stmt(c, node->as.for_stmt.body, 0);
+            emit_loop(c, loop_start, line);
+            patch_jump(c, exit);
+            end_loop(c);
+            c->depth -= 3;
+            nil_value(c, keep, line);
+            return;
+        }
+
+        case AST_RETURN:
+            emit_return(c, node->as.return_stmt.value, OP_RETURN, line);
+            nil_value(c, keep, line);
+            return;
+
+        case AST_YIELD:
+            compile_expr(c, node->as.yield_stmt.value);
+            emit_op(c, OP_YIELD, -1, line);
+            nil_value(c, keep, line);
+            return;
+
+        case AST_BREAK:
+        case AST_CONTINUE:
+            compile_loop_jump(c, node, node->type == AST_BREAK);
+            nil_value(c, keep, line);
+            return;
+
+        case AST_FUNCTION: {
+            Chunk *proto = compile_function(c, node);
+            emit_op(c, OP_CLOSURE, 1, line);
+            emit_u16(c, chunk_add_proto(c->chunk, proto), line);
+            emit_set_var(c, node->as.function.name_ref, line);
+            finish_value(c, keep, line);
+            return;
+        }
+
+        case AST_CLASS: {
+            emit_op(c, OP_CLASS, 1, line);
+            const char *name = node->as.class_def.name;
+            emit_u16(c, chunk_add_name(c->chunk, obj_string_intern(name, strlen(name))), line);
+            if (node->as.class_def.superclass)
+                emit_u16(c, chunk_add_name(c->chunk, node->as.class_def.super_key), line);
+            else
+                emit_u16(c, NO_SUPERCLASS, line);
+            for (size_t i = 0; i < node->as.class_def.method_count; i++) {
+                AstNode *method = node->as.class_def.methods[i];
+                if (method->type != AST_FUNCTION) continue;
+                Chunk *proto = compile_function(c, method);
+                emit_op(c, OP_METHOD, 0, method->line);
+                emit_u16(c, chunk_add_proto(c->chunk, proto), method->line);
+            }
+            emit_set_var(c, node->as.class_def.name_ref, line);
+            finish_value(c, keep, line);
+            return;
+        }
+
+        case AST_TRY:
+            compile_try(c, node);
+            nil_value(c, keep, line);
+            return;
+
+        case AST_MATCH: {
+            compile_expr(c, node->as.match_stmt.expr);
+            size_t *ends = (size_t *)malloc(sizeof(size_t) * (node->as.match_stmt.case_count + 1));
+            for (size_t i = 0; i < node->as.match_stmt.case_count; i++) {
+                AstNode *case_node = node->as.match_stmt.cases[i];
+                emit_op(c, OP_MATCH, 1, case_node->line);
+                emit_u16(c, chunk_add_node(c->chunk, case_node->as.if_stmt.cond), case_node->line);
+                size_t next = emit_jump(c, OP_JUMP_IF_FALSE, -1, case_node->line);
+                emit_op(c, OP_POP, -1, case_node->line);
+                compile_stmt(c, case_node->as.if_stmt.then_branch, 0);
+                ends[i] = emit_jump(c, OP_JUMP, 0, case_node->line);
+                c->depth++;
+                patch_jump(c, next);
+            }
+            emit_op(c, OP_POP, -1, line);
+            for (size_t i = 0; i < node->as.match_stmt.case_count; i++) patch_jump(c, ends[i]);
+            free(ends);
+            nil_value(c, keep, line);
+            return;
+        }
+
+        case AST_IMPORT:
+            /* No-op: module system not yet implemented */
+            nil_value(c, keep, line);
+            return;
+
+        case AST_HPC:
+            if (ast_is_parallel(node)) {
+                if (node->as.hpc.spec_count > 0) compile_expr(c, node->as.hpc.specs[0]);
+                else emit_op(c, OP_NIL, 1, line);
+                Chunk *proto = compile_function(c, node);
+                emit_op(c, OP_PARALLEL, -1, line);
+                emit_u16(c, chunk_add_proto(c->chunk, proto), line);
+                nil_value(c, keep, line);
+                return;
+            }
+            compile_stmt(c, node->as.hpc.body, keep);
+            return;
+
+        default:
+            emit_error(c, "Unsupported statement node type.", line);
+            nil_value(c, keep, line);
+            return;
+    }
+}
+
+/* ========================================================================= */
+/* Entry points                                                              */
+/* ========================================================================= */
+
+static void compiler_init(Compiler *c, Chunk *chunk, char *error, size_t error_size) {
+    c->chunk = chunk;
+    c->control_count = 0;
+    c->depth = 0;
+    c->error = error;
+    c->error_size = error_size;
+    c->had_error = 0;
+}
+
+static Chunk *compile_function(Compiler *parent, AstNode *fn_node) {
+    Compiler c;
+    compiler_init(&c, chunk_new(fn_node), parent->error, parent->error_size);
+    c.had_error = parent->had_error;
+
+    if (fn_node->type == AST_LAMBDA) {
+        /* Lambdas evaluate to their last statement */
+        compile_block(&c, fn_node->as.lambda.body, 1);
+        emit_op(&c, OP_END, -1, fn_node->line);
+    } else {
+        /* Functions, and parallel blocks run once per worker */
+        compile_block(&c, fn_node->type == AST_HPC ? fn_node->as.hpc.body : fn_node->as.function.body, 0);
+        emit_op(&c, OP_NIL, 1, fn_node->line);
+        emit_op(&c, OP_END, -1, fn_node->line);
+    }
+
+    parent->had_error = c.had_error;
+    return c.chunk;
+}
+
+Chunk *compile_program(AstNode *program, char *error, size_t error_size) {
+    Compiler c;
+    compiler_init(&c, chunk_new(NULL), error, error_size);
+    compile_stmt(&c, program, 1);
+    emit_op(&c, OP_END, -1, program->line);
+    if (c.had_error) {
+        chunk_free(c.chunk);
+        return NULL;
+    }
+    return c.chunk;
+}
@@ -0,0 +1,15 @@
+#ifndef LILITH_COMPILER_H
+#define LILITH_COMPILER_H
+
+#include "chunk.h"
+
+/* -------------------------------------------------------------------------- */
+/* AST -> bytecode compiler                                                   */
+/* -------------------------------------------------------------------------- */
+
+/* Compile a parsed program.  Function, lambda and method bodies become
+   nested protos of the returned chunk.  On failure returns NULL and writes a
+   message into `error`. */
+Chunk *compile_program(AstNode *program, char *error, size_t error_size);
+
+#endif
@@ -1,87 +1,178 @@
 #define _GNU_SOURCE
 #include "environment.h"
+#include "gc.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 Environment *env_new(void) {
-    Environment *env = (Environment *)malloc(sizeof(Environment));
+    Environment *env = (Environment *)calloc(1, sizeof(Environment));
     if (!env) {
         fprintf(stderr, "Out of memory\n");
         exit(1);
     }
-    env->values = obj_dict_new();
-    env->enclosing = NULL;
+    env->index = obj_dict_new();
+    gc_push_root(OBJ_VAL(env->index));
+    env->keys = obj_dict_new();
+    gc_pop_roots(1);
     return env;
 }
 
-Environment *env_new_enclosing(Environment *enclosing) {
-    Environment *env = env_new();
+/* Slots are allocated together with the environment itself. */
+Environment *env_new_scope(Environment *enclosing, AstScope *scope) {
+    Environment *env = (Environment *)malloc(sizeof(Environment) + sizeof(Value) * scope->count);
+    if (!env) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    env->slots = (Value *)(env + 1);
+    for (size_t i = 0; i < scope->count; i++) env->slots[i] = UNDEFINED_VAL;
+    env->count = scope->count;
+    env->capacity = scope->count;
+    env->names = scope->names;
+    env->index = NULL;
+    env->keys = NULL;
+    env->scope = scope;
     env->enclosing = enclosing;
+    env->gc_epoch = 0;
+    env->gc_young_epoch = 0;
+    gc_track_env(env);
     return env;
 }
 
 void env_free(Environment *env) {
     if (!env) return;
-    /* values dict is GC-managed; do not free here */
+    if (!env->scope) {
+        /* index dict is GC-managed; do not free here */
+        for (size_t i = 0; i < env->count; i++) free(env->names[i]);
+        free(env->names);
+        free(env->slots);
+    }
     free(env);
 }
 
-void env_define(Environment *env, const char *name, Value value) {
-    ObjString *key = obj_string_copy(name, strlen(name));
-    dict_set(env->values, key, value);
+/* ========================================================================= */
+/* Scope stack                                                               */
+/* ========================================================================= */
+
+#define ENV_SEGMENT_SIZE (64 * 1024)
+
+void env_stack_init(EnvStack *stack) {
+    stack->top = NULL;
+    stack->last = NULL;
 }
 
-int env_get(Environment *env, const char *name, Value *out) {
-    ObjString key;
-    key.obj.type = OBJ_STRING;
-    key.chars = (char *)name;
-    key.length = strlen(name);
-    key.hash = hash_string(name, key.length);
+void env_stack_free(EnvStack *stack) {
+    EnvSegment *seg = stack->top;
+    if (!seg) return;
+    while (seg->next) seg = seg->next;
+    while (seg) {
+        EnvSegment *prev = seg->prev;
+        free(seg);
+        seg = prev;
+    }
+    stack->top = NULL;
+    stack->last = NULL;
+}
 
-    if (dict_get(env->values, &key, out)) return 1;
-    if (env->enclosing) return env_get(env->enclosing, name, out);
-    return 0;
+/* Slow path of env_enter: move to the next segment, allocating it on first
+   use, and take `size` bytes from it. */
+EnvFrame *env_stack_grow(EnvStack *stack, size_t size) {
+    EnvSegment *seg = stack->top ? stack->top->next : NULL;
+    if (seg && seg->capacity < size) {
+        /* Too small for this scope: drop it and everything after it */
+        while (seg) {
+            EnvSegment *next = seg->next;
+            free(seg);
+            seg = next;
+        }
+        stack->top->next = NULL;
+    }
+    if (!seg) {
+        size_t capacity = size > ENV_SEGMENT_SIZE ? size : ENV_SEGMENT_SIZE;
+        seg = (EnvSegment *)malloc(sizeof(EnvSegment) + capacity);
+        if (!seg) {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+        seg->prev = stack->top;
+        seg->next = NULL;
+        seg->capacity = capacity;
+        if (stack->top) stack->top->next = seg;
+    }
+    seg->used = size;
+    stack->top = seg;
+    return (EnvFrame *)seg->data;
 }
 
-int env_set(Environment *env, const char *name, Value value) {
-    ObjString key;
-    key.obj.type = OBJ_STRING;
-    key.chars = (char *)name;
-    key.length = strlen(name);
-    key.hash = hash_string(name, key.length);
+/* ========================================================================= */
+/* Slots                                                                     */
+/* ========================================================================= */
 
-    /* If it exists in this scope, update it */
-    Value dummy;
-    if (dict_get(env->values, &key, &dummy)) {
-        dict_set(env->values, &key, value);
-        return 1;
+static int find_slot(Environment *env, ObjString *name) {
+    if (env->index) {
+        Value slot;
+        if (dict_get(env->index, name, &slot)) return (int)AS_NUMBER(slot);
+        return -1;
     }
-    /* Otherwise walk up */
-    if (env->enclosing) return env_set(env->enclosing, name, value);
-    return 0;
+    for (size_t i = 0; i < env->count; i++) {
+        if (strcmp(env->names[i], string_chars(name)) == 0) return (int)i;
+    }
+    return -1;
+}
+
+int env_global_slot(Environment *globals, ObjString *name) {
+    int slot = find_slot(globals, name);
+    if (slot >= 0) return slot;
+
+    if (globals->count + 1 > globals->capacity) {
+        size_t cap = globals->capacity < 64 ? 64 : globals->capacity * 2;
+        globals->slots = (Value *)realloc(globals->slots, sizeof(Value) * cap);
+        globals->names = (char **)realloc(globals->names, sizeof(char *) * cap);
+        if (!globals->slots || !globals->names) {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+        globals->capacity = cap;
+    }
+    slot = (int)globals->count++;
+    globals->slots[slot] = UNDEFINED_VAL;
+    globals->names[slot] = strdup(string_chars(name));
+    dict_set(globals->index, name, NUMBER_VAL(slot));
+    return slot;
 }
 
-int env_get_at(Environment *env, const char *name, Value *out, int depth) {
-    Environment *current = env;
-    for (int i = 0; i < depth && current; i++) {
-        current = current->enclosing;
+void env_define(Environment *env, const char *name, Value value) {
+    /* Interning the name allocates */
+    gc_push_root(value);
+    ObjString *key = obj_string_intern(name, strlen(name));
+    int slot = env->index ? env_global_slot(env, key) : find_slot(env, key);
+    gc_pop_roots(1);
+    if (slot >= 0) {
+        gc_slot_barrier(value);
+        env->slots[slot] = value;
+    }
+}
+
+int env_get(Environment *env, ObjString *name, Value *out) {
+    for (; env; env = env->enclosing) {
+        int slot = find_slot(env, name);
+        if (slot >= 0 && !IS_UNDEFINED(env->slots[slot])) {
+            *out = env->slots[slot];
+            return 1;
+        }
     }
-    if (!current) return 0;
-    return env_get(current, name, out);
+    return 0;
 }
 
-int env_set_at(Environment *env, const char *name, Value value, int depth) {
-    Environment *current = env;
-    for (int i = 0; i < depth && current; i++) {
-        current = current->enclosing;
+int env_set(Environment *env, ObjString *name, Value value) {
+    for (; env; env = env->enclosing) {
+        int slot = find_slot(env, name);
+        if (slot >= 0 && !IS_UNDEFINED(env->slots[slot])) {
+            gc_slot_barrier(value);
+            env->slots[slot] = value;
+            return 1;
+        }
     }
-    if (!current) return 0;
-    ObjString key;
-    key.obj.type = OBJ_STRING;
-    key.chars = (char *)name;
-    key.length = strlen(name);
-    key.hash = hash_string(name, key.length);
-    dict_set(current->values, &key, value);
-    return 1;
+    return 0;
 }
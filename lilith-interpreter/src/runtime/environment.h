@@ -2,24 +2,141 @@
 #define LILITH_ENVIRONMENT_H
 
 #include "value.h"
+#include "gc.h"
+#include "parser/ast.h"
+#include <assert.h>
 
 /* -------------------------------------------------------------------------- */
 /* Environment — lexical variable scoping                                    */
 /* -------------------------------------------------------------------------- */
 
+/* Variables live in slots assigned by the resolver.  A scope environment
+   (function call or catch block) has a fixed slot count taken from its
+   AstScope.  The global environment grows on demand and keeps a name ->
+   slot index for the resolver and for by-name lookups. */
 typedef struct Environment {
-    ObjDict *values;
+    Value *slots;
+    size_t count;
+    size_t capacity;                /* globals only */
+    char **names;                   /* slot names, for by-name lookups */
+    ObjDict *index;                 /* globals only: name -> slot number */
+    ObjDict *keys;                  /* globals only: interned strings the resolved AST holds */
+    AstScope *scope;                /* NULL for globals */
     struct Environment *enclosing;
+    unsigned gc_epoch;              /* last major cycle that marked it */
+    unsigned gc_young_epoch;        /* last minor collection that visited it */
+    struct Environment *gc_next;    /* heap scopes, owned by the collector */
 } Environment;
 
 Environment *env_new(void);
-Environment *env_new_enclosing(Environment *enclosing);
+Environment *env_new_scope(Environment *enclosing, AstScope *scope);
 void env_free(Environment *env);
 
+/* -------------------------------------------------------------------------- */
+/* Scope stack                                                                */
+/* -------------------------------------------------------------------------- */
+
+/* Every scope entered gets a frame on a LIFO stack of segments that is kept
+   across calls; the frames are how the collector finds live scopes.  The
+   environment of a scope that no closure captures lives inside its frame,
+   so entering and leaving it does not touch the heap.  Captured scopes are
+   heap-allocated, outlive the call and are freed by the collector. */
+typedef struct EnvSegment {
+    struct EnvSegment *prev;
+    struct EnvSegment *next;
+    size_t used;
+    size_t capacity;
+    unsigned char data[];
+} EnvSegment;
+
+typedef struct EnvFrame {
+    struct EnvFrame *prev;
+    Environment *env;
+} EnvFrame;
+
+typedef struct {
+    EnvSegment *top;
+    EnvFrame *last;                 /* innermost frame */
+} EnvStack;
+
+void env_stack_init(EnvStack *stack);
+void env_stack_free(EnvStack *stack);
+EnvFrame *env_stack_grow(EnvStack *stack, size_t size);
+
+static inline size_t env_scope_size(const AstScope *scope) {
+    size_t size = sizeof(Environment) + sizeof(Value) * scope->count;
+    return (size + 15) & ~(size_t)15;
+}
+
+/* Enter a function, lambda or catch scope */
+static inline Environment *env_enter(EnvStack *stack, Environment *enclosing, AstScope *scope) {
+    size_t size = sizeof(EnvFrame) + (scope->captured ? 0 : env_scope_size(scope));
+    EnvSegment *seg = stack->top;
+    EnvFrame *frame;
+    if (seg && seg->used + size <= seg->capacity) {
+        frame = (EnvFrame *)(seg->data + seg->used);
+        seg->used += size;
+    } else {
+        frame = env_stack_grow(stack, size);
+    }
+    frame->prev = stack->last;
+    stack->last = frame;
+    if (scope->captured) return frame->env = env_new_scope(enclosing, scope);
+
+    Environment *env = (Environment *)(frame + 1);
+    frame->env = env;
+    env->slots = (Value *)(env + 1);
+    for (size_t i = 0; i < scope->count; i++) env->slots[i] = UNDEFINED_VAL;
+    env->count = scope->count;
+    env->capacity = scope->count;
+    env->names = scope->names;
+    env->index = NULL;
+    env->keys = NULL;
+    env->scope = scope;
+    env->enclosing = enclosing;
+    env->gc_epoch = 0;
+    env->gc_young_epoch = 0;
+    env->gc_next = NULL;
+    return env;
+}
+
+/* Leave the innermost scope entered on `stack`, which must be `env` */
+static inline void env_leave(EnvStack *stack, Environment *env) {
+    EnvFrame *frame = stack->last;
+    EnvSegment *seg = stack->top;
+    assert(frame->env == env);
+    stack->last = frame->prev;
+    while ((unsigned char *)frame < seg->data || (unsigned char *)frame >= seg->data + seg->capacity) {
+        seg->used = 0;
+        seg = seg->prev;
+    }
+    seg->used = (size_t)((unsigned char *)frame - seg->data);
+    stack->top = seg;
+}
+
+/* Globals.  Names are interned strings, so the index matches them by
+   pointer. */
+int  env_global_slot(Environment *globals, ObjString *name);
+
+/* By-name access: slow paths for natives, superclass lookup and slots that
+   were never assigned. */
 void env_define(Environment *env, const char *name, Value value);
-int  env_get(Environment *env, const char *name, Value *out);
-int  env_set(Environment *env, const char *name, Value value);
-int  env_get_at(Environment *env, const char *name, Value *out, int depth);
-int  env_set_at(Environment *env, const char *name, Value value, int depth);
+int  env_get(Environment *env, ObjString *name, Value *out);
+int  env_set(Environment *env, ObjString *name, Value value);
+
+/* Resolved access */
+static inline Environment *env_ancestor(Environment *env, int depth) {
+    while (depth-- > 0) env = env->enclosing;
+    return env;
+}
+
+static inline Value env_get_at(Environment *env, int depth, int slot) {
+    return env_ancestor(env, depth)->slots[slot];
+}
+
+static inline void env_set_at(Environment *env, int depth, int slot, Value value) {
+    gc_slot_barrier(value);
+    env_ancestor(env, depth)->slots[slot] = value;
+}
 
 #endif
@@ -0,0 +1,220 @@
+#define _GNU_SOURCE
+#include "future.h"
+#include "gc.h"
+#include "concurrency/scheduler.h"
+#include "async/async_runtime.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ========================================================================= */
+/* Bookkeeping                                                               */
+/* ========================================================================= */
+
+/* `running` holds the states whose call has not finished, so a program can
+   wait for its own before its globals go away.  `released` holds states
+   whose object died while the pool still had their task; they are freed
+   once the task is marked done.  Coroutines waiting for a call hang off
+   its state. */
+typedef struct FutureWaiter {
+    Coroutine *co;
+    struct FutureWaiter *next;
+} FutureWaiter;
+
+static pthread_mutex_t futures_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t futures_finished = PTHREAD_COND_INITIALIZER;
+static FutureState *running;
+static FutureState *released;
+
+static void free_state(FutureState *state) {
+    free(state->args);
+    free(state->error);
+    free(state);
+}
+
+/* Under futures_lock */
+static void reap_released(void) {
+    FutureState **link = &released;
+    while (*link) {
+        FutureState *state = *link;
+        if (atomic_load_explicit(&state->task.done, memory_order_acquire)) {
+            *link = state->next_released;
+            free_state(state);
+        } else {
+            link = &state->next_released;
+        }
+    }
+}
+
+static void unlink_running(FutureState *state) {
+    for (FutureState **link = &running; *link; link = &(*link)->next) {
+        if (*link == state) {
+            *link = state->next;
+            return;
+        }
+    }
+}
+
+/* Roots while the call runs: what it was given, what it returned and the
+   object, which nothing else may reference yet */
+static void mark_future(void *arg) {
+    FutureState *state = (FutureState *)arg;
+    gc_mark_slot(&state->callee);
+    for (int i = 0; i < state->argc; i++) gc_mark_slot(&state->args[i]);
+    gc_mark_slot(&state->result);
+    gc_mark_object_slot(&state->future);
+}
+
+/* ========================================================================= */
+/* Worker side                                                               */
+/* ========================================================================= */
+
+static void future_body(Interpreter *context, void *arg) {
+    FutureState *state = (FutureState *)arg;
+    Value result = interp_call_direct(context, state->callee, state->argc, state->args);
+    int failed = context->throw_flag;
+    if (failed) state->error = strdup(context->error_msg ? context->error_msg : "unknown error");
+    else state->result = result;
+
+    /* From here on the object, if still alive, keeps the result */
+    gc_remove_roots(mark_future, state);
+    Obj *future = state->future;
+    state->future = NULL;
+    gc_write_barrier(future, state->result);
+    atomic_store_explicit(&state->status, failed ? FUTURE_FAILED : FUTURE_DONE, memory_order_release);
+}
+
+static void run_future(void *arg) {
+    FutureState *state = (FutureState *)arg;
+    interpreter_run_context(&state->context, future_body, state);
+    interpreter_free_context(&state->context);
+
+    pthread_mutex_lock(&futures_lock);
+    unlink_running(state);
+    /* A woken coroutine may return at once, taking its node with it */
+    FutureWaiter *waiter = state->waiters;
+    state->waiters = NULL;
+    while (waiter) {
+        FutureWaiter *next = waiter->next;
+        async_wake(waiter->co);
+        waiter = next;
+    }
+    pthread_cond_broadcast(&futures_finished);
+    pthread_mutex_unlock(&futures_lock);
+}
+
+static void run_coroutine(void *arg) {
+    FutureState *state = (FutureState *)arg;
+    run_future(state);
+    atomic_store_explicit(&state->task.done, 1, memory_order_release);
+}
+
+/* ========================================================================= */
+/* Public API                                                                */
+/* ========================================================================= */
+
+static ObjFuture *spawn(Interpreter *interp, Value callee, int argc, Value *args, int on_loop) {
+    FutureState *state = (FutureState *)calloc(1, sizeof(FutureState));
+    if (!state || (argc > 0 && !(state->args = (Value *)malloc(sizeof(Value) * (size_t)argc)))) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    state->callee = NIL_VAL;
+    state->result = NIL_VAL;
+    atomic_init(&state->status, FUTURE_RUNNING);
+
+    /* Registering is a safepoint, after which the arguments may have moved;
+       read them only once the state roots its copies */
+    gc_add_roots(mark_future, state);
+    state->callee = callee;
+    for (int i = 0; i < argc; i++) state->args[i] = args[i];
+    state->argc = argc;
+    ObjFuture *future = obj_future_new(state);
+    state->future = (Obj *)future;
+
+    interpreter_init_context(&state->context, interp);
+    state->globals = interp->globals;
+    state->on_loop = on_loop;
+    task_init(&state->task, run_future, state);
+
+    pthread_mutex_lock(&futures_lock);
+    reap_released();
+    state->next = running;
+    running = state;
+    pthread_mutex_unlock(&futures_lock);
+
+    if (on_loop) async_spawn(run_coroutine, state);
+    else thread_pool_spawn(scheduler_pool(), &state->task);
+    return future;
+}
+
+ObjFuture *future_spawn(Interpreter *interp, Value callee, int argc, Value *args) {
+    return spawn(interp, callee, argc, args, 0);
+}
+
+ObjFuture *future_spawn_coroutine(Interpreter *interp, Value callee, int argc, Value *args) {
+    return spawn(interp, callee, argc, args, 1);
+}
+
+Value future_await(Interpreter *interp, Value future) {
+    FutureState *state = AS_FUTURE(future)->state;
+    size_t roots = gc_root_depth();
+    gc_push_root(future);
+    if (async_current()) {
+        FutureWaiter waiter = { async_current(), NULL };
+        pthread_mutex_lock(&futures_lock);
+        int pending = atomic_load_explicit(&state->status, memory_order_acquire) == FUTURE_RUNNING;
+        if (pending) {
+            waiter.next = state->waiters;
+            state->waiters = &waiter;
+        }
+        pthread_mutex_unlock(&futures_lock);
+        if (pending) async_park();
+    } else if (!state->on_loop) {
+        /* Joining runs other pool tasks meanwhile */
+        gc_safe_enter();
+        thread_pool_join(scheduler_pool(), &state->task);
+        gc_safe_leave();
+    } else {
+        gc_safe_enter();
+        pthread_mutex_lock(&futures_lock);
+        while (atomic_load_explicit(&state->status, memory_order_acquire) == FUTURE_RUNNING)
+            pthread_cond_wait(&futures_finished, &futures_lock);
+        pthread_mutex_unlock(&futures_lock);
+        gc_safe_leave();
+    }
+    gc_restore_roots(roots);
+
+    if (atomic_load_explicit(&state->status, memory_order_acquire) == FUTURE_FAILED) {
+        runtime_error(interp, "%s", state->error);
+        return NIL_VAL;
+    }
+    return state->result;
+}
+
+void future_drain(Environment *globals) {
+    gc_safe_enter();
+    pthread_mutex_lock(&futures_lock);
+    for (;;) {
+        FutureState *state = running;
+        while (state && state->globals != globals) state = state->next;
+        if (!state) break;
+        pthread_cond_wait(&futures_finished, &futures_lock);
+    }
+    reap_released();
+    pthread_mutex_unlock(&futures_lock);
+    gc_safe_leave();
+}
+
+/* Runs during a sweep, with the world stopped */
+void future_release(FutureState *state) {
+    pthread_mutex_lock(&futures_lock);
+    if (atomic_load_explicit(&state->task.done, memory_order_acquire)) {
+        free_state(state);
+    } else {
+        state->next_released = released;
+        released = state;
+    }
+    pthread_mutex_unlock(&futures_lock);
+}
@@ -0,0 +1,64 @@
+#ifndef LILITH_FUTURE_H
+#define LILITH_FUTURE_H
+
+#include "interpreter.h"
+#include "concurrency/thread_pool.h"
+
+/* -------------------------------------------------------------------------- */
+/* Futures — calls running on a pool worker                                   */
+/* -------------------------------------------------------------------------- */
+
+/* compute_async starts a call as a task on the shared pool, and a call to
+   an async function starts it as a coroutine on the event loop (see
+   async/async_runtime.h).  Either way it runs in an interpreter context
+   of its own and an ObjFuture is returned at once.  `~( future )~` waits
+   for it and yields its result, or raises its error; inside a coroutine
+   waiting parks the coroutine, so the loop runs others meanwhile.
+
+   The call's state lives outside the heap, since the pool holds on to its
+   task while the object may move.  Until the call finishes the state is a
+   root set of its own, which also keeps the future object alive; after
+   that the object keeps the result.  A state outlives its object when the
+   task has not yet been marked done; coroutines mark it themselves. */
+typedef enum {
+    FUTURE_RUNNING,
+    FUTURE_DONE,
+    FUTURE_FAILED,
+} FutureStatus;
+
+typedef struct FutureState {
+    Task task;
+    Interpreter context;
+    Environment *globals;           /* of the program that started it */
+    Value callee;
+    Value *args;
+    int argc;
+    Value result;
+    char *error;
+    atomic_int status;
+    int on_loop;                    /* a coroutine rather than a pool task */
+    struct FutureWaiter *waiters;   /* parked coroutines */
+    Obj *future;                    /* the object, while running */
+    struct FutureState *next;       /* running list */
+    struct FutureState *next_released;
+} FutureState;
+
+/* Start callee((args)) under `interp`'s program.  The callee must be a
+   temporary root; the arguments may be rooted anywhere, the VM stack
+   included, since they are read only after the last safepoint. */
+ObjFuture *future_spawn(Interpreter *interp, Value callee, int argc, Value *args);
+
+/* The same on the event loop */
+ObjFuture *future_spawn_coroutine(Interpreter *interp, Value callee, int argc, Value *args);
+
+/* Wait for `future` and return its result; on failure raise its error on
+   `interp` and return nil */
+Value future_await(Interpreter *interp, Value future);
+
+/* Wait for every future started under `globals` to finish */
+void future_drain(Environment *globals);
+
+/* The object is being freed */
+void future_release(FutureState *state);
+
+#endif
@@ -2,103 +2,997 @@
 #include "gc.h"
 #include "value.h"
 #include "environment.h"
+#include "slab.h"
+#include "future.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 /* ========================================================================= */
-/* Simple mark-and-sweep garbage collector                                   */
+/* Generational garbage collector                                            */
 /* ========================================================================= */
 
-static Obj *gc_objects = NULL;
+#define GC_INITIAL_THRESHOLD (1024 * 1024)
+#define GC_HEAP_GROW_FACTOR  2
 
-void gc_track(void *obj) {
-    Obj *o = (Obj *)obj;
-    o->next = gc_objects;
-    gc_objects = o;
+/* A major cycle advances by one step per GC_STEP_BYTES allocated; each step
+   works until the pause target runs out, looking at the clock every
+   GC_STEP_CHECK objects.  Once the heap outgrows the threshold by the grow
+   factor the cycle is finished in one go instead. */
+#define GC_STEP_BYTES        (64 * 1024)
+#define GC_STEP_CHECK        64
+#define GC_DEFAULT_PAUSE_US  500
+#define GC_STRESS_STEP       4      /* objects per step under LILITH_GC_STRESS */
+
+/* The nursery holds up to GC_NURSERY_BLOCKS blocks of GC_BLOCK_SIZE bytes
+   per attached thread, each aligned to its size so an object can find its
+   block.  A thread bumps through a block of its own. */
+#define GC_BLOCK_SIZE        (32 * 1024)
+#define GC_NURSERY_BLOCKS    8
+
+/* Objects this big, long strings mostly, go straight to the old space
+   rather than being copied out of the nursery */
+#define GC_LARGE_OBJECT      (GC_BLOCK_SIZE / 4)
+
+/* Threads add to the shared byte count in batches */
+#define GC_ACCOUNT_BATCH     (16 * 1024)
+
+#define GC_ALIGN(size)       (((size) + 7) & ~(size_t)7)
+
+/* Obj.marked of a young object during a minor collection */
+#define GC_PINNED            1      /* held by a temporary root, stays put */
+#define GC_FORWARDED         2      /* copied to the old space, see Obj.next */
+
+/* Obj.marked of an old object reached by a major cycle.  The two colours
+   alternate between cycles, so survivors never need to be cleared: an
+   object is black or gray if it carries the current colour, white if not. */
+#define GC_COLOR_A           3
+#define GC_COLOR_B           4
+
+typedef enum {
+    GC_IDLE,
+    GC_MARKING,
+    GC_SWEEPING,
+} GcPhase;
+
+typedef struct {
+    unsigned char *top;             /* bump pointer */
+    size_t live;                    /* promoted objects left, once retired */
+} GcBlock;
+
+#define BLOCK_DATA(block)    ((unsigned char *)(block) + GC_ALIGN(sizeof(GcBlock)))
+#define BLOCK_END(block)     ((unsigned char *)(block) + GC_BLOCK_SIZE)
+#define BLOCK_OF(obj)        ((GcBlock *)((uintptr_t)(obj) & ~(uintptr_t)(GC_BLOCK_SIZE - 1)))
+
+typedef struct {
+    GcRootFn fn;
+    void *context;
+} RootSet;
+
+typedef struct {
+    Obj **items;
+    size_t count;
+    size_t capacity;
+} ObjStack;
+
+/* What the collector needs from each attached thread.  A thread only
+   touches its own record; the collector reads them all while the world is
+   stopped. */
+typedef struct GcThread {
+    struct GcThread *next;          /* attached threads */
+    GcRootStack *roots;             /* its gc_temp_roots */
+    int attached;                   /* gc_thread_attach depth */
+    int safe;                       /* inside gc_safe_enter */
+    int pin_depth;
+    int collecting;                 /* this thread stopped the world */
+    GcBlock *block;                 /* nursery block it bumps through */
+    Obj *objects;                   /* allocated straight into the old space */
+    Obj *objects_last;
+    Environment *envs;              /* heap scopes created */
+    Environment *envs_last;
+    ObjStack remembered;            /* write barrier records */
+    ObjStack shaded;                /* grayed by barriers while marking */
+    ptrdiff_t allocated;            /* bytes not yet in bytes_allocated */
+    size_t step_debt;               /* bytes allocated since the last step */
+} GcThread;
+
+static _Thread_local GcThread self;
+
+static Obj *gc_objects = NULL;               /* old space */
+static Environment *gc_envs = NULL;          /* heap (captured) scopes */
+
+/* Blocks handed out since the last minor collection, and reset ones.
+   Threads add old objects and scopes to lists of their own, which join
+   these whenever the world stops. */
+static GcBlock **nursery = NULL;
+static size_t nursery_count = 0;
+static size_t nursery_capacity = 0;
+static GcBlock **spare = NULL;
+static size_t spare_count = 0;
+static size_t spare_capacity = 0;
+static atomic_size_t nursery_budget = GC_NURSERY_BLOCKS;
+
+/* Guards the nursery block lists */
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static atomic_llong bytes_allocated = 0;
+static size_t next_gc = GC_INITIAL_THRESHOLD;
+static unsigned epoch = 1;                   /* environments marked by the major cycle */
+static unsigned young_epoch = 1;             /* ... and visited by the minor one */
+static int minor = 0;                        /* the running cycle is a minor one */
+
+static GcPhase phase = GC_IDLE;
+static unsigned char mark_color = GC_COLOR_A;
+static unsigned pause_target_us = GC_DEFAULT_PAUSE_US;
+static Obj **sweep_object = &gc_objects;     /* lazy sweep positions */
+static Environment **sweep_env = &gc_envs;
+int gc_marking = 0;
+
+static RootSet *root_sets = NULL;
+static size_t root_set_count = 0;
+
+_Thread_local GcRootStack gc_temp_roots = { NULL, 0, 0 };
+
+/* Temporary roots of suspended coroutines */
+static GcRootStack **root_stacks = NULL;
+static size_t root_stack_count = 0;
+
+static ObjStack young_gray;                  /* promoted, not yet scanned */
+static ObjStack gray;                        /* major mark stack, kept across steps */
+static ObjStack remembered;                  /* old objects pointing at young ones */
+static ObjStack orphaned;                    /* shaded by threads since detached */
+
+/* Stopping the world.  Attached threads poll gc_stop_requested at
+   safepoints and park until the collecting thread clears it.  Threads in
+   a safe region count as stopped already. */
+static pthread_mutex_t world_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t world_changed = PTHREAD_COND_INITIALIZER;
+static GcThread *threads = NULL;
+static size_t thread_count = 0;
+static size_t stopped_count = 0;
+atomic_int gc_stop_requested = 0;
+
+static void *grow_array(void *array, size_t *capacity, size_t elem_size) {
+    *capacity = *capacity < 64 ? 64 : *capacity * 2;
+    array = realloc(array, elem_size * *capacity);
+    if (!array) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    return array;
 }
 
-static void mark_value(Value value);
+static size_t object_size(Obj *obj) {
+    switch (obj->type) {
+        case OBJ_STRING:   return GC_ALIGN(string_size((ObjString *)obj));
+        case OBJ_LIST:     return GC_ALIGN(sizeof(ObjList));
+        case OBJ_TUPLE:    return GC_ALIGN(sizeof(ObjTuple));
+        case OBJ_DICT:     return GC_ALIGN(sizeof(ObjDict));
+        case OBJ_FUNCTION: return GC_ALIGN(sizeof(ObjFunction));
+        case OBJ_CLASS:    return GC_ALIGN(sizeof(ObjClass));
+        case OBJ_INSTANCE: return GC_ALIGN(sizeof(ObjInstance));
+        case OBJ_NATIVE:   return GC_ALIGN(sizeof(ObjNative));
+        case OBJ_FUTURE:   return GC_ALIGN(sizeof(ObjFuture));
+        case OBJ_GENERATOR: return GC_ALIGN(sizeof(ObjGenerator));
+        case OBJ_RANGE:    return GC_ALIGN(sizeof(ObjRange));
+        case OBJ_ENTRIES:  return GC_ALIGN(sizeof(ObjEntries));
+        case OBJ_ARRAY:    return GC_ALIGN(sizeof(ObjArray));
+    }
+    return 0;
+}
+
+/* ========================================================================= */
+/* Roots                                                                     */
+/* ========================================================================= */
 
-static void mark_obj(Obj *obj) {
-    if (!obj) return;
-    if (obj->type & 0x80) return; /* Already marked */
-    obj->type |= 0x80; /* Mark flag */
+static void push(ObjStack *stack, Obj *obj);
 
-    switch (obj->type & 0x7F) {
-        case OBJ_STRING: break;
+/* With world_lock held: wait out a stop, counted as stopped */
+static void park_locked(void) {
+    stopped_count++;
+    pthread_cond_broadcast(&world_changed);
+    while (atomic_load(&gc_stop_requested)) pthread_cond_wait(&world_changed, &world_lock);
+    stopped_count--;
+}
+
+/* With world_lock held: wait until no collection is running.  Root sets
+   and the thread list only change then. */
+static void wait_for_world(void) {
+    if (!atomic_load(&gc_stop_requested)) return;
+    if (self.attached && !self.safe && !self.collecting) {
+        park_locked();
+    } else {
+        while (atomic_load(&gc_stop_requested)) pthread_cond_wait(&world_changed, &world_lock);
+    }
+}
+
+static void enter_safe_locked(GcThread *t) {
+    t->safe = 1;
+    stopped_count++;
+    pthread_cond_broadcast(&world_changed);
+}
+
+static void leave_safe_locked(GcThread *t) {
+    while (atomic_load(&gc_stop_requested)) pthread_cond_wait(&world_changed, &world_lock);
+    t->safe = 0;
+    stopped_count--;
+}
+
+static void flush_account(GcThread *t) {
+    if (t->allocated == 0) return;
+    atomic_fetch_add(&bytes_allocated, (long long)t->allocated);
+    t->allocated = 0;
+}
+
+/* Hand a thread's records to the collector.  Only while no collection can
+   start or every other thread is stopped. */
+static void adopt_thread_state(GcThread *t) {
+    flush_account(t);
+    for (size_t i = 0; i < t->remembered.count; i++) push(&remembered, t->remembered.items[i]);
+    t->remembered.count = 0;
+    for (size_t i = 0; i < t->shaded.count; i++) push(&orphaned, t->shaded.items[i]);
+    t->shaded.count = 0;
+    if (t->objects) {
+        t->objects_last->next = gc_objects;
+        gc_objects = t->objects;
+        t->objects = t->objects_last = NULL;
+    }
+    if (t->envs) {
+        t->envs_last->gc_next = gc_envs;
+        gc_envs = t->envs;
+        t->envs = t->envs_last = NULL;
+    }
+}
+
+int gc_thread_attach(void) {
+    GcThread *t = &self;
+    int token = 0;
+    pthread_mutex_lock(&world_lock);
+    if (t->attached == 0) {
+        while (atomic_load(&gc_stop_requested)) pthread_cond_wait(&world_changed, &world_lock);
+        t->roots = &gc_temp_roots;
+        t->next = threads;
+        threads = t;
+        thread_count++;
+        atomic_store(&nursery_budget, GC_NURSERY_BLOCKS * thread_count);
+    } else if (t->safe) {
+        /* Running tasks while joining: back to work for the duration */
+        token = 1;
+        leave_safe_locked(t);
+    }
+    t->attached++;
+    pthread_mutex_unlock(&world_lock);
+    return token;
+}
+
+void gc_thread_detach(int token) {
+    GcThread *t = &self;
+    pthread_mutex_lock(&world_lock);
+    if (--t->attached > 0) {
+        if (token) enter_safe_locked(t);
+        pthread_mutex_unlock(&world_lock);
+        return;
+    }
+    if (atomic_load(&gc_stop_requested)) park_locked();
+
+    /* No collection can start while world_lock is held */
+    adopt_thread_state(t);
+    t->block = NULL;
+
+    for (GcThread **link = &threads; *link; link = &(*link)->next) {
+        if (*link == t) {
+            *link = t->next;
+            break;
+        }
+    }
+    thread_count--;
+    atomic_store(&nursery_budget, GC_NURSERY_BLOCKS * (thread_count > 0 ? thread_count : 1));
+    pthread_cond_broadcast(&world_changed);
+    pthread_mutex_unlock(&world_lock);
+}
+
+void gc_safe_enter(void) {
+    if (!self.attached) return;
+    pthread_mutex_lock(&world_lock);
+    enter_safe_locked(&self);
+    pthread_mutex_unlock(&world_lock);
+}
+
+void gc_safe_leave(void) {
+    if (!self.attached) return;
+    pthread_mutex_lock(&world_lock);
+    leave_safe_locked(&self);
+    pthread_mutex_unlock(&world_lock);
+}
+
+void gc_safepoint(void) {
+    if (!self.attached || self.safe || self.pin_depth > 0 || self.collecting) return;
+    pthread_mutex_lock(&world_lock);
+    if (atomic_load(&gc_stop_requested)) park_locked();
+    pthread_mutex_unlock(&world_lock);
+}
+
+/* Stop every other attached thread at a safepoint.  Returns 0 when another
+   thread was already collecting; the caller was parked until it finished. */
+static int world_stop(void) {
+    if (!self.attached) gc_thread_attach();   /* attached for good */
+    pthread_mutex_lock(&world_lock);
+    if (atomic_load(&gc_stop_requested)) {
+        park_locked();
+        pthread_mutex_unlock(&world_lock);
+        return 0;
+    }
+    atomic_store(&gc_stop_requested, 1);
+    while (stopped_count + 1 < thread_count) pthread_cond_wait(&world_changed, &world_lock);
+    pthread_mutex_unlock(&world_lock);
+    self.collecting = 1;
+
+    for (GcThread *t = threads; t; t = t->next) adopt_thread_state(t);
+    return 1;
+}
+
+static void world_start(void) {
+    self.collecting = 0;
+    flush_account(&self);
+    pthread_mutex_lock(&world_lock);
+    atomic_store(&gc_stop_requested, 0);
+    pthread_cond_broadcast(&world_changed);
+    pthread_mutex_unlock(&world_lock);
+}
+
+void gc_add_roots(GcRootFn fn, void *context) {
+    pthread_mutex_lock(&world_lock);
+    wait_for_world();
+    root_sets = (RootSet *)realloc(root_sets, sizeof(RootSet) * (root_set_count + 1));
+    if (!root_sets) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    root_sets[root_set_count].fn = fn;
+    root_sets[root_set_count].context = context;
+    root_set_count++;
+    pthread_mutex_unlock(&world_lock);
+}
+
+void gc_remove_roots(GcRootFn fn, void *context) {
+    pthread_mutex_lock(&world_lock);
+    wait_for_world();
+    for (size_t i = 0; i < root_set_count; i++) {
+        if (root_sets[i].fn == fn && root_sets[i].context == context) {
+            root_sets[i] = root_sets[--root_set_count];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&world_lock);
+}
+
+void gc_register_root_stack(GcRootStack *stack) {
+    pthread_mutex_lock(&world_lock);
+    wait_for_world();
+    root_stacks = (GcRootStack **)realloc(root_stacks, sizeof(GcRootStack *) * (root_stack_count + 1));
+    if (!root_stacks) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    root_stacks[root_stack_count++] = stack;
+    pthread_mutex_unlock(&world_lock);
+}
+
+void gc_unregister_root_stack(GcRootStack *stack) {
+    pthread_mutex_lock(&world_lock);
+    wait_for_world();
+    for (size_t i = 0; i < root_stack_count; i++) {
+        if (root_stacks[i] == stack) {
+            root_stacks[i] = root_stacks[--root_stack_count];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&world_lock);
+}
+
+void gc_grow_roots(void) {
+    gc_temp_roots.values = (Value *)grow_array(gc_temp_roots.values, &gc_temp_roots.capacity, sizeof(Value));
+}
+
+size_t gc_pin_begin(void) {
+    self.pin_depth++;
+    return gc_temp_roots.count;
+}
+
+void gc_pin_end(size_t depth) {
+    self.pin_depth--;
+    gc_temp_roots.count = depth;
+}
+
+int gc_pin_suspend(void) {
+    int depth = self.pin_depth;
+    self.pin_depth = 0;
+    return depth;
+}
+
+void gc_pin_resume(int depth) {
+    self.pin_depth = depth;
+}
+
+void gc_remember(Obj *owner) {
+    if (atomic_exchange_explicit(&owner->remembered, 1, memory_order_relaxed)) return;
+    push(&self.remembered, owner);
+}
+
+static void push(ObjStack *stack, Obj *obj) {
+    if (stack->count == stack->capacity)
+        stack->items = (Obj **)grow_array(stack->items, &stack->capacity, sizeof(Obj *));
+    stack->items[stack->count++] = obj;
+}
+
+/* An object entering the old space takes the current colour.  While a
+   cycle is marking it is also gray: it may hold the only reference to an
+   old object the cycle has not reached. */
+static void promote(Obj *obj) {
+    obj->marked = mark_color;
+    if (phase == GC_MARKING) push(&gray, obj);
+}
+
+/* ========================================================================= */
+/* Allocation                                                                */
+/* ========================================================================= */
+
+static GcBlock *block_new(void) {
+#ifdef _MSC_VER
+    GcBlock *block = (GcBlock *)_aligned_malloc(GC_BLOCK_SIZE, GC_BLOCK_SIZE);
+#else
+    GcBlock *block = (GcBlock *)aligned_alloc(GC_BLOCK_SIZE, GC_BLOCK_SIZE);
+#endif
+    if (!block) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    block->top = BLOCK_DATA(block);
+    block->live = 0;
+    return block;
+}
+
+static void block_free(GcBlock *block) {
+#ifdef _MSC_VER
+    _aligned_free(block);
+#else
+    free(block);
+#endif
+}
+
+static void collect_if_needed(size_t size);
+static void collect_young(void);
+
+static Obj *block_bump(GcBlock *block, size_t size) {
+    if (!block || block->top + size > BLOCK_END(block)) return NULL;
+    Obj *obj = (Obj *)block->top;
+    block->top += size;
+    return obj;
+}
+
+/* Give the thread a fresh nursery block; NULL once the nursery is full */
+static Obj *nursery_refill(size_t size) {
+    GcBlock *block = NULL;
+    pthread_mutex_lock(&heap_lock);
+    if (nursery_count < atomic_load(&nursery_budget)) {
+        block = spare_count > 0 ? spare[--spare_count] : block_new();
+        if (nursery_count == nursery_capacity)
+            nursery = (GcBlock **)grow_array(nursery, &nursery_capacity, sizeof(GcBlock *));
+        nursery[nursery_count++] = block;
+    }
+    pthread_mutex_unlock(&heap_lock);
+    if (!block) return NULL;
+    self.block = block;
+    return block_bump(block, size);
+}
+
+/* Straight into the old space.  While marking it is left white and
+   shaded, the collector grays it. */
+static Obj *old_allocate(size_t size) {
+    Obj *obj = (Obj *)slab_alloc(size);
+    obj->space = GC_SPACE_OLD;
+    obj->marked = gc_marking ? 0 : mark_color;
+    obj->next = self.objects;
+    if (!self.objects) self.objects_last = obj;
+    self.objects = obj;
+    gc_account((ptrdiff_t)size);
+    if (gc_marking) push(&self.shaded, obj);
+    return obj;
+}
+
+Obj *gc_allocate(size_t size) {
+    if (!self.attached) gc_thread_attach();   /* attached for good */
+    size = GC_ALIGN(size);
+    int can_collect = !self.collecting && self.pin_depth == 0;
+    if (can_collect) {
+        gc_poll();
+        collect_if_needed(size);
+    }
+
+    Obj *obj = NULL;
+    if (size < GC_LARGE_OBJECT) {
+        obj = block_bump(self.block, size);
+        if (!obj) obj = nursery_refill(size);
+        if (!obj && can_collect) {
+            collect_young();
+            obj = nursery_refill(size);
+        }
+    }
+    if (obj) {
+        obj->space = GC_SPACE_NURSERY;
+        obj->marked = 0;
+    } else {
+        obj = old_allocate(size);   /* large, or pinned with a full nursery */
+    }
+    atomic_store_explicit(&obj->remembered, 0, memory_order_relaxed);
+    if (self.pin_depth > 0) gc_push_root(OBJ_VAL(obj));
+    return obj;
+}
+
+Obj *gc_allocate_old(size_t size) {
+    if (!self.attached) gc_thread_attach();   /* attached for good */
+    Obj *obj = old_allocate(GC_ALIGN(size));
+    atomic_store_explicit(&obj->remembered, 0, memory_order_relaxed);
+    if (self.pin_depth > 0) gc_push_root(OBJ_VAL(obj));
+    return obj;
+}
+
+bool gc_weak_claim(Obj *obj) {
+    if (phase == GC_SWEEPING && obj->space != GC_SPACE_NURSERY && obj->marked != mark_color)
+        return false;
+    if (gc_marking) gc_shade(obj);
+    return true;
+}
+
+void gc_track_env(Environment *env) {
+    if (!self.attached) gc_thread_attach();   /* attached for good */
+    /* Scopes created while a cycle sweeps survive it */
+    if (phase == GC_SWEEPING) env->gc_epoch = epoch;
+    env->gc_next = self.envs;
+    if (!self.envs) self.envs_last = env;
+    self.envs = env;
+}
+
+void gc_account(ptrdiff_t delta) {
+    self.allocated += delta;
+    if (self.collecting || self.allocated > GC_ACCOUNT_BATCH || self.allocated < -GC_ACCOUNT_BATCH)
+        flush_account(&self);
+}
+
+static size_t heap_bytes(void) {
+    long long bytes = atomic_load(&bytes_allocated);
+    return bytes > 0 ? (size_t)bytes : 0;
+}
+
+size_t gc_bytes_allocated(void) {
+    flush_account(&self);
+    return heap_bytes();
+}
+
+/* ========================================================================= */
+/* Tracing                                                                   */
+/* ========================================================================= */
+
+/* Minor collections: move a young object to the old space, once */
+static Obj *evacuate(Obj *obj) {
+    if (obj->space != GC_SPACE_NURSERY || obj->marked == GC_PINNED) return obj;
+    if (obj->marked == GC_FORWARDED) return obj->next;
+
+    size_t size = object_size(obj);
+    Obj *copy = (Obj *)slab_alloc(size);
+    memcpy(copy, obj, size);
+    copy->space = GC_SPACE_OLD;
+    copy->next = gc_objects;
+    gc_objects = copy;
+    gc_account((ptrdiff_t)size);
+
+    obj->marked = GC_FORWARDED;
+    obj->next = copy;
+    promote(copy);
+    push(&young_gray, copy);
+    return copy;
+}
+
+/* Major cycles: gray an old white object.  Young objects count as black,
+   they are promoted gray before marking ends. */
+static void mark_object(Obj *obj) {
+    if (obj->space == GC_SPACE_NURSERY || obj->space == GC_SPACE_STATIC || obj->marked == mark_color)
+        return;
+    obj->marked = mark_color;
+    push(&gray, obj);
+}
+
+/* Mutators only record the object; the collector grays it at its next
+   step.  Marking a promoted object twice is harmless. */
+void gc_shade(Obj *obj) {
+    if (obj->space == GC_SPACE_NURSERY || obj->space == GC_SPACE_STATIC || obj->marked == mark_color)
+        return;
+    if (self.collecting) mark_object(obj);
+    else push(&self.shaded, obj);
+}
+
+void gc_mark_object_slot(Obj **slot) {
+    if (!*slot) return;
+    if (minor) *slot = evacuate(*slot);
+    else mark_object(*slot);
+}
+
+void gc_mark_slot(Value *slot) {
+    if (IS_OBJ(*slot)) gc_mark_object_slot(&slot->as.obj);
+}
+
+static void visit_env(Environment *env) {
+    if (minor) env->gc_young_epoch = young_epoch;
+    else env->gc_epoch = epoch;
+    for (size_t i = 0; i < env->count; i++) gc_mark_slot(&env->slots[i]);
+    if (env->index) gc_mark_object_slot((Obj **)&env->index);
+    if (env->keys) gc_mark_object_slot((Obj **)&env->keys);
+}
+
+/* Visit an environment and everything it encloses, each at most once per
+   cycle.  Slots written after a major cycle visited a scope go through
+   gc_slot_barrier. */
+void gc_mark_env(Environment *env) {
+    if (minor) {
+        for (; env && env->gc_young_epoch != young_epoch; env = env->enclosing) visit_env(env);
+    } else {
+        for (; env && env->gc_epoch != epoch; env = env->enclosing) visit_env(env);
+    }
+}
+
+/* Visit every reference `obj` holds */
+static void blacken(Obj *obj) {
+    switch (obj->type) {
+        case OBJ_STRING: {
+            ObjString *str = (ObjString *)obj;
+            if (str->kind == STRING_FLAT) break;
+            /* Once flat, the halves or parent are garbage unless held elsewhere */
+            int flat = atomic_load_explicit(&str->text, memory_order_acquire) != NULL;
+            if (str->kind == STRING_ROPE) {
+                StringRope *rope = STRING_ROPE_OF(str);
+                if (flat) rope->left = rope->right = NULL;
+                gc_mark_object_slot((Obj **)&rope->left);
+                gc_mark_object_slot((Obj **)&rope->right);
+            } else {
+                StringView *view = STRING_VIEW_OF(str);
+                if (flat) {
+                    view->parent = NULL;
+                    view->bytes = NULL;
+                }
+                gc_mark_object_slot((Obj **)&view->parent);
+            }
+            break;
+        }
+        case OBJ_NATIVE:
+        case OBJ_RANGE:
+        case OBJ_ARRAY:
+            break;
         case OBJ_LIST: {
             ObjList *list = (ObjList *)obj;
-            for (size_t i = 0; i < list->count; i++) {
-                mark_value(list->items[i]);
-            }
+            for (size_t i = 0; i < list->count; i++) gc_mark_slot(&list->items[i]);
             break;
         }
         case OBJ_TUPLE: {
             ObjTuple *tuple = (ObjTuple *)obj;
-            for (size_t i = 0; i < tuple->count; i++) {
-                mark_value(tuple->items[i]);
-            }
+            for (size_t i = 0; i < tuple->count; i++) gc_mark_slot(&tuple->items[i]);
             break;
         }
         case OBJ_DICT: {
             ObjDict *dict = (ObjDict *)obj;
-            for (size_t i = 0; i < dict->capacity; i++) {
+            for (size_t i = 0; i < dict->used; i++) {
                 DictEntry *entry = &dict->entries[i];
                 if (entry->key) {
-                    mark_obj((Obj *)entry->key);
-                    mark_value(entry->value);
+                    gc_mark_object_slot((Obj **)&entry->key);
+                    gc_mark_slot(&entry->value);
                 }
             }
             break;
         }
-        case OBJ_FUNCTION: {
-            ObjFunction *fn = (ObjFunction *)obj;
-            if (fn->closure) {
-                /* Mark closure environment's values dict */
-                mark_obj((Obj *)fn->closure->values);
-            }
+        case OBJ_FUNCTION:
+            gc_mark_env(((ObjFunction *)obj)->closure);
             break;
-        }
         case OBJ_CLASS: {
             ObjClass *klass = (ObjClass *)obj;
-            mark_obj((Obj *)klass->methods);
-            if (klass->superclass) mark_obj((Obj *)klass->superclass);
+            gc_mark_object_slot((Obj **)&klass->methods);
+            gc_mark_object_slot((Obj **)&klass->superclass);
             break;
         }
         case OBJ_INSTANCE: {
             ObjInstance *inst = (ObjInstance *)obj;
-            mark_obj((Obj *)inst->fields);
-            mark_obj((Obj *)inst->klass);
+            gc_mark_object_slot((Obj **)&inst->fields);
+            gc_mark_object_slot((Obj **)&inst->klass);
+            break;
+        }
+        case OBJ_FUTURE:
+            /* While the call runs its state is a root set of its own */
+            gc_mark_slot(&((ObjFuture *)obj)->state->result);
+            break;
+        case OBJ_GENERATOR:
+            /* Its state is a root set until the body is done */
+            break;
+        case OBJ_ENTRIES:
+            gc_mark_object_slot((Obj **)&((ObjEntries *)obj)->dict);
             break;
+    }
+}
+
+static void visit_roots(void) {
+    for (size_t i = 0; i < root_set_count; i++) root_sets[i].fn(root_sets[i].context);
+}
+
+static void mark_root_stack(GcRootStack *roots) {
+    for (size_t i = 0; i < roots->count; i++) gc_mark_slot(&roots->values[i]);
+}
+
+static void mark_temp_roots(void) {
+    for (GcThread *t = threads; t; t = t->next) mark_root_stack(t->roots);
+    for (size_t i = 0; i < root_stack_count; i++) mark_root_stack(root_stacks[i]);
+}
+
+/* Gray what the barriers recorded, or drop it between cycles */
+static void mark_shaded(void) {
+    if (phase == GC_MARKING)
+        for (size_t i = 0; i < orphaned.count; i++) mark_object(orphaned.items[i]);
+    orphaned.count = 0;
+}
+
+/* An explicit mark stack keeps deep structures off the C stack */
+static void drain(ObjStack *stack) {
+    while (stack->count > 0) blacken(stack->items[--stack->count]);
+}
+
+/* ========================================================================= */
+/* Minor collection                                                          */
+/* ========================================================================= */
+
+/* Free what died in the nursery and reset it.  A block holding pinned
+   survivors is retired: they become old where they are, and the block is
+   released once the last of them dies. */
+static void sweep_nursery(void) {
+    for (size_t i = 0; i < nursery_count; i++) {
+        GcBlock *block = nursery[i];
+        for (unsigned char *p = BLOCK_DATA(block); p < block->top;) {
+            Obj *obj = (Obj *)p;
+            size_t size = object_size(obj);
+            p += size;
+            if (obj->marked == GC_FORWARDED) continue;
+            if (obj->marked == GC_PINNED) {
+                promote(obj);
+                obj->space = GC_SPACE_BLOCK;
+                obj->next = gc_objects;
+                gc_objects = obj;
+                block->live++;
+                gc_account((ptrdiff_t)size);
+                continue;
+            }
+            free_object_contents(obj);
         }
-        case OBJ_NATIVE: break;
+        if (block->live > 0) continue;
+#ifdef LILITH_GC_STRESS
+        /* Never reuse memory, so stale pointers to moved objects fault */
+        block_free(block);
+#else
+        block->top = BLOCK_DATA(block);
+        if (spare_count == spare_capacity)
+            spare = (GcBlock **)grow_array(spare, &spare_capacity, sizeof(GcBlock *));
+        spare[spare_count++] = block;
+#endif
     }
+    nursery_count = 0;
+    for (GcThread *t = threads; t; t = t->next) t->block = NULL;
 }
 
-static void mark_value(Value value) {
-    if (IS_OBJ(value)) {
-        mark_obj(AS_OBJ(value));
+static void pin_root_stack(GcRootStack *roots) {
+    for (size_t i = 0; i < roots->count; i++) {
+        Value value = roots->values[i];
+        if (IS_OBJ(value) && AS_OBJ(value)->space == GC_SPACE_NURSERY && !AS_OBJ(value)->marked) {
+            AS_OBJ(value)->marked = GC_PINNED;
+            push(&young_gray, AS_OBJ(value));
+        }
     }
 }
 
-void gc_collect(void) {
-    /* Unmark all */
-    for (Obj *obj = gc_objects; obj; obj = obj->next) {
-        obj->type &= 0x7F;
+static void minor_collection(void) {
+    minor = 1;
+    young_epoch++;
+
+    /* C locals may point at temporary roots, so they must not move */
+    for (GcThread *t = threads; t; t = t->next) pin_root_stack(t->roots);
+    for (size_t i = 0; i < root_stack_count; i++) pin_root_stack(root_stacks[i]);
+
+    visit_roots();
+    /* Unreachable scopes may enclose freed ones, so no walking out here.
+       Scopes a lazy sweep has yet to free may point at freed objects. */
+    for (Environment *env = gc_envs; env; env = env->gc_next) {
+        if (env->gc_young_epoch == young_epoch) continue;
+        if (phase == GC_SWEEPING && env->gc_epoch != epoch) continue;
+        visit_env(env);
+    }
+    for (size_t i = 0; i < remembered.count; i++) {
+        atomic_store_explicit(&remembered.items[i]->remembered, 0, memory_order_relaxed);
+        blacken(remembered.items[i]);
+    }
+    remembered.count = 0;
+    drain(&young_gray);
+
+    sweep_nursery();
+    minor = 0;
+}
+
+/* With a full nursery.  If another thread was collecting, its minor
+   collection emptied the nursery already. */
+static void collect_young(void) {
+    if (!world_stop()) return;
+    minor_collection();
+    world_start();
+}
+
+void gc_collect_young(void) {
+    if (self.collecting || self.pin_depth > 0) return;
+    while (!world_stop()) {}
+    minor_collection();
+    world_start();
+}
+
+/* ========================================================================= */
+/* Major collection                                                          */
+/* ========================================================================= */
+
+/* A major cycle marks incrementally, in steps interleaved with allocation.
+   gc_write_barrier and gc_slot_barrier gray every old object stored while
+   marking, so no black object or visited scope can come to hold the only
+   reference to a white one.  Every step runs with the world stopped and
+   starts by graying what the barriers of all threads recorded.
+
+   Roots are written without barriers and are visited once more when the
+   mark stack runs dry; the nursery is promoted gray first.  Sweeping is
+   lazy too.  Objects and scopes created while a cycle runs are never freed
+   by it. */
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void start_cycle(void) {
+    mark_color = mark_color == GC_COLOR_A ? GC_COLOR_B : GC_COLOR_A;
+    epoch++;
+    phase = GC_MARKING;
+    gc_marking = 1;
+    orphaned.count = 0;
+    visit_roots();
+    mark_temp_roots();
+}
+
+static void finish_marking(void) {
+    minor_collection();
+    visit_roots();
+    mark_temp_roots();
+    mark_shaded();
+    drain(&gray);
+
+    gc_marking = 0;
+    phase = GC_SWEEPING;
+    sweep_object = &gc_objects;
+    sweep_env = &gc_envs;
+}
+
+static void free_unreached(Obj *obj) {
+    size_t size = object_size(obj);
+    free_object_contents(obj);
+    gc_account(-(ptrdiff_t)size);
+    if (obj->space == GC_SPACE_BLOCK) {
+        GcBlock *block = BLOCK_OF(obj);
+        if (--block->live == 0) block_free(block);
+    } else {
+        slab_free(obj, size);
     }
+}
 
-    /* TODO: Mark roots from interpreter globals, env chain, call stack */
-    /* For now, this is a no-op sweep to prevent crashes until root marking is wired */
+static void finish_sweeping(void) {
+    phase = GC_IDLE;
+    next_gc = heap_bytes() * GC_HEAP_GROW_FACTOR;
+    if (next_gc < GC_INITIAL_THRESHOLD) next_gc = GC_INITIAL_THRESHOLD;
+}
 
-    /* Sweep unmarked objects */
-    Obj **current = &gc_objects;
-    while (*current) {
-        Obj *obj = *current;
-        if (!(obj->type & 0x80)) {
-            *current = obj->next;
-            free_object(obj);
+/* Advance the running cycle by up to `work` objects, stopping early at
+   `deadline` (0 for none). */
+static void major_step(size_t work, uint64_t deadline) {
+    size_t done = 0;
+#define STEP_DONE() \
+    (++done >= work || (deadline && done % GC_STEP_CHECK == 0 && now_ns() >= deadline))
+
+    if (phase == GC_MARKING) {
+        mark_shaded();
+        while (gray.count > 0) {
+            blacken(gray.items[--gray.count]);
+            if (STEP_DONE()) return;
+        }
+        finish_marking();
+        return;
+    }
+
+    while (*sweep_object) {
+        Obj *obj = *sweep_object;
+        if (obj->marked == mark_color) {
+            sweep_object = &obj->next;
+        } else {
+            *sweep_object = obj->next;
+            free_unreached(obj);
+        }
+        if (STEP_DONE()) return;
+    }
+    while (*sweep_env) {
+        Environment *env = *sweep_env;
+        if (env->gc_epoch == epoch) {
+            sweep_env = &env->gc_next;
         } else {
-            obj->type &= 0x7F; /* Unmark for next cycle */
-            current = &obj->next;
+            *sweep_env = env->gc_next;
+            env_free(env);
         }
+        if (STEP_DONE()) return;
     }
+#undef STEP_DONE
+    finish_sweeping();
+}
+
+static void finish_cycle(void) {
+    while (phase != GC_IDLE) major_step(SIZE_MAX, 0);
+}
+
+/* Called from gc_allocate when collecting is allowed.  The decision is
+   taken again once the world is stopped, another thread may have acted
+   on it meanwhile. */
+static void collect_if_needed(size_t size) {
+#ifdef LILITH_GC_STRESS
+    (void)size;
+    if (!world_stop()) return;
+    minor_collection();
+    if (phase == GC_IDLE) start_cycle();
+    else major_step(GC_STRESS_STEP, 0);
+    world_start();
+#else
+    if (phase == GC_IDLE) {
+        if (heap_bytes() <= next_gc || !world_stop()) return;
+        if (phase == GC_IDLE && heap_bytes() > next_gc) start_cycle();
+    } else if (heap_bytes() > next_gc * GC_HEAP_GROW_FACTOR) {
+        if (!world_stop()) return;
+        finish_cycle();
+    } else if ((self.step_debt += size) >= GC_STEP_BYTES) {
+        self.step_debt = 0;
+        if (!world_stop()) return;
+        if (phase != GC_IDLE) major_step(SIZE_MAX, now_ns() + (uint64_t)pause_target_us * 1000u);
+    } else {
+        return;
+    }
+    world_start();
+#endif
+}
+
+void gc_finish_cycle(void) {
+    if (self.collecting || self.pin_depth > 0) return;
+    while (!world_stop()) {}
+    finish_cycle();
+    world_start();
+}
+
+void gc_collect(void) {
+    if (self.collecting || self.pin_depth > 0) return;
+    while (!world_stop()) {}
+    finish_cycle();
+    start_cycle();
+    finish_cycle();
+    world_start();
+}
+
+void gc_set_pause_target(unsigned microseconds) {
+    pause_target_us = microseconds > 0 ? microseconds : 1;
+}
+
+unsigned gc_pause_target(void) {
+    return pause_target_us;
 }
@@ -1,12 +1,184 @@
 #ifndef LILITH_GC_H
 #define LILITH_GC_H
 
+#include <stddef.h>
+#include "value.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-void gc_track(void *obj);
-void gc_collect(void);
+struct Environment;
+
+/* -------------------------------------------------------------------------- */
+/* Generational garbage collector                                             */
+/* -------------------------------------------------------------------------- */
+
+/* New objects are bump-allocated in a nursery of fixed-size blocks.  When
+   the nursery fills up a minor collection copies its survivors into the
+   malloc-backed old space, so it costs in proportion to live young data.
+   Old objects are collected by mark-and-sweep once the old space has grown
+   past its threshold; a major collection always starts with a minor one.
+
+   Collection can therefore run at any object allocation.  Every value that
+   is still needed must be reachable from a root at that point:
+     - whatever the registered root callbacks visit (globals, environments,
+       VM stack and frames, ...);
+     - the temporary root stack, for values only C locals hold;
+     - everything allocated inside a pinned region (natives, compiler).
+   A minor collection moves objects and updates the roots in place, except
+   objects on the temporary root stack: C locals may still point at those,
+   so they are promoted where they are.  Nothing is collected while pinned.
+
+   Environments are always scanned by minor collections.  Stores into any
+   other object go through gc_write_barrier, which records old objects
+   that come to point at young ones.
+
+   Major collections are incremental: marking and sweeping advance in small
+   steps taken as objects are allocated, each bounded by the pause target.
+   While marking, stores into objects and into environment slots must also
+   reach the barriers (gc_write_barrier, gc_slot_barrier), which gray the
+   stored object.
+
+   Several threads may share the heap.  Each one attaches before it touches
+   objects and gets its own temporary roots, pins and nursery block, and
+   keeps the old objects and scopes it creates on lists of its own until
+   the next collection takes them over, so allocating takes no lock.  A
+   collection stops the world: the collecting thread waits until every
+   other attached thread is parked at a safepoint (an allocation, gc_poll,
+   attaching or adding roots) or inside a safe region, and resumes them
+   when done.  Code that may block for long, such as joining other
+   threads, must wait inside gc_safe_enter / gc_safe_leave and hold no
+   unrooted object meanwhile. */
+
+/* Where an object lives, Obj.space */
+enum {
+    GC_SPACE_OLD,           /* individually malloc'd */
+    GC_SPACE_NURSERY,       /* young, in a nursery block */
+    GC_SPACE_BLOCK,         /* promoted in place, in a retired nursery block */
+    GC_SPACE_STATIC,        /* outside the heap, never collected */
+};
+
+/* Root callbacks, registered by each interpreter.  They visit slots rather
+   than values because minor collections update them. */
+typedef void (*GcRootFn)(void *context);
+void gc_add_roots(GcRootFn fn, void *context);
+void gc_remove_roots(GcRootFn fn, void *context);
+
+void gc_mark_slot(Value *slot);
+void gc_mark_object_slot(Obj **slot);
+void gc_mark_env(struct Environment *env);
+
+/* Temporary roots, pushed and popped on every evaluation so kept inline */
+typedef struct {
+    Value *values;
+    size_t count;
+    size_t capacity;
+} GcRootStack;
+
+extern _Thread_local GcRootStack gc_temp_roots;
+
+void gc_grow_roots(void);
+
+static inline void gc_push_root(Value value) {
+    if (gc_temp_roots.count == gc_temp_roots.capacity) gc_grow_roots();
+    gc_temp_roots.values[gc_temp_roots.count++] = value;
+}
+
+static inline void   gc_pop_roots(size_t count)   { gc_temp_roots.count -= count; }
+static inline size_t gc_root_depth(void)          { return gc_temp_roots.count; }
+static inline void   gc_restore_roots(size_t depth) { gc_temp_roots.count = depth; }
+
+/* Coroutines each keep temporary roots of their own, swapped with the
+   thread's while they run.  A registered stack is marked and pinned like
+   a thread's, so whichever side is switched out stays rooted. */
+void gc_register_root_stack(GcRootStack *stack);
+void gc_unregister_root_stack(GcRootStack *stack);
+
+static inline void gc_swap_roots(GcRootStack *stack) {
+    GcRootStack running = gc_temp_roots;
+    gc_temp_roots = *stack;
+    *stack = running;
+}
+
+/* Between gc_pin_begin and gc_pin_end every new object is a temporary root
+   and collections are deferred, so code such as natives can build
+   structures and hold plain pointers without rooting each part. */
+size_t gc_pin_begin(void);
+void   gc_pin_end(size_t depth);
+
+/* A pinned native that calls back into the interpreter lifts its pins for
+   the call, so the callee may collect.  Temporary roots never move, the
+   native keeps what it holds rooted there. */
+int  gc_pin_suspend(void);
+void gc_pin_resume(int depth);
+
+/* Threads.  gc_thread_attach nests; when the thread was in a safe region
+   it leaves it until the matching gc_thread_detach, which takes the token
+   attach returned.  A thread that allocates without attaching is attached
+   for good. */
+int  gc_thread_attach(void);
+void gc_thread_detach(int token);
+void gc_safe_enter(void);
+void gc_safe_leave(void);
+
+extern atomic_int gc_stop_requested;
+
+void gc_safepoint(void);
+
+/* Park here if another thread is waiting to collect */
+static inline void gc_poll(void) {
+    if (atomic_load_explicit(&gc_stop_requested, memory_order_relaxed)) gc_safepoint();
+}
+
+/* Record that `owner` now references a young object */
+void gc_remember(Obj *owner);
+
+/* Gray an object for the major cycle that is marking */
+void gc_shade(Obj *obj);
+
+extern int gc_marking;
+
+/* Before `value` is stored into `owner` */
+static inline void gc_write_barrier(Obj *owner, Value value) {
+    if (!IS_OBJ(value)) return;
+    Obj *target = AS_OBJ(value);
+    if (target->space == GC_SPACE_NURSERY) {
+        if (owner->space != GC_SPACE_NURSERY &&
+            !atomic_load_explicit(&owner->remembered, memory_order_relaxed))
+            gc_remember(owner);
+    } else if (gc_marking) {
+        gc_shade(target);
+    }
+}
+
+/* Before `value` is stored into an environment slot */
+static inline void gc_slot_barrier(Value value) {
+    if (gc_marking && IS_OBJ(value)) gc_shade(AS_OBJ(value));
+}
+
+/* Allocation hooks used by value.c and environment.c.  gc_allocate may
+   collect first; the caller must set the type before allocating again. */
+Obj *gc_allocate(size_t size);
+/* Straight into the old space, where nothing moves; never collects */
+Obj *gc_allocate_old(size_t size);
+void gc_track_env(struct Environment *env);
+void gc_account(ptrdiff_t delta);
+
+/* Whether an object held only weakly may be handed out again.  False for
+   one the running sweep is about to free; one handed out while marking is
+   shaded. */
+bool gc_weak_claim(Obj *obj);
+
+void   gc_collect(void);          /* full, not incremental */
+void   gc_collect_young(void);
+void   gc_finish_cycle(void);     /* complete the major cycle in progress */
+size_t gc_bytes_allocated(void);
+
+/* Longest a single incremental step may take, in microseconds.  The final
+   root scan of a cycle is not bounded by it. */
+void     gc_set_pause_target(unsigned microseconds);
+unsigned gc_pause_target(void);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,193 @@
+#define _GNU_SOURCE
+#include "generator.h"
+#include "gc.h"
+#include "async/async_runtime.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ========================================================================= */
+/* Bookkeeping                                                               */
+/* ========================================================================= */
+
+/* `live` holds the states not yet torn down, so a program can close its
+   own before its globals go away, and `released` those whose object died
+   meanwhile.  The sweep releases states, so generators_lock is never held
+   across a safepoint. */
+static pthread_mutex_t generators_lock = PTHREAD_MUTEX_INITIALIZER;
+static GeneratorState *live;
+static GeneratorState *released;
+
+static void free_state(GeneratorState *state) {
+    free(state->args);
+    free(state->error);
+    free(state);
+}
+
+/* Under generators_lock */
+static void unlink_live(GeneratorState *state) {
+    if (state->prev) state->prev->next = state->next;
+    else live = state->next;
+    if (state->next) state->next->prev = state->prev;
+    state->prev = state->next = NULL;
+    state->closing = 1;
+}
+
+/* What the body was given, what it is handing out and its scopes */
+static void mark_generator(void *arg) {
+    GeneratorState *state = (GeneratorState *)arg;
+    gc_mark_slot(&state->callee);
+    for (int i = 0; i < state->argc; i++) gc_mark_slot(&state->args[i]);
+    gc_mark_slot(&state->yielded);
+    interp_mark_roots(&state->context);
+}
+
+/* Drop the fiber, roots and context of a state off the live list.  A body
+   still suspended is abandoned with its stack. */
+static void tear_down(GeneratorState *state) {
+    gc_remove_roots(mark_generator, state);
+    fiber_free(state->fiber);
+    state->fiber = NULL;
+    interpreter_free_context(&state->context);
+
+    pthread_mutex_lock(&generators_lock);
+    state->done = 1;
+    int orphaned = state->orphaned;
+    pthread_mutex_unlock(&generators_lock);
+    if (orphaned) free_state(state);
+}
+
+static void reap_released(void) {
+    pthread_mutex_lock(&generators_lock);
+    GeneratorState *state = released;
+    released = NULL;
+    pthread_mutex_unlock(&generators_lock);
+    while (state) {
+        GeneratorState *next = state->next;
+        tear_down(state);
+        state = next;
+    }
+}
+
+/* ========================================================================= */
+/* Fiber side                                                                */
+/* ========================================================================= */
+
+static void run_body(void *arg) {
+    GeneratorState *state = (GeneratorState *)arg;
+    Interpreter *context = &state->context;
+    interpreter_set_current(context);
+    interp_call_direct(context, state->callee, state->argc, state->args);
+    if (context->throw_flag) state->error = strdup(context->error_msg ? context->error_msg : "unknown error");
+}
+
+void generator_yield(Interpreter *interp, Value value) {
+    /* Only generators run on fibers */
+    GeneratorState *state = (GeneratorState *)fiber_current_arg();
+    if (!state || &state->context != interp) {
+        runtime_error(interp, "Can only yield inside a generator.");
+        return;
+    }
+    state->yielded = value;
+    fiber_suspend();
+}
+
+/* ========================================================================= */
+/* Public API                                                                */
+/* ========================================================================= */
+
+ObjGenerator *generator_new(Interpreter *interp, Value callee, int argc, Value *args) {
+    reap_released();
+    GeneratorState *state = (GeneratorState *)calloc(1, sizeof(GeneratorState));
+    if (!state || (argc > 0 && !(state->args = (Value *)malloc(sizeof(Value) * (size_t)argc)))) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    state->callee = NIL_VAL;
+    state->yielded = NIL_VAL;
+    atomic_init(&state->running, 0);
+    interpreter_init_context(&state->context, interp);
+    state->globals = interp->globals;
+
+    /* Both are safepoints, after which the arguments may have moved */
+    gc_add_roots(mark_generator, state);
+    state->fiber = fiber_new(run_body, state);
+    state->callee = callee;
+    for (int i = 0; i < argc; i++) state->args[i] = args[i];
+    state->argc = argc;
+    ObjGenerator *generator = obj_generator_new(state);
+
+    pthread_mutex_lock(&generators_lock);
+    state->next = live;
+    if (live) live->prev = state;
+    live = state;
+    pthread_mutex_unlock(&generators_lock);
+    return generator;
+}
+
+int generator_next(Interpreter *interp, Value generator, Value *out) {
+    GeneratorState *state = AS_GENERATOR(generator)->state;
+    if (state->done) return 0;
+    if (atomic_exchange(&state->running, 1)) {
+        runtime_error(interp, "Generator is already running.");
+        return 0;
+    }
+    size_t roots = gc_root_depth();
+    gc_push_root(generator);
+
+    int finished = fiber_resume(state->fiber);
+
+    if (!finished) {
+        *out = state->yielded;
+        state->yielded = NIL_VAL;
+    } else {
+        pthread_mutex_lock(&generators_lock);
+        unlink_live(state);
+        pthread_mutex_unlock(&generators_lock);
+        tear_down(state);
+        if (state->error) runtime_error(interp, "%s", state->error);
+    }
+    atomic_store(&state->running, 0);
+    gc_restore_roots(roots);
+    return !finished;
+}
+
+void generator_close_all(Environment *globals) {
+    GeneratorState *closing = NULL;
+    pthread_mutex_lock(&generators_lock);
+    GeneratorState *state = live;
+    while (state) {
+        GeneratorState *next = state->next;
+        if (state->globals == globals) {
+            unlink_live(state);
+            state->next = closing;
+            closing = state;
+        }
+        state = next;
+    }
+    pthread_mutex_unlock(&generators_lock);
+    while (closing) {
+        GeneratorState *next = closing->next;
+        tear_down(closing);
+        closing = next;
+    }
+    reap_released();
+}
+
+/* Runs during a sweep, with the world stopped */
+void generator_release(GeneratorState *state) {
+    pthread_mutex_lock(&generators_lock);
+    if (state->done) {
+        free_state(state);
+    } else {
+        /* Whoever is tearing it down frees it, or the next generator */
+        state->orphaned = 1;
+        if (!state->closing) {
+            unlink_live(state);
+            state->next = released;
+            released = state;
+        }
+    }
+    pthread_mutex_unlock(&generators_lock);
+}
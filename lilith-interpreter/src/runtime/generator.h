@@ -0,0 +1,58 @@
+#ifndef LILITH_GENERATOR_H
+#define LILITH_GENERATOR_H
+
+#include "interpreter.h"
+
+/* -------------------------------------------------------------------------- */
+/* Generators — functions that yield                                          */
+/* -------------------------------------------------------------------------- */
+
+/* A function whose body contains `)-? x ?-(` is a generator function:
+   calling it binds the arguments and returns an ObjGenerator without
+   running anything.  Each step resumes the body on a fiber of its own (see
+   async/async_runtime.h) until the next yield hands out an item, so loops
+   and comprehensions over it never hold more than one item at a time.
+
+   The body runs in an interpreter context of its own.  Its state lives
+   outside the heap and, until the body returns or the object dies, is a
+   root set of its own together with the fiber's temporary roots.  An
+   object that dies while its body is suspended only queues the state, and
+   the next generator created tears it down. */
+typedef struct GeneratorState {
+    struct Fiber *fiber;
+    Interpreter context;
+    Environment *globals;           /* of the program that created it */
+    Value callee;
+    Value *args;
+    int argc;
+    Value yielded;                  /* the item being handed out */
+    char *error;
+    atomic_int running;
+    int closing;                    /* off the live list, being torn down */
+    int done;                       /* torn down */
+    int orphaned;                   /* the object died */
+    struct GeneratorState *prev;    /* live list */
+    struct GeneratorState *next;    /* live list, or released list */
+} GeneratorState;
+
+/* Bind callee((args)) under `interp`'s program; nothing runs yet.  The
+   callee must be a temporary root; the arguments may be rooted anywhere,
+   since they are read only after the last safepoint. */
+ObjGenerator *generator_new(Interpreter *interp, Value callee, int argc, Value *args);
+
+/* Run the body up to its next yield.  Returns 1 with the item in `out`, or
+   0 once the body has returned; on error the error is raised on `interp`
+   and 0 returned. */
+int generator_next(Interpreter *interp, Value generator, Value *out);
+
+/* `)-? value ?-(`: hand `value` to whoever resumed the running generator
+   and suspend until the next step.  Raises an error outside a generator. */
+void generator_yield(Interpreter *interp, Value value);
+
+/* Tear down every unfinished generator created under `globals` */
+void generator_close_all(Environment *globals);
+
+/* The object is being freed */
+void generator_release(GeneratorState *state);
+
+#endif
@@ -1,10 +1,18 @@
 #define _GNU_SOURCE
 #include "interpreter.h"
 #include "gc.h"
+#include "vm.h"
+#include "resolver.h"
+#include "future.h"
+#include "generator.h"
+#include "iterator.h"
+#include "array.h"
 #include "stdlib/io.h"
 #include "stdlib/math.h"
 #include "stdlib/string.h"
 #include "stdlib/list.h"
+#include "stdlib/arr.h"
+#include "stdlib/vec.h"
 #include "stdlib/json.h"
 #include "stdlib/os.h"
 #include "stdlib/meta.h"
@@ -12,6 +20,12 @@
 #include "stdlib/time.h"
 #include "stdlib/num.h"
 #include "stdlib/hpc.h"
+#include "stdlib/par.h"
+#include "concurrency/scheduler.h"
+#include "concurrency/thread_pool.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -36,33 +50,35 @@ void runtime_error(Interpreter *interp, const char *fmt, ...) {
     interp->throw_flag = 1;
 }
 
-static void runtime_error_node(Interpreter *interp, AstNode *node, const char *fmt, ...) {
+void runtime_error_at(Interpreter *interp, size_t line, const char *fmt, ...) {
     va_list args;
     va_start(args, fmt);
     char msg[512];
     vsnprintf(msg, sizeof(msg), fmt, args);
     va_end(args);
-    runtime_error(interp, "[line %zu] %s", node->line, msg);
+    runtime_error(interp, "[line %zu] %s", line, msg);
 }
 
+#define runtime_error_node(interp, node, ...) runtime_error_at((interp), (node)->line, __VA_ARGS__)
+
 /* ========================================================================= */
 /* Helpers                                                                   */
 /* ========================================================================= */
 
-static int is_truthy(Value value) {
+int interp_truthy(Value value) {
     if (IS_NIL(value)) return 0;
     if (IS_BOOL(value)) return AS_BOOL(value);
     return 1;
 }
 
-static int check_type(Value value, const char *type_name) {
+int interp_check_type(Value value, const char *type_name) {
     if (!type_name) return 1;
     if (strcmp(type_name, "any") == 0) return 1;
     return strcmp(value_type_name(value), type_name) == 0;
 }
 
 /* Look up a method in a class and its superclass chain */
-static int class_lookup_method(ObjClass *klass, ObjString *name, Value *out) {
+int interp_lookup_method(ObjClass *klass, ObjString *name, Value *out) {
     ObjClass *current = klass;
     while (current) {
         if (dict_get(current->methods, name, out)) return 1;
@@ -71,16 +87,42 @@ static int class_lookup_method(ObjClass *klass, ObjString *name, Value *out) {
     return 0;
 }
 
-static Value value_str_concat(Value a, Value b) {
-    const char *as = value_to_string(a);
-    const char *bs = value_to_string(b);
-    size_t alen = strlen(as);
-    size_t blen = strlen(bs);
-    char *buf = (char *)malloc(alen + blen + 1);
-    memcpy(buf, as, alen);
-    memcpy(buf + alen, bs, blen);
-    buf[alen + blen] = '\0';
-    return OBJ_VAL(obj_string_take(buf, alen + blen));
+/* "init", interned once and kept as a root */
+static ObjString *init_name = NULL;
+static pthread_once_t init_name_once = PTHREAD_ONCE_INIT;
+
+static void mark_init_name(void *context) {
+    (void)context;
+    gc_mark_object_slot((Obj **)&init_name);
+}
+
+static void intern_init_name(void) {
+    gc_add_roots(mark_init_name, NULL);
+    init_name = obj_string_intern("init", 4);
+}
+
+int interp_lookup_init(ObjClass *klass, Value *out) {
+    return interp_lookup_method(klass, init_name, out);
+}
+
+/* Operands that are not strings are converted first */
+Value interp_str_concat(Value a, Value b) {
+    size_t roots = gc_root_depth();
+    gc_push_root(a);
+    gc_push_root(b);
+    if (!IS_STRING(a)) {
+        const char *s = value_to_string(a);
+        a = OBJ_VAL(obj_string_copy(s, strlen(s)));
+        gc_push_root(a);
+    }
+    if (!IS_STRING(b)) {
+        const char *s = value_to_string(b);
+        b = OBJ_VAL(obj_string_copy(s, strlen(s)));
+        gc_push_root(b);
+    }
+    ObjString *result = obj_string_concat(AS_STRING(a), AS_STRING(b));
+    gc_restore_roots(roots);
+    return OBJ_VAL(result);
 }
 
 static Value native_input(int argc, Value *argv) {
@@ -98,12 +140,15 @@ static Value native_input(int argc, Value *argv) {
     return OBJ_VAL(obj_string_take(line, strlen(line)));
 }
 
+/* Lines from parallel workers come out whole */
 static Value native_print(int argc, Value *argv) {
+    flockfile(stdout);
     for (int i = 0; i < argc; i++) {
         if (i > 0) printf(" ");
         value_print(argv[i]);
     }
     printf("\n");
+    funlockfile(stdout);
     return NIL_VAL;
 }
 
@@ -111,19 +156,59 @@ static void define_native(Interpreter *interp, const char *name, NativeFn fn) {
     env_define(interp->globals, name, OBJ_VAL(obj_native_new(fn, name)));
 }
 
+/* A native that only computes its result from its arguments */
+static void define_pure_native(Interpreter *interp, const char *name, NativeFn fn) {
+    ObjNative *native = obj_native_new(fn, name);
+    native->pure = 1;
+    env_define(interp->globals, name, OBJ_VAL(native));
+}
+
 /* ========================================================================= */
 /* Interpreter lifecycle                                                     */
 /* ========================================================================= */
 
+/* Everything the collector must keep alive for this interpreter */
+void interp_mark_roots(void *context) {
+    Interpreter *interp = (Interpreter *)context;
+    gc_mark_env(interp->globals);
+    gc_mark_env(interp->env);
+    for (EnvFrame *frame = interp->frames.last; frame; frame = frame->prev) gc_mark_env(frame->env);
+    gc_mark_slot(&interp->return_value);
+    gc_mark_object_slot((Obj **)&interp->current_function);
+    if (interp->vm) vm_mark_roots(interp->vm);
+}
+
+static _Thread_local Interpreter *current_interp = NULL;
+
+Interpreter *interpreter_current(void) {
+    return current_interp;
+}
+
+void interpreter_set_current(Interpreter *interp) {
+    current_interp = interp;
+}
+
 void interpreter_init(Interpreter *interp) {
-    interp->globals = env_new();
-    interp->env = interp->globals;
+    gc_thread_attach();
+    interp->globals = NULL;
+    interp->env = NULL;
+    env_stack_init(&interp->frames);
     interp->return_flag = 0;
+    interp->return_value = NIL_VAL;
     interp->break_flag = 0;
     interp->continue_flag = 0;
     interp->throw_flag = 0;
     interp->error_msg = NULL;
     interp->current_function = NULL;
+    interp->engine = ENGINE_AST;
+    interp->vm = NULL;
+    interp->worker_id = 0;
+    /* Rooted before the first allocation: another thread may collect
+       while this one registers */
+    gc_add_roots(interp_mark_roots, interp);
+    pthread_once(&init_name_once, intern_init_name);
+    interp->globals = env_new();
+    interp->env = interp->globals;
 
     /* Sacred core: print & input */
     define_native(interp, "@!", native_print);
@@ -139,62 +224,89 @@ void interpreter_init(Interpreter *interp) {
     define_native(interp, "sys..exit", native_exit);
 
     /* Math */
-    define_native(interp, "math..abs", native_math_abs);
-    define_native(interp, "math..floor", native_math_floor);
-    define_native(interp, "math..ceil", native_math_ceil);
-    define_native(interp, "math..sqrt", native_math_sqrt);
-    define_native(interp, "math..pow", native_math_pow);
-    define_native(interp, "math..sin", native_math_sin);
-    define_native(interp, "math..cos", native_math_cos);
-    define_native(interp, "math..tan", native_math_tan);
-    define_native(interp, "math..pi", native_math_pi);
-    define_native(interp, "math..e", native_math_e);
+    define_pure_native(interp, "math..abs", native_math_abs);
+    define_pure_native(interp, "math..floor", native_math_floor);
+    define_pure_native(interp, "math..ceil", native_math_ceil);
+    define_pure_native(interp, "math..sqrt", native_math_sqrt);
+    define_pure_native(interp, "math..pow", native_math_pow);
+    define_pure_native(interp, "math..sin", native_math_sin);
+    define_pure_native(interp, "math..cos", native_math_cos);
+    define_pure_native(interp, "math..tan", native_math_tan);
+    define_pure_native(interp, "math..pi", native_math_pi);
+    define_pure_native(interp, "math..e", native_math_e);
     define_native(interp, "math..rand", native_math_rand);
 
     /* String */
-    define_native(interp, "str..from", native_str_from);
-    define_native(interp, "str..trim", native_str_trim);
-    define_native(interp, "str..contains", native_str_contains);
-    define_native(interp, "str..starts", native_str_starts);
-    define_native(interp, "str..ends", native_str_ends);
-    define_native(interp, "str..replace", native_str_replace);
-    define_native(interp, "str..slice", native_str_slice);
-    define_native(interp, "str..split", native_str_split);
-    define_native(interp, "str..join", native_str_join);
+    define_pure_native(interp, "str..from", native_str_from);
+    define_pure_native(interp, "str..trim", native_str_trim);
+    define_pure_native(interp, "str..contains", native_str_contains);
+    define_pure_native(interp, "str..starts", native_str_starts);
+    define_pure_native(interp, "str..ends", native_str_ends);
+    define_pure_native(interp, "str..replace", native_str_replace);
+    define_pure_native(interp, "str..slice", native_str_slice);
+    define_pure_native(interp, "str..split", native_str_split);
+    define_pure_native(interp, "str..join", native_str_join);
 
     /* List */
     define_native(interp, "list..push", native_list_push);
     define_native(interp, "list..pop", native_list_pop);
-    define_native(interp, "list..find", native_list_find);
+    define_pure_native(interp, "list..find", native_list_find);
     define_native(interp, "list..sort", native_list_sort);
+    define_native(interp, "list..from", native_list_from);
+
+    /* Arr */
+    define_pure_native(interp, "arr..new", native_arr_new);
+    define_native(interp, "arr..from", native_arr_from);
+
+    /* Vec */
+    define_pure_native(interp, "vec..add", native_vec_add);
+    define_pure_native(interp, "vec..sub", native_vec_sub);
+    define_pure_native(interp, "vec..mul", native_vec_mul);
+    define_pure_native(interp, "vec..div", native_vec_div);
+    define_pure_native(interp, "vec..scale", native_vec_scale);
+    define_pure_native(interp, "vec..fma", native_vec_fma);
+    define_pure_native(interp, "vec..dot", native_vec_dot);
+    define_pure_native(interp, "vec..sum", native_vec_sum);
+    define_pure_native(interp, "vec..min", native_vec_min);
+    define_pure_native(interp, "vec..max", native_vec_max);
+    define_pure_native(interp, "vec..argmin", native_vec_argmin);
+    define_pure_native(interp, "vec..argmax", native_vec_argmax);
 
     /* JSON */
-    define_native(interp, "json..encode", native_json_encode);
-    define_native(interp, "json..decode", native_json_decode);
+    define_pure_native(interp, "json..encode", native_json_encode);
+    define_pure_native(interp, "json..decode", native_json_decode);
 
     /* OS & Env */
     define_native(interp, "env..get", native_env_get);
     define_native(interp, "env..set", native_env_set);
     define_native(interp, "os..time", native_os_time);
     define_native(interp, "os..sleep", native_os_sleep);
+    define_native(interp, "os..run", native_os_run);
 
     /* Meta */
-    define_native(interp, "meta..type", native_meta_type);
+    define_pure_native(interp, "meta..type", native_meta_type);
 
     /* Seq */
-    define_native(interp, "seq..len", native_seq_len);
+    define_pure_native(interp, "seq..len", native_seq_len);
+    define_pure_native(interp, "seq..range", native_seq_range);
+    define_pure_native(interp, "seq..entries", native_seq_entries);
 
     /* Time */
     define_native(interp, "time..clock", native_time_clock);
 
     /* Num */
-    define_native(interp, "num..from", native_num_from);
+    define_pure_native(interp, "num..from", native_num_from);
+
+    /* Par */
+    define_native(interp, "par..map", native_par_map);
+    define_native(interp, "par..reduce", native_par_reduce);
+    define_native(interp, "par..for", native_par_for);
 
     /* Convenience aliases (shorthand for common namespaced functions) */
-    define_native(interp, "len", native_seq_len);
-    define_native(interp, "type", native_meta_type);
-    define_native(interp, "str", native_str_from);
-    define_native(interp, "num", native_num_from);
+    define_pure_native(interp, "len", native_seq_len);
+    define_pure_native(interp, "type", native_meta_type);
+    define_pure_native(interp, "str", native_str_from);
+    define_pure_native(interp, "num", native_num_from);
     define_native(interp, "clock", native_time_clock);
 
     /* HPC stubs — vaporware placeholders for parallel/GPU/tensor runtime */
@@ -211,9 +323,60 @@ void interpreter_init(Interpreter *interp) {
     define_native(interp, "zero_buffer", native_zero_buffer);
 }
 
+void interpreter_init_context(Interpreter *context, Interpreter *owner) {
+    context->globals = owner->globals;
+    context->env = owner->globals;
+    env_stack_init(&context->frames);
+    context->return_flag = 0;
+    context->return_value = NIL_VAL;
+    context->break_flag = 0;
+    context->continue_flag = 0;
+    context->throw_flag = 0;
+    context->error_msg = NULL;
+    context->current_function = NULL;
+    context->engine = owner->engine;
+    context->vm = NULL;
+    context->worker_id = 0;
+}
+
+void interpreter_run_context(Interpreter *context, ContextFn fn, void *arg) {
+    int token = gc_thread_attach();
+    Interpreter *saved = current_interp;
+    current_interp = context;
+    gc_add_roots(interp_mark_roots, context);
+    fn(context, arg);
+    gc_remove_roots(interp_mark_roots, context);
+
+    /* Done with the VM stacks; the error message stays for the owner */
+    if (context->vm) vm_free(context->vm);
+    context->vm = NULL;
+    current_interp = saved;
+    gc_thread_detach(token);
+}
+
+void interpreter_free_context(Interpreter *context) {
+    if (context->vm) vm_free(context->vm);
+    context->vm = NULL;
+    free(context->error_msg);
+    context->error_msg = NULL;
+    env_stack_free(&context->frames);
+}
+
 void interpreter_free(Interpreter *interp) {
+    /* Futures nobody awaited still run on the globals */
+    future_drain(interp->globals);
+    generator_close_all(interp->globals);
+    gc_remove_roots(interp_mark_roots, interp);
+    /* Marking must not follow closures out to the globals freed below, nor
+       a later minor collection on another thread promote young objects
+       that still point at them */
+    gc_collect_young();
+    gc_finish_cycle();
+    if (interp->vm) vm_free(interp->vm);
     if (interp->error_msg) free(interp->error_msg);
     env_free(interp->globals);
+    env_stack_free(&interp->frames);
+    gc_thread_detach(0);
 }
 
 Value interpreter_run(Interpreter *interp, AstNode *program) {
@@ -227,7 +390,251 @@ Value interpreter_run(Interpreter *interp, AstNode *program) {
         runtime_error(interp, "Expected AST_PROGRAM node.");
         return NIL_VAL;
     }
-    return eval_stmt(interp, program->as.program.body);
+    resolve_program(interp->globals, program);
+    Interpreter *saved = current_interp;
+    current_interp = interp;
+    Value result = interp->engine == ENGINE_VM ? vm_run(interp, program)
+                                               : eval_stmt(interp, program->as.program.body);
+    current_interp = saved;
+    return result;
+}
+
+/* ========================================================================= */
+/* Shared semantics (tree-walker and bytecode VM)                            */
+/* ========================================================================= */
+
+Value interp_binary(Interpreter *interp, int op, Value left, Value right, size_t line) {
+    switch (op) {
+        case OP_ADD: {
+            if (IS_NUMBER(left) && IS_NUMBER(right))
+                return NUMBER_VAL(AS_NUMBER(left) + AS_NUMBER(right));
+            return interp_str_concat(left, right);
+        }
+        case OP_SUB: {
+            if (!IS_NUMBER(left) || !IS_NUMBER(right))
+                { runtime_error_at(interp, line, "Operands must be numbers for '--'."); return NIL_VAL; }
+            return NUMBER_VAL(AS_NUMBER(left) - AS_NUMBER(right));
+        }
+        case OP_MUL: {
+            if (!IS_NUMBER(left) || !IS_NUMBER(right))
+                { runtime_error_at(interp, line, "Operands must be numbers for '**'."); return NIL_VAL; }
+            return NUMBER_VAL(AS_NUMBER(left) * AS_NUMBER(right));
+        }
+        case OP_DIV: {
+            if (!IS_NUMBER(left) || !IS_NUMBER(right))
+                { runtime_error_at(interp, line, "Operands must be numbers for '//'."); return NIL_VAL; }
+            if (AS_NUMBER(right) == 0)
+                { runtime_error_at(interp, line, "Division by zero."); return NIL_VAL; }
+            return NUMBER_VAL(AS_NUMBER(left) / AS_NUMBER(right));
+        }
+        case OP_MOD: {
+            if (!IS_NUMBER(left) || !IS_NUMBER(right))
+                { runtime_error_at(interp, line, "Operands must be numbers for '%%'."); return NIL_VAL; }
+            if (AS_NUMBER(right) == 0)
+                { runtime_error_at(interp, line, "Modulo by zero."); return NIL_VAL; }
+            return NUMBER_VAL((double)((long)AS_NUMBER(left) % (long)AS_NUMBER(right)));
+        }
+        case OP_EQ:  return BOOL_VAL(values_equal(left, right));
+        case OP_NE:  return BOOL_VAL(!values_equal(left, right));
+        case OP_LT: {
+            if (!IS_NUMBER(left) || !IS_NUMBER(right))
+                { runtime_error_at(interp, line, "Operands must be numbers for '<<'."); return NIL_VAL; }
+            return BOOL_VAL(AS_NUMBER(left) < AS_NUMBER(right));
+        }
+        case OP_GT: {
+            if (!IS_NUMBER(left) || !IS_NUMBER(right))
+                { runtime_error_at(interp, line, "Operands must be numbers for '>>'."); return NIL_VAL; }
+            return BOOL_VAL(AS_NUMBER(left) > AS_NUMBER(right));
+        }
+    }
+    return NIL_VAL;
+}
+
+Value interp_get_member(Interpreter *interp, Value obj, ObjString *name, size_t line) {
+    if (IS_INSTANCE(obj)) {
+        ObjInstance *inst = AS_INSTANCE(obj);
+        Value val;
+        if (dict_get(inst->fields, name, &val)) return val;
+        if (interp_lookup_method(inst->klass, name, &val)) return val;
+        runtime_error_at(interp, line, "Undefined property '%s'.", string_chars(name));
+        return NIL_VAL;
+    }
+
+    if (IS_DICT(obj)) {
+        Value val;
+        if (dict_get(AS_DICT(obj), name, &val)) return val;
+        return NIL_VAL;
+    }
+
+    if (IS_LIST(obj) || IS_STRING(obj) || IS_TUPLE(obj) || IS_ARRAY(obj)) {
+        if (strcmp(string_chars(name), "length") == 0) {
+            return native_seq_len(1, &obj);
+        }
+    }
+
+    runtime_error_at(interp, line, "Only instances and dicts have properties.");
+    return NIL_VAL;
+}
+
+Value interp_set_member(Interpreter *interp, Value obj, ObjString *name, Value value, size_t line) {
+    if (!IS_INSTANCE(obj) && !IS_DICT(obj)) {
+        runtime_error_at(interp, line, "Can only assign to instance or dict properties.");
+        return value;
+    }
+    dict_set(IS_INSTANCE(obj) ? AS_INSTANCE(obj)->fields : AS_DICT(obj), name, value);
+    return value;
+}
+
+Value interp_get_index(Interpreter *interp, Value obj, Value idx, size_t line) {
+    if (IS_LIST(obj)) {
+        if (!IS_NUMBER(idx)) { runtime_error_at(interp, line, "List index must be a number."); return NIL_VAL; }
+        ObjList *list = AS_LIST(obj);
+        long i = (long)AS_NUMBER(idx);
+        if (i < 0 || (size_t)i >= list->count) { runtime_error_at(interp, line, "List index out of bounds."); return NIL_VAL; }
+        return list->items[i];
+    }
+    if (IS_TUPLE(obj)) {
+        if (!IS_NUMBER(idx)) { runtime_error_at(interp, line, "Tuple index must be a number."); return NIL_VAL; }
+        ObjTuple *tuple = AS_TUPLE(obj);
+        long i = (long)AS_NUMBER(idx);
+        if (i < 0 || (size_t)i >= tuple->count) { runtime_error_at(interp, line, "Tuple index out of bounds."); return NIL_VAL; }
+        return tuple->items[i];
+    }
+    if (IS_STRING(obj)) {
+        if (!IS_NUMBER(idx)) { runtime_error_at(interp, line, "String index must be a number."); return NIL_VAL; }
+        ObjString *str = AS_STRING(obj);
+        long i = (long)AS_NUMBER(idx);
+        if (i < 0 || (size_t)i >= str->length) { runtime_error_at(interp, line, "String index out of bounds."); return NIL_VAL; }
+        return OBJ_VAL(obj_string_byte((unsigned char)string_bytes(str)[i]));
+    }
+    if (IS_DICT(obj)) {
+        ObjDict *dict = AS_DICT(obj);
+        if (!IS_STRING(idx)) { runtime_error_at(interp, line, "Dict key must be a string."); return NIL_VAL; }
+        Value val;
+        if (dict_get(dict, AS_STRING(idx), &val)) return val;
+        return NIL_VAL;
+    }
+    if (IS_ARRAY(obj)) {
+        if (!IS_NUMBER(idx)) { runtime_error_at(interp, line, "Array index must be a number."); return NIL_VAL; }
+        ObjArray *array = AS_ARRAY(obj);
+        long i = (long)AS_NUMBER(idx);
+        if (i < 0 || (size_t)i >= array->count) { runtime_error_at(interp, line, "Array index out of bounds."); return NIL_VAL; }
+        return NUMBER_VAL(array_get(array, (size_t)i));
+    }
+    runtime_error_at(interp, line, "Only lists, tuples, strings, dicts, and arrays are indexable.");
+    return NIL_VAL;
+}
+
+Value interp_set_index(Interpreter *interp, Value obj, Value idx, Value value, size_t line) {
+    if (IS_LIST(obj)) {
+        if (!IS_NUMBER(idx)) { runtime_error_at(interp, line, "List index must be a number."); return NIL_VAL; }
+        ObjList *list = AS_LIST(obj);
+        long i = (long)AS_NUMBER(idx);
+        if (i < 0 || (size_t)i >= list->count) { runtime_error_at(interp, line, "List index out of bounds."); return NIL_VAL; }
+        list->items[i] = value;
+        gc_write_barrier((Obj *)list, value);
+    } else if (IS_DICT(obj)) {
+        if (!IS_STRING(idx)) { runtime_error_at(interp, line, "Dict key must be a string."); return NIL_VAL; }
+        dict_set(AS_DICT(obj), AS_STRING(idx), value);
+    } else if (IS_ARRAY(obj)) {
+        if (!IS_NUMBER(idx)) { runtime_error_at(interp, line, "Array index must be a number."); return NIL_VAL; }
+        ObjArray *array = AS_ARRAY(obj);
+        long i = (long)AS_NUMBER(idx);
+        if (i < 0 || (size_t)i >= array->count) { runtime_error_at(interp, line, "Array index out of bounds."); return NIL_VAL; }
+        if (!IS_NUMBER(value) || !array_set(array, (size_t)i, AS_NUMBER(value))) {
+            runtime_error_at(interp, line, "%s arrays cannot hold %s.", array_type_name(array->type), value_to_string(value));
+            return NIL_VAL;
+        }
+    } else {
+        runtime_error_at(interp, line, "Can only index-assign to lists, dicts, and arrays.");
+    }
+    return value;
+}
+
+/* Build a function object for an AST_FUNCTION (also class methods) or an
+   AST_LAMBDA, closing over the current environment. */
+ObjFunction *interp_make_function(Interpreter *interp, AstNode *node) {
+    ObjFunction *fn;
+    if (node->type == AST_LAMBDA) {
+        fn = obj_function_new(NULL);
+        fn->param_count = node->as.lambda.param_count;
+        fn->params = (char **)malloc(sizeof(char *) * fn->param_count);
+        for (size_t i = 0; i < fn->param_count; i++) {
+            fn->params[i] = strdup(node->as.lambda.params[i]);
+        }
+        fn->body = node->as.lambda.body;
+        fn->scope = &node->as.lambda.scope;
+        fn->implicit_return = 1;
+    } else {
+        fn = obj_function_new(node->as.function.name);
+        fn->param_count = node->as.function.param_count;
+        fn->params = (char **)malloc(sizeof(char *) * fn->param_count);
+        fn->param_types = (char **)calloc(fn->param_count, sizeof(char *));
+        for (size_t i = 0; i < fn->param_count; i++) {
+            fn->params[i] = strdup(node->as.function.params[i]);
+            if (node->as.function.param_types && node->as.function.param_types[i])
+                fn->param_types[i] = strdup(node->as.function.param_types[i]);
+        }
+        fn->body = node->as.function.body;
+        fn->return_type = node->as.function.return_type ? strdup(node->as.function.return_type) : NULL;
+        fn->is_async = node->as.function.is_async;
+        fn->scope = &node->as.function.scope;
+    }
+    fn->is_generator = fn->scope->generator;
+    fn->closure = interp->env;
+    return fn;
+}
+
+/* A fresh environment for a call to `fn`; the caller binds the parameters
+   to slots 0..param_count-1. */
+Environment *interp_call_env(Interpreter *interp, ObjFunction *fn) {
+    return env_enter(&interp->frames, fn->closure ? fn->closure : interp->globals, fn->scope);
+}
+
+int interp_read_var(Interpreter *interp, VarRef ref, ObjString *name, Value *out) {
+    if (ref.depth == VAR_GLOBAL) {
+        *out = interp->globals->slots[ref.slot];
+        return !IS_UNDEFINED(*out);
+    }
+    Environment *env = env_ancestor(interp->env, ref.depth);
+    *out = env->slots[ref.slot];
+    if (!IS_UNDEFINED(*out)) return 1;
+    /* Read before the local is first assigned: look further out by name */
+    return env_get(env->enclosing, name, out);
+}
+
+void interp_write_var(Interpreter *interp, VarRef ref, Value value) {
+    if (ref.depth == VAR_GLOBAL) {
+        gc_slot_barrier(value);
+        interp->globals->slots[ref.slot] = value;
+    } else {
+        env_set_at(interp->env, ref.depth, ref.slot, value);
+    }
+}
+
+/* Set comprehension - for now deduplicate via dict keys */
+Value interp_list_to_set(ObjList *result) {
+    size_t roots = gc_root_depth();
+    gc_push_root(OBJ_VAL(result));
+    ObjDict *set = obj_dict_new();
+    gc_push_root(OBJ_VAL(set));
+    for (size_t i = 0; i < result->count; i++) {
+        /* Strings are their own keys; dict_set interns only the new ones */
+        ObjString *key;
+        if (IS_STRING(result->items[i])) {
+            key = AS_STRING(result->items[i]);
+        } else {
+            const char *s = value_to_string(result->items[i]);
+            key = obj_string_copy(s, strlen(s));
+        }
+        dict_set(set, key, result->items[i]);
+    }
+    ObjList *list = obj_list_new();
+    for (size_t i = 0; i < set->count; i++) {
+        value_array_write(list, set->entries[i].value);
+    }
+    gc_restore_roots(roots);
+    return OBJ_VAL(list);
 }
 
 /* ========================================================================= */
@@ -236,24 +643,179 @@ Value interpreter_run(Interpreter *interp, AstNode *program) {
 
 static void eval_comprehension(Interpreter *interp, AstNode *comp, ObjList *result, size_t clause_idx);
 static void eval_dict_comprehension(Interpreter *interp, AstNode *comp, ObjDict *result, size_t clause_idx);
-static int match_pattern(Interpreter *interp, AstNode *pattern, Value value);
+
+/* ========================================================================= */
+/* Calls                                                                     */
+/* ========================================================================= */
+
+/* Natives called with at most this many arguments get them on the C stack */
+#define NATIVE_FAST_ARGS 8
+
+/* Evaluate the arguments of `call` left to right, storing the first `count`
+   of them in `slots`; the rest are evaluated for their effects only.
+   Returns 0 if an argument threw. */
+static int eval_args(Interpreter *interp, AstNode *call, Value *slots, size_t count) {
+    for (size_t i = 0; i < call->as.call.arg_count; i++) {
+        Value arg = eval_expr(interp, call->as.call.args[i]);
+        if (interp->throw_flag) return 0;
+        if (i < count) {
+            gc_slot_barrier(arg);
+            slots[i] = arg;
+        }
+    }
+    return 1;
+}
+
+/* Run the body of `fn` in `call_env`, whose parameter slots are bound, then
+   leave the environment.  Methods and initialisers do not become the current
+   function for return-type checks. */
+static Value run_function(Interpreter *interp, ObjFunction *fn, Environment *call_env, int is_function) {
+    Environment *prev = interp->env;
+    ObjFunction *prev_fn = interp->current_function;
+    interp->env = call_env;
+    if (is_function) interp->current_function = fn;
+    interp->return_flag = 0;
+    gc_poll();
+    Value block_result = eval_stmt(interp, fn->body);
+    Value result = NIL_VAL;
+    if (interp->return_flag) {
+        result = interp->return_value;
+    } else if (fn->implicit_return) {
+        result = block_result;
+    }
+    interp->return_flag = 0;
+    interp->current_function = prev_fn;
+    env_leave(&interp->frames, call_env);
+    interp->env = prev;
+    return result;
+}
+
+/* Calls from native code.  The tree-walker binds the arguments as AST_CALL
+   does; every argument is rooted first, since creating an instance may
+   collect. */
+static Value call_from_native(Interpreter *interp, Value callee, int argc, Value *args) {
+    size_t roots = gc_root_depth();
+    gc_push_root(callee);
+    for (int i = 0; i < argc; i++) gc_push_root(args[i]);
+    Value result = NIL_VAL;
+
+    if (IS_NATIVE(callee)) {
+        size_t pin = gc_pin_begin();
+        result = AS_NATIVE(callee)->fn(argc, args);
+        gc_pin_end(pin);
+    } else if (IS_FUNCTION(callee)) {
+        ObjFunction *fn = AS_FUNCTION(callee);
+        size_t bound = fn->param_count < (size_t)argc ? fn->param_count : (size_t)argc;
+        for (size_t i = 0; i < bound; i++) {
+            if (fn->param_types && fn->param_types[i] && !interp_check_type(args[i], fn->param_types[i])) {
+                fprintf(stderr, "Type error: Expected argument %zu to be %s, got %s\n",
+                        i + 1, fn->param_types[i], value_type_name(args[i]));
+                gc_restore_roots(roots);
+                return NIL_VAL;
+            }
+        }
+        Environment *call_env = interp_call_env(interp, fn);
+        for (size_t i = 0; i < bound; i++) {
+            gc_slot_barrier(args[i]);
+            call_env->slots[i] = args[i];
+        }
+        result = run_function(interp, fn, call_env, 1);
+    } else {
+        ObjClass *klass = AS_CLASS(callee);
+        ObjInstance *inst = obj_instance_new(klass);
+        gc_push_root(OBJ_VAL(inst));
+        Value init_val;
+        if (interp_lookup_init(klass, &init_val) && IS_FUNCTION(init_val)) {
+            ObjFunction *init = AS_FUNCTION(init_val);
+            Environment *call_env = interp_call_env(interp, init);
+            gc_slot_barrier(OBJ_VAL(inst));
+            if (init->param_count > 0) call_env->slots[0] = OBJ_VAL(inst);
+            for (size_t i = 1; i < init->param_count && (i - 1) < (size_t)argc; i++) {
+                gc_slot_barrier(args[i - 1]);
+                call_env->slots[i] = args[i - 1];
+            }
+            run_function(interp, init, call_env, 0);
+        }
+        result = OBJ_VAL(inst);
+    }
+    gc_restore_roots(roots);
+    return result;
+}
+
+Value interp_call_direct(Interpreter *interp, Value callee, int argc, Value *args) {
+    if (!IS_FUNCTION(callee) && !IS_NATIVE(callee) && !IS_CLASS(callee)) {
+        runtime_error(interp, "Can only call functions and classes.");
+        return NIL_VAL;
+    }
+    int pins = gc_pin_suspend();
+    Value result = interp->engine == ENGINE_VM ? vm_call(interp, callee, argc, args)
+                                               : call_from_native(interp, callee, argc, args);
+    gc_pin_resume(pins);
+    return interp->throw_flag ? NIL_VAL : result;
+}
+
+Value interp_call(Interpreter *interp, Value callee, int argc, Value *args) {
+    if (!IS_FUNCTION(callee) || !(AS_FUNCTION(callee)->is_async || AS_FUNCTION(callee)->is_generator))
+        return interp_call_direct(interp, callee, argc, args);
+    size_t roots = gc_root_depth();
+    gc_push_root(callee);
+    int pins = gc_pin_suspend();
+    Obj *result = AS_FUNCTION(callee)->is_generator ? (Obj *)generator_new(interp, callee, argc, args)
+                                                    : (Obj *)future_spawn_coroutine(interp, callee, argc, args);
+    gc_pin_resume(pins);
+    gc_restore_roots(roots);
+    return OBJ_VAL(result);
+}
+
+/* A generator function returns a generator without running its body, and
+   an async function runs as a coroutine on the event loop: the arguments
+   bound in `call_env` go to the generator or future, the call's value */
+static Value spawn_call(Interpreter *interp, ObjFunction *fn, Environment *call_env) {
+    Obj *result = fn->is_generator
+        ? (Obj *)generator_new(interp, OBJ_VAL(fn), (int)fn->param_count, call_env->slots)
+        : (Obj *)future_spawn_coroutine(interp, OBJ_VAL(fn), (int)fn->param_count, call_env->slots);
+    env_leave(&interp->frames, call_env);
+    return OBJ_VAL(result);
+}
 
 /* ========================================================================= */
 /* Expression Evaluation                                                     */
 /* ========================================================================= */
 
+/* Values held only in C locals across an allocation are pushed as temporary
+   roots; eval_expr and eval_stmt drop whatever their node pushed, so the
+   cases below never pop explicitly.  A returned value is unrooted and the
+   caller must protect it before allocating again. */
+static Value eval_expr_node(Interpreter *interp, AstNode *node);
+static Value eval_stmt_node(Interpreter *interp, AstNode *node);
+
 Value eval_expr(Interpreter *interp, AstNode *node) {
     if (!node) return NIL_VAL;
+    size_t roots = gc_root_depth();
+    Value result = eval_expr_node(interp, node);
+    gc_restore_roots(roots);
+    return result;
+}
+
+Value eval_stmt(Interpreter *interp, AstNode *node) {
+    if (!node) return NIL_VAL;
+    size_t roots = gc_root_depth();
+    Value result = eval_stmt_node(interp, node);
+    gc_restore_roots(roots);
+    return result;
+}
+
+static Value eval_expr_node(Interpreter *interp, AstNode *node) {
 
     switch (node->type) {
         case AST_NUMBER:    return NUMBER_VAL(node->as.number.value);
-        case AST_STRING:    return OBJ_VAL(obj_string_copy(node->as.string.value, strlen(node->as.string.value)));
+        case AST_STRING:    return OBJ_VAL(node->as.string.key);
         case AST_BOOL:      return BOOL_VAL(node->as.boolean.value);
         case AST_NIL:       return NIL_VAL;
 
         case AST_IDENTIFIER: {
             Value val;
-            if (env_get(interp->env, node->as.identifier.name, &val)) return val;
+            if (interp_read_var(interp, node->as.identifier.ref, node->as.identifier.key, &val)) return val;
             runtime_error_node(interp, node, "Undefined variable '%s'.", node->as.identifier.name);
             return NIL_VAL;
         }
@@ -261,53 +823,11 @@ Value eval_expr(Interpreter *interp, AstNode *node) {
         case AST_BINARY: {
             Value left = eval_expr(interp, node->as.binary.left);
             if (interp->throw_flag) return NIL_VAL;
+            gc_push_root(left);
             Value right = eval_expr(interp, node->as.binary.right);
             if (interp->throw_flag) return NIL_VAL;
 
-            switch (node->as.binary.op) {
-                case OP_ADD: {
-                    if (IS_NUMBER(left) && IS_NUMBER(right))
-                        return NUMBER_VAL(AS_NUMBER(left) + AS_NUMBER(right));
-                    return value_str_concat(left, right);
-                }
-                case OP_SUB: {
-                    if (!IS_NUMBER(left) || !IS_NUMBER(right))
-                        { runtime_error_node(interp, node, "Operands must be numbers for '--'."); return NIL_VAL; }
-                    return NUMBER_VAL(AS_NUMBER(left) - AS_NUMBER(right));
-                }
-                case OP_MUL: {
-                    if (!IS_NUMBER(left) || !IS_NUMBER(right))
-                        { runtime_error_node(interp, node, "Operands must be numbers for '**'."); return NIL_VAL; }
-                    return NUMBER_VAL(AS_NUMBER(left) * AS_NUMBER(right));
-                }
-                case OP_DIV: {
-                    if (!IS_NUMBER(left) || !IS_NUMBER(right))
-                        { runtime_error_node(interp, node, "Operands must be numbers for '//'."); return NIL_VAL; }
-                    if (AS_NUMBER(right) == 0)
-                        { runtime_error_node(interp, node, "Division by zero."); return NIL_VAL; }
-                    return NUMBER_VAL(AS_NUMBER(left) / AS_NUMBER(right));
-                }
-                case OP_MOD: {
-                    if (!IS_NUMBER(left) || !IS_NUMBER(right))
-                        { runtime_error_node(interp, node, "Operands must be numbers for '%%'."); return NIL_VAL; }
-                    if (AS_NUMBER(right) == 0)
-                        { runtime_error_node(interp, node, "Modulo by zero."); return NIL_VAL; }
-                    return NUMBER_VAL((double)((long)AS_NUMBER(left) % (long)AS_NUMBER(right)));
-                }
-                case OP_EQ:  return BOOL_VAL(values_equal(left, right));
-                case OP_NE:  return BOOL_VAL(!values_equal(left, right));
-                case OP_LT: {
-                    if (!IS_NUMBER(left) || !IS_NUMBER(right))
-                        { runtime_error_node(interp, node, "Operands must be numbers for '<<'."); return NIL_VAL; }
-                    return BOOL_VAL(AS_NUMBER(left) < AS_NUMBER(right));
-                }
-                case OP_GT: {
-                    if (!IS_NUMBER(left) || !IS_NUMBER(right))
-                        { runtime_error_node(interp, node, "Operands must be numbers for '>>'."); return NIL_VAL; }
-                    return BOOL_VAL(AS_NUMBER(left) > AS_NUMBER(right));
-                }
-            }
-            return NIL_VAL;
+            return interp_binary(interp, node->as.binary.op, left, right, node->line);
         }
 
         case AST_UNARY: {
@@ -327,256 +847,156 @@ Value eval_expr(Interpreter *interp, AstNode *node) {
                 AstNode *member = node->as.call.callee;
                 Value obj = eval_expr(interp, member->as.member.object);
                 if (interp->throw_flag) return NIL_VAL;
-                const char *method_name = member->as.member.name;
-
-                /* Evaluate arguments */
-                Value *args = NULL;
-                size_t arg_count = node->as.call.arg_count;
-                if (arg_count > 0) {
-                    args = (Value *)malloc(sizeof(Value) * (arg_count + 1));
-                    for (size_t i = 0; i < arg_count; i++) {
-                        args[i + 1] = eval_expr(interp, node->as.call.args[i]);
-                        if (interp->throw_flag) { free(args); return NIL_VAL; }
-                    }
-                } else {
-                    args = (Value *)malloc(sizeof(Value));
-                }
-                args[0] = obj;
+                gc_push_root(obj);
+                ObjString *method_name = member->as.member.key;
 
                 /* Resolve method */
                 ObjFunction *method = NULL;
+                Value val;
                 if (IS_INSTANCE(obj)) {
                     ObjInstance *inst = AS_INSTANCE(obj);
-                    Value val;
-                    if (dict_get(inst->fields, obj_string_copy(method_name, strlen(method_name)), &val)) {
-                        if (IS_FUNCTION(val)) method = AS_FUNCTION(val);
-                    }
-                    if (!method && class_lookup_method(inst->klass, obj_string_copy(method_name, strlen(method_name)), &val)) {
-                        if (IS_FUNCTION(val)) method = AS_FUNCTION(val);
-                    }
+                    if (dict_get(inst->fields, method_name, &val) && IS_FUNCTION(val))
+                        method = AS_FUNCTION(val);
+                    if (!method && interp_lookup_method(inst->klass, method_name, &val) && IS_FUNCTION(val))
+                        method = AS_FUNCTION(val);
                 } else if (IS_CLASS(obj)) {
-                    Value val;
-                    if (class_lookup_method(AS_CLASS(obj), obj_string_copy(method_name, strlen(method_name)), &val)) {
-                        if (IS_FUNCTION(val)) method = AS_FUNCTION(val);
-                    }
-                } else if (IS_LIST(obj) || IS_DICT(obj) || IS_STRING(obj) || IS_TUPLE(obj)) {
-                    /* Native method dispatch */
-                    if (strcmp(method_name, "length") == 0) {
-                        free(args);
-                        return native_seq_len(1, &obj);
-                    }
+                    if (interp_lookup_method(AS_CLASS(obj), method_name, &val) && IS_FUNCTION(val))
+                        method = AS_FUNCTION(val);
                 }
 
                 if (!method) {
-                    runtime_error_node(interp, node, "Undefined method '%s'.", method_name);
-                    free(args);
+                    if (!eval_args(interp, node, NULL, 0)) return NIL_VAL;
+                    if ((IS_LIST(obj) || IS_DICT(obj) || IS_STRING(obj) || IS_TUPLE(obj)) &&
+                        strcmp(string_chars(method_name), "length") == 0) {
+                        /* Native method dispatch */
+                        return native_seq_len(1, &obj);
+                    }
+                    runtime_error_node(interp, node, "Undefined method '%s'.", string_chars(method_name));
                     return NIL_VAL;
                 }
 
-                Environment *call_env = env_new_enclosing(method->closure ? method->closure : interp->globals);
-                for (size_t i = 0; i < method->param_count && i < (arg_count + 1); i++) {
-                    env_define(call_env, method->params[i], args[i]);
-                }
-                free(args);
-
-                Environment *prev = interp->env;
-                interp->env = call_env;
-                interp->return_flag = 0;
-                Value block_result = eval_stmt(interp, method->body);
-                Value result = NIL_VAL;
-                if (interp->return_flag) {
-                    env_get(call_env, "__return__", &result);
-                } else if (method->implicit_return) {
-                    result = block_result;
+                /* The receiver binds to the first parameter, conventionally self */
+                gc_push_root(OBJ_VAL(method));
+                Environment *call_env = interp_call_env(interp, method);
+                gc_slot_barrier(obj);
+                if (method->param_count > 0) call_env->slots[0] = obj;
+                if (!eval_args(interp, node, call_env->slots + 1, method->param_count > 0 ? method->param_count - 1 : 0)) {
+                    env_leave(&interp->frames, call_env);
+                    return NIL_VAL;
                 }
-                interp->return_flag = 0;
-                env_free(call_env);
-                interp->env = prev;
-                return result;
+                if (method->is_async || method->is_generator) return spawn_call(interp, method, call_env);
+                return run_function(interp, method, call_env, 0);
             }
 
             Value callee = eval_expr(interp, node->as.call.callee);
             if (interp->throw_flag) return NIL_VAL;
-
-            /* Evaluate arguments */
-            size_t arg_count = node->as.call.arg_count;
-            Value *args = arg_count > 0 ? (Value *)malloc(sizeof(Value) * arg_count) : NULL;
-            for (size_t i = 0; i < arg_count; i++) {
-                args[i] = eval_expr(interp, node->as.call.args[i]);
-                if (interp->throw_flag) { free(args); return NIL_VAL; }
-            }
-
-            if (IS_NATIVE(callee)) {
-                Value result = AS_NATIVE(callee)->fn((int)arg_count, args);
-                free(args);
-                return result;
-            }
+            gc_push_root(callee);
 
             if (IS_FUNCTION(callee)) {
                 ObjFunction *fn = AS_FUNCTION(callee);
+                Environment *call_env = interp_call_env(interp, fn);
+                if (!eval_args(interp, node, call_env->slots, fn->param_count)) {
+                    env_leave(&interp->frames, call_env);
+                    return NIL_VAL;
+                }
+                if (fn->is_async || fn->is_generator) return spawn_call(interp, fn, call_env);
 
-                /* Type-check arguments before binding */
-                for (size_t i = 0; i < fn->param_count && i < arg_count; i++) {
-                    if (fn->param_types && fn->param_types[i] && !check_type(args[i], fn->param_types[i])) {
+                /* Type-check arguments before running the body */
+                size_t bound = fn->param_count < node->as.call.arg_count ? fn->param_count : node->as.call.arg_count;
+                for (size_t i = 0; i < bound; i++) {
+                    if (fn->param_types && fn->param_types[i] && !interp_check_type(call_env->slots[i], fn->param_types[i])) {
                         fprintf(stderr, "Type error: Expected argument %zu to be %s, got %s\n",
-                                i + 1, fn->param_types[i], value_type_name(args[i]));
-                        free(args);
+                                i + 1, fn->param_types[i], value_type_name(call_env->slots[i]));
+                        env_leave(&interp->frames, call_env);
                         return NIL_VAL;
                     }
                 }
+                return run_function(interp, fn, call_env, 1);
+            }
 
-                Environment *call_env = env_new_enclosing(fn->closure ? fn->closure : interp->globals);
-                for (size_t i = 0; i < fn->param_count && i < arg_count; i++) {
-                    env_define(call_env, fn->params[i], args[i]);
-                }
-                free(args);
-
-                Environment *prev = interp->env;
-                ObjFunction *prev_fn = interp->current_function;
-                interp->env = call_env;
-                interp->current_function = fn;
-                interp->return_flag = 0;
-                Value block_result = eval_stmt(interp, fn->body);
+            if (IS_NATIVE(callee)) {
+                /* Arguments of small calls live on the C stack; each is
+                   rooted while the rest are evaluated.  Natives run pinned. */
+                size_t arg_count = node->as.call.arg_count;
+                Value local[NATIVE_FAST_ARGS];
+                Value *args = arg_count <= NATIVE_FAST_ARGS ? local : (Value *)malloc(sizeof(Value) * arg_count);
                 Value result = NIL_VAL;
-                if (interp->return_flag) {
-                    env_get(call_env, "__return__", &result);
-                } else if (fn->implicit_return) {
-                    result = block_result;
+                size_t i = 0;
+                for (; i < arg_count; i++) {
+                    args[i] = eval_expr(interp, node->as.call.args[i]);
+                    if (interp->throw_flag) break;
+                    gc_push_root(args[i]);
                 }
-                interp->return_flag = 0;
-                interp->current_function = prev_fn;
-                env_free(call_env);
-                interp->env = prev;
+                if (i == arg_count) {
+                    size_t pin = gc_pin_begin();
+                    result = AS_NATIVE(callee)->fn((int)arg_count, args);
+                    gc_pin_end(pin);
+                }
+                if (args != local) free(args);
                 return result;
             }
 
             if (IS_CLASS(callee)) {
                 ObjClass *klass = AS_CLASS(callee);
                 ObjInstance *inst = obj_instance_new(klass);
+                gc_push_root(OBJ_VAL(inst));
                 /* Call init if present */
                 Value init_val;
-                if (class_lookup_method(klass, obj_string_copy("init", 4), &init_val) && IS_FUNCTION(init_val)) {
+                if (interp_lookup_init(klass, &init_val) && IS_FUNCTION(init_val)) {
                     ObjFunction *init = AS_FUNCTION(init_val);
-                    Environment *call_env = env_new_enclosing(interp->globals);
-                    env_define(call_env, "self", OBJ_VAL(inst));
-                    for (size_t i = 1; i < init->param_count && (i - 1) < arg_count; i++) {
-                        env_define(call_env, init->params[i], args[i - 1]);
+                    Environment *call_env = interp_call_env(interp, init);
+                    gc_slot_barrier(OBJ_VAL(inst));
+                    if (init->param_count > 0) call_env->slots[0] = OBJ_VAL(inst);
+                    if (!eval_args(interp, node, call_env->slots + 1, init->param_count > 0 ? init->param_count - 1 : 0)) {
+                        env_leave(&interp->frames, call_env);
+                        return NIL_VAL;
                     }
-                    free(args);
-                    Environment *prev = interp->env;
-                    interp->env = call_env;
-                    interp->return_flag = 0;
-                    eval_stmt(interp, init->body);
-                    interp->return_flag = 0;
-                    env_free(call_env);
-                    interp->env = prev;
-                } else {
-                    free(args);
+                    run_function(interp, init, call_env, 0);
+                } else if (!eval_args(interp, node, NULL, 0)) {
+                    return NIL_VAL;
                 }
                 return OBJ_VAL(inst);
             }
 
+            if (!eval_args(interp, node, NULL, 0)) return NIL_VAL;
             runtime_error_node(interp, node, "Can only call functions and classes.");
-            free(args);
             return NIL_VAL;
         }
 
         case AST_MEMBER: {
             Value obj = eval_expr(interp, node->as.member.object);
             if (interp->throw_flag) return NIL_VAL;
-            const char *name = node->as.member.name;
-
-            if (IS_INSTANCE(obj)) {
-                ObjInstance *inst = AS_INSTANCE(obj);
-                Value val;
-                if (dict_get(inst->fields, obj_string_copy(name, strlen(name)), &val)) return val;
-                if (class_lookup_method(inst->klass, obj_string_copy(name, strlen(name)), &val)) return val;
-                runtime_error_node(interp, node, "Undefined property '%s'.", name);
-                return NIL_VAL;
-            }
-
-            if (IS_DICT(obj)) {
-                Value val;
-                if (dict_get(AS_DICT(obj), obj_string_copy(name, strlen(name)), &val)) return val;
-                return NIL_VAL;
-            }
-
-            if (IS_LIST(obj) || IS_STRING(obj) || IS_TUPLE(obj)) {
-                if (strcmp(name, "length") == 0) {
-                    return native_seq_len(1, &obj);
-                }
-            }
-
-            runtime_error_node(interp, node, "Only instances and dicts have properties.");
-            return NIL_VAL;
+            return interp_get_member(interp, obj, node->as.member.key, node->line);
         }
 
         case AST_INDEX: {
             Value obj = eval_expr(interp, node->as.index.object);
             if (interp->throw_flag) return NIL_VAL;
+            gc_push_root(obj);
             Value idx = eval_expr(interp, node->as.index.index);
             if (interp->throw_flag) return NIL_VAL;
-
-            if (IS_LIST(obj)) {
-                if (!IS_NUMBER(idx)) { runtime_error_node(interp, node, "List index must be a number."); return NIL_VAL; }
-                ObjList *list = AS_LIST(obj);
-                long i = (long)AS_NUMBER(idx);
-                if (i < 0 || (size_t)i >= list->count) { runtime_error_node(interp, node, "List index out of bounds."); return NIL_VAL; }
-                return list->items[i];
-            }
-            if (IS_TUPLE(obj)) {
-                if (!IS_NUMBER(idx)) { runtime_error_node(interp, node, "Tuple index must be a number."); return NIL_VAL; }
-                ObjTuple *tuple = AS_TUPLE(obj);
-                long i = (long)AS_NUMBER(idx);
-                if (i < 0 || (size_t)i >= tuple->count) { runtime_error_node(interp, node, "Tuple index out of bounds."); return NIL_VAL; }
-                return tuple->items[i];
-            }
-            if (IS_STRING(obj)) {
-                if (!IS_NUMBER(idx)) { runtime_error_node(interp, node, "String index must be a number."); return NIL_VAL; }
-                ObjString *str = AS_STRING(obj);
-                long i = (long)AS_NUMBER(idx);
-                if (i < 0 || (size_t)i >= str->length) { runtime_error_node(interp, node, "String index out of bounds."); return NIL_VAL; }
-                char *buf = (char *)malloc(2);
-                buf[0] = str->chars[i];
-                buf[1] = '\0';
-                return OBJ_VAL(obj_string_take(buf, 1));
-            }
-            if (IS_DICT(obj)) {
-                ObjDict *dict = AS_DICT(obj);
-                if (!IS_STRING(idx)) { runtime_error_node(interp, node, "Dict key must be a string."); return NIL_VAL; }
-                Value val;
-                if (dict_get(dict, AS_STRING(idx), &val)) return val;
-                return NIL_VAL;
-            }
-            runtime_error_node(interp, node, "Only lists, tuples, strings, and dicts are indexable.");
-            return NIL_VAL;
+            return interp_get_index(interp, obj, idx, node->line);
         }
 
         case AST_CONDITIONAL: {
             Value cond = eval_expr(interp, node->as.conditional.cond);
             if (interp->throw_flag) return NIL_VAL;
-            return eval_expr(interp, is_truthy(cond) ? node->as.conditional.then_branch : node->as.conditional.else_branch);
+            return eval_expr(interp, interp_truthy(cond) ? node->as.conditional.then_branch : node->as.conditional.else_branch);
         }
 
         case AST_AWAIT: {
-            return eval_expr(interp, node->as.await_expr.value);
+            /* Awaiting anything but a future yields it unchanged */
+            Value value = eval_expr(interp, node->as.await_expr.value);
+            if (interp->throw_flag || !IS_FUTURE(value)) return value;
+            return future_await(interp, value);
         }
 
-        case AST_LAMBDA: {
-            ObjFunction *fn = obj_function_new(NULL);
-            fn->param_count = node->as.lambda.param_count;
-            fn->params = (char **)malloc(sizeof(char *) * fn->param_count);
-            for (size_t i = 0; i < fn->param_count; i++) {
-                fn->params[i] = strdup(node->as.lambda.params[i]);
-            }
-            fn->body = node->as.lambda.body;
-            fn->implicit_return = 1;
-            fn->closure = interp->env;
-            return OBJ_VAL(fn);
-        }
+        case AST_LAMBDA:
+            return OBJ_VAL(interp_make_function(interp, node));
 
         case AST_LIST: {
             ObjList *list = obj_list_new();
+            gc_push_root(OBJ_VAL(list));
             for (size_t i = 0; i < node->as.list.count; i++) {
                 Value elem = eval_expr(interp, node->as.list.elements[i]);
                 if (interp->throw_flag) return NIL_VAL;
@@ -587,20 +1007,24 @@ Value eval_expr(Interpreter *interp, AstNode *node) {
 
         case AST_TUPLE: {
             ObjTuple *tuple = obj_tuple_new(node->as.tuple.count);
+            gc_push_root(OBJ_VAL(tuple));
             for (size_t i = 0; i < node->as.tuple.count; i++) {
                 Value elem = eval_expr(interp, node->as.tuple.elements[i]);
                 if (interp->throw_flag) return NIL_VAL;
                 tuple->items[i] = elem;
+                gc_write_barrier((Obj *)tuple, elem);
             }
             return OBJ_VAL(tuple);
         }
 
         case AST_DICT: {
             ObjDict *dict = obj_dict_new();
+            gc_push_root(OBJ_VAL(dict));
             for (size_t i = 0; i < node->as.dict.count; i++) {
                 AstNode *entry = node->as.dict.entries[i];
                 Value key = eval_expr(interp, entry->as.dict_entry.key);
                 if (interp->throw_flag) return NIL_VAL;
+                gc_push_root(key);
                 Value val = eval_expr(interp, entry->as.dict_entry.value);
                 if (interp->throw_flag) return NIL_VAL;
                 if (!IS_STRING(key)) { runtime_error_node(interp, node, "Dict keys must be strings."); return NIL_VAL; }
@@ -612,30 +1036,25 @@ Value eval_expr(Interpreter *interp, AstNode *node) {
         case AST_COMPREHENSION: {
             /* Build a result list by iterating over for-clauses and filtering with if-clauses */
             ObjList *result = obj_list_new();
+            gc_push_root(OBJ_VAL(result));
             eval_comprehension(interp, node, result, 0);
             if (node->as.comprehension.container == 1) {
                 /* Tuple comprehension */
                 ObjTuple *tuple = obj_tuple_new(result->count);
-                for (size_t i = 0; i < result->count; i++) tuple->items[i] = result->items[i];
-                return OBJ_VAL(tuple);
-            } else if (node->as.comprehension.container == 2) {
-                /* Set comprehension - for now deduplicate via dict keys */
-                ObjDict *set = obj_dict_new();
                 for (size_t i = 0; i < result->count; i++) {
-                    const char *s = value_to_string(result->items[i]);
-                    dict_set(set, obj_string_copy(s, strlen(s)), result->items[i]);
-                }
-                ObjList *list = obj_list_new();
-                for (size_t i = 0; i < set->count; i++) {
-                    value_array_write(list, set->entries[i].value);
+                    tuple->items[i] = result->items[i];
+                    gc_write_barrier((Obj *)tuple, tuple->items[i]);
                 }
-                return OBJ_VAL(list);
+                return OBJ_VAL(tuple);
+            } else if (node->as.comprehension.container == 2) {
+                return interp_list_to_set(result);
             }
             return OBJ_VAL(result);
         }
 
         case AST_DICT_COMPREHENSION: {
             ObjDict *result = obj_dict_new();
+            gc_push_root(OBJ_VAL(result));
             eval_dict_comprehension(interp, node, result, 0);
             return OBJ_VAL(result);
         }
@@ -650,9 +1069,7 @@ Value eval_expr(Interpreter *interp, AstNode *node) {
 /* Statement Evaluation                                                      */
 /* ========================================================================= */
 
-Value eval_stmt(Interpreter *interp, AstNode *node) {
-    if (!node) return NIL_VAL;
-
+static Value eval_stmt_node(Interpreter *interp, AstNode *node) {
     switch (node->type) {
         case AST_PROGRAM:
             return eval_stmt(interp, node->as.program.body);
@@ -661,12 +1078,7 @@ Value eval_stmt(Interpreter *interp, AstNode *node) {
             Value last = NIL_VAL;
             for (size_t i = 0; i < node->as.block.count; i++) {
                 last = eval_stmt(interp, node->as.block.stmts[i]);
-                if (interp->return_flag) {
-                    /* Propagate return value from __return__ */
-                    Value ret;
-                    if (env_get(interp->env, "__return__", &ret)) return ret;
-                    return NIL_VAL;
-                }
+                if (interp->return_flag) return interp->return_value;
                 if (interp->break_flag || interp->continue_flag || interp->throw_flag)
                     return NIL_VAL;
             }
@@ -682,43 +1094,25 @@ Value eval_stmt(Interpreter *interp, AstNode *node) {
             if (interp->throw_flag) return NIL_VAL;
 
             if (target->type == AST_IDENTIFIER) {
-                if (!env_set(interp->env, target->as.identifier.name, value))
-                    env_define(interp->env, target->as.identifier.name, value);
+                interp_write_var(interp, target->as.identifier.ref, value);
                 return value;
             }
 
+            gc_push_root(value);
             if (target->type == AST_MEMBER) {
                 Value obj = eval_expr(interp, target->as.member.object);
                 if (interp->throw_flag) return NIL_VAL;
-                const char *name = target->as.member.name;
-                if (IS_INSTANCE(obj)) {
-                    dict_set(AS_INSTANCE(obj)->fields, obj_string_copy(name, strlen(name)), value);
-                } else if (IS_DICT(obj)) {
-                    dict_set(AS_DICT(obj), obj_string_copy(name, strlen(name)), value);
-                } else {
-                    runtime_error_node(interp, node, "Can only assign to instance or dict properties.");
-                }
-                return value;
+                gc_push_root(obj);
+                return interp_set_member(interp, obj, target->as.member.key, value, node->line);
             }
 
             if (target->type == AST_INDEX) {
                 Value obj = eval_expr(interp, target->as.index.object);
                 if (interp->throw_flag) return NIL_VAL;
+                gc_push_root(obj);
                 Value idx = eval_expr(interp, target->as.index.index);
                 if (interp->throw_flag) return NIL_VAL;
-                if (IS_LIST(obj)) {
-                    if (!IS_NUMBER(idx)) { runtime_error_node(interp, node, "List index must be a number."); return NIL_VAL; }
-                    ObjList *list = AS_LIST(obj);
-                    long i = (long)AS_NUMBER(idx);
-                    if (i < 0 || (size_t)i >= list->count) { runtime_error_node(interp, node, "List index out of bounds."); return NIL_VAL; }
-                    list->items[i] = value;
-                } else if (IS_DICT(obj)) {
-                    if (!IS_STRING(idx)) { runtime_error_node(interp, node, "Dict key must be a string."); return NIL_VAL; }
-                    dict_set(AS_DICT(obj), AS_STRING(idx), value);
-                } else {
-                    runtime_error_node(interp, node, "Can only index-assign to lists and dicts.");
-                }
-                return value;
+                return interp_set_index(interp, obj, idx, value, node->line);
             }
 
             if (target->type == AST_TUPLE) {
@@ -740,8 +1134,7 @@ Value eval_stmt(Interpreter *interp, AstNode *node) {
                         runtime_error_node(interp, node, "Destructuring target must be an identifier.");
                         return NIL_VAL;
                     }
-                    if (!env_set(interp->env, var->as.identifier.name, items[i]))
-                        env_define(interp->env, var->as.identifier.name, items[i]);
+                    interp_write_var(interp, var->as.identifier.ref, items[i]);
                 }
                 return value;
             }
@@ -753,7 +1146,7 @@ Value eval_stmt(Interpreter *interp, AstNode *node) {
         case AST_IF: {
             Value cond = eval_expr(interp, node->as.if_stmt.cond);
             if (interp->throw_flag) return NIL_VAL;
-            if (is_truthy(cond)) {
+            if (interp_truthy(cond)) {
                 eval_stmt(interp, node->as.if_stmt.then_branch);
             } else if (node->as.if_stmt.else_branch) {
                 eval_stmt(interp, node->as.if_stmt.else_branch);
@@ -763,9 +1156,10 @@ Value eval_stmt(Interpreter *interp, AstNode *node) {
 
         case AST_WHILE: {
             for (;;) {
+                gc_poll();
                 Value cond = eval_expr(interp, node->as.while_stmt.cond);
                 if (interp->throw_flag) return NIL_VAL;
-                if (!is_truthy(cond)) break;
+                if (!interp_truthy(cond)) break;
                 eval_stmt(interp, node->as.while_stmt.body);
                 if (interp->return_flag || interp->throw_flag) return NIL_VAL;
                 if (interp->break_flag) { interp->break_flag = 0; break; }
@@ -777,20 +1171,16 @@ Value eval_stmt(Interpreter *interp, AstNode *node) {
         case AST_FOR: {
             Value iterable = eval_expr(interp, node->as.for_stmt.iter);
             if (interp->throw_flag) return NIL_VAL;
-            ObjList *list = NULL;
-            ObjTuple *tuple = NULL;
-            ObjString *str = NULL;
-            size_t count = 0;
-            Value *items = NULL;
-
-            if (IS_LIST(iterable)) { list = AS_LIST(iterable); count = list->count; items = list->items; }
-            else if (IS_TUPLE(iterable)) { tuple = AS_TUPLE(iterable); count = tuple->count; items = tuple->items; }
-            else if (IS_STRING(iterable)) { str = AS_STRING(iterable); count = str->length; }
-            else { runtime_error_node(interp, node, "Can only iterate over lists, tuples, and strings."); return NIL_VAL; }
-
-            for (size_t i = 0; i < count; i++) {
-                Value item = str ? OBJ_VAL(obj_string_copy(&str->chars[i], 1)) : items[i];
-                env_define(interp->env, node->as.for_stmt.var, item);
+            gc_push_root(iterable);
+            IterCursor cursor;
+            if (!iter_begin(iterable, &cursor)) {
+                runtime_error_node(interp, node, "Cannot iterate over %s.", value_type_name(iterable));
+                return NIL_VAL;
+            }
+            Value item;
+            while (iter_next(interp, iterable, &cursor, &item)) {
+                gc_poll();
+                interp_write_var(interp, node->as.for_stmt.var_ref, item);
                 eval_stmt(interp, node->as.for_stmt.body);
                 if (interp->return_flag || interp->throw_flag) return NIL_VAL;
                 if (interp->break_flag) { interp->break_flag = 0; break; }
@@ -806,12 +1196,12 @@ Value eval_stmt(Interpreter *interp, AstNode *node) {
             if (interp->throw_flag) return NIL_VAL;
             /* Check return type if annotated */
             if (interp->current_function && interp->current_function->return_type &&
-                !check_type(val, interp->current_function->return_type)) {
+                !interp_check_type(val, interp->current_function->return_type)) {
                 fprintf(stderr, "Type error: Expected return type %s, got %s\n",
                         interp->current_function->return_type, value_type_name(val));
                 return NIL_VAL;
             }
-            env_define(interp->env, "__return__", val);
+            interp->return_value = val;
             interp->return_flag = 1;
             return val;
         }
@@ -819,9 +1209,8 @@ Value eval_stmt(Interpreter *interp, AstNode *node) {
         case AST_YIELD: {
             Value val = eval_expr(interp, node->as.yield_stmt.value);
             if (interp->throw_flag) return NIL_VAL;
-            env_define(interp->env, "__return__", val);
-            interp->return_flag = 1;
-            return val;
+            generator_yield(interp, val);
+            return NIL_VAL;
         }
 
         case AST_BREAK:
@@ -833,29 +1222,18 @@ Value eval_stmt(Interpreter *interp, AstNode *node) {
             return NIL_VAL;
 
         case AST_FUNCTION: {
-            ObjFunction *fn = obj_function_new(node->as.function.name);
-            fn->param_count = node->as.function.param_count;
-            fn->params = (char **)malloc(sizeof(char *) * fn->param_count);
-            fn->param_types = (char **)calloc(fn->param_count, sizeof(char *));
-            for (size_t i = 0; i < fn->param_count; i++) {
-                fn->params[i] = strdup(node->as.function.params[i]);
-                if (node->as.function.param_types && node->as.function.param_types[i])
-                    fn->param_types[i] = strdup(node->as.function.param_types[i]);
-            }
-            fn->body = node->as.function.body;
-            fn->return_type = node->as.function.return_type ? strdup(node->as.function.return_type) : NULL;
-            fn->is_async = node->as.function.is_async;
-            fn->closure = interp->env;
-            env_define(interp->env, node->as.function.name, OBJ_VAL(fn));
+            ObjFunction *fn = interp_make_function(interp, node);
+            interp_write_var(interp, node->as.function.name_ref, OBJ_VAL(fn));
             return OBJ_VAL(fn);
         }
 
         case AST_CLASS: {
             ObjClass *klass = obj_class_new(node->as.class_def.name);
+            gc_push_root(OBJ_VAL(klass));
             /* Resolve superclass if specified */
             if (node->as.class_def.superclass) {
                 Value super_val;
-                if (!env_get(interp->env, node->as.class_def.superclass, &super_val)) {
+                if (!env_get(interp->env, node->as.class_def.super_key, &super_val)) {
                     runtime_error(interp, "Undefined superclass '%s'.", node->as.class_def.superclass);
                     return NIL_VAL;
                 }
@@ -864,27 +1242,18 @@ Value eval_stmt(Interpreter *interp, AstNode *node) {
                     return NIL_VAL;
                 }
                 klass->superclass = AS_CLASS(super_val);
+                gc_write_barrier((Obj *)klass, super_val);
             }
             for (size_t i = 0; i < node->as.class_def.method_count; i++) {
                 AstNode *method = node->as.class_def.methods[i];
                 if (method->type == AST_FUNCTION) {
-                    ObjFunction *fn = obj_function_new(method->as.function.name);
-                    fn->param_count = method->as.function.param_count;
-                    fn->params = (char **)malloc(sizeof(char *) * fn->param_count);
-                    fn->param_types = (char **)calloc(fn->param_count, sizeof(char *));
-                    for (size_t j = 0; j < fn->param_count; j++) {
-                        fn->params[j] = strdup(method->as.function.params[j]);
-                        if (method->as.function.param_types && method->as.function.param_types[j])
-                            fn->param_types[j] = strdup(method->as.function.param_types[j]);
-                    }
-                    fn->body = method->as.function.body;
-                    fn->return_type = method->as.function.return_type ? strdup(method->as.function.return_type) : NULL;
-                    fn->is_async = method->as.function.is_async;
-                    fn->closure = interp->env;
-                    dict_set(klass->methods, obj_string_copy(fn->name, strlen(fn->name)), OBJ_VAL(fn));
+                    ObjFunction *fn = interp_make_function(interp, method);
+                    gc_push_root(OBJ_VAL(fn));
+                    ObjString *key = obj_string_intern(fn->name, strlen(fn->name));
+                    dict_set(klass->methods, key, OBJ_VAL(fn));
                 }
             }
-            env_define(interp->env, node->as.class_def.name, OBJ_VAL(klass));
+            interp_write_var(interp, node->as.class_def.name_ref, OBJ_VAL(klass));
             return OBJ_VAL(klass);
         }
 
@@ -896,15 +1265,15 @@ Value eval_stmt(Interpreter *interp, AstNode *node) {
                 if (interp->error_msg) { free(interp->error_msg); interp->error_msg = NULL; }
 
                 if (node->as.try_stmt.catch_body) {
-                    Environment *catch_env = env_new_enclosing(interp->env);
+                    Environment *catch_env = env_enter(&interp->frames, interp->env, &node->as.try_stmt.catch_scope);
                     if (node->as.try_stmt.catch_var) {
-                        env_define(catch_env, node->as.try_stmt.catch_var, OBJ_VAL(obj_string_copy(err, strlen(err))));
+                        catch_env->slots[0] = OBJ_VAL(obj_string_copy(err, strlen(err)));
                     }
                     Environment *prev = interp->env;
                     interp->env = catch_env;
                     eval_stmt(interp, node->as.try_stmt.catch_body);
                     interp->env = prev;
-                    env_free(catch_env);
+                    env_leave(&interp->frames, catch_env);
                 }
                 free(err);
             }
@@ -930,7 +1299,7 @@ Value eval_stmt(Interpreter *interp, AstNode *node) {
             if (interp->throw_flag) return NIL_VAL;
             for (size_t i = 0; i < node->as.match_stmt.case_count; i++) {
                 AstNode *case_node = node->as.match_stmt.cases[i]; /* AST_IF node: cond=pattern, then_branch=body */
-                if (match_pattern(interp, case_node->as.if_stmt.cond, val)) {
+                if (interp_match_pattern(interp, case_node->as.if_stmt.cond, val)) {
                     eval_stmt(interp, case_node->as.if_stmt.then_branch);
                     return NIL_VAL;
                 }
@@ -943,7 +1312,13 @@ Value eval_stmt(Interpreter *interp, AstNode *node) {
             return NIL_VAL;
 
         case AST_HPC:
-            /* Execute HPC body in a new scope */
+            if (ast_is_parallel(node)) {
+                Value workers = node->as.hpc.spec_count > 0 ? eval_expr(interp, node->as.hpc.specs[0]) : NIL_VAL;
+                if (interp->throw_flag) return NIL_VAL;
+                interp_run_parallel(interp, node, workers, NULL);
+                return NIL_VAL;
+            }
+            /* The other HPC blocks run their body in place */
             return eval_stmt(interp, node->as.hpc.body);
 
         default:
@@ -967,28 +1342,30 @@ static void eval_comprehension(Interpreter *interp, AstNode *comp, ObjList *resu
     if (clause->type == AST_FOR_CLAUSE) {
         Value iterable = eval_expr(interp, clause->as.for_clause.iter);
         if (interp->throw_flag) return;
-
-        ObjList *list = NULL;
-        ObjTuple *tuple = NULL;
-        ObjString *str = NULL;
-        size_t count = 0;
-        Value *items = NULL;
-
-        if (IS_LIST(iterable)) { list = AS_LIST(iterable); count = list->count; items = list->items; }
-        else if (IS_TUPLE(iterable)) { tuple = AS_TUPLE(iterable); count = tuple->count; items = tuple->items; }
-        else if (IS_STRING(iterable)) { str = AS_STRING(iterable); count = str->length; }
-        else { runtime_error(interp, "Can only iterate over lists, tuples, and strings in comprehensions."); return; }
-
-        for (size_t i = 0; i < count; i++) {
-            Value item = str ? OBJ_VAL(obj_string_copy(&str->chars[i], 1)) : items[i];
-            env_define(interp->env, clause->as.for_clause.var, item);
+        size_t roots = gc_root_depth();
+        gc_push_root(iterable);
+
+        IterCursor cursor;
+        if (!iter_begin(iterable, &cursor)) {
+            runtime_error(interp, "Cannot iterate over %s in a comprehension.", value_type_name(iterable));
+            gc_restore_roots(roots);
+            return;
+        }
+        if (clause_idx == 0 && interp_parallel_comprehension(interp, comp, iterable, result, NULL)) {
+            gc_restore_roots(roots);
+            return;
+        }
+        Value item;
+        while (iter_next(interp, iterable, &cursor, &item)) {
+            interp_write_var(interp, clause->as.for_clause.var_ref, item);
             eval_comprehension(interp, comp, result, clause_idx + 1);
-            if (interp->throw_flag) return;
+            if (interp->throw_flag) break;
         }
+        gc_restore_roots(roots);
     } else if (clause->type == AST_IF_CLAUSE) {
         Value cond = eval_expr(interp, clause->as.if_clause.cond);
         if (interp->throw_flag) return;
-        if (is_truthy(cond)) {
+        if (interp_truthy(cond)) {
             eval_comprehension(interp, comp, result, clause_idx + 1);
         }
     }
@@ -998,7 +1375,9 @@ static void eval_dict_comprehension(Interpreter *interp, AstNode *comp, ObjDict
     if (clause_idx >= comp->as.dict_comprehension.clause_count) {
         Value key = eval_expr(interp, comp->as.dict_comprehension.key);
         if (interp->throw_flag) return;
+        gc_push_root(key);
         Value val = eval_expr(interp, comp->as.dict_comprehension.value);
+        gc_pop_roots(1);
         if (interp->throw_flag) return;
         if (!IS_STRING(key)) { runtime_error(interp, "Dict comprehension keys must be strings."); return; }
         dict_set(result, AS_STRING(key), val);
@@ -1009,50 +1388,320 @@ static void eval_dict_comprehension(Interpreter *interp, AstNode *comp, ObjDict
     if (clause->type == AST_FOR_CLAUSE) {
         Value iterable = eval_expr(interp, clause->as.for_clause.iter);
         if (interp->throw_flag) return;
-
-        ObjList *list = NULL;
-        ObjTuple *tuple = NULL;
-        ObjString *str = NULL;
-        size_t count = 0;
-        Value *items = NULL;
-
-        if (IS_LIST(iterable)) { list = AS_LIST(iterable); count = list->count; items = list->items; }
-        else if (IS_TUPLE(iterable)) { tuple = AS_TUPLE(iterable); count = tuple->count; items = tuple->items; }
-        else if (IS_STRING(iterable)) { str = AS_STRING(iterable); count = str->length; }
-        else { runtime_error(interp, "Can only iterate over lists, tuples, and strings in comprehensions."); return; }
-
-        for (size_t i = 0; i < count; i++) {
-            Value item = str ? OBJ_VAL(obj_string_copy(&str->chars[i], 1)) : items[i];
-            env_define(interp->env, clause->as.for_clause.var, item);
+        size_t roots = gc_root_depth();
+        gc_push_root(iterable);
+
+        IterCursor cursor;
+        if (!iter_begin(iterable, &cursor)) {
+            runtime_error(interp, "Cannot iterate over %s in a comprehension.", value_type_name(iterable));
+            gc_restore_roots(roots);
+            return;
+        }
+        Value item;
+        while (iter_next(interp, iterable, &cursor, &item)) {
+            interp_write_var(interp, clause->as.for_clause.var_ref, item);
             eval_dict_comprehension(interp, comp, result, clause_idx + 1);
-            if (interp->throw_flag) return;
+            if (interp->throw_flag) break;
         }
+        gc_restore_roots(roots);
     } else if (clause->type == AST_IF_CLAUSE) {
         Value cond = eval_expr(interp, clause->as.if_clause.cond);
         if (interp->throw_flag) return;
-        if (is_truthy(cond)) {
+        if (interp_truthy(cond)) {
             eval_dict_comprehension(interp, comp, result, clause_idx + 1);
         }
     }
 }
 
+/* ========================================================================= */
+/* Parallel blocks                                                           */
+/* ========================================================================= */
+
+/* `<| ((n)) [[ body ]] |>` runs the body once on each of n workers from the
+   shared pool and waits for all of them.  Every worker gets an interpreter
+   context of its own (see interpreter_init_context) and a fresh local
+   scope for the body; names bound outside the block are shared. */
+typedef struct {
+    Interpreter context;
+    Interpreter *parent;
+    AstNode *node;
+    struct Chunk *chunk;            /* compiled body under the VM, else NULL */
+    Environment *enclosing;
+    Task task;
+} ParallelWorker;
+
+static void run_block(Interpreter *interp, void *arg) {
+    ParallelWorker *worker = (ParallelWorker *)arg;
+    Environment *scope = env_enter(&interp->frames, worker->enclosing, &worker->node->as.hpc.scope);
+    interp->env = scope;
+    if (worker->chunk) vm_run_chunk(interp, worker->chunk, worker->node->line);
+    else eval_stmt(interp, worker->node->as.hpc.body);
+    env_leave(&interp->frames, scope);
+    interp->env = interp->globals;
+}
+
+static void run_worker(void *arg) {
+    ParallelWorker *worker = (ParallelWorker *)arg;
+    interpreter_run_context(&worker->context, run_block, worker);
+}
+
+void interp_run_parallel(Interpreter *interp, AstNode *node, Value workers, struct Chunk *body) {
+    ThreadPool *pool = scheduler_pool();
+    size_t count;
+    if (IS_NIL(workers)) {
+        count = thread_pool_size(pool);
+    } else if (IS_NUMBER(workers) && AS_NUMBER(workers) >= 0 && AS_NUMBER(workers) <= 65536 &&
+               AS_NUMBER(workers) == floor(AS_NUMBER(workers))) {
+        count = (size_t)AS_NUMBER(workers);
+    } else {
+        runtime_error_node(interp, node, "Parallel block needs a whole number of workers, got %s.",
+                           value_type_name(workers));
+        return;
+    }
+    if (count == 0) return;
+
+    ParallelWorker *group = (ParallelWorker *)calloc(count, sizeof(ParallelWorker));
+    if (!group) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < count; i++) {
+        ParallelWorker *worker = &group[i];
+        interpreter_init_context(&worker->context, interp);
+        worker->context.worker_id = (int)i;
+        worker->parent = interp;
+        worker->node = node;
+        worker->chunk = body;
+        worker->enclosing = interp->env;
+        task_init(&worker->task, run_worker, worker);
+    }
+
+    /* The calling thread takes worker 0 itself.  While it waits for the
+       rest it is in a safe region: collections triggered by the workers
+       need not wait for it, and it holds nothing unrooted. */
+    for (size_t i = 1; i < count; i++) thread_pool_spawn(pool, &group[i].task);
+    run_worker(&group[0]);
+    gc_safe_enter();
+    for (size_t i = 1; i < count; i++) thread_pool_join(pool, &group[i].task);
+    gc_safe_leave();
+
+    /* The first failing worker, by index, reports the error */
+    for (size_t i = 0; i < count; i++) {
+        Interpreter *context = &group[i].context;
+        if (context->throw_flag && !interp->throw_flag) runtime_error(interp, "%s", context->error_msg);
+        interpreter_free_context(context);
+    }
+    free(group);
+}
+
+/* ========================================================================= */
+/* Parallel comprehensions                                                   */
+/* ========================================================================= */
+
+/* A pure comprehension (see ast_analyze_comprehension) over at least this
+   many items has them split into chunks that pool workers claim in order.
+   Each worker evaluates the remaining clauses with the loop variable in a
+   private copy of its scope, appending to a list per chunk; the lists are
+   concatenated in order at the end. */
+#define PARALLEL_COMPREHENSION_MIN 1024
+#define COMPREHENSION_CHUNKS_PER_WORKER 4
+
+typedef struct {
+    AstNode *node;
+    struct Chunk *rest;             /* compiled clauses after the first, under the VM */
+    Environment *scope;             /* the scope holding the loop variable */
+    Value iterable;
+    size_t count;
+    Value *parts;                   /* one list per chunk, pinned as roots */
+    size_t chunk_size;
+    size_t chunk_count;
+    atomic_size_t next_chunk;
+    atomic_int failed;
+    pthread_mutex_t error_lock;
+    size_t error_index;
+    char *error_msg;
+} ComprehensionJob;
+
+typedef struct {
+    ComprehensionJob *job;
+    Interpreter context;
+    Task task;
+} ComprehensionTask;
+
+static void comprehension_failed(ComprehensionJob *job, Interpreter *interp, size_t index) {
+    pthread_mutex_lock(&job->error_lock);
+    if (!job->error_msg || index < job->error_index) {
+        free(job->error_msg);
+        job->error_msg = strdup(interp->error_msg ? interp->error_msg : "unknown error");
+        job->error_index = index;
+    }
+    pthread_mutex_unlock(&job->error_lock);
+    atomic_store(&job->failed, 1);
+}
+
+static void run_comprehension_chunks(Interpreter *interp, void *arg) {
+    ComprehensionJob *job = (ComprehensionJob *)arg;
+    VarRef var = job->node->as.comprehension.clauses[0]->as.for_clause.var_ref;
+
+    /* Nothing else in the scope changes, so a copy taken now stays exact.
+       A copy of the globals shares their name index. */
+    Environment globals;
+    Environment *scope = NULL;
+    if (var.depth == VAR_GLOBAL) {
+        globals = *job->scope;
+        globals.slots = (Value *)malloc(sizeof(Value) * (job->scope->count ? job->scope->count : 1));
+        if (!globals.slots) {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+        memcpy(globals.slots, job->scope->slots, sizeof(Value) * job->scope->count);
+        globals.capacity = globals.count;
+        globals.gc_epoch = 0;
+        globals.gc_young_epoch = 0;
+        globals.gc_next = NULL;
+        interp->globals = interp->env = &globals;
+    } else {
+        scope = env_enter(&interp->frames, job->scope->enclosing, job->scope->scope);
+        memcpy(scope->slots, job->scope->slots, sizeof(Value) * job->scope->count);
+        interp->env = scope;
+    }
+
+    while (!atomic_load(&job->failed)) {
+        size_t chunk = atomic_fetch_add(&job->next_chunk, 1);
+        if (chunk >= job->chunk_count) break;
+        size_t begin = chunk * job->chunk_size;
+        size_t end = begin + job->chunk_size < job->count ? begin + job->chunk_size : job->count;
+        ObjList *part = AS_LIST(job->parts[chunk]);
+        for (size_t i = begin; i < end; i++) {
+            interp_write_var(interp, var, iter_item(job->iterable, i));
+            if (job->rest) vm_run_comprehension(interp, job->rest, part);
+            else eval_comprehension(interp, job->node, part, 1);
+            if (interp->throw_flag) {
+                comprehension_failed(job, interp, i);
+                break;
+            }
+        }
+    }
+
+    if (scope) {
+        env_leave(&interp->frames, scope);
+    } else {
+        interp->globals = job->scope;
+        free(globals.slots);
+    }
+    interp->env = interp->globals;
+}
+
+static void run_comprehension_task(void *arg) {
+    ComprehensionTask *task = (ComprehensionTask *)arg;
+    interpreter_run_context(&task->context, run_comprehension_chunks, task->job);
+}
+
+/* Every callee must still be a pure native: the names are read once here,
+   and nothing the comprehension runs can rebind them. */
+static int comprehension_callees_pure(Interpreter *interp, AstNode *node) {
+    for (size_t i = 0; i < node->as.comprehension.callee_count; i++) {
+        AstNode *callee = node->as.comprehension.callees[i];
+        Value fn;
+        if (!interp_read_var(interp, callee->as.identifier.ref, callee->as.identifier.key, &fn)) return 0;
+        if (!IS_NATIVE(fn) || !AS_NATIVE(fn)->pure) return 0;
+    }
+    return 1;
+}
+
+int interp_parallel_comprehension(Interpreter *interp, AstNode *node, Value iterable, ObjList *result,
+                                  struct Chunk *rest) {
+    if (node->type != AST_COMPREHENSION || !node->as.comprehension.pure) return 0;
+    size_t count;
+    if (!iter_count(iterable, &count) || count < PARALLEL_COMPREHENSION_MIN) return 0;
+
+    VarRef var = node->as.comprehension.clauses[0]->as.for_clause.var_ref;
+    if (var.depth != VAR_GLOBAL && var.depth != 0) return 0;
+    if (var.depth == VAR_GLOBAL ? interp->env != interp->globals : interp->env == interp->globals) return 0;
+    if (!comprehension_callees_pure(interp, node)) return 0;
+    ThreadPool *pool = scheduler_pool();
+    size_t workers = thread_pool_size(pool);
+    if (workers < 2) return 0;
+
+    ComprehensionJob job;
+    job.node = node;
+    job.rest = rest;
+    job.scope = interp->env;
+    job.iterable = iterable;
+    job.count = count;
+    size_t chunks = workers * COMPREHENSION_CHUNKS_PER_WORKER;
+    if (chunks > count) chunks = count;
+    job.chunk_size = (count + chunks - 1) / chunks;
+    job.chunk_count = (count + job.chunk_size - 1) / job.chunk_size;
+    atomic_init(&job.next_chunk, 0);
+    atomic_init(&job.failed, 0);
+    pthread_mutex_init(&job.error_lock, NULL);
+    job.error_msg = NULL;
+
+    /* Temporary roots stay where they are, so the workers may hold them */
+    size_t roots = gc_root_depth();
+    gc_push_root(iterable);
+    gc_push_root(OBJ_VAL(result));
+    job.parts = (Value *)malloc(sizeof(Value) * job.chunk_count);
+    size_t task_count = workers < job.chunk_count ? workers : job.chunk_count;
+    ComprehensionTask *tasks = (ComprehensionTask *)calloc(task_count, sizeof(ComprehensionTask));
+    if (!job.parts || !tasks) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < job.chunk_count; i++) {
+        job.parts[i] = OBJ_VAL(obj_list_new());
+        gc_push_root(job.parts[i]);
+    }
+    for (size_t i = 0; i < task_count; i++) {
+        tasks[i].job = &job;
+        interpreter_init_context(&tasks[i].context, interp);
+        tasks[i].context.worker_id = (int)i;
+        task_init(&tasks[i].task, run_comprehension_task, &tasks[i]);
+    }
+
+    for (size_t i = 1; i < task_count; i++) thread_pool_spawn(pool, &tasks[i].task);
+    run_comprehension_task(&tasks[0]);
+    gc_safe_enter();
+    for (size_t i = 1; i < task_count; i++) thread_pool_join(pool, &tasks[i].task);
+    gc_safe_leave();
+    for (size_t i = 0; i < task_count; i++) interpreter_free_context(&tasks[i].context);
+    free(tasks);
+    pthread_mutex_destroy(&job.error_lock);
+
+    /* The loop variable ends where a sequential run would leave it */
+    interp_write_var(interp, var, iter_item(iterable, job.error_msg ? job.error_index : count - 1));
+    if (job.error_msg) {
+        runtime_error(interp, "%s", job.error_msg);
+        free(job.error_msg);
+    } else {
+        for (size_t i = 0; i < job.chunk_count; i++) {
+            ObjList *part = AS_LIST(job.parts[i]);
+            for (size_t j = 0; j < part->count; j++) value_array_write(result, part->items[j]);
+        }
+    }
+    free(job.parts);
+    gc_restore_roots(roots);
+    return 1;
+}
+
 /* ========================================================================= */
 /* Pattern matching                                                          */
 /* ========================================================================= */
 
-static int match_pattern(Interpreter *interp, AstNode *pattern, Value value) {
+int interp_match_pattern(Interpreter *interp, AstNode *pattern, Value value) {
     switch (pattern->type) {
         case AST_NUMBER:
             return IS_NUMBER(value) && AS_NUMBER(value) == pattern->as.number.value;
         case AST_STRING:
-            return IS_STRING(value) && strcmp(AS_STRING(value)->chars, pattern->as.string.value) == 0;
+            return IS_STRING(value) && strcmp(string_chars(AS_STRING(value)), pattern->as.string.value) == 0;
         case AST_BOOL:
             return IS_BOOL(value) && AS_BOOL(value) == pattern->as.boolean.value;
         case AST_NIL:
             return IS_NIL(value);
         case AST_IDENTIFIER:
             /* Binding pattern: always matches, binds the value */
-            env_define(interp->env, pattern->as.identifier.name, value);
+            interp_write_var(interp, pattern->as.identifier.ref, value);
             return 1;
         case AST_TUPLE: {
             if (!IS_TUPLE(value) && !IS_LIST(value)) return 0;
@@ -1060,7 +1709,7 @@ static int match_pattern(Interpreter *interp, AstNode *pattern, Value value) {
             Value *items = IS_TUPLE(value) ? AS_TUPLE(value)->items : AS_LIST(value)->items;
             if (count != pattern->as.tuple.count) return 0;
             for (size_t i = 0; i < count; i++) {
-                if (!match_pattern(interp, pattern->as.tuple.elements[i], items[i])) return 0;
+                if (!interp_match_pattern(interp, pattern->as.tuple.elements[i], items[i])) return 0;
             }
             return 1;
         }
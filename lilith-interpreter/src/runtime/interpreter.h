@@ -9,12 +9,23 @@
 /* Interpreter state                                                         */
 /* -------------------------------------------------------------------------- */
 
+/* Execution engine selected with --engine=ast|vm */
+typedef enum {
+    ENGINE_AST,
+    ENGINE_VM,
+} Engine;
+
+struct Vm;
+struct Chunk;
+
 typedef struct Interpreter {
     Environment *globals;
     Environment *env;
+    EnvStack frames;                /* call and catch scopes, see env_enter */
 
     /* Control-flow flags */
     int return_flag;
+    Value return_value;             /* set together with return_flag */
     int break_flag;
     int continue_flag;
     int throw_flag;
@@ -22,20 +33,94 @@ typedef struct Interpreter {
 
     /* Current function for return-type checking */
     ObjFunction *current_function;
+
+    /* Bytecode engine state, created lazily when engine == ENGINE_VM */
+    Engine engine;
+    struct Vm *vm;
+
+    /* Index of this worker in its parallel block, 0 outside one */
+    int worker_id;
 } Interpreter;
 
+/* Nothing in the runtime is global to the process except the collector,
+   which serves every thread.  Separate interpreters may run on separate
+   threads at once.  To run more code of one program on another thread,
+   that thread takes a context: it shares the owner's globals and engine
+   and has scopes, control flags, error and VM state of its own.  The
+   owner must outlive its contexts.  interpreter_run_context runs `fn` on
+   the calling thread with the context current, attached to the collector
+   and rooted; it may be called more than once per context. */
+typedef void (*ContextFn)(Interpreter *context, void *arg);
+
 /* -------------------------------------------------------------------------- */
 /* Public API                                                                */
 /* -------------------------------------------------------------------------- */
 
 void interpreter_init(Interpreter *interp);
 void interpreter_free(Interpreter *interp);
+void interpreter_init_context(Interpreter *context, Interpreter *owner);
+void interpreter_run_context(Interpreter *context, ContextFn fn, void *arg);
+void interpreter_free_context(Interpreter *context);
+
+/* Root callback for an interpreter or context, for contexts kept across
+   calls to anything but interpreter_run_context */
+void interp_mark_roots(void *interp);
 Value interpreter_run(Interpreter *interp, AstNode *program);
 
+/* The interpreter running on the calling thread, NULL if none */
+Interpreter *interpreter_current(void);
+
+/* The event loop switches it along with the running coroutine */
+void interpreter_set_current(Interpreter *interp);
+
 Value eval_expr(Interpreter *interp, AstNode *node);
 Value eval_stmt(Interpreter *interp, AstNode *node);
 
 /* Error handling */
 void runtime_error(Interpreter *interp, const char *fmt, ...);
+void runtime_error_at(Interpreter *interp, size_t line, const char *fmt, ...);
+
+/* -------------------------------------------------------------------------- */
+/* Shared semantics — used by both the tree-walker and the bytecode VM so    */
+/* that the two engines cannot drift apart.                                   */
+/* -------------------------------------------------------------------------- */
+
+int   interp_truthy(Value value);
+int   interp_check_type(Value value, const char *type_name);
+int   interp_lookup_method(ObjClass *klass, ObjString *name, Value *out);
+int   interp_lookup_init(ObjClass *klass, Value *out);
+Value interp_str_concat(Value a, Value b);
+Value interp_binary(Interpreter *interp, int op, Value left, Value right, size_t line);
+Value interp_get_member(Interpreter *interp, Value obj, ObjString *name, size_t line);
+Value interp_set_member(Interpreter *interp, Value obj, ObjString *name, Value value, size_t line);
+Value interp_get_index(Interpreter *interp, Value obj, Value idx, size_t line);
+Value interp_set_index(Interpreter *interp, Value obj, Value idx, Value value, size_t line);
+Value interp_list_to_set(ObjList *result);
+ObjFunction *interp_make_function(Interpreter *interp, AstNode *node);
+int   interp_read_var(Interpreter *interp, VarRef ref, ObjString *name, Value *out);
+void  interp_write_var(Interpreter *interp, VarRef ref, Value value);
+Environment *interp_call_env(Interpreter *interp, ObjFunction *fn);
+int   interp_match_pattern(Interpreter *interp, AstNode *pattern, Value value);
+void  interp_run_parallel(Interpreter *interp, AstNode *node, Value workers, struct Chunk *body);
+
+/* Evaluate a pure comprehension over `iterable`, its first clause's
+   evaluated iterable, on pool workers, appending to `result`.  Returns 0
+   without doing anything when it is not worth it (small input, one worker)
+   or not safe; the caller then loops as usual.  `rest` holds the remaining
+   clauses compiled for the VM, NULL under the tree-walker. */
+int   interp_parallel_comprehension(Interpreter *interp, AstNode *node, Value iterable, ObjList *result,
+                                    struct Chunk *rest);
+
+/* Call a function, native or class from native code with `argc` arguments
+   and run it to completion under the interpreter's engine.  The calling
+   native's pins are lifted meanwhile (see gc_pin_suspend): objects it holds
+   must be temporary roots.  On error throw_flag is set and nil returned.
+   Calling an async function returns its future (see future.h), calling a
+   generator function its generator (see generator.h). */
+Value interp_call(Interpreter *interp, Value callee, int argc, Value *args);
+
+/* As interp_call, but an async function runs to completion in place and
+   a generator function runs its body, which yields only on its fiber */
+Value interp_call_direct(Interpreter *interp, Value callee, int argc, Value *args);
 
 #endif
@@ -0,0 +1,113 @@
+#include "iterator.h"
+#include "gc.h"
+#include "generator.h"
+#include "array.h"
+
+/* ========================================================================= */
+/* Cursors                                                                   */
+/* ========================================================================= */
+
+bool iter_begin(Value seq, IterCursor *cursor) {
+    cursor->index = 0;
+    if (iter_count(seq, &cursor->limit)) return true;
+    /* A dict's cursor is an entry, its limit the epoch the walk began in */
+    if (IS_DICT(seq)) cursor->limit = AS_DICT(seq)->epoch;
+    else if (IS_ENTRIES(seq)) cursor->limit = AS_ENTRIES(seq)->dict->epoch;
+    else if (IS_GENERATOR(seq)) cursor->limit = 0;
+    else return false;
+    return true;
+}
+
+/* The next live entry at or after the cursor, or NULL at the end.  Keys
+   added meanwhile are walked too, until the dict grows and renumbers. */
+static DictEntry *next_entry(Interpreter *interp, ObjDict *dict, IterCursor *cursor) {
+    if (dict->epoch != cursor->limit) {
+        runtime_error(interp, "Dictionary changed size during iteration.");
+        return NULL;
+    }
+    while (cursor->index < dict->used) {
+        DictEntry *entry = &dict->entries[cursor->index++];
+        if (entry->key) return entry;
+    }
+    return NULL;
+}
+
+int iter_next(Interpreter *interp, Value seq, IterCursor *cursor, Value *out) {
+    if (IS_LIST(seq)) {
+        ObjList *list = AS_LIST(seq);
+        if (cursor->index >= cursor->limit || cursor->index >= list->count) return 0;
+        *out = list->items[cursor->index++];
+        return 1;
+    }
+    if (IS_DICT(seq)) {
+        DictEntry *entry = next_entry(interp, AS_DICT(seq), cursor);
+        if (!entry) return 0;
+        *out = OBJ_VAL(entry->key);
+        return 1;
+    }
+    if (IS_ENTRIES(seq)) {
+        if (!next_entry(interp, AS_ENTRIES(seq)->dict, cursor)) return 0;
+        /* The view stays where it is, the dict it points at may move */
+        size_t roots = gc_root_depth();
+        gc_push_root(seq);
+        ObjTuple *tuple = obj_tuple_new(2);
+        DictEntry *entry = &AS_ENTRIES(seq)->dict->entries[cursor->index - 1];
+        tuple->items[0] = OBJ_VAL(entry->key);
+        tuple->items[1] = entry->value;
+        gc_write_barrier((Obj *)tuple, tuple->items[0]);
+        gc_write_barrier((Obj *)tuple, tuple->items[1]);
+        gc_restore_roots(roots);
+        *out = OBJ_VAL(tuple);
+        return 1;
+    }
+    if (IS_GENERATOR(seq)) return generator_next(interp, seq, out);
+    if (cursor->index >= cursor->limit) return 0;
+    *out = iter_item(seq, cursor->index++);
+    return 1;
+}
+
+/* ========================================================================= */
+/* Random access                                                             */
+/* ========================================================================= */
+
+bool iter_count(Value seq, size_t *count) {
+    if (IS_LIST(seq)) *count = AS_LIST(seq)->count;
+    else if (IS_TUPLE(seq)) *count = AS_TUPLE(seq)->count;
+    else if (IS_STRING(seq)) *count = AS_STRING(seq)->length;
+    else if (IS_RANGE(seq)) *count = AS_RANGE(seq)->count;
+    else if (IS_ARRAY(seq)) *count = AS_ARRAY(seq)->count;
+    else return false;
+    return true;
+}
+
+Value iter_item(Value seq, size_t index) {
+    if (IS_LIST(seq)) return AS_LIST(seq)->items[index];
+    if (IS_TUPLE(seq)) return AS_TUPLE(seq)->items[index];
+    if (IS_RANGE(seq)) return NUMBER_VAL(AS_RANGE(seq)->start + (double)index * AS_RANGE(seq)->step);
+    if (IS_ARRAY(seq)) return NUMBER_VAL(array_get(AS_ARRAY(seq), index));
+    return OBJ_VAL(obj_string_byte((unsigned char)string_bytes(AS_STRING(seq))[index]));
+}
+
+/* ========================================================================= */
+/* Natives                                                                   */
+/* ========================================================================= */
+
+ObjList *iter_collect(Interpreter *interp, Value seq) {
+    IterCursor cursor;
+    if (!iter_begin(seq, &cursor)) {
+        runtime_error(interp, "Cannot iterate over %s.", value_type_name(seq));
+        return NULL;
+    }
+    size_t roots = gc_root_depth();
+    gc_push_root(seq);
+    ObjList *list = obj_list_new();
+    gc_push_root(OBJ_VAL(list));
+
+    int pins = gc_pin_suspend();
+    Value item;
+    while (iter_next(interp, seq, &cursor, &item)) value_array_write(list, item);
+    gc_pin_resume(pins);
+    gc_restore_roots(roots);
+    /* Nothing is collected again until the native returns */
+    return interp->throw_flag ? NULL : list;
+}
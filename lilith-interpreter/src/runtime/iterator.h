@@ -0,0 +1,40 @@
+#ifndef LILITH_ITERATOR_H
+#define LILITH_ITERATOR_H
+
+#include "interpreter.h"
+
+/* -------------------------------------------------------------------------- */
+/* Iteration — what for loops, comprehensions and natives walk                */
+/* -------------------------------------------------------------------------- */
+
+/* Lists, tuples, strings and numeric arrays yield their items, ranges
+   their numbers (computed, never stored), dicts their keys and entry
+   views (key,, value) tuples, both read straight off the entry array, and
+   generators whatever their body yields.
+
+   A cursor is two counters, so the VM keeps it in its loop slots.  A list
+   is walked up to the length it had when the loop began, or less if it
+   shrank; a dict that grows meanwhile raises an error. */
+typedef struct {
+    size_t index;
+    size_t limit;
+} IterCursor;
+
+/* Start walking `seq`; false when it is not iterable */
+bool iter_begin(Value seq, IterCursor *cursor);
+
+/* The next item into `out`; returns 0 once done, or after raising an error
+   on `interp`.  `seq` must be a temporary root or on the VM stack, and may
+   collect (strings, entries and generators allocate). */
+int iter_next(Interpreter *interp, Value seq, IterCursor *cursor, Value *out);
+
+/* Sequences whose items can be had in any order: lists, tuples, strings,
+   ranges and arrays.  iter_item may allocate. */
+bool  iter_count(Value seq, size_t *count);
+Value iter_item(Value seq, size_t index);
+
+/* A new list of every item, for natives; NULL after raising an error.
+   Lifts the native's pins while a generator runs. */
+ObjList *iter_collect(Interpreter *interp, Value seq);
+
+#endif
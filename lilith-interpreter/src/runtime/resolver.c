@@ -0,0 +1,552 @@
+#define _GNU_SOURCE
+#include "resolver.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ========================================================================= */
+/* Name lists                                                                */
+/* ========================================================================= */
+
+typedef struct {
+    char **items;
+    size_t count;
+    size_t capacity;
+} NameList;
+
+static int names_index(const NameList *list, const char *name) {
+    for (size_t i = 0; i < list->count; i++) {
+        if (strcmp(list->items[i], name) == 0) return (int)i;
+    }
+    return -1;
+}
+
+static int names_append(NameList *list, char *name) {
+    if (list->count + 1 > list->capacity) {
+        list->capacity = list->capacity < 8 ? 8 : list->capacity * 2;
+        list->items = (char **)realloc(list->items, sizeof(char *) * list->capacity);
+        if (!list->items) {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+    }
+    list->items[list->count] = name;
+    return (int)list->count++;
+}
+
+static int names_add(NameList *list, char *name) {
+    int index = names_index(list, name);
+    return index >= 0 ? index : names_append(list, name);
+}
+
+/* ========================================================================= */
+/* Scopes                                                                    */
+/* ========================================================================= */
+
+typedef struct ResolverScope {
+    AstScope *scope;                 /* NULL for the global scope */
+    NameList names;                  /* slot names of a local scope */
+    NameList assigned;               /* assignment targets collected in pass 1 */
+    int function;                    /* a function or lambda body */
+    struct ResolverScope *enclosing;
+} ResolverScope;
+
+typedef struct {
+    Environment *globals;
+    NameList global_names;           /* names the program binds at top level */
+} Resolver;
+
+static void declare_stmt(ResolverScope *s, AstNode *node);
+static void declare_expr(ResolverScope *s, AstNode *node);
+static void resolve_stmt(Resolver *r, ResolverScope *s, AstNode *node);
+static void resolve_expr(Resolver *r, ResolverScope *s, AstNode *node);
+
+/* The interned `chars`, kept alive with the globals for the AST to cache */
+static ObjString *resolve_key(Resolver *r, const char *chars) {
+    ObjString *key = obj_string_intern(chars, strlen(chars));
+    dict_set(r->globals->keys, key, BOOL_VAL(1));
+    return key;
+}
+
+/* The index holds on to the name of every global */
+static int global_slot(Resolver *r, const char *name) {
+    return env_global_slot(r->globals, obj_string_intern(name, strlen(name)));
+}
+
+static int bound_in(Resolver *r, ResolverScope *s, const char *name) {
+    for (; s; s = s->enclosing) {
+        if (!s->scope) {
+            Value unused;
+            if (names_index(&r->global_names, name) >= 0) return 1;
+            return env_get(r->globals, obj_string_intern(name, strlen(name)), &unused);
+        }
+        if (names_index(&s->names, name) >= 0) return 1;
+    }
+    return 0;
+}
+
+/* After pass 1: assigned names that no enclosing scope binds are local. */
+static void finish_declarations(Resolver *r, ResolverScope *s) {
+    for (size_t i = 0; i < s->assigned.count; i++) {
+        char *name = s->assigned.items[i];
+        if (!s->scope) {
+            names_add(&r->global_names, name);
+            global_slot(r, name);
+        } else if (names_index(&s->names, name) < 0 && !bound_in(r, s->enclosing, name)) {
+            names_append(&s->names, name);
+        }
+    }
+    free(s->assigned.items);
+    s->assigned.items = NULL;
+    s->assigned.count = s->assigned.capacity = 0;
+}
+
+/* A name defined in the current scope (for variables, definitions, pattern
+   bindings). */
+static void declare(ResolverScope *s, char *name) {
+    names_add(s->scope ? &s->names : &s->assigned, name);
+}
+
+static VarRef lookup(Resolver *r, ResolverScope *s, const char *name) {
+    VarRef ref;
+    int depth = 0;
+    for (; s->scope; s = s->enclosing, depth++) {
+        int slot = names_index(&s->names, name);
+        if (slot >= 0) {
+            ref.depth = depth;
+            ref.slot = slot;
+            return ref;
+        }
+    }
+    ref.depth = VAR_GLOBAL;
+    ref.slot = global_slot(r, name);
+    return ref;
+}
+
+static VarRef define_ref(Resolver *r, ResolverScope *s, char *name) {
+    if (!s->scope) {
+        VarRef ref = { VAR_GLOBAL, global_slot(r, name) };
+        return ref;
+    }
+    VarRef ref = { 0, names_add(&s->names, name) };
+    return ref;
+}
+
+static void finish_scope(ResolverScope *s) {
+    s->scope->names = s->names.items;
+    s->scope->count = s->names.count;
+}
+
+/* A yield makes the function it is in a generator; yielding from a catch
+   or parallel body still belongs to the function around it. */
+static void mark_generator(ResolverScope *s) {
+    while (s && s->scope && !s->function) s = s->enclosing;
+    if (s && s->scope) s->scope->generator = 1;
+}
+
+/* Closures keep every enclosing scope alive. */
+static void mark_captured(ResolverScope *s) {
+    for (; s && s->scope; s = s->enclosing) s->scope->captured = 1;
+}
+
+/* ========================================================================= */
+/* Pass 1: declarations                                                      */
+/* ========================================================================= */
+
+static void declare_target(ResolverScope *s, AstNode *target) {
+    if (!target) return;
+    switch (target->type) {
+        case AST_IDENTIFIER:
+            names_add(&s->assigned, target->as.identifier.name);
+            break;
+        case AST_TUPLE:
+            for (size_t i = 0; i < target->as.tuple.count; i++) {
+                if (target->as.tuple.elements[i]->type == AST_IDENTIFIER)
+                    names_add(&s->assigned, target->as.tuple.elements[i]->as.identifier.name);
+            }
+            break;
+        default:
+            declare_expr(s, target);
+            break;
+    }
+}
+
+static void declare_pattern(ResolverScope *s, AstNode *pattern) {
+    if (pattern->type == AST_IDENTIFIER) {
+        declare(s, pattern->as.identifier.name);
+    } else if (pattern->type == AST_TUPLE) {
+        for (size_t i = 0; i < pattern->as.tuple.count; i++) declare_pattern(s, pattern->as.tuple.elements[i]);
+    }
+}
+
+static void declare_clauses(ResolverScope *s, AstNode **clauses, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        AstNode *clause = clauses[i];
+        if (clause->type == AST_FOR_CLAUSE) {
+            declare(s, clause->as.for_clause.var);
+            declare_expr(s, clause->as.for_clause.iter);
+        } else if (clause->type == AST_IF_CLAUSE) {
+            declare_expr(s, clause->as.if_clause.cond);
+        }
+    }
+}
+
+static void declare_expr(ResolverScope *s, AstNode *node) {
+    if (!node) return;
+    switch (node->type) {
+        case AST_BINARY:
+            declare_expr(s, node->as.binary.left);
+            declare_expr(s, node->as.binary.right);
+            break;
+        case AST_UNARY:
+            declare_expr(s, node->as.unary.operand);
+            break;
+        case AST_CALL:
+            declare_expr(s, node->as.call.callee);
+            for (size_t i = 0; i < node->as.call.arg_count; i++) declare_expr(s, node->as.call.args[i]);
+            break;
+        case AST_MEMBER:
+            declare_expr(s, node->as.member.object);
+            break;
+        case AST_INDEX:
+            declare_expr(s, node->as.index.object);
+            declare_expr(s, node->as.index.index);
+            break;
+        case AST_CONDITIONAL:
+            declare_expr(s, node->as.conditional.cond);
+            declare_expr(s, node->as.conditional.then_branch);
+            declare_expr(s, node->as.conditional.else_branch);
+            break;
+        case AST_AWAIT:
+            declare_expr(s, node->as.await_expr.value);
+            break;
+        case AST_LIST:
+            for (size_t i = 0; i < node->as.list.count; i++) declare_expr(s, node->as.list.elements[i]);
+            break;
+        case AST_TUPLE:
+            for (size_t i = 0; i < node->as.tuple.count; i++) declare_expr(s, node->as.tuple.elements[i]);
+            break;
+        case AST_DICT:
+            for (size_t i = 0; i < node->as.dict.count; i++) {
+                declare_expr(s, node->as.dict.entries[i]->as.dict_entry.key);
+                declare_expr(s, node->as.dict.entries[i]->as.dict_entry.value);
+            }
+            break;
+        case AST_COMPREHENSION:
+            declare_clauses(s, node->as.comprehension.clauses, node->as.comprehension.clause_count);
+            declare_expr(s, node->as.comprehension.expr);
+            break;
+        case AST_DICT_COMPREHENSION:
+            declare_clauses(s, node->as.dict_comprehension.clauses, node->as.dict_comprehension.clause_count);
+            declare_expr(s, node->as.dict_comprehension.key);
+            declare_expr(s, node->as.dict_comprehension.value);
+            break;
+        default:
+            /* Literals, identifiers and lambdas (their own scope) */
+            break;
+    }
+}
+
+static void declare_stmt(ResolverScope *s, AstNode *node) {
+    if (!node) return;
+    switch (node->type) {
+        case AST_PROGRAM:
+            declare_stmt(s, node->as.program.body);
+            break;
+        case AST_BLOCK:
+            for (size_t i = 0; i < node->as.block.count; i++) declare_stmt(s, node->as.block.stmts[i]);
+            break;
+        case AST_EXPRESSION_STMT:
+            declare_expr(s, node->as.expression_stmt.expr);
+            break;
+        case AST_ASSIGN:
+            declare_expr(s, node->as.assign.value);
+            declare_target(s, node->as.assign.target);
+            break;
+        case AST_IF:
+            declare_expr(s, node->as.if_stmt.cond);
+            declare_stmt(s, node->as.if_stmt.then_branch);
+            declare_stmt(s, node->as.if_stmt.else_branch);
+            break;
+        case AST_WHILE:
+            declare_expr(s, node->as.while_stmt.cond);
+            declare_stmt(s, node->as.while_stmt.body);
+            break;
+        case AST_FOR:
+            declare(s, node->as.for_stmt.var);
+            declare_expr(s, node->as.for_stmt.iter);
+            declare_stmt(s, node->as.for_stmt.body);
+            break;
+        case AST_RETURN:
+            declare_expr(s, node->as.return_stmt.value);
+            break;
+        case AST_YIELD:
+            declare_expr(s, node->as.yield_stmt.value);
+            break;
+        case AST_FUNCTION:
+            declare(s, node->as.function.name);
+            break;
+        case AST_CLASS:
+            declare(s, node->as.class_def.name);
+            break;
+        case AST_TRY:
+            /* The catch body is a scope of its own */
+            declare_stmt(s, node->as.try_stmt.try_body);
+            declare_stmt(s, node->as.try_stmt.finally_body);
+            break;
+        case AST_MATCH:
+            declare_expr(s, node->as.match_stmt.expr);
+            for (size_t i = 0; i < node->as.match_stmt.case_count; i++) {
+                AstNode *case_node = node->as.match_stmt.cases[i];
+                declare_pattern(s, case_node->as.if_stmt.cond);
+                declare_stmt(s, case_node->as.if_stmt.then_branch);
+            }
+            break;
+        case AST_HPC:
+            /* A parallel body is a scope of its own, one per worker */
+            if (ast_is_parallel(node)) {
+                for (size_t i = 0; i < node->as.hpc.spec_count; i++) declare_expr(s, node->as.hpc.specs[i]);
+            } else {
+                declare_stmt(s, node->as.hpc.body);
+            }
+            break;
+        default:
+            declare_expr(s, node);
+            break;
+    }
+}
+
+/* ========================================================================= */
+/* Pass 2: references                                                        */
+/* ========================================================================= */
+
+/* Declare, then resolve, the body of a function, lambda or catch scope whose
+   leading slots (`params`) are already in place. */
+static void resolve_body(Resolver *r, ResolverScope *scope, AstNode *body) {
+    declare_stmt(scope, body);
+    finish_declarations(r, scope);
+    resolve_stmt(r, scope, body);
+    finish_scope(scope);
+    free(scope->assigned.items);
+}
+
+static void resolve_function(Resolver *r, ResolverScope *s, AstNode *node) {
+    ResolverScope scope;
+    memset(&scope, 0, sizeof(scope));
+    scope.enclosing = s;
+    scope.function = 1;
+    mark_captured(s);
+
+    if (node->type == AST_LAMBDA) {
+        scope.scope = &node->as.lambda.scope;
+        free(scope.scope->names);
+        for (size_t i = 0; i < node->as.lambda.param_count; i++) names_append(&scope.names, node->as.lambda.params[i]);
+        resolve_body(r, &scope, node->as.lambda.body);
+    } else {
+        scope.scope = &node->as.function.scope;
+        free(scope.scope->names);
+        for (size_t i = 0; i < node->as.function.param_count; i++) names_append(&scope.names, node->as.function.params[i]);
+        resolve_body(r, &scope, node->as.function.body);
+    }
+}
+
+static void resolve_pattern(Resolver *r, ResolverScope *s, AstNode *pattern) {
+    if (pattern->type == AST_IDENTIFIER) {
+        pattern->as.identifier.ref = define_ref(r, s, pattern->as.identifier.name);
+    } else if (pattern->type == AST_TUPLE) {
+        for (size_t i = 0; i < pattern->as.tuple.count; i++) resolve_pattern(r, s, pattern->as.tuple.elements[i]);
+    }
+}
+
+static void resolve_clauses(Resolver *r, ResolverScope *s, AstNode **clauses, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        AstNode *clause = clauses[i];
+        if (clause->type == AST_FOR_CLAUSE) {
+            resolve_expr(r, s, clause->as.for_clause.iter);
+            clause->as.for_clause.var_ref = define_ref(r, s, clause->as.for_clause.var);
+        } else if (clause->type == AST_IF_CLAUSE) {
+            resolve_expr(r, s, clause->as.if_clause.cond);
+        }
+    }
+}
+
+static void resolve_expr(Resolver *r, ResolverScope *s, AstNode *node) {
+    if (!node) return;
+    switch (node->type) {
+        case AST_STRING:
+            node->as.string.key = resolve_key(r, node->as.string.value);
+            break;
+        case AST_IDENTIFIER:
+            node->as.identifier.ref = lookup(r, s, node->as.identifier.name);
+            node->as.identifier.key = resolve_key(r, node->as.identifier.name);
+            break;
+        case AST_BINARY:
+            resolve_expr(r, s, node->as.binary.left);
+            resolve_expr(r, s, node->as.binary.right);
+            break;
+        case AST_UNARY:
+            resolve_expr(r, s, node->as.unary.operand);
+            break;
+        case AST_CALL:
+            resolve_expr(r, s, node->as.call.callee);
+            for (size_t i = 0; i < node->as.call.arg_count; i++) resolve_expr(r, s, node->as.call.args[i]);
+            break;
+        case AST_MEMBER:
+            resolve_expr(r, s, node->as.member.object);
+            node->as.member.key = resolve_key(r, node->as.member.name);
+            break;
+        case AST_INDEX:
+            resolve_expr(r, s, node->as.index.object);
+            resolve_expr(r, s, node->as.index.index);
+            break;
+        case AST_CONDITIONAL:
+            resolve_expr(r, s, node->as.conditional.cond);
+            resolve_expr(r, s, node->as.conditional.then_branch);
+            resolve_expr(r, s, node->as.conditional.else_branch);
+            break;
+        case AST_AWAIT:
+            resolve_expr(r, s, node->as.await_expr.value);
+            break;
+        case AST_LAMBDA:
+            resolve_function(r, s, node);
+            break;
+        case AST_LIST:
+            for (size_t i = 0; i < node->as.list.count; i++) resolve_expr(r, s, node->as.list.elements[i]);
+            break;
+        case AST_TUPLE:
+            for (size_t i = 0; i < node->as.tuple.count; i++) resolve_expr(r, s, node->as.tuple.elements[i]);
+            break;
+        case AST_DICT:
+            for (size_t i = 0; i < node->as.dict.count; i++) {
+                resolve_expr(r, s, node->as.dict.entries[i]->as.dict_entry.key);
+                resolve_expr(r, s, node->as.dict.entries[i]->as.dict_entry.value);
+            }
+            break;
+        case AST_COMPREHENSION:
+            resolve_clauses(r, s, node->as.comprehension.clauses, node->as.comprehension.clause_count);
+            resolve_expr(r, s, node->as.comprehension.expr);
+            ast_analyze_comprehension(node);
+            break;
+        case AST_DICT_COMPREHENSION:
+            resolve_clauses(r, s, node->as.dict_comprehension.clauses, node->as.dict_comprehension.clause_count);
+            resolve_expr(r, s, node->as.dict_comprehension.key);
+            resolve_expr(r, s, node->as.dict_comprehension.value);
+            break;
+        default:
+            break;
+    }
+}
+
+static void resolve_stmt(Resolver *r, ResolverScope *s, AstNode *node) {
+    if (!node) return;
+    switch (node->type) {
+        case AST_PROGRAM:
+            resolve_stmt(r, s, node->as.program.body);
+            break;
+        case AST_BLOCK:
+            for (size_t i = 0; i < node->as.block.count; i++) resolve_stmt(r, s, node->as.block.stmts[i]);
+            break;
+        case AST_EXPRESSION_STMT:
+            resolve_expr(r, s, node->as.expression_stmt.expr);
+            break;
+        case AST_ASSIGN:
+            resolve_expr(r, s, node->as.assign.value);
+            resolve_expr(r, s, node->as.assign.target);
+            break;
+        case AST_IF:
+            resolve_expr(r, s, node->as.if_stmt.cond);
+            resolve_stmt(r, s, node->as.if_stmt.then_branch);
+            resolve_stmt(r, s, node->as.if_stmt.else_branch);
+            break;
+        case AST_WHILE:
+            resolve_expr(r, s, node->as.while_stmt.cond);
+            resolve_stmt(r, s, node->as.while_stmt.body);
+            break;
+        case AST_FOR:
+            resolve_expr(r, s, node->as.for_stmt.iter);
+            node->as.for_stmt.var_ref = define_ref(r, s, node->as.for_stmt.var);
+            resolve_stmt(r, s, node->as.for_stmt.body);
+            break;
+        case AST_RETURN:
+            resolve_expr(r, s, node->as.return_stmt.value);
+            break;
+        case AST_YIELD:
+            resolve_expr(r, s, node->as.yield_stmt.value);
+            mark_generator(s);
+            break;
+        case AST_FUNCTION:
+            node->as.function.name_ref = define_ref(r, s, node->as.function.name);
+            resolve_function(r, s, node);
+            break;
+        case AST_CLASS:
+            node->as.class_def.name_ref = define_ref(r, s, node->as.class_def.name);
+            if (node->as.class_def.superclass)
+                node->as.class_def.super_key = resolve_key(r, node->as.class_def.superclass);
+            for (size_t i = 0; i < node->as.class_def.method_count; i++) {
+                AstNode *method = node->as.class_def.methods[i];
+                if (method->type == AST_FUNCTION) resolve_function(r, s, method);
+            }
+            break;
+        case AST_TRY: {
+            resolve_stmt(r, s, node->as.try_stmt.try_body);
+            if (node->as.try_stmt.catch_body) {
+                ResolverScope scope;
+                memset(&scope, 0, sizeof(scope));
+                scope.scope = &node->as.try_stmt.catch_scope;
+                scope.enclosing = s;
+                free(scope.scope->names);
+                if (node->as.try_stmt.catch_var) names_append(&scope.names, node->as.try_stmt.catch_var);
+                resolve_body(r, &scope, node->as.try_stmt.catch_body);
+            }
+            resolve_stmt(r, s, node->as.try_stmt.finally_body);
+            break;
+        }
+        case AST_MATCH:
+            resolve_expr(r, s, node->as.match_stmt.expr);
+            for (size_t i = 0; i < node->as.match_stmt.case_count; i++) {
+                AstNode *case_node = node->as.match_stmt.cases[i];
+                resolve_pattern(r, s, case_node->as.if_stmt.cond);
+                resolve_stmt(r, s, case_node->as.if_stmt.then_branch);
+            }
+            break;
+        case AST_HPC:
+            if (ast_is_parallel(node)) {
+                /* Workers are joined before the block ends, so unlike a
+                   closure the body does not keep the enclosing scopes alive */
+                for (size_t i = 0; i < node->as.hpc.spec_count; i++) resolve_expr(r, s, node->as.hpc.specs[i]);
+                ResolverScope scope;
+                memset(&scope, 0, sizeof(scope));
+                scope.scope = &node->as.hpc.scope;
+                scope.enclosing = s;
+                free(scope.scope->names);
+                resolve_body(r, &scope, node->as.hpc.body);
+            } else {
+                resolve_stmt(r, s, node->as.hpc.body);
+            }
+            break;
+        default:
+            resolve_expr(r, s, node);
+            break;
+    }
+}
+
+/* ========================================================================= */
+/* Entry point                                                               */
+/* ========================================================================= */
+
+void resolve_program(Environment *globals, AstNode *program) {
+    if (!program || program->type != AST_PROGRAM || program->as.program.resolved) return;
+
+    Resolver r;
+    memset(&r, 0, sizeof(r));
+    r.globals = globals;
+
+    ResolverScope global;
+    memset(&global, 0, sizeof(global));
+    declare_stmt(&global, program);
+    finish_declarations(&r, &global);
+    resolve_stmt(&r, &global, program);
+
+    free(r.global_names.items);
+    program->as.program.resolved = 1;
+}
@@ -0,0 +1,23 @@
+#ifndef LILITH_RESOLVER_H
+#define LILITH_RESOLVER_H
+
+#include "environment.h"
+#include "parser/ast.h"
+
+/* -------------------------------------------------------------------------- */
+/* Resolver — binds every name to a (depth, slot) pair before execution       */
+/* -------------------------------------------------------------------------- */
+
+/* Scoping follows the tree-walker's rules, decided statically:
+     - function, lambda and catch bodies are scopes; other blocks are not;
+     - parameters, loop and comprehension variables, definitions and pattern
+       bindings belong to the scope they appear in;
+     - an assigned name belongs to the nearest enclosing scope that binds
+       it, otherwise to the scope containing the assignment.
+   Globals get slots in `globals`.  Identifiers, member names and string
+   literals get their interned string, which `globals` keeps alive, so the
+   engines look names up by pointer.  Resolving an already resolved program
+   is a no-op. */
+void resolve_program(Environment *globals, AstNode *program);
+
+#endif
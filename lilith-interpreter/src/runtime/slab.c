@@ -0,0 +1,122 @@
+#include "slab.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void *checked(void *ptr) {
+    if (!ptr) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    return ptr;
+}
+
+#ifdef LILITH_SLAB_ALLOC
+
+/* ========================================================================= */
+/* Size classes                                                              */
+/* ========================================================================= */
+
+#define SLAB_CLASSES   (SLAB_MAX_SIZE / SLAB_GRANULE)
+#define SLAB_SIZE      (64 * 1024)
+
+typedef struct SlabBlock {
+    struct SlabBlock *next;
+} SlabBlock;
+
+typedef struct Slab {
+    struct Slab *next;
+    unsigned char *data;
+} Slab;
+
+typedef struct {
+    SlabBlock *free;                /* blocks given back */
+    unsigned char *top;             /* carving position in the newest slab */
+    unsigned char *end;
+} SizeClass;
+
+/* Each thread carves and recycles through its own classes, so the fast
+   paths take no lock.  A block freed by another thread (the collector
+   sweeping) simply joins that thread's free list. */
+static _Thread_local SizeClass classes[SLAB_CLASSES];
+static Slab *slabs = NULL;          /* all slabs, kept reachable */
+static pthread_mutex_t slabs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline size_t class_of(size_t size) {
+    return size == 0 ? 0 : (size - 1) / SLAB_GRANULE;
+}
+
+/* Blocks are carved from a fresh slab on demand, so a class only takes
+   memory once it is used. */
+static void *carve(SizeClass *c, size_t block_size) {
+    if (c->top + block_size > c->end) {
+        Slab *slab = (Slab *)checked(malloc(sizeof(Slab) + SLAB_SIZE + SLAB_GRANULE));
+        pthread_mutex_lock(&slabs_lock);
+        slab->next = slabs;
+        slabs = slab;
+        pthread_mutex_unlock(&slabs_lock);
+        uintptr_t data = ((uintptr_t)(slab + 1) + SLAB_GRANULE - 1) & ~(uintptr_t)(SLAB_GRANULE - 1);
+        slab->data = (unsigned char *)data;
+        c->top = slab->data;
+        c->end = slab->data + SLAB_SIZE;
+    }
+    void *block = c->top;
+    c->top += block_size;
+    return block;
+}
+
+void *slab_alloc(size_t size) {
+    if (size > SLAB_MAX_SIZE) return checked(malloc(size));
+    size_t index = class_of(size);
+    SizeClass *c = &classes[index];
+    SlabBlock *block = c->free;
+    if (block) {
+        c->free = block->next;
+        return block;
+    }
+    return carve(c, (index + 1) * SLAB_GRANULE);
+}
+
+void slab_free(void *ptr, size_t size) {
+    if (!ptr) return;
+    if (size > SLAB_MAX_SIZE) {
+        free(ptr);
+        return;
+    }
+    SizeClass *c = &classes[class_of(size)];
+    SlabBlock *block = (SlabBlock *)ptr;
+    block->next = c->free;
+    c->free = block;
+}
+
+void *slab_realloc(void *ptr, size_t old_size, size_t new_size) {
+    if (!ptr) return slab_alloc(new_size);
+    if (old_size > SLAB_MAX_SIZE && new_size > SLAB_MAX_SIZE) return checked(realloc(ptr, new_size));
+    if (old_size <= SLAB_MAX_SIZE && new_size <= SLAB_MAX_SIZE &&
+        class_of(old_size) == class_of(new_size))
+        return ptr;
+    void *result = slab_alloc(new_size);
+    memcpy(result, ptr, old_size < new_size ? old_size : new_size);
+    slab_free(ptr, old_size);
+    return result;
+}
+
+#else
+
+void *slab_alloc(size_t size) {
+    return checked(malloc(size));
+}
+
+void *slab_realloc(void *ptr, size_t old_size, size_t new_size) {
+    (void)old_size;
+    return checked(realloc(ptr, new_size));
+}
+
+void slab_free(void *ptr, size_t size) {
+    (void)size;
+    free(ptr);
+}
+
+#endif
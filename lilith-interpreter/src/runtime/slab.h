@@ -0,0 +1,34 @@
+#ifndef LILITH_SLAB_H
+#define LILITH_SLAB_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Size-class slab allocator                                                  */
+/* -------------------------------------------------------------------------- */
+
+/* Old-space objects and small payloads (string bodies, item arrays, entry
+   tables) come from slabs carved into blocks of one size class, a multiple
+   of SLAB_GRANULE up to SLAB_MAX_SIZE.  Each class keeps a free list that
+   the sweeper refills; slabs are kept for reuse, never returned.  Larger
+   requests go to malloc.  The caller passes the size back when freeing.
+   Size classes are per thread; a block may be freed on any thread.
+
+   Built with LILITH_SLAB_ALLOC off, these are plain malloc, realloc and
+   free, for comparison. */
+#define SLAB_GRANULE   16
+#define SLAB_MAX_SIZE  256
+
+void *slab_alloc(size_t size);
+void *slab_realloc(void *ptr, size_t old_size, size_t new_size);
+void  slab_free(void *ptr, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
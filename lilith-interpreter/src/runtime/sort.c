@@ -0,0 +1,325 @@
+#include "sort.h"
+#include "concurrency/scheduler.h"
+#include "concurrency/thread_pool.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Lists shorter than this are not worth handing to the pool */
+#define SORT_PARALLEL_MIN 65536
+/* Runs this short are insertion sorted before merging starts */
+#define SORT_RUN 32
+
+static void *sort_alloc(size_t size) {
+    void *p = malloc(size ? size : 1);
+    if (!p) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+/* ========================================================================= */
+/* Comparisons                                                               */
+/* ========================================================================= */
+
+static inline int compare_numbers(Value a, Value b) {
+    double x = AS_NUMBER(a), y = AS_NUMBER(b);
+    if (x < y) return -1;
+    if (x > y) return 1;
+    /* Equal, or at least one NaN: NaN goes last */
+    return (x != x) - (y != y);
+}
+
+static inline int compare_strings(Value a, Value b) {
+    ObjString *x = AS_STRING(a), *y = AS_STRING(b);
+    size_t common = x->length < y->length ? x->length : y->length;
+    int order = memcmp(string_bytes(x), string_bytes(y), common);
+    if (order != 0) return order;
+    return (x->length > y->length) - (x->length < y->length);
+}
+
+static inline int type_rank(Value v) {
+    return IS_NUMBER(v) ? 0 : IS_STRING(v) ? 1 : 2;
+}
+
+static inline int compare_mixed(Value a, Value b) {
+    int ra = type_rank(a), rb = type_rank(b);
+    if (ra != rb) return ra - rb;
+    if (ra == 0) return compare_numbers(a, b);
+    if (ra == 1) return compare_strings(a, b);
+    return 0;
+}
+
+/* ========================================================================= */
+/* Merge sort                                                                */
+/* ========================================================================= */
+
+/* What a run of elements is sorted and merged with, so the parallel
+   driver can handle every kind of element */
+typedef struct {
+    size_t size;
+    void (*sort)(void *items, void *scratch, size_t n);
+    void (*merge)(const void *a, size_t na, const void *b, size_t nb, void *out);
+} SortOps;
+
+/* A pair the keyed sort moves around as one */
+typedef struct {
+    Value key;
+    Value item;
+} SortPair;
+
+#define VALUE_KEY(e) (e)
+#define PAIR_KEY(e) ((e).key)
+
+/* Bottom-up and stable: insertion sorted runs, then merges that take from
+   the right only when it is strictly smaller.  One copy per element type
+   and compare, so the compare is inlined rather than called. */
+#define DEFINE_MERGE_SORT(name, T, KEY, compare)                                     \
+    static void name##_merge(const void *va, size_t na, const void *vb, size_t nb,   \
+                             void *vout) {                                           \
+        const T *a = va, *b = vb;                                                    \
+        T *out = vout;                                                               \
+        size_t i = 0, j = 0, k = 0;                                                  \
+        while (i < na && j < nb) {                                                   \
+            if (compare(KEY(b[j]), KEY(a[i])) < 0) out[k++] = b[j++];                \
+            else out[k++] = a[i++];                                                  \
+        }                                                                            \
+        while (i < na) out[k++] = a[i++];                                            \
+        while (j < nb) out[k++] = b[j++];                                            \
+    }                                                                                \
+                                                                                     \
+    static void name##_sort(void *vitems, void *vscratch, size_t n) {                \
+        T *items = vitems, *scratch = vscratch;                                      \
+        for (size_t start = 0; start < n; start += SORT_RUN) {                       \
+            size_t end = start + SORT_RUN < n ? start + SORT_RUN : n;                \
+            for (size_t i = start + 1; i < end; i++) {                               \
+                T e = items[i];                                                      \
+                size_t j = i;                                                        \
+                while (j > start && compare(KEY(e), KEY(items[j - 1])) < 0) {        \
+                    items[j] = items[j - 1];                                         \
+                    j--;                                                             \
+                }                                                                    \
+                items[j] = e;                                                        \
+            }                                                                        \
+        }                                                                            \
+        T *from = items, *to = scratch;                                              \
+        for (size_t width = SORT_RUN; width < n; width *= 2) {                       \
+            for (size_t lo = 0; lo < n; lo += 2 * width) {                           \
+                size_t mid = lo + width < n ? lo + width : n;                        \
+                size_t hi = lo + 2 * width < n ? lo + 2 * width : n;                 \
+                name##_merge(from + lo, mid - lo, from + mid, hi - mid, to + lo);    \
+            }                                                                        \
+            T *swap = from;                                                          \
+            from = to;                                                               \
+            to = swap;                                                               \
+        }                                                                            \
+        if (from != items) memcpy(items, from, n * sizeof(T));                       \
+    }                                                                                \
+                                                                                     \
+    static const SortOps name##_ops = { sizeof(T), name##_sort, name##_merge };
+
+DEFINE_MERGE_SORT(numbers, Value, VALUE_KEY, compare_numbers)
+DEFINE_MERGE_SORT(strings, Value, VALUE_KEY, compare_strings)
+DEFINE_MERGE_SORT(mixed, Value, VALUE_KEY, compare_mixed)
+DEFINE_MERGE_SORT(pair_numbers, SortPair, PAIR_KEY, compare_numbers)
+DEFINE_MERGE_SORT(pair_strings, SortPair, PAIR_KEY, compare_strings)
+DEFINE_MERGE_SORT(pair_mixed, SortPair, PAIR_KEY, compare_mixed)
+
+/* ========================================================================= */
+/* Radix sort                                                                */
+/* ========================================================================= */
+
+/* A double's bits as an unsigned number in the same order: positives get
+   the sign bit set, negatives have every bit flipped.  -0 would land just
+   before 0, so lists holding one are merge sorted instead. */
+static inline uint64_t number_bits(double d) {
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    return (bits >> 63) ? ~bits : bits | (UINT64_C(1) << 63);
+}
+
+static inline double bits_number(uint64_t bits) {
+    bits = (bits >> 63) ? bits & ~(UINT64_C(1) << 63) : ~bits;
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    return d;
+}
+
+/* Least significant byte first, skipping bytes every key shares */
+static void radix_sort(void *vitems, void *vscratch, size_t n) {
+    uint64_t *items = vitems, *scratch = vscratch;
+    if (n < 2) return;
+    size_t counts[8][256] = {{0}};
+    for (size_t i = 0; i < n; i++) {
+        uint64_t k = items[i];
+        for (int b = 0; b < 8; b++) counts[b][(k >> (8 * b)) & 0xff]++;
+    }
+    uint64_t *from = items, *to = scratch;
+    for (int b = 0; b < 8; b++) {
+        size_t *count = counts[b];
+        if (count[(from[0] >> (8 * b)) & 0xff] == n) continue;
+        size_t offset = 0;
+        for (int d = 0; d < 256; d++) {
+            size_t c = count[d];
+            count[d] = offset;
+            offset += c;
+        }
+        for (size_t i = 0; i < n; i++) to[count[(from[i] >> (8 * b)) & 0xff]++] = from[i];
+        uint64_t *swap = from;
+        from = to;
+        to = swap;
+    }
+    if (from != items) memcpy(items, from, n * sizeof(uint64_t));
+}
+
+static void radix_merge(const void *va, size_t na, const void *vb, size_t nb, void *vout) {
+    const uint64_t *a = va, *b = vb;
+    uint64_t *out = vout;
+    size_t i = 0, j = 0, k = 0;
+    while (i < na && j < nb) out[k++] = b[j] < a[i] ? b[j++] : a[i++];
+    while (i < na) out[k++] = a[i++];
+    while (j < nb) out[k++] = b[j++];
+}
+
+static const SortOps radix_ops = { sizeof(uint64_t), radix_sort, radix_merge };
+
+/* ========================================================================= */
+/* Parallel driver                                                           */
+/* ========================================================================= */
+
+typedef struct {
+    Task task;
+    const SortOps *ops;
+    char *items;
+    char *scratch;
+    size_t lo, mid, hi;
+} SortTask;
+
+static void run_sort_task(void *arg) {
+    SortTask *t = arg;
+    size_t size = t->ops->size;
+    t->ops->sort(t->items + t->lo * size, t->scratch + t->lo * size, t->hi - t->lo);
+}
+
+/* Merges from `items` into `scratch` */
+static void run_merge_task(void *arg) {
+    SortTask *t = arg;
+    size_t size = t->ops->size;
+    t->ops->merge(t->items + t->lo * size, t->mid - t->lo, t->items + t->mid * size,
+                  t->hi - t->mid, t->scratch + t->lo * size);
+}
+
+/* Run tasks[1..] on the pool and tasks[0] here.  The caller stays out of
+   a safe region: the values being sorted must not move under the workers. */
+static void run_tasks(ThreadPool *pool, SortTask *tasks, size_t count) {
+    for (size_t i = 1; i < count; i++) thread_pool_spawn(pool, &tasks[i].task);
+    tasks[0].task.fn(tasks[0].task.arg);
+    for (size_t i = 1; i < count; i++) thread_pool_join(pool, &tasks[i].task);
+}
+
+static void sort_run(const SortOps *ops, void *items, size_t n) {
+    if (n < 2) return;
+    void *scratch = sort_alloc(n * ops->size);
+    ThreadPool *pool = n >= SORT_PARALLEL_MIN ? scheduler_pool() : NULL;
+    size_t runs = pool ? thread_pool_size(pool) : 1;
+    if (runs < 2) {
+        ops->sort(items, scratch, n);
+        free(scratch);
+        return;
+    }
+
+    /* One run per worker, then rounds of pairwise merges */
+    size_t *bounds = sort_alloc((runs + 1) * sizeof(size_t));
+    for (size_t r = 0; r <= runs; r++) bounds[r] = n * r / runs;
+    SortTask *tasks = sort_alloc(runs * sizeof(SortTask));
+    for (size_t r = 0; r < runs; r++) {
+        tasks[r] = (SortTask){ .ops = ops, .items = items, .scratch = scratch,
+                               .lo = bounds[r], .hi = bounds[r + 1] };
+        task_init(&tasks[r].task, run_sort_task, &tasks[r]);
+    }
+    run_tasks(pool, tasks, runs);
+
+    char *from = items, *to = scratch;
+    while (runs > 1) {
+        size_t merges = 0;
+        for (size_t r = 0; r < runs; r += 2) {
+            size_t hi = r + 2 <= runs ? bounds[r + 2] : bounds[runs];
+            size_t mid = r + 1 <= runs ? bounds[r + 1] : hi;
+            tasks[merges] = (SortTask){ .ops = ops, .items = from, .scratch = to,
+                                        .lo = bounds[r], .mid = mid, .hi = hi };
+            task_init(&tasks[merges].task, run_merge_task, &tasks[merges]);
+            bounds[merges++] = bounds[r];
+        }
+        bounds[merges] = n;
+        run_tasks(pool, tasks, merges);
+        runs = merges;
+        char *swap = from;
+        from = to;
+        to = swap;
+    }
+    if (from != (char *)items) memcpy(items, from, n * ops->size);
+    free(tasks);
+    free(bounds);
+    free(scratch);
+}
+
+/* ========================================================================= */
+/* Entry points                                                              */
+/* ========================================================================= */
+
+typedef enum { SORT_NUMBERS, SORT_RADIX, SORT_STRINGS, SORT_MIXED } SortKind;
+
+/* The sort a run of keys needs */
+static SortKind classify(const Value *keys, size_t count) {
+    bool numbers = true, strings = true, radix = true;
+    for (size_t i = 0; i < count && (numbers || strings); i++) {
+        Value v = keys[i];
+        if (IS_NUMBER(v)) {
+            double d = AS_NUMBER(v);
+            if (d != d || (d == 0 && signbit(d))) radix = false;
+        } else {
+            numbers = false;
+        }
+        strings = strings && IS_STRING(v);
+    }
+    if (numbers) return radix ? SORT_RADIX : SORT_NUMBERS;
+    return strings ? SORT_STRINGS : SORT_MIXED;
+}
+
+void sort_values(Value *items, size_t count) {
+    if (count < 2) return;
+    switch (classify(items, count)) {
+        case SORT_RADIX: {
+            uint64_t *bits = sort_alloc(count * sizeof(uint64_t));
+            for (size_t i = 0; i < count; i++) bits[i] = number_bits(AS_NUMBER(items[i]));
+            sort_run(&radix_ops, bits, count);
+            for (size_t i = 0; i < count; i++) items[i] = NUMBER_VAL(bits_number(bits[i]));
+            free(bits);
+            return;
+        }
+        case SORT_NUMBERS: sort_run(&numbers_ops, items, count); return;
+        case SORT_STRINGS: sort_run(&strings_ops, items, count); return;
+        case SORT_MIXED:   sort_run(&mixed_ops, items, count); return;
+    }
+}
+
+void sort_values_by(Value *items, Value *keys, size_t count) {
+    if (count < 2) return;
+    SortKind kind = classify(keys, count);
+    SortPair *pairs = sort_alloc(count * sizeof(SortPair));
+    for (size_t i = 0; i < count; i++) pairs[i] = (SortPair){ keys[i], items[i] };
+    switch (kind) {
+        case SORT_RADIX:
+        case SORT_NUMBERS: sort_run(&pair_numbers_ops, pairs, count); break;
+        case SORT_STRINGS: sort_run(&pair_strings_ops, pairs, count); break;
+        case SORT_MIXED:   sort_run(&pair_mixed_ops, pairs, count); break;
+    }
+    for (size_t i = 0; i < count; i++) {
+        keys[i] = pairs[i].key;
+        items[i] = pairs[i].item;
+    }
+    free(pairs);
+}
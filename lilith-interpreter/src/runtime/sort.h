@@ -0,0 +1,29 @@
+#ifndef LILITH_SORT_H
+#define LILITH_SORT_H
+
+#include "value.h"
+
+/* -------------------------------------------------------------------------- */
+/* Sorting                                                                    */
+/* -------------------------------------------------------------------------- */
+
+/* Stable sorts for list..sort.  Values order as numbers first, by value
+   with NaN after every other number, then strings, byte by byte with a
+   prefix before the longer string, then everything else, left where it
+   was.
+
+   The algorithm follows the values: a list of numbers without NaN or -0
+   is radix sorted on their bits, anything else merge sorted with the
+   compare for what it holds.  Long lists are cut into one run per pool
+   worker, sorted in parallel and merged back pairwise.
+
+   Only C runs here, no collection can happen meanwhile, and the values
+   must stay reachable from the caller. */
+
+void sort_values(Value *items, size_t count);
+
+/* Order `items` by the matching entries of `keys`, both `count` long;
+   keys are reordered along with their items */
+void sort_values_by(Value *items, Value *keys, size_t count);
+
+#endif
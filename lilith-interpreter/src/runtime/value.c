@@ -1,9 +1,19 @@
 #define _GNU_SOURCE
 #include "value.h"
 #include "gc.h"
+#include "slab.h"
+#include "future.h"
+#include "generator.h"
+#include "array.h"
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 /* ========================================================================= */
 /* Simple Value Constructors                                                */
@@ -18,51 +28,419 @@ Value value_obj(Obj *obj) { return OBJ_VAL(obj); }
 /* Hashing                                                                  */
 /* ========================================================================= */
 
-uint32_t hash_string(const char *key, size_t length) {
-    uint32_t hash = 2166136261u;
-    for (size_t i = 0; i < length; i++) {
-        hash ^= (uint8_t)key[i];
-        hash *= 16777619;
+/* wyhash: eight bytes at a time, mixed by 64x64->128 bit multiplies.  The
+   seed is drawn once per process so keys cannot be chosen to collide. */
+
+#define WY_P0 0xa0761d6478bd642full
+#define WY_P1 0xe7037ed1a0b428dbull
+#define WY_P2 0x8ebc6af09c88c6e3ull
+#define WY_P3 0x589965cc75374cc3ull
+
+static uint64_t hash_seed;
+static pthread_once_t hash_seed_once = PTHREAD_ONCE_INIT;
+
+static void hash_seed_init(void) {
+    uint64_t seed = 0;
+    if (getentropy(&seed, sizeof(seed)) != 0)
+        seed = (uint64_t)time(NULL) ^ (uint64_t)(uintptr_t)&seed;
+    hash_seed = seed;
+}
+
+/* Both halves of a * b */
+static inline void wy_mum(uint64_t *a, uint64_t *b) {
+#ifdef __SIZEOF_INT128__
+    __extension__ unsigned __int128 r = (unsigned __int128)*a * *b;
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+#else
+    uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32), c = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    c += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t wy_mix(uint64_t a, uint64_t b) {
+    wy_mum(&a, &b);
+    return a ^ b;
+}
+
+static inline uint64_t wy_read8(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static inline uint64_t wy_read4(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+uint64_t hash_string(const char *key, size_t length) {
+    pthread_once(&hash_seed_once, hash_seed_init);
+    const uint8_t *p = (const uint8_t *)key;
+    uint64_t seed = hash_seed ^ wy_mix(hash_seed ^ WY_P0, WY_P1);
+    uint64_t a, b;
+    if (length <= 16) {
+        if (length >= 4) {
+            size_t mid = (length >> 3) << 2;
+            a = (wy_read4(p) << 32) | wy_read4(p + mid);
+            b = (wy_read4(p + length - 4) << 32) | wy_read4(p + length - 4 - mid);
+        } else if (length > 0) {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[length >> 1] << 8) | p[length - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = length;
+        if (i > 48) {
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = wy_mix(wy_read8(p) ^ WY_P1, wy_read8(p + 8) ^ seed);
+                see1 = wy_mix(wy_read8(p + 16) ^ WY_P2, wy_read8(p + 24) ^ see1);
+                see2 = wy_mix(wy_read8(p + 32) ^ WY_P3, wy_read8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = wy_mix(wy_read8(p) ^ WY_P1, wy_read8(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        a = wy_read8(p + i - 16);
+        b = wy_read8(p + i - 8);
     }
-    return hash;
+    a ^= WY_P1;
+    b ^= seed;
+    wy_mum(&a, &b);
+    uint64_t hash = wy_mix(a ^ WY_P0 ^ length, b ^ WY_P1);
+    return hash ? hash : 1;
 }
 
 /* ========================================================================= */
 /* Object Constructors                                                      */
 /* ========================================================================= */
 
-static void *allocate_object(size_t size, ObjType type) {
-    Obj *obj = (Obj *)malloc(size);
-    if (!obj) {
-        fprintf(stderr, "Out of memory\n");
-        exit(1);
+/* Object payloads (string bodies, item arrays, entry tables) go through
+   here so the collector can pace itself by bytes.  Never collects. */
+static void *reallocate(void *ptr, size_t old_size, size_t new_size) {
+    gc_account((ptrdiff_t)new_size - (ptrdiff_t)old_size);
+    if (new_size == 0) {
+        slab_free(ptr, old_size);
+        return NULL;
     }
+    return slab_realloc(ptr, old_size, new_size);
+}
+
+/* May run a collection before allocating. */
+static void *allocate_object(size_t size, ObjType type) {
+    Obj *obj = gc_allocate(size);
     obj->type = type;
-    obj->next = NULL;
-    gc_track(obj);
     return obj;
 }
 
 #define ALLOCATE_OBJ(type, obj_type) (type *)allocate_object(sizeof(type), obj_type)
 
+#define STRING_SIZE(length) (sizeof(ObjString) + (length) + 1)
+
+/* `hash` may be 0, to be computed when first needed */
+static void string_fill(ObjString *str, const char *chars, size_t length, uint64_t hash) {
+    str->obj.type = OBJ_STRING;
+    str->length = length;
+    atomic_init(&str->hash, hash);
+    str->interned = false;
+    str->kind = STRING_FLAT;
+    atomic_init(&str->text, NULL);
+    memcpy(str->chars, chars, length);
+    str->chars[length] = '\0';
+}
+
+/* The 256 one-byte strings live outside the heap, so taking a string
+   apart byte by byte allocates nothing.  They count as interned. */
+#define BYTE_STRING_SIZE ((STRING_SIZE(1) + 7) & ~(size_t)7)
+
+static _Alignas(max_align_t) unsigned char byte_strings[256 * BYTE_STRING_SIZE];
+static pthread_once_t byte_strings_once = PTHREAD_ONCE_INIT;
+
+static void byte_strings_init(void) {
+    for (int c = 0; c < 256; c++) {
+        ObjString *str = (ObjString *)&byte_strings[c * BYTE_STRING_SIZE];
+        char byte = (char)c;
+        string_fill(str, &byte, 1, hash_string(&byte, 1));
+        str->obj.space = GC_SPACE_STATIC;
+        str->obj.next = NULL;
+        str->interned = true;
+    }
+}
+
+ObjString *obj_string_byte(unsigned char byte) {
+    pthread_once(&byte_strings_once, byte_strings_init);
+    return (ObjString *)&byte_strings[byte * BYTE_STRING_SIZE];
+}
+
+ObjString *obj_string_copy(const char *chars, size_t length) {
+    if (length == 1) return obj_string_byte((unsigned char)chars[0]);
+    ObjString *str = (ObjString *)gc_allocate(STRING_SIZE(length));
+    string_fill(str, chars, length, 0);
+    return str;
+}
+
 ObjString *obj_string_take(char *chars, size_t length) {
-    uint32_t hash = hash_string(chars, length);
-    ObjString *str = ALLOCATE_OBJ(ObjString, OBJ_STRING);
-    str->chars = chars;
+    ObjString *str = obj_string_copy(chars, length);
+    free(chars);
+    return str;
+}
+
+/* ========================================================================= */
+/* Ropes and Views                                                          */
+/* ========================================================================= */
+
+/* Shorter results are copied flat: a rope costs a node and a flatten */
+#define STRING_ROPE_MIN 64
+
+/* Below this a copy takes no more room than a view */
+#define STRING_VIEW_MIN 32
+
+/* A rope or view with its payload cleared */
+static ObjString *string_node_new(StringKind kind, size_t length) {
+    size_t payload = kind == STRING_ROPE ? sizeof(StringRope) : sizeof(StringView);
+    ObjString *str = (ObjString *)gc_allocate(sizeof(ObjString) + payload);
+    str->obj.type = OBJ_STRING;
     str->length = length;
-    str->hash = hash;
+    atomic_init(&str->hash, 0);
+    str->interned = false;
+    str->kind = (unsigned char)kind;
+    atomic_init(&str->text, NULL);
+    memset(str->chars, 0, payload);
     return str;
 }
 
-ObjString *obj_string_copy(const char *chars, size_t length) {
-    char *heap_chars = (char *)malloc(length + 1);
-    if (!heap_chars) {
+static ObjString *rope_new(size_t length) {
+    return string_node_new(STRING_ROPE, length);
+}
+
+static void rope_join(ObjString *rope, ObjString *left, ObjString *right) {
+    STRING_ROPE_OF(rope)->left = left;
+    STRING_ROPE_OF(rope)->right = right;
+    gc_write_barrier((Obj *)rope, OBJ_VAL(left));
+    gc_write_barrier((Obj *)rope, OBJ_VAL(right));
+}
+
+ObjString *obj_string_concat(ObjString *a, ObjString *b) {
+    if (b->length == 0) return a;
+    if (a->length == 0) return b;
+    size_t length = a->length + b->length;
+    if (length < STRING_ROPE_MIN) {
+        ObjString *str = (ObjString *)gc_allocate(STRING_SIZE(length));
+        string_fill(str, string_bytes(a), a->length, 0);
+        memcpy(str->chars + a->length, string_bytes(b), b->length);
+        str->length = length;
+        str->chars[length] = '\0';
+        return str;
+    }
+
+    /* Appending a short piece to a rope ending in one merges the two, so
+       building a string a character at a time makes few nodes.  Whatever
+       is not rooted is read back after allocating: it may have moved. */
+    size_t roots = gc_root_depth();
+    ObjString *rope;
+    if (a->kind == STRING_ROPE && !atomic_load_explicit(&a->text, memory_order_acquire) &&
+        STRING_ROPE_OF(a)->right->length + b->length < STRING_ROPE_MIN) {
+        gc_push_root(OBJ_VAL(STRING_ROPE_OF(a)->right));
+        ObjString *tail = obj_string_concat(STRING_ROPE_OF(a)->right, b);
+        gc_push_root(OBJ_VAL(tail));
+        rope = rope_new(length);
+        rope_join(rope, STRING_ROPE_OF(a)->left, tail);
+    } else {
+        rope = rope_new(length);
+        rope_join(rope, a, b);
+    }
+    gc_restore_roots(roots);
+    return rope;
+}
+
+/* Where the bytes of `parent` stay put for as long as it lives, or NULL
+   for those of a young flat string, which a collection may move.  The
+   string that owns them may be another. */
+static const char *stable_bytes(ObjString **parent) {
+    ObjString *str = *parent;
+    if (str->kind == STRING_FLAT) return str->obj.space == GC_SPACE_NURSERY ? NULL : str->chars;
+    const char *text = atomic_load_explicit(&str->text, memory_order_acquire);
+    if (text) return text;
+    if (str->kind == STRING_ROPE) return string_flatten(str);
+    *parent = STRING_VIEW_OF(str)->parent;
+    return STRING_VIEW_OF(str)->bytes;
+}
+
+ObjString *obj_string_slice(ObjString *parent, size_t offset, size_t length) {
+    if (offset == 0 && length == parent->length) return parent;
+    size_t roots = gc_root_depth();
+    gc_push_root(OBJ_VAL(parent));      /* pinned, so its bytes stay put */
+    ObjString *owner = parent;
+    const char *bytes = length >= STRING_VIEW_MIN ? stable_bytes(&owner) : NULL;
+    ObjString *str;
+    if (!bytes) {
+        str = obj_string_copy(string_bytes(parent) + offset, length);
+    } else {
+        gc_push_root(OBJ_VAL(owner));
+        str = string_node_new(STRING_VIEW, length);
+        STRING_VIEW_OF(str)->parent = owner;
+        STRING_VIEW_OF(str)->bytes = bytes + offset;
+        gc_write_barrier((Obj *)str, OBJ_VAL(owner));
+    }
+    gc_restore_roots(roots);
+    return str;
+}
+
+/* Right half first, so a rope built by appending needs one stack entry */
+const char *string_flatten(ObjString *str) {
+    char *buffer = (char *)reallocate(NULL, 0, str->length + 1);
+    buffer[str->length] = '\0';
+    ObjString **stack = NULL;
+    size_t count = 0, capacity = 0;
+    size_t end = str->length;
+    for (ObjString *node = str;;) {
+        const char *text = node->kind == STRING_ROPE
+            ? atomic_load_explicit(&node->text, memory_order_acquire) : string_bytes(node);
+        if (!text) {
+            if (count == capacity) {
+                capacity = capacity < 16 ? 16 : capacity * 2;
+                stack = (ObjString **)realloc(stack, sizeof(ObjString *) * capacity);
+                if (!stack) {
+                    fprintf(stderr, "Out of memory\n");
+                    exit(1);
+                }
+            }
+            stack[count++] = STRING_ROPE_OF(node)->left;
+            node = STRING_ROPE_OF(node)->right;
+            continue;
+        }
+        end -= node->length;
+        memcpy(buffer + end, text, node->length);
+        if (count == 0) break;
+        node = stack[--count];
+    }
+    free(stack);
+
+    /* Another thread may have flattened it meanwhile */
+    const char *expected = NULL;
+    if (!atomic_compare_exchange_strong_explicit(&str->text, &expected, buffer,
+                                                 memory_order_acq_rel, memory_order_acquire)) {
+        reallocate(buffer, str->length + 1, 0);
+        return expected;
+    }
+    return buffer;
+}
+
+/* ========================================================================= */
+/* String Interning                                                         */
+/* ========================================================================= */
+
+/* Open addressing over canonical strings.  The table holds them weakly: a
+   sweep freeing one removes it, and one the running sweep has yet to free
+   counts as gone.  Interned strings live in the old space, so nothing
+   here has to follow a move. */
+
+#define INTERN_TOMBSTONE ((ObjString *)1)
+
+static ObjString **intern_slots = NULL;
+static size_t intern_capacity = 0;     /* 0 or a power of two */
+static size_t intern_used = 0;         /* strings and tombstones */
+static pthread_mutex_t intern_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void intern_grow(void) {
+    size_t live = 0;
+    for (size_t i = 0; i < intern_capacity; i++)
+        if (intern_slots[i] > INTERN_TOMBSTONE) live++;
+    size_t capacity = intern_capacity < 256 ? 256 : intern_capacity;
+    while (live * 2 >= capacity) capacity *= 2;
+
+    ObjString **slots = (ObjString **)calloc(capacity, sizeof(ObjString *));
+    if (!slots) {
         fprintf(stderr, "Out of memory\n");
         exit(1);
     }
-    memcpy(heap_chars, chars, length);
-    heap_chars[length] = '\0';
-    return obj_string_take(heap_chars, length);
+    for (size_t i = 0; i < intern_capacity; i++) {
+        ObjString *str = intern_slots[i];
+        if (str <= INTERN_TOMBSTONE) continue;
+        size_t at = string_hash(str) & (capacity - 1);
+        while (slots[at]) at = (at + 1) & (capacity - 1);
+        slots[at] = str;
+    }
+    free(intern_slots);
+    intern_slots = slots;
+    intern_capacity = capacity;
+    intern_used = live;
+}
+
+/* The live string with these contents, or NULL and the slot to put it
+   in.  Under intern_lock. */
+static ObjString *intern_find(const char *chars, size_t length, uint64_t hash, size_t *slot) {
+    if ((intern_used + 1) * 4 > intern_capacity * 3) intern_grow();
+    size_t mask = intern_capacity - 1;
+    size_t at = hash & mask;
+    long reuse = -1;
+    for (ObjString *str; (str = intern_slots[at]); at = (at + 1) & mask) {
+        if (str == INTERN_TOMBSTONE) {
+            if (reuse < 0) reuse = (long)at;
+        } else if (string_hash(str) == hash && str->length == length &&
+                   memcmp(str->chars, chars, length) == 0) {
+            if (gc_weak_claim((Obj *)str)) return str;
+            reuse = (long)at;       /* about to be swept, replace it */
+            break;
+        }
+    }
+    *slot = reuse >= 0 ? (size_t)reuse : at;
+    return NULL;
+}
+
+static ObjString *intern(const char *chars, size_t length, uint64_t hash) {
+    if (length == 1) return obj_string_byte((unsigned char)chars[0]);
+    size_t slot;
+    pthread_mutex_lock(&intern_lock);
+    ObjString *found = intern_find(chars, length, hash, &slot);
+    pthread_mutex_unlock(&intern_lock);
+    if (found) return found;
+
+    /* Allocated unlocked: attaching the thread may wait for a collection,
+       whose sweep takes the lock */
+    ObjString *str = (ObjString *)gc_allocate_old(STRING_SIZE(length));
+    string_fill(str, chars, length, hash);
+
+    pthread_mutex_lock(&intern_lock);
+    found = intern_find(chars, length, hash, &slot);
+    if (!found) {
+        if (!intern_slots[slot]) intern_used++;
+        intern_slots[slot] = str;
+        str->interned = true;
+        found = str;
+    }
+    pthread_mutex_unlock(&intern_lock);
+    return found;   /* another thread's copy may have won */
+}
+
+/* A swept string leaves the table, unless a replacement took its slot */
+static void intern_forget(ObjString *dead) {
+    pthread_mutex_lock(&intern_lock);
+    size_t mask = intern_capacity - 1;
+    for (size_t at = string_hash(dead) & mask; intern_slots[at]; at = (at + 1) & mask) {
+        if (intern_slots[at] == dead) {
+            intern_slots[at] = INTERN_TOMBSTONE;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&intern_lock);
+}
+
+ObjString *obj_string_intern(const char *chars, size_t length) {
+    return intern(chars, length, hash_string(chars, length));
 }
 
 ObjList *obj_list_new(void) {
@@ -75,11 +453,8 @@ ObjList *obj_list_new(void) {
 
 ObjTuple *obj_tuple_new(size_t count) {
     ObjTuple *tuple = ALLOCATE_OBJ(ObjTuple, OBJ_TUPLE);
-    tuple->items = (Value *)malloc(sizeof(Value) * count);
-    if (!tuple->items) {
-        fprintf(stderr, "Out of memory\n");
-        exit(1);
-    }
+    tuple->items = count > 0 ? (Value *)reallocate(NULL, 0, sizeof(Value) * count) : NULL;
+    for (size_t i = 0; i < count; i++) tuple->items[i] = NIL_VAL;
     tuple->count = count;
     return tuple;
 }
@@ -88,7 +463,12 @@ ObjDict *obj_dict_new(void) {
     ObjDict *dict = ALLOCATE_OBJ(ObjDict, OBJ_DICT);
     dict->entries = NULL;
     dict->count = 0;
+    dict->used = 0;
+    dict->entry_capacity = 0;
+    dict->ctrl = NULL;
     dict->capacity = 0;
+    dict->growth_left = 0;
+    dict->epoch = 0;
     return dict;
 }
 
@@ -101,23 +481,36 @@ ObjFunction *obj_function_new(const char *name) {
     fn->body = NULL;
     fn->return_type = NULL;
     fn->is_async = 0;
+    fn->is_generator = 0;
     fn->implicit_return = 0;
     fn->closure = NULL;
+    fn->scope = NULL;
+    fn->chunk = NULL;
     return fn;
 }
 
 ObjClass *obj_class_new(const char *name) {
+    ObjDict *methods = obj_dict_new();
+    gc_push_root(OBJ_VAL(methods));
     ObjClass *klass = ALLOCATE_OBJ(ObjClass, OBJ_CLASS);
+    gc_pop_roots(1);
     klass->name = name ? strdup(name) : NULL;
     klass->superclass = NULL;
-    klass->methods = obj_dict_new();
+    klass->methods = methods;
+    gc_write_barrier((Obj *)klass, OBJ_VAL(methods));
     return klass;
 }
 
 ObjInstance *obj_instance_new(ObjClass *klass) {
+    gc_push_root(OBJ_VAL(klass));
+    ObjDict *fields = obj_dict_new();
+    gc_push_root(OBJ_VAL(fields));
     ObjInstance *inst = ALLOCATE_OBJ(ObjInstance, OBJ_INSTANCE);
+    gc_pop_roots(2);
     inst->klass = klass;
-    inst->fields = obj_dict_new();
+    inst->fields = fields;
+    gc_write_barrier((Obj *)inst, OBJ_VAL(klass));
+    gc_write_barrier((Obj *)inst, OBJ_VAL(fields));
     return inst;
 }
 
@@ -125,9 +518,63 @@ ObjNative *obj_native_new(NativeFn fn, const char *name) {
     ObjNative *native = ALLOCATE_OBJ(ObjNative, OBJ_NATIVE);
     native->fn = fn;
     native->name = name ? strdup(name) : NULL;
+    native->pure = 0;
     return native;
 }
 
+ObjFuture *obj_future_new(struct FutureState *state) {
+    ObjFuture *future = ALLOCATE_OBJ(ObjFuture, OBJ_FUTURE);
+    future->state = state;
+    return future;
+}
+
+ObjGenerator *obj_generator_new(struct GeneratorState *state) {
+    ObjGenerator *generator = ALLOCATE_OBJ(ObjGenerator, OBJ_GENERATOR);
+    generator->state = state;
+    return generator;
+}
+
+ObjRange *obj_range_new(double start, double step, size_t count) {
+    ObjRange *range = ALLOCATE_OBJ(ObjRange, OBJ_RANGE);
+    range->start = start;
+    range->step = step;
+    range->count = count;
+    return range;
+}
+
+/* Storage rounded up to whole alignment units, as aligned_alloc wants */
+static size_t array_bytes(ObjArray *array) {
+    size_t bytes = array->count * array_elem_size(array->type);
+    return (bytes + ARRAY_ALIGN - 1) / ARRAY_ALIGN * ARRAY_ALIGN;
+}
+
+/* Zero-filled */
+ObjArray *obj_array_new(ArrayType type, size_t count) {
+    ObjArray *array = ALLOCATE_OBJ(ObjArray, OBJ_ARRAY);
+    array->type = type;
+    array->count = count;
+    array->data = NULL;
+    size_t bytes = array_bytes(array);
+    if (bytes > 0) {
+        array->data = aligned_alloc(ARRAY_ALIGN, bytes);
+        if (!array->data) {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+        memset(array->data, 0, bytes);
+        gc_account((ptrdiff_t)bytes);
+    }
+    return array;
+}
+
+/* The dict must be a temporary root */
+ObjEntries *obj_entries_new(ObjDict *dict) {
+    ObjEntries *entries = ALLOCATE_OBJ(ObjEntries, OBJ_ENTRIES);
+    entries->dict = dict;
+    gc_write_barrier((Obj *)entries, OBJ_VAL(dict));
+    return entries;
+}
+
 /* ========================================================================= */
 /* List Helpers                                                             */
 /* ========================================================================= */
@@ -136,81 +583,191 @@ void value_array_write(ObjList *list, Value value) {
     if (list->capacity < list->count + 1) {
         size_t old = list->capacity;
         list->capacity = old < 8 ? 8 : old * 2;
-        list->items = (Value *)realloc(list->items, sizeof(Value) * list->capacity);
-        if (!list->items) {
-            fprintf(stderr, "Out of memory\n");
-            exit(1);
-        }
+        list->items = (Value *)reallocate(list->items, sizeof(Value) * old, sizeof(Value) * list->capacity);
     }
     list->items[list->count++] = value;
+    gc_write_barrier((Obj *)list, value);
 }
 
 /* ========================================================================= */
 /* Dict Helpers                                                             */
 /* ========================================================================= */
 
-static DictEntry *dict_find_entry(DictEntry *entries, size_t capacity, ObjString *key) {
-    uint32_t index = key->hash & (capacity - 1);
-    for (;;) {
-        DictEntry *entry = &entries[index];
-        if (entry->key == NULL || (entry->key == key)) {
-            return entry;
-        }
-        if (entry->key != NULL && entry->key->hash == key->hash &&
-            entry->key->length == key->length &&
-            memcmp(entry->key->chars, key->chars, key->length) == 0) {
-            return entry;
+/* Control bytes: a full bucket holds the low 7 bits of its key's hash, so
+   the high bit marks the two free states */
+#define CTRL_EMPTY   ((uint8_t)0x80)
+#define CTRL_DELETED ((uint8_t)0xFE)
+#define DICT_GROUP   16
+
+/* At most 7 in 8 buckets are ever full or deleted */
+static inline size_t dict_max_load(size_t capacity) {
+    return capacity - capacity / 8;
+}
+
+static inline uint32_t *dict_slots(const ObjDict *dict) {
+    return (uint32_t *)(dict->ctrl + dict->capacity);
+}
+
+static inline size_t dict_table_size(size_t capacity) {
+    return capacity * (1 + sizeof(uint32_t));
+}
+
+/* Bit i set where byte i of the group equals `byte` */
+static inline uint32_t group_match(const uint8_t *group, uint8_t byte) {
+#ifdef __SSE2__
+    __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)byte)));
+#else
+    uint32_t bits = 0;
+    for (int i = 0; i < DICT_GROUP; i++) bits |= (uint32_t)(group[i] == byte) << i;
+    return bits;
+#endif
+}
+
+/* Bit i set where byte i is empty or deleted */
+static inline uint32_t group_match_free(const uint8_t *group) {
+#ifdef __SSE2__
+    return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)group));
+#else
+    uint32_t bits = 0;
+    for (int i = 0; i < DICT_GROUP; i++) bits |= (uint32_t)(group[i] >> 7) << i;
+    return bits;
+#endif
+}
+
+/* Groups are probed at triangular offsets from the hash's home group, which
+   visits every group of a power-of-two table.  A group with an empty
+   bucket ends the search: the key would have gone there. */
+static long dict_find_bucket(const ObjDict *dict, const char *chars, size_t length, uint64_t hash) {
+    if (dict->capacity == 0) return -1;
+    size_t mask = dict->capacity / DICT_GROUP - 1;
+    size_t group = (hash >> 7) & mask;
+    uint8_t tag = hash & 0x7F;
+    const uint32_t *slots = dict_slots(dict);
+    for (size_t step = 1;; step++) {
+        const uint8_t *ctrl = dict->ctrl + group * DICT_GROUP;
+        for (uint32_t hits = group_match(ctrl, tag); hits; hits &= hits - 1) {
+            size_t bucket = group * DICT_GROUP + (size_t)__builtin_ctz(hits);
+            ObjString *key = dict->entries[slots[bucket]].key;
+            if (key->chars == chars ||
+                (string_hash(key) == hash && key->length == length && memcmp(string_bytes(key), chars, length) == 0)) {
+                return (long)bucket;
+            }
         }
-        index = (index + 1) & (capacity - 1);
+        if (group_match(ctrl, CTRL_EMPTY)) return -1;
+        group = (group + step) & mask;
     }
 }
 
-static void dict_adjust_capacity(ObjDict *dict, size_t capacity) {
-    DictEntry *entries = (DictEntry *)calloc(capacity, sizeof(DictEntry));
-    if (!entries) {
-        fprintf(stderr, "Out of memory\n");
-        exit(1);
+/* The first empty or deleted bucket on the hash's probe path */
+static size_t dict_free_bucket(const ObjDict *dict, uint64_t hash) {
+    size_t mask = dict->capacity / DICT_GROUP - 1;
+    size_t group = (hash >> 7) & mask;
+    for (size_t step = 1;; step++) {
+        uint32_t open = group_match_free(dict->ctrl + group * DICT_GROUP);
+        if (open) return group * DICT_GROUP + (size_t)__builtin_ctz(open);
+        group = (group + step) & mask;
     }
-    for (size_t i = 0; i < dict->capacity; i++) {
-        DictEntry *entry = &dict->entries[i];
-        if (entry->key == NULL) continue;
-        DictEntry *dest = dict_find_entry(entries, capacity, entry->key);
-        dest->key = entry->key;
-        dest->value = entry->value;
+}
+
+/* Rebuild the buckets at `capacity`, squeezing removed entries out */
+static void dict_rehash(ObjDict *dict, size_t capacity) {
+    size_t live = 0;
+    for (size_t i = 0; i < dict->used; i++) {
+        if (dict->entries[i].key) dict->entries[live++] = dict->entries[i];
     }
-    free(dict->entries);
-    dict->entries = entries;
+    dict->used = live;
+    dict->epoch++;
+
+    reallocate(dict->ctrl, dict_table_size(dict->capacity), 0);
+    dict->ctrl = (uint8_t *)reallocate(NULL, 0, dict_table_size(capacity));
     dict->capacity = capacity;
+    memset(dict->ctrl, CTRL_EMPTY, capacity);
+    uint32_t *slots = dict_slots(dict);
+    for (size_t i = 0; i < live; i++) {
+        uint64_t hash = string_hash(dict->entries[i].key);
+        size_t bucket = dict_free_bucket(dict, hash);
+        dict->ctrl[bucket] = hash & 0x7F;
+        slots[bucket] = (uint32_t)i;
+    }
+    dict->growth_left = dict_max_load(capacity) - live;
 }
 
 void dict_set(ObjDict *dict, ObjString *key, Value value) {
-    if (dict->count + 1 > dict->capacity * 0.75) {
-        size_t capacity = dict->capacity < 8 ? 8 : dict->capacity * 2;
-        dict_adjust_capacity(dict, capacity);
+    uint64_t hash = string_hash(key);
+    long found = dict_find_bucket(dict, string_bytes(key), key->length, hash);
+    if (found >= 0) {
+        DictEntry *entry = &dict->entries[dict_slots(dict)[found]];
+        entry->value = value;
+        gc_write_barrier((Obj *)dict, value);
+        return;
     }
-    DictEntry *entry = dict_find_entry(dict->entries, dict->capacity, key);
-    bool is_new = entry->key == NULL;
-    if (is_new) {
-        entry->key = key;
-        dict->count++;
+
+    /* New keys are canonical, so later lookups match on the pointer */
+    if (!key->interned) key = intern(string_bytes(key), key->length, hash);
+    size_t bucket = dict->capacity ? dict_free_bucket(dict, hash) : 0;
+    if (dict->capacity == 0 || (dict->ctrl[bucket] == CTRL_EMPTY && dict->growth_left == 0) ||
+        dict->used == dict_max_load(dict->capacity)) {
+        /* Out of empty buckets or entries: grow, unless removed keys are
+           taking the room */
+        size_t capacity = dict->capacity == 0 ? DICT_GROUP : dict->capacity;
+        if (dict->count + 1 > dict_max_load(capacity) / 2) capacity *= 2;
+        dict_rehash(dict, capacity);
+        bucket = dict_free_bucket(dict, hash);
+    }
+    if (dict->used == dict->entry_capacity) {
+        size_t capacity = dict->entry_capacity < 4 ? 4 : dict->entry_capacity * 2;
+        size_t most = dict_max_load(dict->capacity);
+        if (capacity > most) capacity = most;
+        dict->entries = (DictEntry *)reallocate(dict->entries, sizeof(DictEntry) * dict->entry_capacity,
+                                                sizeof(DictEntry) * capacity);
+        dict->entry_capacity = capacity;
     }
+
+    if (dict->ctrl[bucket] == CTRL_EMPTY) dict->growth_left--;
+    dict->ctrl[bucket] = hash & 0x7F;
+    dict_slots(dict)[bucket] = (uint32_t)dict->used;
+    DictEntry *entry = &dict->entries[dict->used++];
+    entry->key = key;
     entry->value = value;
+    dict->count++;
+    gc_write_barrier((Obj *)dict, OBJ_VAL(key));
+    gc_write_barrier((Obj *)dict, value);
 }
 
 bool dict_get(ObjDict *dict, ObjString *key, Value *value) {
+    long bucket = dict_find_bucket(dict, string_bytes(key), key->length, string_hash(key));
+    if (bucket < 0) return false;
+    *value = dict->entries[dict_slots(dict)[bucket]].value;
+    return true;
+}
+
+/* Lookup by raw characters, without allocating a key string */
+bool dict_get_chars(ObjDict *dict, const char *chars, size_t length, Value *value) {
     if (dict->count == 0) return false;
-    DictEntry *entry = dict_find_entry(dict->entries, dict->capacity, key);
-    if (entry->key == NULL) return false;
-    *value = entry->value;
+    long bucket = dict_find_bucket(dict, chars, length, hash_string(chars, length));
+    if (bucket < 0) return false;
+    *value = dict->entries[dict_slots(dict)[bucket]].value;
     return true;
 }
 
 bool dict_delete(ObjDict *dict, ObjString *key) {
-    if (dict->count == 0) return false;
-    DictEntry *entry = dict_find_entry(dict->entries, dict->capacity, key);
-    if (entry->key == NULL) return false;
+    long bucket = dict_find_bucket(dict, string_bytes(key), key->length, string_hash(key));
+    if (bucket < 0) return false;
+    /* A group that still has an empty bucket ends every probe reaching it,
+       so the bucket can go back to empty; otherwise it stays on the path */
+    uint8_t *group = dict->ctrl + (size_t)bucket / DICT_GROUP * DICT_GROUP;
+    if (group_match(group, CTRL_EMPTY)) {
+        dict->ctrl[bucket] = CTRL_EMPTY;
+        dict->growth_left++;
+    } else {
+        dict->ctrl[bucket] = CTRL_DELETED;
+    }
+    DictEntry *entry = &dict->entries[dict_slots(dict)[bucket]];
     entry->key = NULL;
     entry->value = NIL_VAL;
+    dict->count--;
+    while (dict->used > 0 && dict->entries[dict->used - 1].key == NULL) dict->used--;
     return true;
 }
 
@@ -223,9 +780,10 @@ void value_print(Value value) {
         case VAL_NIL:    printf("nil"); break;
         case VAL_BOOL:   printf(AS_BOOL(value) ? "true" : "false"); break;
         case VAL_NUMBER: printf("%.14g", AS_NUMBER(value)); break;
+        case VAL_UNDEFINED: printf("undefined"); break;
         case VAL_OBJ: {
             switch (AS_OBJ(value)->type) {
-                case OBJ_STRING:  printf("%s", AS_STRING(value)->chars); break;
+                case OBJ_STRING:  printf("%.*s", (int)AS_STRING(value)->length, string_bytes(AS_STRING(value))); break;
                 case OBJ_LIST: {
                     printf("[< ");
                     ObjList *list = AS_LIST(value);
@@ -250,7 +808,7 @@ void value_print(Value value) {
                     printf("{< ");
                     ObjDict *dict = AS_DICT(value);
                     size_t printed = 0;
-                    for (size_t i = 0; i < dict->capacity; i++) {
+                    for (size_t i = 0; i < dict->used; i++) {
                         DictEntry *entry = &dict->entries[i];
                         if (entry->key == NULL) continue;
                         value_print(OBJ_VAL(entry->key));
@@ -269,6 +827,20 @@ void value_print(Value value) {
                 case OBJ_CLASS:     printf("<class %s>", AS_CLASS(value)->name); break;
                 case OBJ_INSTANCE:  printf("<instance %s>", AS_INSTANCE(value)->klass->name); break;
                 case OBJ_NATIVE:    printf("<native fn %s>", AS_NATIVE(value)->name); break;
+                case OBJ_FUTURE:    printf("<future>"); break;
+                case OBJ_GENERATOR: printf("<generator>"); break;
+                case OBJ_RANGE:     printf("<range>"); break;
+                case OBJ_ENTRIES:   printf("<entries>"); break;
+                case OBJ_ARRAY: {
+                    ObjArray *array = AS_ARRAY(value);
+                    printf("%s[< ", array_type_name(array->type));
+                    for (size_t i = 0; i < array->count; i++) {
+                        printf("%.14g", array_get(array, i));
+                        if (i + 1 < array->count) printf(",, ");
+                    }
+                    printf(" >]");
+                    break;
+                }
             }
             break;
         }
@@ -276,15 +848,16 @@ void value_print(Value value) {
 }
 
 const char *value_to_string(Value value) {
-    static char buffer[256];
+    static _Thread_local char buffer[256];
     switch (value.type) {
         case VAL_NIL:    return "nil";
         case VAL_BOOL:   return AS_BOOL(value) ? "true" : "false";
         case VAL_NUMBER:
             snprintf(buffer, sizeof(buffer), "%.14g", AS_NUMBER(value));
             return buffer;
+        case VAL_UNDEFINED: return "undefined";
         case VAL_OBJ:
-            if (IS_STRING(value)) return AS_STRING(value)->chars;
+            if (IS_STRING(value)) return string_chars(AS_STRING(value));
             return "<object>";
     }
     return "<unknown>";
@@ -302,6 +875,11 @@ const char *value_type_name(Value value) {
     if (IS_CLASS(value))     return "class";
     if (IS_INSTANCE(value))  return "instance";
     if (IS_NATIVE(value))    return "native";
+    if (IS_FUTURE(value))    return "future";
+    if (IS_GENERATOR(value)) return "generator";
+    if (IS_RANGE(value))     return "range";
+    if (IS_ENTRIES(value))   return "entries";
+    if (IS_ARRAY(value))     return "array";
     return "unknown";
 }
 
@@ -313,6 +891,7 @@ bool values_equal(Value a, Value b) {
     if (a.type != b.type) return false;
     switch (a.type) {
         case VAL_NIL:    return true;
+        case VAL_UNDEFINED: return true;
         case VAL_BOOL:   return AS_BOOL(a) == AS_BOOL(b);
         case VAL_NUMBER: return AS_NUMBER(a) == AS_NUMBER(b);
         case VAL_OBJ: {
@@ -320,7 +899,9 @@ bool values_equal(Value a, Value b) {
             if (IS_STRING(a)) {
                 ObjString *as = AS_STRING(a);
                 ObjString *bs = AS_STRING(b);
-                return as->length == bs->length && memcmp(as->chars, bs->chars, as->length) == 0;
+                if (as == bs) return true;
+                if (as->interned && bs->interned) return false;
+                return as->length == bs->length && memcmp(string_bytes(as), string_bytes(bs), as->length) == 0;
             }
             return AS_OBJ(a) == AS_OBJ(b);
         }
@@ -332,31 +913,31 @@ bool values_equal(Value a, Value b) {
 /* Object Cleanup                                                           */
 /* ========================================================================= */
 
-void free_object(Obj *obj) {
+/* Release what an object owns; the collector reclaims the object itself. */
+void free_object_contents(Obj *obj) {
     if (!obj) return;
     switch (obj->type) {
         case OBJ_STRING: {
             ObjString *s = (ObjString *)obj;
-            free(s->chars);
-            free(s);
+            if (s->interned) intern_forget(s);
+            if (s->kind != STRING_FLAT && atomic_load(&s->text))
+                reallocate((void *)atomic_load(&s->text), s->length + 1, 0);
             break;
         }
         case OBJ_LIST: {
             ObjList *l = (ObjList *)obj;
-            free(l->items);
-            free(l);
+            reallocate(l->items, sizeof(Value) * l->capacity, 0);
             break;
         }
         case OBJ_TUPLE: {
             ObjTuple *t = (ObjTuple *)obj;
-            free(t->items);
-            free(t);
+            reallocate(t->items, sizeof(Value) * t->count, 0);
             break;
         }
         case OBJ_DICT: {
             ObjDict *d = (ObjDict *)obj;
-            free(d->entries);
-            free(d);
+            reallocate(d->entries, sizeof(DictEntry) * d->entry_capacity, 0);
+            reallocate(d->ctrl, dict_table_size(d->capacity), 0);
             break;
         }
         case OBJ_FUNCTION: {
@@ -371,27 +952,36 @@ void free_object(Obj *obj) {
                 free(f->param_types);
             }
             free(f->return_type);
-            free(f);
             break;
         }
         case OBJ_CLASS: {
             ObjClass *c = (ObjClass *)obj;
             free(c->name);
             /* methods dict is tracked separately by GC */
-            free(c);
             break;
         }
-        case OBJ_INSTANCE: {
-            ObjInstance *i = (ObjInstance *)obj;
+        case OBJ_INSTANCE:
             /* fields dict is tracked separately by GC */
-            free(i);
             break;
-        }
         case OBJ_NATIVE: {
             ObjNative *n = (ObjNative *)obj;
             free(n->name);
-            free(n);
             break;
         }
+        case OBJ_FUTURE:
+            future_release(((ObjFuture *)obj)->state);
+            break;
+        case OBJ_GENERATOR:
+            generator_release(((ObjGenerator *)obj)->state);
+            break;
+        case OBJ_ARRAY: {
+            ObjArray *a = (ObjArray *)obj;
+            gc_account(-(ptrdiff_t)array_bytes(a));
+            free(a->data);
+            break;
+        }
+        case OBJ_RANGE:
+        case OBJ_ENTRIES:
+            break;
     }
 }
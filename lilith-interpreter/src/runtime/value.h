@@ -1,6 +1,7 @@
 #ifndef LILITH_VALUE_H
 #define LILITH_VALUE_H
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -8,6 +9,8 @@
 /* Forward declarations */
 struct AstNode;
 struct Environment;
+struct Chunk;
+struct AstScope;
 
 /* -------------------------------------------------------------------------- */
 /* Object system                                                              */
@@ -24,10 +27,18 @@ typedef enum {
     OBJ_CLASS,
     OBJ_INSTANCE,
     OBJ_NATIVE,
+    OBJ_FUTURE,
+    OBJ_GENERATOR,
+    OBJ_RANGE,
+    OBJ_ENTRIES,
+    OBJ_ARRAY,
 } ObjType;
 
 struct Obj {
     ObjType type;
+    unsigned char marked;
+    unsigned char space;        /* see gc.h */
+    atomic_uchar remembered;    /* in the collector's remembered set */
     Obj *next; /* Intrusive GC list */
 };
 
@@ -40,6 +51,7 @@ typedef enum {
     VAL_BOOL,
     VAL_NUMBER,
     VAL_OBJ,
+    VAL_UNDEFINED,  /* an environment slot that has not been assigned yet */
 } ValueType;
 
 typedef struct {
@@ -55,13 +67,44 @@ typedef struct {
 /* Object subtypes                                                            */
 /* -------------------------------------------------------------------------- */
 
-typedef struct {
+/* A string is flat, its bytes inline; a rope, the concatenation of two
+   others; or a view of part of another's bytes.  A rope is flattened into
+   a buffer of its own when its bytes are first needed, a view only when
+   they must end in a NUL.  Read the bytes through string_bytes, or
+   string_chars for a C string. */
+typedef enum {
+    STRING_FLAT,
+    STRING_ROPE,
+    STRING_VIEW,
+} StringKind;
+
+typedef struct ObjString {
     Obj obj;
-    char *chars;
     size_t length;
-    uint32_t hash;
+    atomic_uint_fast64_t hash;  /* 0 until first needed, see string_hash */
+    bool interned;      /* the canonical copy of its contents */
+    unsigned char kind; /* StringKind */
+    _Atomic(const char *) text;     /* a rope's or view's bytes, once flattened */
+    _Alignas(void *) char chars[];  /* length bytes and a NUL, a StringRope or a StringView */
 } ObjString;
 
+/* A rope's halves; the collector drops them once it is flat */
+typedef struct {
+    ObjString *left;
+    ObjString *right;
+} StringRope;
+
+/* Bytes that never move, those of an old flat string or a flattened
+   one, and the string that owns them; the collector drops the parent
+   once the view is flat */
+typedef struct {
+    ObjString *parent;
+    const char *bytes;
+} StringView;
+
+#define STRING_ROPE_OF(str) ((StringRope *)(void *)(str)->chars)
+#define STRING_VIEW_OF(str) ((StringView *)(void *)(str)->chars)
+
 typedef struct {
     Obj obj;
     Value *items;
@@ -80,11 +123,21 @@ typedef struct {
     Value value;
 } DictEntry;
 
+/* Open addressing over groups of 16 buckets.  A bucket is one control byte
+   (empty, deleted, or the low 7 bits of its key's hash) and the index of
+   its entry; a lookup compares a whole group's control bytes at once and
+   only looks at entries whose byte matches.  Entries stay in insertion
+   order, removed ones keep a NULL key until the table is rebuilt. */
 typedef struct {
     Obj obj;
     DictEntry *entries;
-    size_t count;
-    size_t capacity;
+    size_t count;           /* live entries */
+    size_t used;            /* entries filled, live or removed */
+    size_t entry_capacity;
+    uint8_t *ctrl;          /* `capacity` control bytes, then as many uint32_t entry indices */
+    size_t capacity;        /* buckets: 0 or a power of two, at least 16 */
+    size_t growth_left;     /* empty buckets that may still be filled */
+    size_t epoch;           /* bumped whenever the entries are renumbered */
 } ObjDict;
 
 typedef struct {
@@ -96,8 +149,11 @@ typedef struct {
     struct AstNode *body;
     char *return_type;    /* NULL = unannotated */
     int is_async;
+    int is_generator;     /* the body yields */
     int implicit_return;
     struct Environment *closure;
+    struct AstScope *scope; /* slot layout of the call environment */
+    struct Chunk *chunk;  /* compiled body, NULL under the tree-walker */
 } ObjFunction;
 
 struct ObjClass;
@@ -121,8 +177,56 @@ typedef struct {
     Obj obj;
     NativeFn fn;
     char *name;
+    int pure;           /* no side effects: may run in parallel comprehensions */
 } ObjNative;
 
+struct FutureState;
+
+/* The result of a call running on another thread, see future.h */
+typedef struct {
+    Obj obj;
+    struct FutureState *state;
+} ObjFuture;
+
+struct GeneratorState;
+
+/* A suspended call to a generator function, see generator.h */
+typedef struct {
+    Obj obj;
+    struct GeneratorState *state;
+} ObjGenerator;
+
+/* Element types of a numeric array */
+typedef enum {
+    ARRAY_FLOAT64,
+    ARRAY_FLOAT32,
+    ARRAY_INT32,
+    ARRAY_INT8,
+} ArrayType;
+
+/* A fixed-length run of unboxed numbers of one type, 64-byte aligned; see
+   array.h */
+typedef struct {
+    Obj obj;
+    ArrayType type;
+    void *data;
+    size_t count;
+} ObjArray;
+
+/* seq..range: start, start + step, ... up to but excluding its end */
+typedef struct {
+    Obj obj;
+    double start;
+    double step;
+    size_t count;
+} ObjRange;
+
+/* seq..entries: the (key,, value) pairs of a dict, read as it is walked */
+typedef struct {
+    Obj obj;
+    ObjDict *dict;
+} ObjEntries;
+
 /* -------------------------------------------------------------------------- */
 /* Value macros                                                               */
 /* -------------------------------------------------------------------------- */
@@ -131,6 +235,7 @@ typedef struct {
 #define BOOL_VAL(v)      ((Value){VAL_BOOL,  { .boolean = (v) }})
 #define NUMBER_VAL(v)    ((Value){VAL_NUMBER,{ .number = (v) }})
 #define OBJ_VAL(o)       ((Value){VAL_OBJ,   { .obj = (Obj*)(o) }})
+#define UNDEFINED_VAL    ((Value){VAL_UNDEFINED, { .number = 0 }})
 
 #define AS_BOOL(v)       ((v).as.boolean)
 #define AS_NUMBER(v)     ((v).as.number)
@@ -140,6 +245,7 @@ typedef struct {
 #define IS_BOOL(v)       ((v).type == VAL_BOOL)
 #define IS_NUMBER(v)     ((v).type == VAL_NUMBER)
 #define IS_OBJ(v)        ((v).type == VAL_OBJ)
+#define IS_UNDEFINED(v)  ((v).type == VAL_UNDEFINED)
 
 #define IS_STRING(v)     (is_obj_type(v, OBJ_STRING))
 #define IS_LIST(v)       (is_obj_type(v, OBJ_LIST))
@@ -149,6 +255,11 @@ typedef struct {
 #define IS_CLASS(v)      (is_obj_type(v, OBJ_CLASS))
 #define IS_INSTANCE(v)   (is_obj_type(v, OBJ_INSTANCE))
 #define IS_NATIVE(v)     (is_obj_type(v, OBJ_NATIVE))
+#define IS_FUTURE(v)     (is_obj_type(v, OBJ_FUTURE))
+#define IS_GENERATOR(v)  (is_obj_type(v, OBJ_GENERATOR))
+#define IS_RANGE(v)      (is_obj_type(v, OBJ_RANGE))
+#define IS_ENTRIES(v)    (is_obj_type(v, OBJ_ENTRIES))
+#define IS_ARRAY(v)      (is_obj_type(v, OBJ_ARRAY))
 
 #define AS_STRING(v)     ((ObjString*)AS_OBJ(v))
 #define AS_LIST(v)       ((ObjList*)AS_OBJ(v))
@@ -158,6 +269,11 @@ typedef struct {
 #define AS_CLASS(v)      ((ObjClass*)AS_OBJ(v))
 #define AS_INSTANCE(v)   ((ObjInstance*)AS_OBJ(v))
 #define AS_NATIVE(v)     ((ObjNative*)AS_OBJ(v))
+#define AS_FUTURE(v)     ((ObjFuture*)AS_OBJ(v))
+#define AS_GENERATOR(v)  ((ObjGenerator*)AS_OBJ(v))
+#define AS_RANGE(v)      ((ObjRange*)AS_OBJ(v))
+#define AS_ENTRIES(v)    ((ObjEntries*)AS_OBJ(v))
+#define AS_ARRAY(v)      ((ObjArray*)AS_OBJ(v))
 
 static inline bool is_obj_type(Value value, ObjType type) {
     return IS_OBJ(value) && AS_OBJ(value)->type == type;
@@ -172,8 +288,15 @@ Value value_bool(bool b);
 Value value_number(double n);
 Value value_obj(Obj *obj);
 
-ObjString *obj_string_take(char *chars, size_t length);
+/* Strings keep their bytes inline, so allocating one may move another:
+   `chars` must not point into a heap string unless the caller is pinned.
+   One-byte strings come from a static table and never allocate. */
+ObjString *obj_string_take(char *chars, size_t length);   /* frees `chars` */
 ObjString *obj_string_copy(const char *chars, size_t length);
+ObjString *obj_string_byte(unsigned char byte);
+/* The one canonical string with these contents, shared by identifiers,
+   literals and dict keys.  Held weakly; never collects. */
+ObjString *obj_string_intern(const char *chars, size_t length);
 ObjList *obj_list_new(void);
 ObjTuple *obj_tuple_new(size_t count);
 ObjDict *obj_dict_new(void);
@@ -181,6 +304,11 @@ ObjFunction *obj_function_new(const char *name);
 ObjClass *obj_class_new(const char *name);
 ObjInstance *obj_instance_new(ObjClass *klass);
 ObjNative *obj_native_new(NativeFn fn, const char *name);
+ObjFuture *obj_future_new(struct FutureState *state);
+ObjGenerator *obj_generator_new(struct GeneratorState *state);
+ObjRange *obj_range_new(double start, double step, size_t count);
+ObjEntries *obj_entries_new(ObjDict *dict);
+ObjArray *obj_array_new(ArrayType type, size_t count);
 
 void value_array_write(ObjList *list, Value value);
 void value_print(Value value);
@@ -188,12 +316,60 @@ const char *value_to_string(Value value);
 const char *value_type_name(Value value);
 bool values_equal(Value a, Value b);
 
-uint32_t hash_string(const char *key, size_t length);
+/* Concatenation; both must be reachable from roots, as either may be
+   kept as a rope half.  Short results are flat. */
+ObjString *obj_string_concat(ObjString *a, ObjString *b);
+
+/* `length` bytes of `parent` from `offset` on.  Long enough pieces of a
+   string whose bytes stay put are views, the rest copies.  The parent
+   must be reachable from roots. */
+ObjString *obj_string_slice(ObjString *parent, size_t offset, size_t length);
+
+/* Flattens a rope or view; only allocates the buffer, never collects */
+const char *string_flatten(ObjString *str);
+
+/* NUL-terminated */
+static inline const char *string_chars(ObjString *str) {
+    if (str->kind == STRING_FLAT) return str->chars;
+    const char *text = atomic_load_explicit(&str->text, memory_order_acquire);
+    return text ? text : string_flatten(str);
+}
+
+/* `length` bytes, not NUL-terminated for a view */
+static inline const char *string_bytes(ObjString *str) {
+    if (str->kind == STRING_VIEW) {
+        const char *text = atomic_load_explicit(&str->text, memory_order_acquire);
+        return text ? text : STRING_VIEW_OF(str)->bytes;
+    }
+    return string_chars(str);
+}
+
+static inline size_t string_size(const ObjString *str) {
+    switch (str->kind) {
+        case STRING_ROPE: return sizeof(ObjString) + sizeof(StringRope);
+        case STRING_VIEW: return sizeof(ObjString) + sizeof(StringView);
+    }
+    return sizeof(ObjString) + str->length + 1;
+}
+
+/* Seeded per process and never 0 */
+uint64_t hash_string(const char *key, size_t length);
+
+/* Hashed on first use as a key; racing threads store the same value */
+static inline uint64_t string_hash(ObjString *str) {
+    uint64_t hash = atomic_load_explicit(&str->hash, memory_order_relaxed);
+    if (hash == 0) {
+        hash = hash_string(string_bytes(str), str->length);
+        atomic_store_explicit(&str->hash, hash, memory_order_relaxed);
+    }
+    return hash;
+}
 
 void dict_set(ObjDict *dict, ObjString *key, Value value);
 bool dict_get(ObjDict *dict, ObjString *key, Value *value);
+bool dict_get_chars(ObjDict *dict, const char *chars, size_t length, Value *value);
 bool dict_delete(ObjDict *dict, ObjString *key);
 
-void free_object(Obj *obj);
+void free_object_contents(Obj *obj);
 
 #endif
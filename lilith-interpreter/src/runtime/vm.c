@@ -0,0 +1,894 @@
+#define _GNU_SOURCE
+#include "vm.h"
+#include "compiler.h"
+#include "gc.h"
+#include "future.h"
+#include "generator.h"
+#include "iterator.h"
+#include "stdlib/seq.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Labels-as-values dispatch where the compiler supports it, a plain switch
+   everywhere else. */
+#if defined(__GNUC__) && !defined(LILITH_VM_SWITCH_DISPATCH)
+#define VM_COMPUTED_GOTO 1
+#endif
+
+/* ========================================================================= */
+/* Lifecycle                                                                 */
+/* ========================================================================= */
+
+Vm *vm_new(void) {
+    Vm *vm = (Vm *)calloc(1, sizeof(Vm));
+    if (vm) {
+        vm->stack = (Value *)malloc(sizeof(Value) * VM_STACK_MAX);
+        vm->frames = (CallFrame *)malloc(sizeof(CallFrame) * VM_FRAMES_MAX);
+        vm->handlers = (Handler *)malloc(sizeof(Handler) * VM_HANDLERS_MAX);
+    }
+    if (!vm || !vm->stack || !vm->frames || !vm->handlers) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    vm->stack_top = vm->stack;
+    return vm;
+}
+
+void vm_free(Vm *vm) {
+    if (!vm) return;
+    for (size_t i = 0; i < vm->program_count; i++) chunk_free(vm->programs[i]);
+    free(vm->programs);
+    free(vm->stack);
+    free(vm->frames);
+    free(vm->handlers);
+    free(vm);
+}
+
+static void mark_chunk(Chunk *chunk) {
+    for (size_t i = 0; i < chunk->constant_count; i++) gc_mark_slot(&chunk->constants[i]);
+    for (size_t i = 0; i < chunk->name_count; i++) gc_mark_object_slot((Obj **)&chunk->names[i]);
+    for (size_t i = 0; i < chunk->proto_count; i++) mark_chunk(chunk->protos[i]);
+}
+
+/* The interpreter loop keeps its stack pointer in a local; it stores it to
+   vm->stack_top before anything that may allocate, so this sees exactly the
+   live slots.  A collection may move what they hold: the loop re-reads the
+   stack rather than keeping object pointers across an allocation. */
+void vm_mark_roots(Vm *vm) {
+    for (Value *slot = vm->stack; slot < vm->stack_top; slot++) gc_mark_slot(slot);
+    for (int i = 0; i < vm->frame_count; i++) {
+        CallFrame *frame = &vm->frames[i];
+        gc_mark_env(frame->call_env);
+        gc_mark_env(frame->saved_env);
+        gc_mark_object_slot((Obj **)&frame->saved_function);
+        gc_mark_slot(&frame->receiver);
+    }
+    for (int i = 0; i < vm->handler_count; i++) gc_mark_env(vm->handlers[i].env);
+    for (size_t i = 0; i < vm->program_count; i++) mark_chunk(vm->programs[i]);
+}
+
+/* ========================================================================= */
+/* Calls                                                                     */
+/* ========================================================================= */
+
+static CallFrame *push_frame(Vm *vm, Interpreter *interp, FrameKind kind, Chunk *chunk, Value *base, size_t line) {
+    if (vm->frame_count >= VM_FRAMES_MAX || base + chunk->max_stack + 1 > vm->stack + VM_STACK_MAX) {
+        runtime_error_at(interp, line, "Stack overflow.");
+        return NULL;
+    }
+    CallFrame *frame = &vm->frames[vm->frame_count++];
+    frame->kind = kind;
+    frame->chunk = chunk;
+    frame->ip = chunk->code;
+    frame->base = base;
+    frame->call_env = NULL;
+    frame->saved_env = interp->env;
+    frame->saved_function = interp->current_function;
+    frame->receiver = NIL_VAL;
+    return frame;
+}
+
+/* Enter `fn` with a fresh environment.  The arguments have already been
+   bound by the caller; the frame starts at `base`. */
+static int enter_function(Vm *vm, Interpreter *interp, ObjFunction *fn, FrameKind kind,
+                          Environment *call_env, Value *base, size_t line) {
+    if (!fn->chunk) {
+        runtime_error_at(interp, line, "Function '%s' has no compiled body.", fn->name ? fn->name : "<lambda>");
+        env_leave(&interp->frames, call_env);
+        return 0;
+    }
+    CallFrame *frame = push_frame(vm, interp, kind, fn->chunk, base, line);
+    if (!frame) {
+        env_leave(&interp->frames, call_env);
+        return 0;
+    }
+    frame->call_env = call_env;
+    interp->env = call_env;
+    vm->stack_top = base;
+    return 1;
+}
+
+/* Callee and arguments sit on top of the stack. */
+static int call_value(Vm *vm, Interpreter *interp, int argc, size_t line) {
+    Value *args = vm->stack_top - argc;
+    Value *base = args - 1;
+    Value callee = *base;
+
+    if (IS_NATIVE(callee)) {
+        size_t pin = gc_pin_begin();
+        Value result = AS_NATIVE(callee)->fn(argc, args);
+        gc_pin_end(pin);
+        vm->stack_top = base;
+        *vm->stack_top++ = result;
+        /* Natives that call back into the interpreter may fail */
+        return !interp->throw_flag;
+    }
+
+    if (IS_FUNCTION(callee)) {
+        ObjFunction *fn = AS_FUNCTION(callee);
+        size_t bound = fn->param_count < (size_t)argc ? fn->param_count : (size_t)argc;
+
+        /* Type-check arguments before binding */
+        for (size_t i = 0; i < bound; i++) {
+            if (fn->param_types && fn->param_types[i] && !interp_check_type(args[i], fn->param_types[i])) {
+                fprintf(stderr, "Type error: Expected argument %zu to be %s, got %s\n",
+                        i + 1, fn->param_types[i], value_type_name(args[i]));
+                vm->stack_top = base;
+                *vm->stack_top++ = NIL_VAL;
+                return 1;
+            }
+        }
+
+        Environment *call_env = interp_call_env(interp, fn);
+        for (size_t i = 0; i < bound; i++) call_env->slots[i] = args[i];
+        if (!enter_function(vm, interp, fn, FRAME_CALL, call_env, base, line)) return 0;
+        interp->current_function = fn;
+        return 1;
+    }
+
+    if (IS_CLASS(callee)) {
+        ObjClass *klass = AS_CLASS(callee);
+        ObjInstance *inst = obj_instance_new(klass);
+        Value init_val;
+        if (interp_lookup_init(klass, &init_val) && IS_FUNCTION(init_val)) {
+            ObjFunction *init = AS_FUNCTION(init_val);
+            Environment *call_env = interp_call_env(interp, init);
+            if (init->param_count > 0) call_env->slots[0] = OBJ_VAL(inst);
+            for (size_t i = 1; i < init->param_count && (i - 1) < (size_t)argc; i++) {
+                call_env->slots[i] = args[i - 1];
+            }
+            if (!enter_function(vm, interp, init, FRAME_INIT, call_env, base, line)) return 0;
+            vm->frames[vm->frame_count - 1].receiver = OBJ_VAL(inst);
+            return 1;
+        }
+        vm->stack_top = base;
+        *vm->stack_top++ = OBJ_VAL(inst);
+        return 1;
+    }
+
+    runtime_error_at(interp, line, "Can only call functions and classes.");
+    return 0;
+}
+
+/* Calling a generator function makes its generator instead of a frame,
+   and calling an async function starts it as a coroutine on the event
+   loop: the generator or future replaces everything from `base` up */
+static void spawn_call(Vm *vm, Interpreter *interp, Value callee, int argc, Value *args, Value *base) {
+    size_t roots = gc_root_depth();
+    gc_push_root(callee);
+    Obj *result = AS_FUNCTION(callee)->is_generator ? (Obj *)generator_new(interp, callee, argc, args)
+                                                    : (Obj *)future_spawn_coroutine(interp, callee, argc, args);
+    gc_restore_roots(roots);
+    vm->stack_top = base;
+    *vm->stack_top++ = OBJ_VAL(result);
+}
+
+/* obj.name((args)): receiver and arguments sit on top of the stack. */
+static int invoke(Vm *vm, Interpreter *interp, ObjString *name, int argc, size_t line) {
+    Value *base = vm->stack_top - argc - 1;
+    Value obj = *base;
+
+    ObjFunction *method = NULL;
+    Value val;
+    if (IS_INSTANCE(obj)) {
+        ObjInstance *inst = AS_INSTANCE(obj);
+        if (dict_get(inst->fields, name, &val) && IS_FUNCTION(val))
+            method = AS_FUNCTION(val);
+        if (!method && interp_lookup_method(inst->klass, name, &val) && IS_FUNCTION(val))
+            method = AS_FUNCTION(val);
+    } else if (IS_CLASS(obj)) {
+        if (interp_lookup_method(AS_CLASS(obj), name, &val) && IS_FUNCTION(val))
+            method = AS_FUNCTION(val);
+    } else if (IS_LIST(obj) || IS_DICT(obj) || IS_STRING(obj) || IS_TUPLE(obj)) {
+        if (strcmp(string_chars(name), "length") == 0) {
+            vm->stack_top = base;
+            *vm->stack_top++ = native_seq_len(1, &obj);
+            return 1;
+        }
+    }
+
+    if (!method) {
+        runtime_error_at(interp, line, "Undefined method '%s'.", string_chars(name));
+        return 0;
+    }
+
+    /* The receiver binds to the first parameter, conventionally self */
+    if (method->is_async || method->is_generator) {
+        spawn_call(vm, interp, OBJ_VAL(method), argc + 1, base, base);
+        return 1;
+    }
+    Environment *call_env = interp_call_env(interp, method);
+    for (size_t i = 0; i < method->param_count && i < (size_t)argc + 1; i++) {
+        call_env->slots[i] = base[i];
+    }
+    return enter_function(vm, interp, method, FRAME_CALL, call_env, base, line);
+}
+
+/* Pop the current frame.  Returns 1 once the program frame itself ends. */
+static int return_from(Vm *vm, Interpreter *interp, Value result) {
+    CallFrame *frame = &vm->frames[vm->frame_count - 1];
+    int index = vm->frame_count - 1;
+    while (vm->handler_count > 0 && vm->handlers[vm->handler_count - 1].frame >= index) vm->handler_count--;
+    vm->frame_count--;
+
+    interp->env = frame->saved_env;
+    interp->current_function = frame->saved_function;
+    if (frame->kind == FRAME_PROGRAM) {
+        vm->stack_top = frame->base;
+        return 1;
+    }
+    env_leave(&interp->frames, frame->call_env);
+    vm->stack_top = frame->base;
+    *vm->stack_top++ = frame->kind == FRAME_INIT ? frame->receiver : result;
+    return 0;
+}
+
+/* Transfer control to the innermost try block, discarding frames above it.
+   Returns 0 when nothing catches the error. */
+static int unwind(Vm *vm, Interpreter *interp, int base_frame) {
+    int caught = vm->handler_count > 0 && vm->handlers[vm->handler_count - 1].frame >= base_frame;
+    int target = caught ? vm->handlers[vm->handler_count - 1].frame : base_frame - 1;
+
+    while (vm->frame_count - 1 > target) {
+        CallFrame *frame = &vm->frames[--vm->frame_count];
+        interp->env = frame->saved_env;
+        interp->current_function = frame->saved_function;
+        if (frame->call_env) env_leave(&interp->frames, frame->call_env);
+        vm->stack_top = frame->base;
+    }
+    if (!caught) return 0;
+
+    Handler *handler = &vm->handlers[--vm->handler_count];
+    const char *msg = interp->error_msg ? interp->error_msg : "unknown error";
+    Value err = OBJ_VAL(obj_string_copy(msg, strlen(msg)));
+    interp->throw_flag = 0;
+    if (interp->error_msg) { free(interp->error_msg); interp->error_msg = NULL; }
+
+    interp->env = handler->env;
+    vm->stack_top = handler->stack_top;
+    *vm->stack_top++ = err;
+    vm->frames[vm->frame_count - 1].ip = handler->catch_ip;
+    return 1;
+}
+
+/* ========================================================================= */
+/* Interpreter loop                                                          */
+/* ========================================================================= */
+
+static Value execute(Vm *vm, Interpreter *interp, int base_frame) {
+    CallFrame *frame;
+    uint8_t *ip;
+    Value *sp;
+    Value result = NIL_VAL;
+
+#define LOAD_FRAME() do { \
+        frame = &vm->frames[vm->frame_count - 1]; \
+        ip = frame->ip; \
+        sp = vm->stack_top; \
+    } while (0)
+#define SAVE_FRAME() do { frame->ip = ip; vm->stack_top = sp; } while (0)
+/* Publish the stack to the collector before an allocation */
+#define SYNC_STACK() (vm->stack_top = sp)
+
+#define READ_BYTE()   (*ip++)
+#define READ_U16()    (ip += 2, (uint16_t)((ip[-2] << 8) | ip[-1]))
+#define PUSH(v)       (*sp++ = (v))
+#define POP()         (*--sp)
+#define PEEK(n)       (sp[-1 - (n)])
+#define LINE()        (frame->chunk->lines[ip - frame->chunk->code - 1])
+#define NAME(i)       (frame->chunk->names[(i)])
+#define THROW()       goto throw_error
+#define CHECK_THROW() do { if (interp->throw_flag) THROW(); } while (0)
+
+#define NUMERIC_OP(ast_op, expr) do { \
+        Value r = POP(); \
+        Value l = PEEK(0); \
+        if (IS_NUMBER(l) && IS_NUMBER(r)) { \
+            double a = AS_NUMBER(l), b = AS_NUMBER(r); \
+            PEEK(0) = (expr); \
+        } else { \
+            SYNC_STACK(); \
+            PEEK(0) = interp_binary(interp, (ast_op), l, r, LINE()); \
+            CHECK_THROW(); \
+        } \
+    } while (0)
+
+#ifdef VM_COMPUTED_GOTO
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+    static void *dispatch_table[] = {
+        [OP_CONSTANT] = &&L_OP_CONSTANT, [OP_NIL] = &&L_OP_NIL, [OP_TRUE] = &&L_OP_TRUE,
+        [OP_FALSE] = &&L_OP_FALSE, [OP_POP] = &&L_OP_POP,
+        [OP_GET_LOCAL] = &&L_OP_GET_LOCAL, [OP_SET_LOCAL] = &&L_OP_SET_LOCAL,
+        [OP_GET_ENCLOSING] = &&L_OP_GET_ENCLOSING, [OP_SET_ENCLOSING] = &&L_OP_SET_ENCLOSING,
+        [OP_GET_GLOBAL] = &&L_OP_GET_GLOBAL, [OP_SET_GLOBAL] = &&L_OP_SET_GLOBAL,
+        [OP_GET_MEMBER] = &&L_OP_GET_MEMBER, [OP_SET_MEMBER] = &&L_OP_SET_MEMBER,
+        [OP_GET_INDEX] = &&L_OP_GET_INDEX, [OP_SET_INDEX] = &&L_OP_SET_INDEX,
+        [OP_PLUS] = &&L_OP_PLUS, [OP_MINUS] = &&L_OP_MINUS, [OP_TIMES] = &&L_OP_TIMES,
+        [OP_DIVIDE] = &&L_OP_DIVIDE, [OP_MODULO] = &&L_OP_MODULO, [OP_EQUAL] = &&L_OP_EQUAL,
+        [OP_NOT_EQUAL] = &&L_OP_NOT_EQUAL, [OP_LESS] = &&L_OP_LESS, [OP_GREATER] = &&L_OP_GREATER,
+        [OP_NEGATE] = &&L_OP_NEGATE,
+        [OP_JUMP] = &&L_OP_JUMP, [OP_JUMP_IF_FALSE] = &&L_OP_JUMP_IF_FALSE, [OP_LOOP] = &&L_OP_LOOP,
+        [OP_CALL] = &&L_OP_CALL, [OP_INVOKE] = &&L_OP_INVOKE, [OP_CLOSURE] = &&L_OP_CLOSURE,
+        [OP_CLASS] = &&L_OP_CLASS, [OP_METHOD] = &&L_OP_METHOD, [OP_RETURN] = &&L_OP_RETURN,
+        [OP_END] = &&L_OP_END,
+        [OP_BUILD_LIST] = &&L_OP_BUILD_LIST, [OP_BUILD_TUPLE] = &&L_OP_BUILD_TUPLE,
+        [OP_BUILD_DICT] = &&L_OP_BUILD_DICT, [OP_LIST_APPEND] = &&L_OP_LIST_APPEND,
+        [OP_DICT_INSERT] = &&L_OP_DICT_INSERT, [OP_TO_TUPLE] = &&L_OP_TO_TUPLE, [OP_TO_SET] = &&L_OP_TO_SET,
+        [OP_ITER_INIT] = &&L_OP_ITER_INIT, [OP_ITER_NEXT] = &&L_OP_ITER_NEXT, [OP_UNPACK] = &&L_OP_UNPACK,
+        [OP_MATCH] = &&L_OP_MATCH,
+        [OP_TRY] = &&L_OP_TRY, [OP_END_TRY] = &&L_OP_END_TRY, [OP_RETHROW] = &&L_OP_RETHROW,
+        [OP_PUSH_SCOPE] = &&L_OP_PUSH_SCOPE, [OP_POP_SCOPE] = &&L_OP_POP_SCOPE, [OP_ERROR] = &&L_OP_ERROR,
+        [OP_PARALLEL] = &&L_OP_PARALLEL, [OP_PAR_COMPREHENSION] = &&L_OP_PAR_COMPREHENSION,
+        [OP_AWAIT] = &&L_OP_AWAIT,
+        [OP_YIELD] = &&L_OP_YIELD,
+    };
+#define VM_CASE(op)   L_##op
+#define VM_NEXT()     goto *dispatch_table[*ip++]
+#else
+#define VM_CASE(op)   case op
+#define VM_NEXT()     goto dispatch
+#endif
+
+    LOAD_FRAME();
+
+#ifdef VM_COMPUTED_GOTO
+    VM_NEXT();
+    {
+#else
+dispatch:
+    switch (*ip++) {
+#endif
+        VM_CASE(OP_CONSTANT): PUSH(frame->chunk->constants[READ_U16()]); VM_NEXT();
+        VM_CASE(OP_NIL):      PUSH(NIL_VAL); VM_NEXT();
+        VM_CASE(OP_TRUE):     PUSH(BOOL_VAL(true)); VM_NEXT();
+        VM_CASE(OP_FALSE):    PUSH(BOOL_VAL(false)); VM_NEXT();
+        VM_CASE(OP_POP):      sp--; VM_NEXT();
+
+        VM_CASE(OP_GET_LOCAL): {
+            VarRef ref = { 0, READ_U16() };
+            uint16_t name = READ_U16();
+            Value val = interp->env->slots[ref.slot];
+            if (!IS_UNDEFINED(val)) {
+                PUSH(val);
+                VM_NEXT();
+            }
+            if (!interp_read_var(interp, ref, NAME(name), &val)) {
+                runtime_error_at(interp, LINE(), "Undefined variable '%s'.", string_chars(NAME(name)));
+                THROW();
+            }
+            PUSH(val);
+            VM_NEXT();
+        }
+        VM_CASE(OP_GET_ENCLOSING): {
+            VarRef ref;
+            ref.depth = READ_BYTE();
+            ref.slot = READ_U16();
+            ObjString *name = NAME(READ_U16());
+            Value val;
+            if (!interp_read_var(interp, ref, name, &val)) {
+                runtime_error_at(interp, LINE(), "Undefined variable '%s'.", string_chars(name));
+                THROW();
+            }
+            PUSH(val);
+            VM_NEXT();
+        }
+        VM_CASE(OP_GET_GLOBAL): {
+            Value val = interp->globals->slots[READ_U16()];
+            uint16_t name = READ_U16();
+            if (IS_UNDEFINED(val)) {
+                runtime_error_at(interp, LINE(), "Undefined variable '%s'.", string_chars(NAME(name)));
+                THROW();
+            }
+            PUSH(val);
+            VM_NEXT();
+        }
+        VM_CASE(OP_SET_LOCAL):
+            gc_slot_barrier(PEEK(0));
+            interp->env->slots[READ_U16()] = PEEK(0);
+            VM_NEXT();
+        VM_CASE(OP_SET_ENCLOSING): {
+            int depth = READ_BYTE();
+            env_set_at(interp->env, depth, READ_U16(), PEEK(0));
+            VM_NEXT();
+        }
+        VM_CASE(OP_SET_GLOBAL):
+            gc_slot_barrier(PEEK(0));
+            interp->globals->slots[READ_U16()] = PEEK(0);
+            VM_NEXT();
+
+        VM_CASE(OP_GET_MEMBER): {
+            ObjString *name = NAME(READ_U16());
+            PEEK(0) = interp_get_member(interp, PEEK(0), name, LINE());
+            CHECK_THROW();
+            VM_NEXT();
+        }
+        VM_CASE(OP_SET_MEMBER): {
+            ObjString *name = NAME(READ_U16());
+            SYNC_STACK();
+            Value obj = POP();
+            interp_set_member(interp, obj, name, PEEK(0), LINE());
+            CHECK_THROW();
+            VM_NEXT();
+        }
+        VM_CASE(OP_GET_INDEX): {
+            Value idx = POP();
+            SYNC_STACK();
+            PEEK(0) = interp_get_index(interp, PEEK(0), idx, LINE());
+            CHECK_THROW();
+            VM_NEXT();
+        }
+        VM_CASE(OP_SET_INDEX): {
+            Value idx = POP();
+            Value obj = POP();
+            interp_set_index(interp, obj, idx, PEEK(0), LINE());
+            CHECK_THROW();
+            VM_NEXT();
+        }
+
+        VM_CASE(OP_PLUS):
+            NUMERIC_OP(OP_ADD, NUMBER_VAL(a + b));
+            VM_NEXT();
+        VM_CASE(OP_MINUS):
+            NUMERIC_OP(OP_SUB, NUMBER_VAL(a - b));
+            VM_NEXT();
+        VM_CASE(OP_TIMES):
+            NUMERIC_OP(OP_MUL, NUMBER_VAL(a * b));
+            VM_NEXT();
+        VM_CASE(OP_DIVIDE): {
+            Value r = POP();
+            PEEK(0) = interp_binary(interp, OP_DIV, PEEK(0), r, LINE());
+            CHECK_THROW();
+            VM_NEXT();
+        }
+        VM_CASE(OP_MODULO): {
+            Value r = POP();
+            PEEK(0) = interp_binary(interp, OP_MOD, PEEK(0), r, LINE());
+            CHECK_THROW();
+            VM_NEXT();
+        }
+        VM_CASE(OP_EQUAL): {
+            Value r = POP();
+            PEEK(0) = BOOL_VAL(values_equal(PEEK(0), r));
+            VM_NEXT();
+        }
+        VM_CASE(OP_NOT_EQUAL): {
+            Value r = POP();
+            PEEK(0) = BOOL_VAL(!values_equal(PEEK(0), r));
+            VM_NEXT();
+        }
+        VM_CASE(OP_LESS):
+            NUMERIC_OP(OP_LT, BOOL_VAL(a < b));
+            VM_NEXT();
+        VM_CASE(OP_GREATER):
+            NUMERIC_OP(OP_GT, BOOL_VAL(a > b));
+            VM_NEXT();
+        VM_CASE(OP_NEGATE):
+            if (!IS_NUMBER(PEEK(0))) {
+                runtime_error_at(interp, LINE(), "Operand must be a number for ':-:'");
+                THROW();
+            }
+            PEEK(0) = NUMBER_VAL(-AS_NUMBER(PEEK(0)));
+            VM_NEXT();
+
+        VM_CASE(OP_JUMP): {
+            uint16_t offset = READ_U16();
+            ip += offset;
+            VM_NEXT();
+        }
+        VM_CASE(OP_JUMP_IF_FALSE): {
+            uint16_t offset = READ_U16();
+            if (!interp_truthy(POP())) ip += offset;
+            VM_NEXT();
+        }
+        VM_CASE(OP_LOOP): {
+            uint16_t offset = READ_U16();
+            ip -= offset;
+            SYNC_STACK();
+            gc_poll();
+            VM_NEXT();
+        }
+
+        VM_CASE(OP_CALL): {
+            int argc = READ_BYTE();
+            SAVE_FRAME();
+            Value callee = PEEK(argc);
+            if (IS_FUNCTION(callee) && (AS_FUNCTION(callee)->is_async || AS_FUNCTION(callee)->is_generator))
+                spawn_call(vm, interp, callee, argc, sp - argc, sp - argc - 1);
+            else if (!call_value(vm, interp, argc, LINE())) THROW();
+            LOAD_FRAME();
+            /* Only once the callee's frame holds everything it needs */
+            gc_poll();
+            VM_NEXT();
+        }
+        VM_CASE(OP_INVOKE): {
+            ObjString *name = NAME(READ_U16());
+            int argc = READ_BYTE();
+            SAVE_FRAME();
+            if (!invoke(vm, interp, name, argc, LINE())) THROW();
+            LOAD_FRAME();
+            gc_poll();
+            VM_NEXT();
+        }
+        VM_CASE(OP_CLOSURE): {
+            Chunk *proto = frame->chunk->protos[READ_U16()];
+            SYNC_STACK();
+            ObjFunction *fn = interp_make_function(interp, proto->fn_node);
+            fn->chunk = proto;
+            PUSH(OBJ_VAL(fn));
+            VM_NEXT();
+        }
+        VM_CASE(OP_CLASS): {
+            ObjString *name = NAME(READ_U16());
+            uint16_t super_idx = READ_U16();
+            SYNC_STACK();
+            ObjClass *klass = obj_class_new(string_chars(name));
+            if (super_idx != 0xFFFF) {
+                ObjString *super_name = NAME(super_idx);
+                Value super_val;
+                if (!env_get(interp->env, super_name, &super_val)) {
+                    runtime_error(interp, "Undefined superclass '%s'.", string_chars(super_name));
+                    THROW();
+                }
+                if (!IS_CLASS(super_val)) {
+                    runtime_error(interp, "Superclass must be a class.");
+                    THROW();
+                }
+                klass->superclass = (struct ObjClass *)AS_CLASS(super_val);
+                gc_write_barrier((Obj *)klass, super_val);
+            }
+            PUSH(OBJ_VAL(klass));
+            VM_NEXT();
+        }
+        VM_CASE(OP_METHOD): {
+            Chunk *proto = frame->chunk->protos[READ_U16()];
+            SYNC_STACK();
+            ObjFunction *fn = interp_make_function(interp, proto->fn_node);
+            fn->chunk = proto;
+            gc_push_root(OBJ_VAL(fn));
+            ObjString *key = obj_string_intern(fn->name, strlen(fn->name));
+            dict_set(AS_CLASS(PEEK(0))->methods, key, OBJ_VAL(fn));
+            gc_pop_roots(1);
+            VM_NEXT();
+        }
+        VM_CASE(OP_RETURN): {
+            Value val = POP();
+            ObjFunction *fn = interp->current_function;
+            if (fn && fn->return_type && !interp_check_type(val, fn->return_type)) {
+                /* Like the tree-walker: report and carry on with the body */
+                fprintf(stderr, "Type error: Expected return type %s, got %s\n",
+                        fn->return_type, value_type_name(val));
+                VM_NEXT();
+            }
+            result = val;
+            goto do_return;
+        }
+        VM_CASE(OP_END):
+            result = POP();
+            goto do_return;
+
+        VM_CASE(OP_BUILD_LIST): {
+            uint16_t count = READ_U16();
+            SYNC_STACK();
+            ObjList *list = obj_list_new();
+            for (uint16_t i = 0; i < count; i++) value_array_write(list, sp[(int)i - count]);
+            sp -= count;
+            PUSH(OBJ_VAL(list));
+            VM_NEXT();
+        }
+        VM_CASE(OP_BUILD_TUPLE): {
+            uint16_t count = READ_U16();
+            SYNC_STACK();
+            ObjTuple *tuple = obj_tuple_new(count);
+            for (uint16_t i = 0; i < count; i++) {
+                tuple->items[i] = sp[(int)i - count];
+                gc_write_barrier((Obj *)tuple, tuple->items[i]);
+            }
+            sp -= count;
+            PUSH(OBJ_VAL(tuple));
+            VM_NEXT();
+        }
+        VM_CASE(OP_BUILD_DICT): {
+            uint16_t count = READ_U16();
+            SYNC_STACK();
+            ObjDict *dict = obj_dict_new();
+            Value *entries = sp - 2 * count;
+            for (uint16_t i = 0; i < count; i++) {
+                Value key = entries[2 * i];
+                if (!IS_STRING(key)) {
+                    runtime_error_at(interp, LINE(), "Dict keys must be strings.");
+                    THROW();
+                }
+                dict_set(dict, AS_STRING(key), entries[2 * i + 1]);
+            }
+            sp = entries;
+            PUSH(OBJ_VAL(dict));
+            VM_NEXT();
+        }
+        VM_CASE(OP_LIST_APPEND): {
+            int depth = READ_BYTE();
+            Value val = POP();
+            value_array_write(AS_LIST(PEEK(depth)), val);
+            VM_NEXT();
+        }
+        VM_CASE(OP_DICT_INSERT): {
+            int depth = READ_BYTE();
+            Value val = POP();
+            Value key = POP();
+            if (!IS_STRING(key)) {
+                runtime_error(interp, "Dict comprehension keys must be strings.");
+                THROW();
+            }
+            dict_set(AS_DICT(PEEK(depth)), AS_STRING(key), val);
+            VM_NEXT();
+        }
+        VM_CASE(OP_TO_TUPLE): {
+            SYNC_STACK();
+            ObjTuple *tuple = obj_tuple_new(AS_LIST(PEEK(0))->count);
+            ObjList *list = AS_LIST(PEEK(0));
+            for (size_t i = 0; i < list->count; i++) {
+                tuple->items[i] = list->items[i];
+                gc_write_barrier((Obj *)tuple, tuple->items[i]);
+            }
+            PEEK(0) = OBJ_VAL(tuple);
+            VM_NEXT();
+        }
+        VM_CASE(OP_TO_SET):
+            SYNC_STACK();
+            PEEK(0) = interp_list_to_set(AS_LIST(PEEK(0)));
+            VM_NEXT();
+
+        VM_CASE(OP_ITER_INIT): {
+            int in_comprehension = READ_BYTE();
+            IterCursor cursor;
+            if (!iter_begin(PEEK(0), &cursor)) {
+                if (in_comprehension)
+                    runtime_error(interp, "Cannot iterate over %s in a comprehension.", value_type_name(PEEK(0)));
+                else
+                    runtime_error_at(interp, LINE(), "Cannot iterate over %s.", value_type_name(PEEK(0)));
+                THROW();
+            }
+            PUSH(NUMBER_VAL(0));
+            PUSH(NUMBER_VAL((double)cursor.limit));
+            VM_NEXT();
+        }
+        VM_CASE(OP_ITER_NEXT): {
+            /* Slots: the iterable, then the cursor's index and limit */
+            uint16_t exit = READ_U16();
+            Value iterable = PEEK(2);
+            size_t i = (size_t)AS_NUMBER(PEEK(1));
+            Value item;
+            if (IS_LIST(iterable) || IS_TUPLE(iterable) || IS_RANGE(iterable) || IS_ARRAY(iterable)) {
+                if (i >= (size_t)AS_NUMBER(PEEK(0)) || (IS_LIST(iterable) && i >= AS_LIST(iterable)->count)) {
+                    sp -= 3;
+                    ip += exit;
+                    VM_NEXT();
+                }
+                item = iter_item(iterable, i);
+                PEEK(1) = NUMBER_VAL((double)(i + 1));
+                PUSH(item);
+                VM_NEXT();
+            }
+            SAVE_FRAME();
+            IterCursor cursor = { i, (size_t)AS_NUMBER(PEEK(0)) };
+            if (!iter_next(interp, iterable, &cursor, &item)) {
+                CHECK_THROW();
+                sp -= 3;
+                ip += exit;
+                VM_NEXT();
+            }
+            PEEK(1) = NUMBER_VAL((double)cursor.index);
+            PUSH(item);
+            VM_NEXT();
+        }
+        VM_CASE(OP_UNPACK): {
+            uint16_t want = READ_U16();
+            Value src = PEEK(0);
+            size_t count;
+            Value *items;
+            if (IS_TUPLE(src)) { count = AS_TUPLE(src)->count; items = AS_TUPLE(src)->items; }
+            else if (IS_LIST(src)) { count = AS_LIST(src)->count; items = AS_LIST(src)->items; }
+            else { runtime_error_at(interp, LINE(), "Can only destructure from list or tuple."); THROW(); }
+            if (count != want) {
+                runtime_error_at(interp, LINE(), "Destructuring mismatch: %zu variables, %zu values.", (size_t)want, count);
+                THROW();
+            }
+            for (size_t i = count; i > 0; i--) PUSH(items[i - 1]);
+            VM_NEXT();
+        }
+        VM_CASE(OP_MATCH): {
+            AstNode *pattern = frame->chunk->nodes[READ_U16()];
+            int matched = interp_match_pattern(interp, pattern, PEEK(0));
+            PUSH(BOOL_VAL(matched));
+            VM_NEXT();
+        }
+
+        VM_CASE(OP_TRY): {
+            uint16_t offset = READ_U16();
+            if (vm->handler_count >= VM_HANDLERS_MAX) {
+                runtime_error_at(interp, LINE(), "Too many nested try blocks.");
+                THROW();
+            }
+            Handler *handler = &vm->handlers[vm->handler_count++];
+            handler->frame = vm->frame_count - 1;
+            handler->catch_ip = ip + offset;
+            handler->stack_top = sp;
+            handler->env = interp->env;
+            VM_NEXT();
+        }
+        VM_CASE(OP_END_TRY):
+            vm->handler_count--;
+            VM_NEXT();
+        VM_CASE(OP_RETHROW): {
+            Value msg = POP();
+            runtime_error(interp, "%s", string_chars(AS_STRING(msg)));
+            THROW();
+        }
+        VM_CASE(OP_PUSH_SCOPE): {
+            AstNode *try_node = frame->chunk->nodes[READ_U16()];
+            interp->env = env_enter(&interp->frames, interp->env, &try_node->as.try_stmt.catch_scope);
+            VM_NEXT();
+        }
+        VM_CASE(OP_POP_SCOPE): {
+            Environment *scope = interp->env;
+            interp->env = scope->enclosing;
+            env_leave(&interp->frames, scope);
+            VM_NEXT();
+        }
+        VM_CASE(OP_ERROR): {
+            Value msg = frame->chunk->constants[READ_U16()];
+            runtime_error_at(interp, LINE(), "%s", string_chars(AS_STRING(msg)));
+            THROW();
+        }
+        VM_CASE(OP_PARALLEL): {
+            Chunk *proto = frame->chunk->protos[READ_U16()];
+            Value workers = POP();
+            SAVE_FRAME();
+            interp_run_parallel(interp, proto->fn_node, workers, proto);
+            CHECK_THROW();
+            VM_NEXT();
+        }
+        VM_CASE(OP_PAR_COMPREHENSION): {
+            Chunk *rest = frame->chunk->protos[READ_U16()];
+            uint16_t done = READ_U16();
+            SAVE_FRAME();
+            if (interp_parallel_comprehension(interp, rest->fn_node, PEEK(0), AS_LIST(PEEK(1)), rest)) {
+                sp--;
+                ip += done;
+                CHECK_THROW();
+            }
+            VM_NEXT();
+        }
+        VM_CASE(OP_AWAIT): {
+            /* Awaiting anything but a future yields it unchanged */
+            if (IS_FUTURE(PEEK(0))) {
+                SAVE_FRAME();
+                Value result = future_await(interp, PEEK(0));
+                CHECK_THROW();
+                PEEK(0) = result;
+            }
+            VM_NEXT();
+        }
+        VM_CASE(OP_YIELD): {
+            /* The value stays on the stack, rooted, while suspended */
+            SAVE_FRAME();
+            generator_yield(interp, PEEK(0));
+            CHECK_THROW();
+            sp--;
+            VM_NEXT();
+        }
+    }
+
+do_return:
+    SAVE_FRAME();
+    if (return_from(vm, interp, result) || vm->frame_count <= base_frame) return result;
+    LOAD_FRAME();
+    VM_NEXT();
+
+throw_error:
+    SAVE_FRAME();
+    if (!unwind(vm, interp, base_frame)) return NIL_VAL;
+    LOAD_FRAME();
+    VM_NEXT();
+
+#ifdef VM_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
+
+#undef LOAD_FRAME
+#undef SAVE_FRAME
+#undef SYNC_STACK
+#undef READ_BYTE
+#undef READ_U16
+#undef PUSH
+#undef POP
+#undef PEEK
+#undef LINE
+#undef NAME
+#undef THROW
+#undef CHECK_THROW
+#undef NUMERIC_OP
+#undef VM_CASE
+#undef VM_NEXT
+}
+
+Value vm_run(Interpreter *interp, AstNode *program) {
+    if (!interp->vm) interp->vm = vm_new();
+    Vm *vm = interp->vm;
+
+    /* Constants are unreachable until the chunk is registered */
+    char error[256];
+    size_t pin = gc_pin_begin();
+    Chunk *chunk = compile_program(program, error, sizeof(error));
+    if (chunk) {
+        vm->programs = (Chunk **)realloc(vm->programs, sizeof(Chunk *) * (vm->program_count + 1));
+        vm->programs[vm->program_count++] = chunk;
+    }
+    gc_pin_end(pin);
+    if (!chunk) {
+        runtime_error(interp, "%s", error);
+        return NIL_VAL;
+    }
+
+    return vm_run_chunk(interp, chunk, program->line);
+}
+
+Value vm_call(Interpreter *interp, Value callee, int argc, Value *args) {
+    if (!interp->vm) interp->vm = vm_new();
+    Vm *vm = interp->vm;
+    Value *base = vm->stack_top;
+    if (base + argc + 1 > vm->stack + VM_STACK_MAX) {
+        runtime_error(interp, "Stack overflow.");
+        return NIL_VAL;
+    }
+    *vm->stack_top++ = callee;
+    for (int i = 0; i < argc; i++) *vm->stack_top++ = args[i];
+
+    /* The callee's result replaces it on the stack, as for OP_CALL */
+    int base_frame = vm->frame_count;
+    Value result = NIL_VAL;
+    if (call_value(vm, interp, argc, 0)) {
+        if (vm->frame_count > base_frame) execute(vm, interp, base_frame);
+        if (!interp->throw_flag) result = vm->stack_top[-1];
+    }
+    vm->stack_top = base;
+    return result;
+}
+
+void vm_run_comprehension(Interpreter *interp, Chunk *rest, ObjList *result) {
+    if (!interp->vm) interp->vm = vm_new();
+    Vm *vm = interp->vm;
+    Value *base = vm->stack_top;
+    *vm->stack_top++ = OBJ_VAL(result);
+    vm_run_chunk(interp, rest, rest->fn_node->line);
+    vm->stack_top = base;
+}
+
+Value vm_run_chunk(Interpreter *interp, Chunk *chunk, size_t line) {
+    if (!interp->vm) interp->vm = vm_new();
+    Vm *vm = interp->vm;
+    int base_frame = vm->frame_count;
+    if (!push_frame(vm, interp, FRAME_PROGRAM, chunk, vm->stack_top, line)) return NIL_VAL;
+    return execute(vm, interp, base_frame);
+}
@@ -0,0 +1,78 @@
+#ifndef LILITH_VM_H
+#define LILITH_VM_H
+
+#include "interpreter.h"
+#include "chunk.h"
+
+/* -------------------------------------------------------------------------- */
+/* Bytecode virtual machine                                                   */
+/* -------------------------------------------------------------------------- */
+
+#define VM_STACK_MAX    65536
+#define VM_FRAMES_MAX   4096
+#define VM_HANDLERS_MAX 1024
+
+typedef enum {
+    FRAME_PROGRAM,
+    FRAME_CALL,     /* function, lambda or method: pushes its result */
+    FRAME_INIT,     /* class initializer: pushes the new instance    */
+} FrameKind;
+
+typedef struct {
+    FrameKind kind;
+    Chunk *chunk;
+    uint8_t *ip;
+    Value *base;                /* stack height restored on return */
+    Environment *call_env;      /* freed on return, NULL for the program */
+    Environment *saved_env;
+    ObjFunction *saved_function;
+    Value receiver;             /* the instance under construction */
+} CallFrame;
+
+/* An active try block, installed by OP_TRY */
+typedef struct {
+    int frame;
+    uint8_t *catch_ip;
+    Value *stack_top;
+    Environment *env;
+} Handler;
+
+typedef struct Vm {
+    Value *stack;
+    Value *stack_top;
+
+    CallFrame *frames;
+    int frame_count;
+
+    Handler *handlers;
+    int handler_count;
+
+    /* Compiled programs stay alive as long as their functions might */
+    Chunk **programs;
+    size_t program_count;
+} Vm;
+
+Vm   *vm_new(void);
+void  vm_free(Vm *vm);
+
+/* Mark the stack, frames, handlers and program constants for the collector */
+void  vm_mark_roots(Vm *vm);
+
+/* Compile and execute a program under `interp`.  Errors are reported the
+   same way as the tree-walker: throw_flag and error_msg on the interpreter. */
+Value vm_run(Interpreter *interp, AstNode *program);
+
+/* Execute an already compiled body, such as a parallel block's, in the
+   interpreter's current scope */
+Value vm_run_chunk(Interpreter *interp, Chunk *chunk, size_t line);
+
+/* Run the clauses compiled after a pure comprehension's first for-clause
+   for the current item, appending to `result` (see
+   interp_parallel_comprehension) */
+void  vm_run_comprehension(Interpreter *interp, Chunk *rest, ObjList *result);
+
+/* Call a function, native or class from C and run it to completion.  See
+   interp_call. */
+Value vm_call(Interpreter *interp, Value callee, int argc, Value *args);
+
+#endif
@@ -0,0 +1,182 @@
+#include "simd.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+
+/* ========================================================================= */
+/* Reductions                                                                */
+/* ========================================================================= */
+
+double simd_combine_sum(const double lanes[SIMD_LANES]) {
+    double low = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    double high = (lanes[4] + lanes[5]) + (lanes[6] + lanes[7]);
+    return low + high;
+}
+
+double simd_combine_min(const double lanes[SIMD_LANES]) {
+    double low = simd_min(simd_min(lanes[0], lanes[1]), simd_min(lanes[2], lanes[3]));
+    double high = simd_min(simd_min(lanes[4], lanes[5]), simd_min(lanes[6], lanes[7]));
+    return simd_min(low, high);
+}
+
+double simd_combine_max(const double lanes[SIMD_LANES]) {
+    double low = simd_max(simd_max(lanes[0], lanes[1]), simd_max(lanes[2], lanes[3]));
+    double high = simd_max(simd_max(lanes[4], lanes[5]), simd_max(lanes[6], lanes[7]));
+    return simd_max(low, high);
+}
+
+/* ========================================================================= */
+/* Scalar kernels                                                            */
+/* ========================================================================= */
+
+static void scalar_add(const double *a, const double *b, double *out, size_t n) {
+    for (size_t i = 0; i < n; i++) out[i] = a[i] + b[i];
+}
+
+static void scalar_sub(const double *a, const double *b, double *out, size_t n) {
+    for (size_t i = 0; i < n; i++) out[i] = a[i] - b[i];
+}
+
+static void scalar_mul(const double *a, const double *b, double *out, size_t n) {
+    for (size_t i = 0; i < n; i++) out[i] = a[i] * b[i];
+}
+
+static void scalar_div(const double *a, const double *b, double *out, size_t n) {
+    for (size_t i = 0; i < n; i++) out[i] = a[i] / b[i];
+}
+
+static void scalar_scale(const double *a, double k, double *out, size_t n) {
+    for (size_t i = 0; i < n; i++) out[i] = a[i] * k;
+}
+
+static void scalar_fma(const double *a, const double *b, const double *c, double *out, size_t n) {
+    for (size_t i = 0; i < n; i++) out[i] = fma(a[i], b[i], c[i]);
+}
+
+/* The lanes the vector versions keep, one element at a time */
+static double scalar_sum(const double *a, size_t n) {
+    double lanes[SIMD_LANES] = {0};
+    size_t body = n - n % SIMD_LANES;
+    for (size_t i = 0; i < body; i++) lanes[i % SIMD_LANES] += a[i];
+    double total = simd_combine_sum(lanes);
+    for (size_t i = body; i < n; i++) total += a[i];
+    return total;
+}
+
+static double scalar_dot(const double *a, const double *b, size_t n) {
+    double lanes[SIMD_LANES] = {0};
+    size_t body = n - n % SIMD_LANES;
+    for (size_t i = 0; i < body; i++) {
+        /* Two roundings, as the vector versions do; never contracted */
+        double product = a[i] * b[i];
+        lanes[i % SIMD_LANES] += product;
+    }
+    double total = simd_combine_sum(lanes);
+    for (size_t i = body; i < n; i++) {
+        double product = a[i] * b[i];
+        total += product;
+    }
+    return total;
+}
+
+static double scalar_min(const double *a, size_t n) {
+    double acc;
+    size_t i = 0;
+    if (n >= SIMD_LANES) {
+        double lanes[SIMD_LANES];
+        for (size_t l = 0; l < SIMD_LANES; l++) lanes[l] = a[l];
+        size_t body = n - n % SIMD_LANES;
+        for (i = SIMD_LANES; i < body; i++) lanes[i % SIMD_LANES] = simd_min(a[i], lanes[i % SIMD_LANES]);
+        acc = simd_combine_min(lanes);
+    } else {
+        acc = a[i++];
+    }
+    for (; i < n; i++) acc = simd_min(a[i], acc);
+    return acc;
+}
+
+static double scalar_max(const double *a, size_t n) {
+    double acc;
+    size_t i = 0;
+    if (n >= SIMD_LANES) {
+        double lanes[SIMD_LANES];
+        for (size_t l = 0; l < SIMD_LANES; l++) lanes[l] = a[l];
+        size_t body = n - n % SIMD_LANES;
+        for (i = SIMD_LANES; i < body; i++) lanes[i % SIMD_LANES] = simd_max(a[i], lanes[i % SIMD_LANES]);
+        acc = simd_combine_max(lanes);
+    } else {
+        acc = a[i++];
+    }
+    for (; i < n; i++) acc = simd_max(a[i], acc);
+    return acc;
+}
+
+static const SimdKernels scalar_kernels = {
+    .add = scalar_add,
+    .sub = scalar_sub,
+    .mul = scalar_mul,
+    .div = scalar_div,
+    .scale = scalar_scale,
+    .fma = scalar_fma,
+    .sum = scalar_sum,
+    .dot = scalar_dot,
+    .min = scalar_min,
+    .max = scalar_max,
+};
+
+/* ========================================================================= */
+/* Dispatch                                                                  */
+/* ========================================================================= */
+
+static SimdLevel best_level = SIMD_SCALAR;
+static const SimdKernels *best_kernels = &scalar_kernels;
+static pthread_once_t detect_once = PTHREAD_ONCE_INIT;
+
+static bool level_supported(SimdLevel level) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    switch (level) {
+        case SIMD_SCALAR: return true;
+        case SIMD_SSE2: return __builtin_cpu_supports("sse2");
+        case SIMD_AVX2: return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    }
+    return false;
+#else
+    return level == SIMD_SCALAR;
+#endif
+}
+
+static void detect_level(void) {
+    if (level_supported(SIMD_AVX2)) best_level = SIMD_AVX2;
+    else if (level_supported(SIMD_SSE2)) best_level = SIMD_SSE2;
+    best_kernels = simd_kernels_for(best_level);
+}
+
+SimdLevel simd_level(void) {
+    pthread_once(&detect_once, detect_level);
+    return best_level;
+}
+
+const SimdKernels *simd_kernels(void) {
+    pthread_once(&detect_once, detect_level);
+    return best_kernels;
+}
+
+const SimdKernels *simd_kernels_for(SimdLevel level) {
+    if (!level_supported(level)) return NULL;
+#if defined(__x86_64__) || defined(__i386__)
+    if (level == SIMD_AVX2) return &simd_avx2_kernels;
+    if (level == SIMD_SSE2) return &simd_sse2_kernels;
+#endif
+    return &scalar_kernels;
+}
+
+const char *simd_level_name(SimdLevel level) {
+    switch (level) {
+        case SIMD_SCALAR: return "scalar";
+        case SIMD_SSE2: return "sse2";
+        case SIMD_AVX2: return "avx2";
+    }
+    return "unknown";
+}
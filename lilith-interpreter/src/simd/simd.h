@@ -0,0 +1,73 @@
+#ifndef LILITH_SIMD_H
+#define LILITH_SIMD_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Vector kernels                                                             */
+/* -------------------------------------------------------------------------- */
+
+/* Loops over runs of doubles, in a scalar, an SSE2 and an AVX2 (with FMA)
+   version; the best one the CPU supports is picked on first use.  Every
+   version gives bit-identical results:
+     - element-wise operations round each element once (fma included, via
+       fma() where the instruction is missing), whatever the width;
+     - reductions keep 8 running lanes, element i going to lane i % 8,
+       combine the lanes pairwise in a fixed order, then fold in the tail
+       in order.  The scalar version walks the same lanes.
+   min and max follow the SSE rule: min(x, acc) is x < acc ? x : acc, so
+   a NaN never replaces a number already held.  Inputs may be unaligned
+   and the output may alias an input. */
+
+typedef enum {
+    SIMD_SCALAR,
+    SIMD_SSE2,
+    SIMD_AVX2,
+} SimdLevel;
+
+typedef struct {
+    void   (*add)(const double *a, const double *b, double *out, size_t n);
+    void   (*sub)(const double *a, const double *b, double *out, size_t n);
+    void   (*mul)(const double *a, const double *b, double *out, size_t n);
+    void   (*div)(const double *a, const double *b, double *out, size_t n);
+    void   (*scale)(const double *a, double k, double *out, size_t n);
+    /* out = a * b + c, rounded once */
+    void   (*fma)(const double *a, const double *b, const double *c, double *out, size_t n);
+    double (*sum)(const double *a, size_t n);
+    double (*dot)(const double *a, const double *b, size_t n);
+    /* n must be at least 1 */
+    double (*min)(const double *a, size_t n);
+    double (*max)(const double *a, size_t n);
+} SimdKernels;
+
+#define SIMD_LANES 8
+
+/* The kernels for the best level this CPU supports */
+const SimdKernels *simd_kernels(void);
+SimdLevel          simd_level(void);
+const char        *simd_level_name(SimdLevel level);
+
+/* The kernels of one level, NULL when the CPU lacks it */
+const SimdKernels *simd_kernels_for(SimdLevel level);
+
+/* Shared by every level: the 8 lanes of a reduction, combined pairwise */
+double simd_combine_sum(const double lanes[SIMD_LANES]);
+double simd_combine_min(const double lanes[SIMD_LANES]);
+double simd_combine_max(const double lanes[SIMD_LANES]);
+
+static inline double simd_min(double x, double acc) { return x < acc ? x : acc; }
+static inline double simd_max(double x, double acc) { return x > acc ? x : acc; }
+
+/* Implemented in simd_x86.c, on x86 only */
+extern const SimdKernels simd_sse2_kernels;
+extern const SimdKernels simd_avx2_kernels;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,246 @@
+#include "simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+#include <math.h>
+
+/* Each function carries the instruction set it needs, so the rest of the
+   build keeps the baseline target and only runs these after detection. */
+#define SSE2_FN __attribute__((target("sse2")))
+#define AVX2_FN __attribute__((target("avx2,fma")))
+
+/* ========================================================================= */
+/* SSE2 — two lanes per register, four registers for the 8 reduction lanes   */
+/* ========================================================================= */
+
+#define SSE2_BINARY(name, op)                                                        \
+    SSE2_FN static void sse2_##name(const double *a, const double *b, double *out,  \
+                                    size_t n) {                                      \
+        size_t i = 0;                                                                \
+        for (; i + 2 <= n; i += 2) {                                                 \
+            _mm_storeu_pd(out + i, op(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));   \
+        }                                                                            \
+        if (i < n) {                                                                 \
+            __m128d x = _mm_load_sd(a + i), y = _mm_load_sd(b + i);                  \
+            _mm_store_sd(out + i, op(x, y));                                         \
+        }                                                                            \
+    }
+
+SSE2_BINARY(add, _mm_add_pd)
+SSE2_BINARY(sub, _mm_sub_pd)
+SSE2_BINARY(mul, _mm_mul_pd)
+SSE2_BINARY(div, _mm_div_pd)
+
+SSE2_FN static void sse2_scale(const double *a, double k, double *out, size_t n) {
+    __m128d factor = _mm_set1_pd(k);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) _mm_storeu_pd(out + i, _mm_mul_pd(_mm_loadu_pd(a + i), factor));
+    if (i < n) out[i] = a[i] * k;
+}
+
+/* SSE2 has no fused multiply-add */
+static void sse2_fma(const double *a, const double *b, const double *c, double *out, size_t n) {
+    for (size_t i = 0; i < n; i++) out[i] = fma(a[i], b[i], c[i]);
+}
+
+SSE2_FN static void sse2_spill(__m128d r0, __m128d r1, __m128d r2, __m128d r3,
+                               double lanes[SIMD_LANES]) {
+    _mm_storeu_pd(lanes + 0, r0);
+    _mm_storeu_pd(lanes + 2, r1);
+    _mm_storeu_pd(lanes + 4, r2);
+    _mm_storeu_pd(lanes + 6, r3);
+}
+
+SSE2_FN static double sse2_sum(const double *a, size_t n) {
+    __m128d r0 = _mm_setzero_pd(), r1 = r0, r2 = r0, r3 = r0;
+    size_t body = n - n % SIMD_LANES;
+    for (size_t i = 0; i < body; i += SIMD_LANES) {
+        r0 = _mm_add_pd(r0, _mm_loadu_pd(a + i));
+        r1 = _mm_add_pd(r1, _mm_loadu_pd(a + i + 2));
+        r2 = _mm_add_pd(r2, _mm_loadu_pd(a + i + 4));
+        r3 = _mm_add_pd(r3, _mm_loadu_pd(a + i + 6));
+    }
+    double lanes[SIMD_LANES];
+    sse2_spill(r0, r1, r2, r3, lanes);
+    double total = simd_combine_sum(lanes);
+    for (size_t i = body; i < n; i++) total += a[i];
+    return total;
+}
+
+SSE2_FN static double sse2_dot(const double *a, const double *b, size_t n) {
+    __m128d r0 = _mm_setzero_pd(), r1 = r0, r2 = r0, r3 = r0;
+    size_t body = n - n % SIMD_LANES;
+    for (size_t i = 0; i < body; i += SIMD_LANES) {
+        r0 = _mm_add_pd(r0, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+        r1 = _mm_add_pd(r1, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+        r2 = _mm_add_pd(r2, _mm_mul_pd(_mm_loadu_pd(a + i + 4), _mm_loadu_pd(b + i + 4)));
+        r3 = _mm_add_pd(r3, _mm_mul_pd(_mm_loadu_pd(a + i + 6), _mm_loadu_pd(b + i + 6)));
+    }
+    double lanes[SIMD_LANES];
+    sse2_spill(r0, r1, r2, r3, lanes);
+    double total = simd_combine_sum(lanes);
+    for (size_t i = body; i < n; i++) {
+        double product = a[i] * b[i];
+        total += product;
+    }
+    return total;
+}
+
+/* _mm_min_pd(x, acc) is x < acc ? x : acc, which is simd_min */
+#define SSE2_EXTREME(name, op, scalar, combine)                                      \
+    SSE2_FN static double sse2_##name(const double *a, size_t n) {                   \
+        double acc;                                                                  \
+        size_t i = 0;                                                                \
+        if (n >= SIMD_LANES) {                                                       \
+            __m128d r0 = _mm_loadu_pd(a), r1 = _mm_loadu_pd(a + 2);                  \
+            __m128d r2 = _mm_loadu_pd(a + 4), r3 = _mm_loadu_pd(a + 6);              \
+            size_t body = n - n % SIMD_LANES;                                        \
+            for (i = SIMD_LANES; i < body; i += SIMD_LANES) {                        \
+                r0 = op(_mm_loadu_pd(a + i), r0);                                    \
+                r1 = op(_mm_loadu_pd(a + i + 2), r1);                                \
+                r2 = op(_mm_loadu_pd(a + i + 4), r2);                                \
+                r3 = op(_mm_loadu_pd(a + i + 6), r3);                                \
+            }                                                                        \
+            double lanes[SIMD_LANES];                                                \
+            sse2_spill(r0, r1, r2, r3, lanes);                                       \
+            acc = combine(lanes);                                                    \
+        } else {                                                                     \
+            acc = a[i++];                                                            \
+        }                                                                            \
+        for (; i < n; i++) acc = scalar(a[i], acc);                                  \
+        return acc;                                                                  \
+    }
+
+SSE2_EXTREME(min, _mm_min_pd, simd_min, simd_combine_min)
+SSE2_EXTREME(max, _mm_max_pd, simd_max, simd_combine_max)
+
+const SimdKernels simd_sse2_kernels = {
+    .add = sse2_add,
+    .sub = sse2_sub,
+    .mul = sse2_mul,
+    .div = sse2_div,
+    .scale = sse2_scale,
+    .fma = sse2_fma,
+    .sum = sse2_sum,
+    .dot = sse2_dot,
+    .min = sse2_min,
+    .max = sse2_max,
+};
+
+/* ========================================================================= */
+/* AVX2 — four lanes per register, two registers for the 8 reduction lanes   */
+/* ========================================================================= */
+
+#define AVX2_BINARY(name, op, scalar_op)                                             \
+    AVX2_FN static void avx2_##name(const double *a, const double *b, double *out,  \
+                                    size_t n) {                                      \
+        size_t i = 0;                                                                \
+        for (; i + 4 <= n; i += 4) {                                                 \
+            _mm256_storeu_pd(out + i,                                                \
+                             op(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));    \
+        }                                                                            \
+        for (; i < n; i++) out[i] = a[i] scalar_op b[i];                             \
+    }
+
+AVX2_BINARY(add, _mm256_add_pd, +)
+AVX2_BINARY(sub, _mm256_sub_pd, -)
+AVX2_BINARY(mul, _mm256_mul_pd, *)
+AVX2_BINARY(div, _mm256_div_pd, /)
+
+AVX2_FN static void avx2_scale(const double *a, double k, double *out, size_t n) {
+    __m256d factor = _mm256_set1_pd(k);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), factor));
+    for (; i < n; i++) out[i] = a[i] * k;
+}
+
+AVX2_FN static void avx2_fma(const double *a, const double *b, const double *c, double *out, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(a + i), y = _mm256_loadu_pd(b + i);
+        _mm256_storeu_pd(out + i, _mm256_fmadd_pd(x, y, _mm256_loadu_pd(c + i)));
+    }
+    for (; i < n; i++) out[i] = fma(a[i], b[i], c[i]);
+}
+
+AVX2_FN static double avx2_sum(const double *a, size_t n) {
+    __m256d low = _mm256_setzero_pd(), high = low;
+    size_t body = n - n % SIMD_LANES;
+    for (size_t i = 0; i < body; i += SIMD_LANES) {
+        low = _mm256_add_pd(low, _mm256_loadu_pd(a + i));
+        high = _mm256_add_pd(high, _mm256_loadu_pd(a + i + 4));
+    }
+    double lanes[SIMD_LANES];
+    _mm256_storeu_pd(lanes, low);
+    _mm256_storeu_pd(lanes + 4, high);
+    double total = simd_combine_sum(lanes);
+    for (size_t i = body; i < n; i++) total += a[i];
+    return total;
+}
+
+/* Multiply, then add: a fused step would round differently from SSE2 */
+AVX2_FN static double avx2_dot(const double *a, const double *b, size_t n) {
+    __m256d low = _mm256_setzero_pd(), high = low;
+    size_t body = n - n % SIMD_LANES;
+    for (size_t i = 0; i < body; i += SIMD_LANES) {
+        __m256d p0 = _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i));
+        __m256d p1 = _mm256_mul_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4));
+        low = _mm256_add_pd(low, p0);
+        high = _mm256_add_pd(high, p1);
+    }
+    double lanes[SIMD_LANES];
+    _mm256_storeu_pd(lanes, low);
+    _mm256_storeu_pd(lanes + 4, high);
+    double total = simd_combine_sum(lanes);
+    for (size_t i = body; i < n; i++) {
+        double product = a[i] * b[i];
+        total += product;
+    }
+    return total;
+}
+
+#define AVX2_EXTREME(name, op, scalar, combine)                                      \
+    AVX2_FN static double avx2_##name(const double *a, size_t n) {                   \
+        double acc;                                                                  \
+        size_t i = 0;                                                                \
+        if (n >= SIMD_LANES) {                                                       \
+            __m256d low = _mm256_loadu_pd(a), high = _mm256_loadu_pd(a + 4);         \
+            size_t body = n - n % SIMD_LANES;                                        \
+            for (i = SIMD_LANES; i < body; i += SIMD_LANES) {                        \
+                low = op(_mm256_loadu_pd(a + i), low);                               \
+                high = op(_mm256_loadu_pd(a + i + 4), high);                         \
+            }                                                                        \
+            double lanes[SIMD_LANES];                                                \
+            _mm256_storeu_pd(lanes, low);                                            \
+            _mm256_storeu_pd(lanes + 4, high);                                       \
+            acc = combine(lanes);                                                    \
+        } else {                                                                     \
+            acc = a[i++];                                                            \
+        }                                                                            \
+        for (; i < n; i++) acc = scalar(a[i], acc);                                  \
+        return acc;                                                                  \
+    }
+
+AVX2_EXTREME(min, _mm256_min_pd, simd_min, simd_combine_min)
+AVX2_EXTREME(max, _mm256_max_pd, simd_max, simd_combine_max)
+
+const SimdKernels simd_avx2_kernels = {
+    .add = avx2_add,
+    .sub = avx2_sub,
+    .mul = avx2_mul,
+    .div = avx2_div,
+    .scale = avx2_scale,
+    .fma = avx2_fma,
+    .sum = avx2_sum,
+    .dot = avx2_dot,
+    .min = avx2_min,
+    .max = avx2_max,
+};
+
+#else
+
+/* Only the scalar kernels of simd.c exist here */
+typedef int simd_x86_unused;
+
+#endif
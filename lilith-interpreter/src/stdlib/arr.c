@@ -0,0 +1,60 @@
+#include "arr.h"
+#include "runtime/interpreter.h"
+#include "runtime/iterator.h"
+#include "runtime/array.h"
+#include <math.h>
+
+/* The optional element type argument, float64 when absent */
+static bool element_type(Interpreter *interp, const char *fn, int argc, Value *argv, int at, ArrayType *type) {
+    *type = ARRAY_FLOAT64;
+    if (argc <= at) return true;
+    if (IS_STRING(argv[at]) && array_type_parse(string_chars(AS_STRING(argv[at])), type)) return true;
+    runtime_error(interp, "%s expects an element type of float64, float32, int32 or int8.", fn);
+    return false;
+}
+
+/* arr..new((count,, type)): `count` zeros */
+Value native_arr_new(int argc, Value *argv) {
+    Interpreter *interp = interpreter_current();
+    if (!interp) return NIL_VAL;
+    if (argc < 1 || !IS_NUMBER(argv[0]) || AS_NUMBER(argv[0]) < 0 ||
+        AS_NUMBER(argv[0]) != floor(AS_NUMBER(argv[0]))) {
+        runtime_error(interp, "arr..new expects a whole number of elements.");
+        return NIL_VAL;
+    }
+    ArrayType type;
+    if (!element_type(interp, "arr..new", argc, argv, 1, &type)) return NIL_VAL;
+    return OBJ_VAL(obj_array_new(type, (size_t)AS_NUMBER(argv[0])));
+}
+
+/* arr..from((items,, type)): the numbers of a list, range or anything else
+   iterable, converted to the element type */
+Value native_arr_from(int argc, Value *argv) {
+    Interpreter *interp = interpreter_current();
+    if (!interp) return NIL_VAL;
+    ArrayType type;
+    if (argc < 1) {
+        runtime_error(interp, "arr..from expects something to iterate over.");
+        return NIL_VAL;
+    }
+    if (!element_type(interp, "arr..from", argc, argv, 1, &type)) return NIL_VAL;
+
+    /* Random access needs no list in between */
+    Value items = argv[0];
+    size_t count;
+    if (!iter_count(items, &count)) {
+        ObjList *list = iter_collect(interp, items);
+        if (!list) return NIL_VAL;
+        items = OBJ_VAL(list);
+        count = list->count;
+    }
+    ObjArray *array = obj_array_new(type, count);
+    for (size_t i = 0; i < count; i++) {
+        Value item = iter_item(items, i);
+        if (!IS_NUMBER(item) || !array_set(array, i, AS_NUMBER(item))) {
+            runtime_error(interp, "%s arrays cannot hold %s.", array_type_name(type), value_to_string(item));
+            return NIL_VAL;
+        }
+    }
+    return OBJ_VAL(array);
+}
@@ -0,0 +1,9 @@
+#ifndef LILITH_STDARR_H
+#define LILITH_STDARR_H
+
+#include "runtime/value.h"
+
+Value native_arr_new(int argc, Value *argv);
+Value native_arr_from(int argc, Value *argv);
+
+#endif
@@ -1,10 +1,16 @@
 #include "hpc.h"
+#include "runtime/interpreter.h"
+#include "runtime/future.h"
+#include "runtime/gc.h"
+#include "runtime/array.h"
+#include "arr.h"
 #include <stdio.h>
+#include <string.h>
 
-/* All HPC natives are stubs.  They print a short message so the user
-   knows the call was reached, then return a placeholder value.  This
-   lets the example programs demonstrate HPC syntax without requiring
-   a real parallel runtime, GPU backend, tensor library, etc.  */
+/* Apart from thread_id, compute_async and the buffer natives, the HPC
+   natives are stubs.  They print a short message so the user knows the
+   call was reached, then return a placeholder value.  This lets the example programs demonstrate HPC
+   syntax without requiring a GPU backend, tensor library, etc.  */
 
 static void hpc_stub_print(const char *name) {
     printf("[HPC stub: %s]\n", name);
@@ -22,10 +28,21 @@ Value native_compute(int argc, Value *argv) {
     return NIL_VAL;
 }
 
+/* compute_async((fn,, args...)): start fn((args...)) on a pool worker
+   and return its future, to be awaited with ~( )~ */
 Value native_compute_async(int argc, Value *argv) {
-    hpc_stub_print("compute_async");
-    (void)argc; (void)argv;
-    return NIL_VAL;
+    Interpreter *interp = interpreter_current();
+    if (!interp) return NIL_VAL;
+    if (argc < 1 || !(IS_FUNCTION(argv[0]) || IS_NATIVE(argv[0]) || IS_CLASS(argv[0]))) {
+        runtime_error(interp, "compute_async expects a function.");
+        return NIL_VAL;
+    }
+    gc_push_root(argv[0]);
+    int pins = gc_pin_suspend();
+    ObjFuture *future = future_spawn(interp, argv[0], argc - 1, argv + 1);
+    gc_pin_resume(pins);
+    gc_pop_roots(1);
+    return OBJ_VAL(future);
 }
 
 Value native_store(int argc, Value *argv) {
@@ -34,10 +51,11 @@ Value native_store(int argc, Value *argv) {
     return NIL_VAL;
 }
 
+/* Index of the calling worker in its parallel block, 0 outside one */
 Value native_thread_id(int argc, Value *argv) {
-    hpc_stub_print("thread_id");
     (void)argc; (void)argv;
-    return NUMBER_VAL(0);
+    Interpreter *interp = interpreter_current();
+    return NUMBER_VAL(interp ? interp->worker_id : 0);
 }
 
 Value native_allocate_tensor(int argc, Value *argv) {
@@ -64,14 +82,15 @@ Value native_emit(int argc, Value *argv) {
     return NIL_VAL;
 }
 
+/* allocate_buffer((size,, type)): a zeroed numeric array, as arr..new */
 Value native_allocate_buffer(int argc, Value *argv) {
-    hpc_stub_print("allocate_buffer");
-    (void)argc; (void)argv;
-    return OBJ_VAL(obj_string_copy("<buffer>", 8));
+    return native_arr_new(argc, argv);
 }
 
+/* zero_buffer((buffer)): set every element of a numeric array to 0 */
 Value native_zero_buffer(int argc, Value *argv) {
-    hpc_stub_print("zero_buffer");
-    (void)argc; (void)argv;
-    return NIL_VAL;
+    if (argc < 1 || !IS_ARRAY(argv[0])) return NIL_VAL;
+    ObjArray *array = AS_ARRAY(argv[0]);
+    if (array->count > 0) memset(array->data, 0, array->count * array_elem_size(array->type));
+    return argv[0];
 }
@@ -5,7 +5,11 @@
 
 /* HPC runtime stubs — these are vaporware placeholders that print
    an informative message and return nil.  They allow the HPC example
-   programs to run to completion without crashing.  */
+   programs to run to completion without crashing.  thread_id is real:
+   the worker index inside a parallel block.  So is compute_async, which
+   returns a future (see runtime/future.h), and so are allocate_buffer and
+   zero_buffer, which make and clear numeric arrays (see
+   runtime/array.h).  */
 
 Value native_compute_parallel(int argc, Value *argv);
 Value native_compute(int argc, Value *argv);
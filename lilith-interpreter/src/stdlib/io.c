@@ -1,5 +1,6 @@
 #define _GNU_SOURCE
 #include "io.h"
+#include "async/async_runtime.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,9 +9,10 @@
 #include <netinet/in.h>
 #include <netdb.h>
 #include <errno.h>
+#include <sys/epoll.h>
 
 /* ========================================================================= */
-/* HTTP client (simple blocking GET over TCP)                                */
+/* HTTP client (simple GET over TCP)                                         */
 /* ========================================================================= */
 
 static int parse_url(const char *url, char *host, size_t host_size,
@@ -48,25 +50,50 @@ static int parse_url(const char *url, char *host, size_t host_size,
     return 0;
 }
 
-static char *http_request(const char *host, int port, const char *path) {
-    int sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock < 0) return NULL;
-
-    struct hostent *server = gethostbyname(host);
-    if (!server) {
-        close(sock);
-        return NULL;
+/* The socket is non-blocking and every wait goes through the event loop,
+   so inside an async function only the calling coroutine waits.  Name
+   resolution still blocks. */
+static int connect_to(const char *host, int port) {
+    char service[16];
+    snprintf(service, sizeof(service), "%d", port);
+    struct addrinfo hints = {0};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo *addrs = NULL;
+    if (getaddrinfo(host, service, &hints, &addrs) != 0 || !addrs) return -1;
+
+    int sock = socket(addrs->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sock >= 0 && connect(sock, addrs->ai_addr, addrs->ai_addrlen) < 0) {
+        int err = errno;
+        socklen_t len = sizeof(err);
+        if (err == EINPROGRESS && async_wait_fd(sock, EPOLLOUT) == 0)
+            getsockopt(sock, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err != 0) {
+            close(sock);
+            sock = -1;
+        }
     }
+    freeaddrinfo(addrs);
+    return sock;
+}
 
-    struct sockaddr_in addr = {0};
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(port);
-    memcpy(&addr.sin_addr.s_addr, server->h_addr, server->h_length);
-
-    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
-        close(sock);
-        return NULL;
+static int send_all(int sock, const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t n = send(sock, data, length, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN || async_wait_fd(sock, EPOLLOUT) < 0) return -1;
+            continue;
+        }
+        data += n;
+        length -= (size_t)n;
     }
+    return 0;
+}
+
+static char *http_request(const char *host, int port, const char *path) {
+    int sock = connect_to(host, port);
+    if (sock < 0) return NULL;
 
     char request[4096];
     int req_len = snprintf(request, sizeof(request),
@@ -77,7 +104,7 @@ static char *http_request(const char *host, int port, const char *path) {
         "\r\n",
         path, host);
 
-    if (send(sock, request, req_len, 0) != req_len) {
+    if (send_all(sock, request, (size_t)req_len) < 0) {
         close(sock);
         return NULL;
     }
@@ -90,8 +117,14 @@ static char *http_request(const char *host, int port, const char *path) {
         return NULL;
     }
 
-    ssize_t n;
-    while ((n = recv(sock, response + count, capacity - count - 1, 0)) > 0) {
+    for (;;) {
+        ssize_t n = recv(sock, response + count, capacity - count - 1, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN && async_wait_fd(sock, EPOLLIN) == 0) continue;
+            break;
+        }
+        if (n == 0) break;
         count += (size_t)n;
         if (count + 1 >= capacity) {
             capacity *= 2;
@@ -121,7 +154,7 @@ Value native_http_get(int argc, Value *argv) {
     if (argc < 1 || !IS_STRING(argv[0])) {
         return NIL_VAL;
     }
-    const char *url = AS_STRING(argv[0])->chars;
+    const char *url = string_chars(AS_STRING(argv[0]));
 
     char host[256];
     char path[1024];
@@ -147,7 +180,7 @@ Value native_http_get(int argc, Value *argv) {
 
 Value native_file_read(int argc, Value *argv) {
     if (argc < 1 || !IS_STRING(argv[0])) return NIL_VAL;
-    const char *path = AS_STRING(argv[0])->chars;
+    const char *path = string_chars(AS_STRING(argv[0]));
 
     FILE *f = fopen(path, "rb");
     if (!f) return NIL_VAL;
@@ -172,15 +205,15 @@ Value native_file_write(int argc, Value *argv) {
     if (argc < 2 || !IS_STRING(argv[0]) || !IS_STRING(argv[1])) {
         return BOOL_VAL(0);
     }
-    const char *path = AS_STRING(argv[0])->chars;
-    const char *content = AS_STRING(argv[1])->chars;
+    const char *path = string_chars(AS_STRING(argv[0]));
+    ObjString *content = AS_STRING(argv[1]);
 
     FILE *f = fopen(path, "wb");
     if (!f) return BOOL_VAL(0);
 
-    size_t written = fwrite(content, 1, strlen(content), f);
+    size_t written = fwrite(string_bytes(content), 1, content->length, f);
     fclose(f);
-    return BOOL_VAL(written == strlen(content));
+    return BOOL_VAL(written == content->length);
 }
 
 /* ========================================================================= */
@@ -191,8 +224,8 @@ Value native_file_open(int argc, Value *argv) {
     if (argc < 2 || !IS_STRING(argv[0]) || !IS_STRING(argv[1])) {
         return NIL_VAL;
     }
-    const char *path = AS_STRING(argv[0])->chars;
-    const char *mode = AS_STRING(argv[1])->chars;
+    const char *path = string_chars(AS_STRING(argv[0]));
+    const char *mode = string_chars(AS_STRING(argv[1]));
     FILE *f = fopen(path, mode);
     if (!f) return NIL_VAL;
     /* Return path as a file handle identifier */
@@ -1,4 +1,5 @@
 #include "json.h"
+#include "runtime/array.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -32,9 +33,10 @@ static void append_char(char **buf, size_t *len, size_t *cap, char c) {
     (*buf)[*len] = '\0';
 }
 
-static void json_encode_string(const char *s, char **buf, size_t *len, size_t *cap) {
+static void json_encode_string(ObjString *str, char **buf, size_t *len, size_t *cap) {
     append_char(buf, len, cap, '"');
-    for (const char *p = s; *p; p++) {
+    const char *s = string_bytes(str);
+    for (const char *p = s; p < s + str->length; p++) {
         switch (*p) {
             case '"': append_str(buf, len, cap, "\\\""); break;
             case '\\': append_str(buf, len, cap, "\\\\"); break;
@@ -66,7 +68,7 @@ static void json_encode_value(Value val, char **buf, size_t *len, size_t *cap) {
         snprintf(num, sizeof(num), "%.14g", AS_NUMBER(val));
         append_str(buf, len, cap, num);
     } else if (IS_STRING(val)) {
-        json_encode_string(AS_STRING(val)->chars, buf, len, cap);
+        json_encode_string(AS_STRING(val), buf, len, cap);
     } else if (IS_LIST(val)) {
         ObjList *list = AS_LIST(val);
         append_char(buf, len, cap, '[');
@@ -75,16 +77,24 @@ static void json_encode_value(Value val, char **buf, size_t *len, size_t *cap) {
             json_encode_value(list->items[i], buf, len, cap);
         }
         append_char(buf, len, cap, ']');
+    } else if (IS_ARRAY(val)) {
+        ObjArray *array = AS_ARRAY(val);
+        append_char(buf, len, cap, '[');
+        for (size_t i = 0; i < array->count; i++) {
+            if (i > 0) append_char(buf, len, cap, ',');
+            json_encode_value(NUMBER_VAL(array_get(array, i)), buf, len, cap);
+        }
+        append_char(buf, len, cap, ']');
     } else if (IS_DICT(val)) {
         ObjDict *dict = AS_DICT(val);
         append_char(buf, len, cap, '{');
         int first = 1;
-        for (size_t i = 0; i < dict->capacity; i++) {
+        for (size_t i = 0; i < dict->used; i++) {
             DictEntry *e = &dict->entries[i];
             if (e->key == NULL) continue;
             if (!first) append_char(buf, len, cap, ',');
             first = 0;
-            json_encode_string(e->key->chars, buf, len, cap);
+            json_encode_string(e->key, buf, len, cap);
             append_char(buf, len, cap, ':');
             json_encode_value(e->value, buf, len, cap);
         }
@@ -121,13 +131,14 @@ static void json_skip_ws(JsonParser *p) {
 
 static Value json_parse_value(JsonParser *p);
 
-static Value json_parse_string(JsonParser *p) {
-    if (p->s[p->pos] != '"') return NIL_VAL;
+/* The unescaped body of a string literal, malloc'd, or NULL */
+static char *json_parse_chars(JsonParser *p, size_t *length) {
+    if (p->s[p->pos] != '"') return NULL;
     p->pos++;
     size_t cap = 64;
     size_t len = 0;
     char *buf = (char *)malloc(cap);
-    if (!buf) return NIL_VAL;
+    if (!buf) return NULL;
     while (p->pos < p->len && p->s[p->pos] != '"') {
         if (p->s[p->pos] == '\\' && p->pos + 1 < p->len) {
             p->pos++;
@@ -164,7 +175,24 @@ static Value json_parse_string(JsonParser *p) {
     }
     if (p->pos < p->len && p->s[p->pos] == '"') p->pos++;
     buf[len] = '\0';
-    return OBJ_VAL(obj_string_take(buf, len));
+    *length = len;
+    return buf;
+}
+
+static Value json_parse_string(JsonParser *p) {
+    size_t len;
+    char *buf = json_parse_chars(p, &len);
+    return buf ? OBJ_VAL(obj_string_take(buf, len)) : NIL_VAL;
+}
+
+/* Object keys repeat from record to record; they are interned */
+static ObjString *json_parse_key(JsonParser *p) {
+    size_t len;
+    char *buf = json_parse_chars(p, &len);
+    if (!buf) return NULL;
+    ObjString *key = obj_string_intern(buf, len);
+    free(buf);
+    return key;
 }
 
 static Value json_parse_number(JsonParser *p) {
@@ -225,15 +253,13 @@ static Value json_parse_object(JsonParser *p) {
     for (;;) {
         json_skip_ws(p);
         if (p->s[p->pos] != '"') break;
-        Value key = json_parse_string(p);
+        ObjString *key = json_parse_key(p);
         json_skip_ws(p);
         if (p->pos >= p->len || p->s[p->pos] != ':') break;
         p->pos++;
         json_skip_ws(p);
         Value val = json_parse_value(p);
-        if (IS_STRING(key)) {
-            dict_set(dict, AS_STRING(key), val);
-        }
+        if (key) dict_set(dict, key, val);
         json_skip_ws(p);
         if (p->pos < p->len && p->s[p->pos] == ',') {
             p->pos++;
@@ -274,7 +300,7 @@ static Value json_parse_value(JsonParser *p) {
 Value native_json_decode(int argc, Value *argv) {
     if (argc < 1 || !IS_STRING(argv[0])) return NIL_VAL;
     JsonParser p;
-    p.s = AS_STRING(argv[0])->chars;
+    p.s = string_chars(AS_STRING(argv[0]));
     p.pos = 0;
     p.len = AS_STRING(argv[0])->length;
     return json_parse_value(&p);
@@ -1,4 +1,7 @@
 #include "list.h"
+#include "runtime/iterator.h"
+#include "runtime/gc.h"
+#include "runtime/sort.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -26,25 +29,52 @@ Value native_list_find(int argc, Value *argv) {
     return NUMBER_VAL(-1);
 }
 
-static int compare_values(const void *a, const void *b) {
-    Value *va = (Value *)a;
-    Value *vb = (Value *)b;
-    if (IS_NUMBER(*va) && IS_NUMBER(*vb)) {
-        double diff = AS_NUMBER(*va) - AS_NUMBER(*vb);
-        return (diff < 0) ? -1 : (diff > 0) ? 1 : 0;
+/* list..sort((list)) or ((list,, key)): sort in place, stably, and return
+   the list.  A key function is called once per item and the items are
+   ordered by what it returned. */
+Value native_list_sort(int argc, Value *argv) {
+    Interpreter *interp = interpreter_current();
+    if (!interp) return NIL_VAL;
+    if (argc < 1 || !IS_LIST(argv[0])) return BOOL_VAL(0);
+    ObjList *list = AS_LIST(argv[0]);
+    if (argc < 2 || IS_NIL(argv[1])) {
+        sort_values(list->items, list->count);
+        return OBJ_VAL(list);
     }
-    if (IS_STRING(*va) && IS_STRING(*vb)) {
-        return strcmp(AS_STRING(*va)->chars, AS_STRING(*vb)->chars);
+
+    size_t roots = gc_root_depth();
+    gc_push_root(argv[0]);
+    gc_push_root(argv[1]);
+    ObjList *keys = obj_list_new();
+    gc_push_root(OBJ_VAL(keys));
+    int pins = gc_pin_suspend();
+    for (size_t i = 0; i < AS_LIST(argv[0])->count && !interp->throw_flag; i++) {
+        Value item = AS_LIST(argv[0])->items[i];
+        Value key = interp_call(interp, argv[1], 1, &item);
+        if (!interp->throw_flag) value_array_write(keys, key);
     }
-    return 0;
-}
+    gc_pin_resume(pins);
+    gc_restore_roots(roots);
+    if (interp->throw_flag) return NIL_VAL;
 
-Value native_list_sort(int argc, Value *argv) {
-    (void)argc;
-    if (!IS_LIST(argv[0])) return BOOL_VAL(0);
-    ObjList *list = AS_LIST(argv[0]);
-    if (list->count > 1) {
-        qsort(list->items, list->count, sizeof(Value), compare_values);
+    list = AS_LIST(argv[0]);
+    if (keys->count != list->count) {
+        runtime_error(interp, "list..sort key function changed the list.");
+        return NIL_VAL;
     }
+    sort_values_by(list->items, keys->items, list->count);
     return OBJ_VAL(list);
 }
+
+/* list..from((iterable)): a new list of its items, running a generator to
+   the end */
+Value native_list_from(int argc, Value *argv) {
+    Interpreter *interp = interpreter_current();
+    if (!interp) return NIL_VAL;
+    if (argc < 1) {
+        runtime_error(interp, "list..from expects something to iterate over.");
+        return NIL_VAL;
+    }
+    ObjList *list = iter_collect(interp, argv[0]);
+    return list ? OBJ_VAL(list) : NIL_VAL;
+}
@@ -7,5 +7,6 @@ Value native_list_push(int argc, Value *argv);
 Value native_list_pop(int argc, Value *argv);
 Value native_list_find(int argc, Value *argv);
 Value native_list_sort(int argc, Value *argv);
+Value native_list_from(int argc, Value *argv);
 
 #endif
@@ -1,15 +1,23 @@
 #include "math.h"
 #include <math.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <time.h>
 
-static int seeded = 0;
+/* Every thread draws from its own xorshift64* generator, seeded on first
+   use from the clock and the thread, so parallel workers neither share
+   nor contend for a sequence. */
+static _Thread_local uint64_t rng_state = 0;
 
-static void ensure_seed(void) {
-    if (!seeded) {
-        srand((unsigned int)time(NULL));
-        seeded = 1;
+static uint64_t next_random(void) {
+    if (rng_state == 0) {
+        rng_state = ((uint64_t)time(NULL) ^ (uint64_t)(uintptr_t)&rng_state) * 0x9E3779B97F4A7C15ull;
+        if (rng_state == 0) rng_state = 1;
     }
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1Dull;
 }
 
 Value native_math_abs(int argc, Value *argv) {
@@ -63,12 +71,13 @@ Value native_math_e(int argc, Value *argv) {
 }
 
 Value native_math_rand(int argc, Value *argv) {
-    ensure_seed();
     if (argc >= 2 && IS_NUMBER(argv[0]) && IS_NUMBER(argv[1])) {
         int min = (int)AS_NUMBER(argv[0]);
         int max = (int)AS_NUMBER(argv[1]);
         if (max <= min) return NUMBER_VAL(min);
-        return NUMBER_VAL((double)(min + rand() % (max - min)));
+        uint64_t span = (uint64_t)((int64_t)max - (int64_t)min);
+        return NUMBER_VAL((double)((int64_t)min + (int64_t)(next_random() % span)));
     }
-    return NUMBER_VAL((double)rand() / (double)RAND_MAX);
+    /* The top 53 bits, uniform in [0, 1) */
+    return NUMBER_VAL((double)(next_random() >> 11) * 0x1.0p-53);
 }
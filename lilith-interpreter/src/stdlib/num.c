@@ -7,7 +7,7 @@ Value native_num_from(int argc, Value *argv) {
     if (IS_NUMBER(v)) return v;
     if (IS_STRING(v)) {
         char *end;
-        double d = strtod(AS_STRING(v)->chars, &end);
+        double d = strtod(string_chars(AS_STRING(v)), &end);
         if (*end == '\0') return NUMBER_VAL(d);
     }
     return NUMBER_VAL(0);
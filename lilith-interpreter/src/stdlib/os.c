@@ -1,23 +1,40 @@
 #define _GNU_SOURCE
 #include "os.h"
+#include "runtime/gc.h"
+#include "async/async_runtime.h"
+#include <pthread.h>
+#include <spawn.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
 
+/* getenv and setenv are not safe against each other across threads.  The
+   value is copied out under the lock, the string allocated after it. */
+static pthread_mutex_t env_lock = PTHREAD_MUTEX_INITIALIZER;
+
 Value native_env_get(int argc, Value *argv) {
     if (argc < 1 || !IS_STRING(argv[0])) return NIL_VAL;
-    const char *name = AS_STRING(argv[0])->chars;
+    const char *name = string_chars(AS_STRING(argv[0]));
+    pthread_mutex_lock(&env_lock);
     const char *val = getenv(name);
-    if (!val) return NIL_VAL;
-    return OBJ_VAL(obj_string_copy(val, strlen(val)));
+    char *copy = val ? strdup(val) : NULL;
+    pthread_mutex_unlock(&env_lock);
+    if (!copy) return NIL_VAL;
+    Value result = OBJ_VAL(obj_string_copy(copy, strlen(copy)));
+    free(copy);
+    return result;
 }
 
 Value native_env_set(int argc, Value *argv) {
     if (argc < 2 || !IS_STRING(argv[0]) || !IS_STRING(argv[1])) return BOOL_VAL(0);
-    const char *name = AS_STRING(argv[0])->chars;
-    const char *val = AS_STRING(argv[1])->chars;
-    return BOOL_VAL(setenv(name, val, 1) == 0);
+    const char *name = string_chars(AS_STRING(argv[0]));
+    const char *val = string_chars(AS_STRING(argv[1]));
+    pthread_mutex_lock(&env_lock);
+    int ok = setenv(name, val, 1) == 0;
+    pthread_mutex_unlock(&env_lock);
+    return BOOL_VAL(ok);
 }
 
 Value native_os_time(int argc, Value *argv) {
@@ -25,9 +42,21 @@ Value native_os_time(int argc, Value *argv) {
     return NUMBER_VAL((double)time(NULL));
 }
 
+/* Inside an async function only the calling coroutine sleeps */
 Value native_os_sleep(int argc, Value *argv) {
     if (argc < 1 || !IS_NUMBER(argv[0])) return NIL_VAL;
-    unsigned int sec = (unsigned int)AS_NUMBER(argv[0]);
-    sleep(sec);
+    async_sleep(AS_NUMBER(argv[0]));
     return NIL_VAL;
 }
+
+/* os..run((command)): run it with /bin/sh and return its exit status, nil
+   if it could not be started or did not exit normally */
+Value native_os_run(int argc, Value *argv) {
+    if (argc < 1 || !IS_STRING(argv[0])) return NIL_VAL;
+    char *shell_argv[] = { "sh", "-c", (char *)string_chars(AS_STRING(argv[0])), NULL };
+    pid_t pid;
+    if (posix_spawn(&pid, "/bin/sh", NULL, NULL, shell_argv, environ) != 0) return NIL_VAL;
+    int status = 0;
+    if (async_wait_child(pid, &status) < 0 || !WIFEXITED(status)) return NIL_VAL;
+    return NUMBER_VAL(WEXITSTATUS(status));
+}
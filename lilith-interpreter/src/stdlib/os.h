@@ -7,5 +7,6 @@ Value native_env_get(int argc, Value *argv);
 Value native_env_set(int argc, Value *argv);
 Value native_os_time(int argc, Value *argv);
 Value native_os_sleep(int argc, Value *argv);
+Value native_os_run(int argc, Value *argv);
 
 #endif
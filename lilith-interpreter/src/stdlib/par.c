@@ -0,0 +1,266 @@
+#define _GNU_SOURCE
+#include "par.h"
+#include "runtime/gc.h"
+#include "runtime/interpreter.h"
+#include "runtime/iterator.h"
+#include "concurrency/scheduler.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Chunks per pool worker, so that workers finishing early find more */
+#define PAR_CHUNKS_PER_WORKER 4
+
+typedef enum {
+    PAR_MAP,
+    PAR_REDUCE,
+    PAR_FOR,
+} ParKind;
+
+/* One par..* call.  Tasks claim chunks in index order until none are left
+   or a callback fails; chunks before a failing one have all been claimed,
+   so the error reported is the one a sequential loop would hit first.
+   `input` and `output` are temporary roots of the calling thread and stay
+   where they are. */
+typedef struct {
+    ParKind kind;
+    Value fn;
+    ObjList *input;
+    ObjList *output;                /* results, or a partial per reduce chunk */
+    size_t count;
+    size_t chunk_size;
+    size_t chunk_count;
+    atomic_size_t next_chunk;
+    atomic_int failed;
+    pthread_mutex_t error_lock;
+    size_t error_chunk;
+    char *error_msg;
+} ParJob;
+
+typedef struct {
+    ParJob *job;
+    Interpreter context;
+    Task task;
+} ParTask;
+
+static void store(ObjList *list, size_t index, Value value) {
+    gc_write_barrier((Obj *)list, value);
+    list->items[index] = value;
+}
+
+/* A callback's result is unrooted until stored, so nothing allocates in
+   between. */
+static int run_chunk(Interpreter *interp, ParJob *job, size_t chunk) {
+    size_t begin = chunk * job->chunk_size;
+    size_t end = begin + job->chunk_size < job->count ? begin + job->chunk_size : job->count;
+    Value args[2];
+
+    switch (job->kind) {
+        case PAR_MAP:
+            for (size_t i = begin; i < end; i++) {
+                args[0] = job->input->items[i];
+                Value result = interp_call(interp, job->fn, 1, args);
+                if (interp->throw_flag) return 0;
+                store(job->output, i, result);
+            }
+            break;
+        case PAR_REDUCE:
+            /* The running partial is kept in the output list between calls */
+            store(job->output, chunk, job->input->items[begin]);
+            for (size_t i = begin + 1; i < end; i++) {
+                args[0] = job->output->items[chunk];
+                args[1] = job->input->items[i];
+                Value result = interp_call(interp, job->fn, 2, args);
+                if (interp->throw_flag) return 0;
+                store(job->output, chunk, result);
+            }
+            break;
+        case PAR_FOR:
+            for (size_t i = begin; i < end; i++) {
+                args[0] = NUMBER_VAL((double)i);
+                interp_call(interp, job->fn, 1, args);
+                if (interp->throw_flag) return 0;
+            }
+            break;
+    }
+    return 1;
+}
+
+static void run_chunks(Interpreter *interp, void *arg) {
+    ParJob *job = (ParJob *)arg;
+    while (!atomic_load(&job->failed)) {
+        size_t chunk = atomic_fetch_add(&job->next_chunk, 1);
+        if (chunk >= job->chunk_count) break;
+        if (run_chunk(interp, job, chunk)) continue;
+
+        pthread_mutex_lock(&job->error_lock);
+        if (!job->error_msg || chunk < job->error_chunk) {
+            free(job->error_msg);
+            job->error_msg = strdup(interp->error_msg ? interp->error_msg : "unknown error");
+            job->error_chunk = chunk;
+        }
+        pthread_mutex_unlock(&job->error_lock);
+        atomic_store(&job->failed, 1);
+    }
+}
+
+static void run_task(void *arg) {
+    ParTask *task = (ParTask *)arg;
+    interpreter_run_context(&task->context, run_chunks, task->job);
+}
+
+/* Split the job across the pool and wait for it.  The calling thread runs
+   the first task itself and waits for the rest in a safe region, like a
+   parallel block.  Returns 0 after reporting a failed callback. */
+static int run_job(Interpreter *interp, ParJob *job) {
+    if (job->count == 0) return 1;
+    ThreadPool *pool = scheduler_pool();
+    size_t workers = thread_pool_size(pool);
+    atomic_init(&job->next_chunk, 0);
+    atomic_init(&job->failed, 0);
+    pthread_mutex_init(&job->error_lock, NULL);
+    job->error_msg = NULL;
+
+    size_t task_count = workers < job->chunk_count ? workers : job->chunk_count;
+    ParTask *tasks = (ParTask *)calloc(task_count, sizeof(ParTask));
+    if (!tasks) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < task_count; i++) {
+        tasks[i].job = job;
+        interpreter_init_context(&tasks[i].context, interp);
+        tasks[i].context.worker_id = (int)i;
+        task_init(&tasks[i].task, run_task, &tasks[i]);
+    }
+
+    for (size_t i = 1; i < task_count; i++) thread_pool_spawn(pool, &tasks[i].task);
+    run_task(&tasks[0]);
+    gc_safe_enter();
+    for (size_t i = 1; i < task_count; i++) thread_pool_join(pool, &tasks[i].task);
+    gc_safe_leave();
+
+    for (size_t i = 0; i < task_count; i++) interpreter_free_context(&tasks[i].context);
+    free(tasks);
+    pthread_mutex_destroy(&job->error_lock);
+    if (!job->error_msg) return 1;
+    runtime_error(interp, "%s", job->error_msg);
+    free(job->error_msg);
+    return 0;
+}
+
+static int is_callable(Value value) {
+    return IS_FUNCTION(value) || IS_NATIVE(value) || IS_CLASS(value);
+}
+
+/* The job's lists are temporary roots, so they keep their addresses while
+   callbacks collect.  Pins are lifted for the whole job. */
+static void job_begin(ParJob *job, ParKind kind, Value fn, ObjList *input, size_t count) {
+    memset(job, 0, sizeof(*job));
+    job->kind = kind;
+    job->fn = fn;
+    job->input = input;
+    job->count = count;
+    gc_push_root(fn);
+    if (input) gc_push_root(OBJ_VAL(input));
+    if (count == 0) return;
+
+    size_t chunks = thread_pool_size(scheduler_pool()) * PAR_CHUNKS_PER_WORKER;
+    if (chunks > count) chunks = count;
+    job->chunk_size = (count + chunks - 1) / chunks;
+    job->chunk_count = (count + job->chunk_size - 1) / job->chunk_size;
+}
+
+/* Anything iterable other than a list is collected into one first */
+static ObjList *input_list(Interpreter *interp, Value seq) {
+    return IS_LIST(seq) ? AS_LIST(seq) : iter_collect(interp, seq);
+}
+
+/* par..map((fn,, items)): a new list of fn((item)) for every item */
+Value native_par_map(int argc, Value *argv) {
+    Interpreter *interp = interpreter_current();
+    if (!interp) return NIL_VAL;
+    if (argc < 2 || !is_callable(argv[0])) {
+        runtime_error(interp, "par..map expects a function and something to iterate over.");
+        return NIL_VAL;
+    }
+    ObjList *input = input_list(interp, argv[1]);
+    if (!input) return NIL_VAL;
+    ParJob job;
+    job_begin(&job, PAR_MAP, argv[0], input, input->count);
+    ObjList *output = obj_list_new();
+    for (size_t i = 0; i < job.count; i++) value_array_write(output, NIL_VAL);
+    job.output = output;
+
+    int pins = gc_pin_suspend();
+    int ok = run_job(interp, &job);
+    gc_pin_resume(pins);
+    return ok ? OBJ_VAL(output) : NIL_VAL;
+}
+
+/* par..reduce((fn,, items,, init)): fn must be associative.  Each chunk is
+   folded from its first item, then the partials are folded into init in
+   order, which matches a sequential left fold.  Without init the first
+   item starts the fold. */
+Value native_par_reduce(int argc, Value *argv) {
+    Interpreter *interp = interpreter_current();
+    if (!interp) return NIL_VAL;
+    if (argc < 2 || !is_callable(argv[0])) {
+        runtime_error(interp, "par..reduce expects a function, something to iterate over and an initial value.");
+        return NIL_VAL;
+    }
+    ObjList *input = input_list(interp, argv[1]);
+    if (!input) return NIL_VAL;
+    ParJob job;
+    job_begin(&job, PAR_REDUCE, argv[0], input, input->count);
+    ObjList *output = obj_list_new();
+    job.output = output;
+
+    for (size_t i = 0; i < job.chunk_count; i++) value_array_write(output, NIL_VAL);
+
+    int pins = gc_pin_suspend();
+    int ok = run_job(interp, &job);
+
+    /* The fold so far lives in an extra slot of the output list */
+    Value result = NIL_VAL;
+    if (ok && job.count > 0) {
+        size_t first = 0;
+        value_array_write(output, argc >= 3 ? argv[2] : output->items[first++]);
+        size_t acc = output->count - 1;
+        for (size_t c = first; c < job.chunk_count; c++) {
+            Value args[2] = { output->items[acc], output->items[c] };
+            Value folded = interp_call(interp, job.fn, 2, args);
+            if (interp->throw_flag) {
+                ok = 0;
+                break;
+            }
+            store(output, acc, folded);
+        }
+        if (ok) result = output->items[acc];
+    } else if (ok && argc >= 3) {
+        result = argv[2];
+    }
+    gc_pin_resume(pins);
+    return result;
+}
+
+/* par..for((n,, fn)): fn((i)) for every i in [0, n), in no particular
+   order */
+Value native_par_for(int argc, Value *argv) {
+    Interpreter *interp = interpreter_current();
+    if (!interp) return NIL_VAL;
+    if (argc < 2 || !IS_NUMBER(argv[0]) || !is_callable(argv[1]) ||
+        AS_NUMBER(argv[0]) < 0 || AS_NUMBER(argv[0]) != floor(AS_NUMBER(argv[0]))) {
+        runtime_error(interp, "par..for expects a whole number and a function.");
+        return NIL_VAL;
+    }
+    ParJob job;
+    job_begin(&job, PAR_FOR, argv[1], NULL, (size_t)AS_NUMBER(argv[0]));
+
+    int pins = gc_pin_suspend();
+    run_job(interp, &job);
+    gc_pin_resume(pins);
+    return NIL_VAL;
+}
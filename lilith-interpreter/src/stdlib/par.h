@@ -0,0 +1,14 @@
+#ifndef LILITH_STDPAR_H
+#define LILITH_STDPAR_H
+
+#include "runtime/value.h"
+
+/* Data-parallel natives.  The input is split into chunks that run on the
+   shared thread pool, each worker calling back into the interpreter in a
+   context of its own; results are merged in input order. */
+
+Value native_par_map(int argc, Value *argv);
+Value native_par_reduce(int argc, Value *argv);
+Value native_par_for(int argc, Value *argv);
+
+#endif
@@ -1,4 +1,6 @@
 #include "seq.h"
+#include "runtime/interpreter.h"
+#include <math.h>
 
 Value native_seq_len(int argc, Value *argv) {
     if (argc == 0) return NUMBER_VAL(0);
@@ -7,5 +9,47 @@ Value native_seq_len(int argc, Value *argv) {
     if (IS_LIST(v))   return NUMBER_VAL((double)AS_LIST(v)->count);
     if (IS_TUPLE(v))  return NUMBER_VAL((double)AS_TUPLE(v)->count);
     if (IS_DICT(v))   return NUMBER_VAL((double)AS_DICT(v)->count);
+    if (IS_RANGE(v))  return NUMBER_VAL((double)AS_RANGE(v)->count);
+    if (IS_ARRAY(v))  return NUMBER_VAL((double)AS_ARRAY(v)->count);
+    if (IS_ENTRIES(v)) return NUMBER_VAL((double)AS_ENTRIES(v)->dict->count);
     return NUMBER_VAL(0);
 }
+
+/* seq..range((end)), ((start,, end)) or ((start,, end,, step)): the numbers
+   from start (0) by step (1) up to but excluding end, computed as they are
+   walked */
+Value native_seq_range(int argc, Value *argv) {
+    Interpreter *interp = interpreter_current();
+    if (!interp) return NIL_VAL;
+    int numbers = argc >= 1 && argc <= 3;
+    for (int i = 0; i < argc; i++) numbers = numbers && IS_NUMBER(argv[i]);
+    if (!numbers) {
+        runtime_error(interp, "seq..range expects one to three numbers.");
+        return NIL_VAL;
+    }
+    double start = argc >= 2 ? AS_NUMBER(argv[0]) : 0;
+    double end = argc >= 2 ? AS_NUMBER(argv[1]) : AS_NUMBER(argv[0]);
+    double step = argc == 3 ? AS_NUMBER(argv[2]) : 1;
+    if (step == 0) {
+        runtime_error(interp, "seq..range step must not be zero.");
+        return NIL_VAL;
+    }
+    double span = ceil((end - start) / step);
+    if (span != span || span >= 9007199254740992.0) {
+        runtime_error(interp, "seq..range is too long.");
+        return NIL_VAL;
+    }
+    return OBJ_VAL(obj_range_new(start, step, span > 0 ? (size_t)span : 0));
+}
+
+/* seq..entries((dict)): its (key,, value) pairs, read off the dict as they
+   are walked rather than copied */
+Value native_seq_entries(int argc, Value *argv) {
+    Interpreter *interp = interpreter_current();
+    if (!interp) return NIL_VAL;
+    if (argc < 1 || !IS_DICT(argv[0])) {
+        runtime_error(interp, "seq..entries expects a dict.");
+        return NIL_VAL;
+    }
+    return OBJ_VAL(obj_entries_new(AS_DICT(argv[0])));
+}
@@ -4,5 +4,7 @@
 #include "runtime/value.h"
 
 Value native_seq_len(int argc, Value *argv);
+Value native_seq_range(int argc, Value *argv);
+Value native_seq_entries(int argc, Value *argv);
 
 #endif
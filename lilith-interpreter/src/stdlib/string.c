@@ -1,86 +1,107 @@
 #include "string.h"
+#include "runtime/iterator.h"
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 
+/* Strings are compared and searched by length: a view's bytes do not end
+   in a NUL. */
+
+/* The first `needle` in `hay`, or NULL */
+static const char *find_bytes(const char *hay, size_t hay_len, const char *needle, size_t needle_len) {
+    if (needle_len == 0) return hay;
+    if (needle_len > hay_len) return NULL;
+    const char *last = hay + hay_len - needle_len;
+    for (const char *p = hay; p <= last; p++) {
+        p = (const char *)memchr(p, needle[0], (size_t)(last - p) + 1);
+        if (!p) return NULL;
+        if (memcmp(p, needle, needle_len) == 0) return p;
+    }
+    return NULL;
+}
+
 Value native_str_from(int argc, Value *argv) {
     if (argc == 0) return OBJ_VAL(obj_string_copy("", 0));
+    if (IS_STRING(argv[0])) return argv[0];
     return OBJ_VAL(obj_string_copy(value_to_string(argv[0]), strlen(value_to_string(argv[0]))));
 }
 
 Value native_str_trim(int argc, Value *argv) {
     if (argc < 1 || !IS_STRING(argv[0])) return argv[0];
-    const char *s = AS_STRING(argv[0])->chars;
-    size_t len = AS_STRING(argv[0])->length;
-    while (len > 0 && isspace((unsigned char)s[0])) { s++; len--; }
-    while (len > 0 && isspace((unsigned char)s[len - 1])) { len--; }
-    return OBJ_VAL(obj_string_copy(s, len));
+    ObjString *str = AS_STRING(argv[0]);
+    const char *s = string_bytes(str);
+    size_t start = 0;
+    size_t end = str->length;
+    while (start < end && isspace((unsigned char)s[start])) start++;
+    while (end > start && isspace((unsigned char)s[end - 1])) end--;
+    return OBJ_VAL(obj_string_slice(str, start, end - start));
 }
 
 Value native_str_contains(int argc, Value *argv) {
     if (argc < 2 || !IS_STRING(argv[0]) || !IS_STRING(argv[1])) return BOOL_VAL(0);
-    return BOOL_VAL(strstr(AS_STRING(argv[0])->chars, AS_STRING(argv[1])->chars) != NULL);
+    ObjString *str = AS_STRING(argv[0]);
+    ObjString *part = AS_STRING(argv[1]);
+    return BOOL_VAL(find_bytes(string_bytes(str), str->length, string_bytes(part), part->length) != NULL);
 }
 
 Value native_str_starts(int argc, Value *argv) {
     if (argc < 2 || !IS_STRING(argv[0]) || !IS_STRING(argv[1])) return BOOL_VAL(0);
-    const char *s = AS_STRING(argv[0])->chars;
-    const char *prefix = AS_STRING(argv[1])->chars;
-    return BOOL_VAL(strncmp(s, prefix, strlen(prefix)) == 0);
+    ObjString *str = AS_STRING(argv[0]);
+    ObjString *prefix = AS_STRING(argv[1]);
+    if (prefix->length > str->length) return BOOL_VAL(0);
+    return BOOL_VAL(memcmp(string_bytes(str), string_bytes(prefix), prefix->length) == 0);
 }
 
 Value native_str_ends(int argc, Value *argv) {
     if (argc < 2 || !IS_STRING(argv[0]) || !IS_STRING(argv[1])) return BOOL_VAL(0);
-    const char *s = AS_STRING(argv[0])->chars;
-    const char *suffix = AS_STRING(argv[1])->chars;
-    size_t slen = strlen(s);
-    size_t suflen = strlen(suffix);
-    if (suflen > slen) return BOOL_VAL(0);
-    return BOOL_VAL(strcmp(s + slen - suflen, suffix) == 0);
+    ObjString *str = AS_STRING(argv[0]);
+    ObjString *suffix = AS_STRING(argv[1]);
+    if (suffix->length > str->length) return BOOL_VAL(0);
+    const char *tail = string_bytes(str) + str->length - suffix->length;
+    return BOOL_VAL(memcmp(tail, string_bytes(suffix), suffix->length) == 0);
 }
 
 Value native_str_replace(int argc, Value *argv) {
     if (argc < 3 || !IS_STRING(argv[0]) || !IS_STRING(argv[1]) || !IS_STRING(argv[2]))
         return argv[0];
-    const char *src = AS_STRING(argv[0])->chars;
-    const char *from = AS_STRING(argv[1])->chars;
-    const char *to = AS_STRING(argv[2])->chars;
-    size_t from_len = strlen(from);
-    size_t to_len = strlen(to);
+    ObjString *str = AS_STRING(argv[0]);
+    const char *src = string_bytes(str);
+    const char *end = src + str->length;
+    const char *from = string_bytes(AS_STRING(argv[1]));
+    const char *to = string_bytes(AS_STRING(argv[2]));
+    size_t from_len = AS_STRING(argv[1])->length;
+    size_t to_len = AS_STRING(argv[2])->length;
+    if (from_len == 0) return argv[0];
 
     size_t count = 0;
-    const char *tmp = src;
-    while ((tmp = strstr(tmp, from)) != NULL) { count++; tmp += from_len; }
+    for (const char *tmp = src; (tmp = find_bytes(tmp, (size_t)(end - tmp), from, from_len)); tmp += from_len)
+        count++;
+    if (count == 0) return argv[0];
 
-    size_t result_len = strlen(src) + count * (to_len - from_len);
+    size_t result_len = str->length + count * to_len - count * from_len;
     char *result = (char *)malloc(result_len + 1);
     if (!result) return argv[0];
 
     char *dst = result;
-    while (*src) {
-        const char *match = strstr(src, from);
-        if (match) {
-            size_t prefix = (size_t)(match - src);
-            memcpy(dst, src, prefix);
-            dst += prefix;
-            memcpy(dst, to, to_len);
-            dst += to_len;
-            src = match + from_len;
-        } else {
-            size_t rest = strlen(src);
-            memcpy(dst, src, rest);
-            dst += rest;
-            break;
-        }
+    for (;;) {
+        const char *match = find_bytes(src, (size_t)(end - src), from, from_len);
+        size_t prefix = (size_t)((match ? match : end) - src);
+        memcpy(dst, src, prefix);
+        dst += prefix;
+        if (!match) break;
+        memcpy(dst, to, to_len);
+        dst += to_len;
+        src = match + from_len;
     }
     *dst = '\0';
     return OBJ_VAL(obj_string_take(result, (size_t)(dst - result)));
 }
 
+/* Slices of a long string share its bytes */
 Value native_str_slice(int argc, Value *argv) {
     if (argc < 2 || !IS_STRING(argv[0]) || !IS_NUMBER(argv[1])) return argv[0];
-    const char *s = AS_STRING(argv[0])->chars;
-    size_t len = AS_STRING(argv[0])->length;
+    ObjString *str = AS_STRING(argv[0]);
+    size_t len = str->length;
     size_t start = (size_t)AS_NUMBER(argv[1]);
     if (start > len) start = len;
     size_t end = len;
@@ -89,38 +110,50 @@ Value native_str_slice(int argc, Value *argv) {
         if (end > len) end = len;
     }
     if (end < start) end = start;
-    return OBJ_VAL(obj_string_copy(s + start, end - start));
+    return OBJ_VAL(obj_string_slice(str, start, end - start));
 }
 
+/* Pieces are slices; an empty delimiter leaves the string whole */
 Value native_str_split(int argc, Value *argv) {
     if (argc < 2 || !IS_STRING(argv[0]) || !IS_STRING(argv[1])) {
         ObjList *list = obj_list_new();
         return OBJ_VAL(list);
     }
-    const char *s = AS_STRING(argv[0])->chars;
-    const char *delim = AS_STRING(argv[1])->chars;
-    size_t dlen = strlen(delim);
+    ObjString *str = AS_STRING(argv[0]);
+    const char *s = string_bytes(str);
+    const char *delim = string_bytes(AS_STRING(argv[1]));
+    size_t dlen = AS_STRING(argv[1])->length;
     ObjList *list = obj_list_new();
+    if (dlen == 0) {
+        if (str->length > 0) value_array_write(list, argv[0]);
+        return OBJ_VAL(list);
+    }
 
-    const char *p = s;
-    while (*p) {
-        const char *match = strstr(p, delim);
-        if (match) {
-            value_array_write(list, OBJ_VAL(obj_string_copy(p, (size_t)(match - p))));
-            p = match + dlen;
-        } else {
-            value_array_write(list, OBJ_VAL(obj_string_copy(p, strlen(p))));
-            break;
-        }
+    size_t pos = 0;
+    while (pos < str->length) {
+        const char *match = find_bytes(s + pos, str->length - pos, delim, dlen);
+        size_t next = match ? (size_t)(match - s) : str->length;
+        value_array_write(list, OBJ_VAL(obj_string_slice(str, pos, next - pos)));
+        if (!match) break;
+        pos = next + dlen;
     }
     return OBJ_VAL(list);
 }
 
 Value native_str_join(int argc, Value *argv) {
-    if (argc < 2 || !IS_LIST(argv[1])) return OBJ_VAL(obj_string_copy("", 0));
-    const char *sep = argc >= 1 && IS_STRING(argv[0]) ? AS_STRING(argv[0])->chars : "";
-    size_t sep_len = strlen(sep);
-    ObjList *list = AS_LIST(argv[1]);
+    if (argc < 2) return OBJ_VAL(obj_string_copy("", 0));
+    ObjList *list;
+    if (IS_LIST(argv[1])) {
+        list = AS_LIST(argv[1]);
+    } else {
+        /* Anything else iterable is collected first */
+        Interpreter *interp = interpreter_current();
+        IterCursor cursor;
+        if (!interp || !iter_begin(argv[1], &cursor)) return OBJ_VAL(obj_string_copy("", 0));
+        if (!(list = iter_collect(interp, argv[1]))) return NIL_VAL;
+    }
+    const char *sep = IS_STRING(argv[0]) ? string_bytes(AS_STRING(argv[0])) : "";
+    size_t sep_len = IS_STRING(argv[0]) ? AS_STRING(argv[0])->length : 0;
 
     size_t total = 0;
     for (size_t i = 0; i < list->count; i++) {
@@ -141,7 +174,7 @@ Value native_str_join(int argc, Value *argv) {
         }
         if (IS_STRING(list->items[i])) {
             size_t len = AS_STRING(list->items[i])->length;
-            memcpy(p, AS_STRING(list->items[i])->chars, len);
+            memcpy(p, string_bytes(AS_STRING(list->items[i])), len);
             p += len;
         }
     }
@@ -0,0 +1,345 @@
+#include "vec.h"
+#include "runtime/interpreter.h"
+#include "runtime/iterator.h"
+#include "runtime/array.h"
+#include "simd/simd.h"
+#include <stdlib.h>
+
+/* ========================================================================= */
+/* Operands                                                                  */
+/* ========================================================================= */
+
+/* A run of doubles for the kernels: float64 arrays lend their storage,
+   lists, tuples, ranges and other arrays are copied out, and a number
+   stands for itself repeated (count is 0 until broadcast). */
+typedef struct {
+    Value source;
+    const double *data;
+    double *owned;
+    size_t count;
+    bool scalar;
+} VecOperand;
+
+static void operand_free(VecOperand *op) {
+    free(op->owned);
+    op->owned = NULL;
+}
+
+static bool operand_load(Interpreter *interp, const char *fn, Value v, bool allow_scalar, VecOperand *op) {
+    op->source = v;
+    op->data = NULL;
+    op->owned = NULL;
+    op->count = 0;
+    op->scalar = false;
+
+    if (allow_scalar && IS_NUMBER(v)) {
+        op->scalar = true;
+        op->owned = malloc(sizeof(double));
+        if (!op->owned) {
+            runtime_error(interp, "%s ran out of memory.", fn);
+            return false;
+        }
+        op->owned[0] = AS_NUMBER(v);
+        op->data = op->owned;
+        return true;
+    }
+    if (IS_ARRAY(v) && AS_ARRAY(v)->type == ARRAY_FLOAT64) {
+        op->data = AS_ARRAY(v)->data;
+        op->count = AS_ARRAY(v)->count;
+        return true;
+    }
+    if (IS_STRING(v) || !iter_count(v, &op->count)) {
+        runtime_error(interp, "%s expects lists or numeric arrays, not %s.", fn, value_type_name(v));
+        return false;
+    }
+    op->owned = malloc((op->count ? op->count : 1) * sizeof(double));
+    if (!op->owned) {
+        runtime_error(interp, "%s ran out of memory.", fn);
+        return false;
+    }
+    for (size_t i = 0; i < op->count; i++) {
+        Value item = iter_item(v, i);
+        if (!IS_NUMBER(item)) {
+            runtime_error(interp, "%s expects numbers, found %s.", fn, value_type_name(item));
+            operand_free(op);
+            return false;
+        }
+        op->owned[i] = AS_NUMBER(item);
+    }
+    op->data = op->owned;
+    return true;
+}
+
+/* Give every scalar operand the length of the sequences, which must agree;
+   the first sequence is returned through `shape` */
+static bool operands_match(Interpreter *interp, const char *fn, VecOperand *ops, int n, VecOperand **shape) {
+    *shape = NULL;
+    for (int i = 0; i < n; i++) {
+        if (ops[i].scalar) continue;
+        if (!*shape) *shape = &ops[i];
+        else if (ops[i].count != (*shape)->count) {
+            runtime_error(interp, "%s expects sequences of the same length, not %zu and %zu.",
+                          fn, (*shape)->count, ops[i].count);
+            return false;
+        }
+    }
+    if (!*shape) {
+        runtime_error(interp, "%s expects at least one list or array.", fn);
+        return false;
+    }
+    size_t count = (*shape)->count;
+    for (int i = 0; i < n; i++) {
+        if (!ops[i].scalar) continue;
+        double value = ops[i].owned[0];
+        double *filled = realloc(ops[i].owned, (count ? count : 1) * sizeof(double));
+        if (!filled) {
+            runtime_error(interp, "%s ran out of memory.", fn);
+            return false;
+        }
+        for (size_t j = 0; j < count; j++) filled[j] = value;
+        ops[i].owned = filled;
+        ops[i].data = filled;
+        ops[i].count = count;
+    }
+    return true;
+}
+
+/* ========================================================================= */
+/* Results                                                                   */
+/* ========================================================================= */
+
+/* Where a kernel writes `count` doubles shaped like `shape`: straight into
+   a new float64 array when that is the result, otherwise a scratch buffer
+   that result_end converts */
+typedef struct {
+    Value result;
+    double *out;
+    double *scratch;
+} VecResult;
+
+static bool result_begin(Interpreter *interp, const char *fn, Value shape, size_t count, VecResult *res) {
+    res->scratch = NULL;
+    if (IS_ARRAY(shape) && AS_ARRAY(shape)->type == ARRAY_FLOAT32) {
+        res->result = OBJ_VAL(obj_array_new(ARRAY_FLOAT32, count));
+    } else if (IS_ARRAY(shape)) {
+        /* Integer arrays widen: sums and quotients need not fit */
+        ObjArray *array = obj_array_new(ARRAY_FLOAT64, count);
+        res->result = OBJ_VAL(array);
+        res->out = array->data;
+        return true;
+    } else {
+        res->result = OBJ_VAL(obj_list_new());
+    }
+    res->scratch = malloc((count ? count : 1) * sizeof(double));
+    if (!res->scratch) {
+        runtime_error(interp, "%s ran out of memory.", fn);
+        return false;
+    }
+    res->out = res->scratch;
+    return true;
+}
+
+static Value result_end(VecResult *res, size_t count) {
+    if (res->scratch) {
+        if (IS_ARRAY(res->result)) {
+            for (size_t i = 0; i < count; i++) array_set(AS_ARRAY(res->result), i, res->scratch[i]);
+        } else {
+            ObjList *list = AS_LIST(res->result);
+            for (size_t i = 0; i < count; i++) value_array_write(list, NUMBER_VAL(res->scratch[i]));
+        }
+        free(res->scratch);
+    }
+    return res->result;
+}
+
+/* ========================================================================= */
+/* Element-wise                                                              */
+/* ========================================================================= */
+
+typedef void (*BinaryKernel)(const double *a, const double *b, double *out, size_t n);
+
+static Value binary(int argc, Value *argv, const char *fn, BinaryKernel kernel) {
+    Interpreter *interp = interpreter_current();
+    if (!interp) return NIL_VAL;
+    if (argc != 2) {
+        runtime_error(interp, "%s expects two operands.", fn);
+        return NIL_VAL;
+    }
+    VecOperand ops[2] = {0};
+    VecOperand *shape;
+    VecResult res;
+    Value result = NIL_VAL;
+    if (operand_load(interp, fn, argv[0], true, &ops[0]) &&
+        operand_load(interp, fn, argv[1], true, &ops[1]) &&
+        operands_match(interp, fn, ops, 2, &shape) &&
+        result_begin(interp, fn, shape->source, shape->count, &res)) {
+        kernel(ops[0].data, ops[1].data, res.out, shape->count);
+        result = result_end(&res, shape->count);
+    }
+    operand_free(&ops[0]);
+    operand_free(&ops[1]);
+    return result;
+}
+
+/* vec..add((a,, b)) and the rest: element by element; either side may be a
+   number, applied to every element of the other */
+Value native_vec_add(int argc, Value *argv) {
+    return binary(argc, argv, "vec..add", simd_kernels()->add);
+}
+
+Value native_vec_sub(int argc, Value *argv) {
+    return binary(argc, argv, "vec..sub", simd_kernels()->sub);
+}
+
+Value native_vec_mul(int argc, Value *argv) {
+    return binary(argc, argv, "vec..mul", simd_kernels()->mul);
+}
+
+Value native_vec_div(int argc, Value *argv) {
+    return binary(argc, argv, "vec..div", simd_kernels()->div);
+}
+
+/* vec..scale((v,, k)): every element times k */
+Value native_vec_scale(int argc, Value *argv) {
+    Interpreter *interp = interpreter_current();
+    if (!interp) return NIL_VAL;
+    if (argc != 2 || !IS_NUMBER(argv[1])) {
+        runtime_error(interp, "vec..scale expects a list or array and a number.");
+        return NIL_VAL;
+    }
+    VecOperand op;
+    VecResult res;
+    Value result = NIL_VAL;
+    if (operand_load(interp, "vec..scale", argv[0], false, &op)) {
+        if (result_begin(interp, "vec..scale", argv[0], op.count, &res)) {
+            simd_kernels()->scale(op.data, AS_NUMBER(argv[1]), res.out, op.count);
+            result = result_end(&res, op.count);
+        }
+        operand_free(&op);
+    }
+    return result;
+}
+
+/* vec..fma((a,, b,, c)): a ** b ++ c, rounded once per element */
+Value native_vec_fma(int argc, Value *argv) {
+    Interpreter *interp = interpreter_current();
+    if (!interp) return NIL_VAL;
+    if (argc != 3) {
+        runtime_error(interp, "vec..fma expects three operands.");
+        return NIL_VAL;
+    }
+    VecOperand ops[3] = {0};
+    VecOperand *shape;
+    VecResult res;
+    Value result = NIL_VAL;
+    if (operand_load(interp, "vec..fma", argv[0], true, &ops[0]) &&
+        operand_load(interp, "vec..fma", argv[1], true, &ops[1]) &&
+        operand_load(interp, "vec..fma", argv[2], true, &ops[2]) &&
+        operands_match(interp, "vec..fma", ops, 3, &shape) &&
+        result_begin(interp, "vec..fma", shape->source, shape->count, &res)) {
+        simd_kernels()->fma(ops[0].data, ops[1].data, ops[2].data, res.out, shape->count);
+        result = result_end(&res, shape->count);
+    }
+    for (int i = 0; i < 3; i++) operand_free(&ops[i]);
+    return result;
+}
+
+/* ========================================================================= */
+/* Reductions                                                                */
+/* ========================================================================= */
+
+/* vec..dot((a,, b)): the sum of the products */
+Value native_vec_dot(int argc, Value *argv) {
+    Interpreter *interp = interpreter_current();
+    if (!interp) return NIL_VAL;
+    if (argc != 2) {
+        runtime_error(interp, "vec..dot expects two lists or arrays.");
+        return NIL_VAL;
+    }
+    VecOperand ops[2] = {0};
+    VecOperand *shape;
+    Value result = NIL_VAL;
+    if (operand_load(interp, "vec..dot", argv[0], false, &ops[0]) &&
+        operand_load(interp, "vec..dot", argv[1], false, &ops[1]) &&
+        operands_match(interp, "vec..dot", ops, 2, &shape)) {
+        result = NUMBER_VAL(simd_kernels()->dot(ops[0].data, ops[1].data, shape->count));
+    }
+    operand_free(&ops[0]);
+    operand_free(&ops[1]);
+    return result;
+}
+
+/* The one operand of a reduction; empty ones are refused unless `empty_ok` */
+static bool unary_operand(Interpreter *interp, const char *fn, int argc, Value *argv, bool empty_ok, VecOperand *op) {
+    if (argc != 1) {
+        runtime_error(interp, "%s expects one list or array.", fn);
+        return false;
+    }
+    if (!operand_load(interp, fn, argv[0], false, op)) return false;
+    if (op->count == 0 && !empty_ok) {
+        runtime_error(interp, "%s expects a non-empty list or array.", fn);
+        operand_free(op);
+        return false;
+    }
+    return true;
+}
+
+Value native_vec_sum(int argc, Value *argv) {
+    Interpreter *interp = interpreter_current();
+    if (!interp) return NIL_VAL;
+    VecOperand op;
+    if (!unary_operand(interp, "vec..sum", argc, argv, true, &op)) return NIL_VAL;
+    double total = simd_kernels()->sum(op.data, op.count);
+    operand_free(&op);
+    return NUMBER_VAL(total);
+}
+
+Value native_vec_min(int argc, Value *argv) {
+    Interpreter *interp = interpreter_current();
+    if (!interp) return NIL_VAL;
+    VecOperand op;
+    if (!unary_operand(interp, "vec..min", argc, argv, false, &op)) return NIL_VAL;
+    double least = simd_kernels()->min(op.data, op.count);
+    operand_free(&op);
+    return NUMBER_VAL(least);
+}
+
+Value native_vec_max(int argc, Value *argv) {
+    Interpreter *interp = interpreter_current();
+    if (!interp) return NIL_VAL;
+    VecOperand op;
+    if (!unary_operand(interp, "vec..max", argc, argv, false, &op)) return NIL_VAL;
+    double most = simd_kernels()->max(op.data, op.count);
+    operand_free(&op);
+    return NUMBER_VAL(most);
+}
+
+/* The first index holding `target`; a NaN target is found as the first NaN */
+static size_t index_of(const double *data, size_t count, double target) {
+    for (size_t i = 0; i < count; i++) {
+        if (data[i] == target || (target != target && data[i] != data[i])) return i;
+    }
+    return 0;
+}
+
+/* vec..argmin((v)) and vec..argmax((v)): where the first least or greatest
+   element is */
+Value native_vec_argmin(int argc, Value *argv) {
+    Interpreter *interp = interpreter_current();
+    if (!interp) return NIL_VAL;
+    VecOperand op;
+    if (!unary_operand(interp, "vec..argmin", argc, argv, false, &op)) return NIL_VAL;
+    size_t index = index_of(op.data, op.count, simd_kernels()->min(op.data, op.count));
+    operand_free(&op);
+    return NUMBER_VAL((double)index);
+}
+
+Value native_vec_argmax(int argc, Value *argv) {
+    Interpreter *interp = interpreter_current();
+    if (!interp) return NIL_VAL;
+    VecOperand op;
+    if (!unary_operand(interp, "vec..argmax", argc, argv, false, &op)) return NIL_VAL;
+    size_t index = index_of(op.data, op.count, simd_kernels()->max(op.data, op.count));
+    operand_free(&op);
+    return NUMBER_VAL((double)index);
+}
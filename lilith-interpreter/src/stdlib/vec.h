@@ -0,0 +1,19 @@
+#ifndef LILITH_STDVEC_H
+#define LILITH_STDVEC_H
+
+#include "runtime/value.h"
+
+Value native_vec_add(int argc, Value *argv);
+Value native_vec_sub(int argc, Value *argv);
+Value native_vec_mul(int argc, Value *argv);
+Value native_vec_div(int argc, Value *argv);
+Value native_vec_scale(int argc, Value *argv);
+Value native_vec_fma(int argc, Value *argv);
+Value native_vec_dot(int argc, Value *argv);
+Value native_vec_sum(int argc, Value *argv);
+Value native_vec_min(int argc, Value *argv);
+Value native_vec_max(int argc, Value *argv);
+Value native_vec_argmin(int argc, Value *argv);
+Value native_vec_argmax(int argc, Value *argv);
+
+#endif
@@ -0,0 +1,182 @@
+/**
+ * @file test_concurrency.c
+ * @brief Unit tests for the work-stealing thread pool and scheduler.
+ *
+ * Covers fork/join from outside and inside the pool, deep recursive
+ * spawning, parallel_for, and how an embarrassingly parallel loop scales
+ * with the number of workers.
+ */
+
+#include "concurrency/thread_pool.h"
+#include "concurrency/scheduler.h"
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+static double now_seconds(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* ========================================================================= */
+/* Fork / join                                                               */
+/* ========================================================================= */
+
+typedef struct {
+    ThreadPool *pool;
+    int n;
+    long result;
+} FibTask;
+
+static void fib_task(void *arg) {
+    FibTask *fib = (FibTask *)arg;
+    if (fib->n < 2) {
+        fib->result = fib->n;
+        return;
+    }
+    FibTask left = { fib->pool, fib->n - 1, 0 };
+    FibTask right = { fib->pool, fib->n - 2, 0 };
+    Task task;
+    task_init(&task, fib_task, &left);
+    thread_pool_spawn(fib->pool, &task);
+    fib_task(&right);
+    thread_pool_join(fib->pool, &task);
+    fib->result = left.result + right.result;
+}
+
+/**
+ * @brief Every recursive call is a task: about 30000 spawns and joins that
+ * workers steal from each other.
+ */
+static void test_recursive_fork_join(void) {
+    ThreadPool *pool = thread_pool_create(4);
+    FibTask fib = { pool, 22, 0 };
+    Task root;
+    task_init(&root, fib_task, &fib);
+    thread_pool_spawn(pool, &root);
+    thread_pool_join(pool, &root);
+    assert(fib.result == 17711);
+    thread_pool_destroy(pool);
+    printf("test_recursive_fork_join passed.\n");
+}
+
+static void bump(void *arg) {
+    atomic_fetch_add((atomic_int *)arg, 1);
+}
+
+/**
+ * @brief Many independent tasks submitted from outside the pool.
+ */
+static void test_external_submission(void) {
+    enum { COUNT = 10000 };
+    static Task tasks[COUNT];
+    ThreadPool *pool = thread_pool_create(3);
+    atomic_int counter;
+    atomic_init(&counter, 0);
+    for (int i = 0; i < COUNT; i++) {
+        task_init(&tasks[i], bump, &counter);
+        thread_pool_spawn(pool, &tasks[i]);
+    }
+    for (int i = 0; i < COUNT; i++) thread_pool_join(pool, &tasks[i]);
+    assert(atomic_load(&counter) == COUNT);
+    assert(thread_pool_worker_index() == -1);
+    thread_pool_destroy(pool);
+    printf("test_external_submission passed.\n");
+}
+
+/* ========================================================================= */
+/* parallel_for                                                              */
+/* ========================================================================= */
+
+typedef struct {
+    atomic_llong sum;
+    atomic_int pieces;
+} SumContext;
+
+static void sum_range(size_t begin, size_t end, void *context) {
+    SumContext *sum = (SumContext *)context;
+    long long local = 0;
+    for (size_t i = begin; i < end; i++) local += (long long)i;
+    atomic_fetch_add(&sum->sum, local);
+    atomic_fetch_add(&sum->pieces, 1);
+}
+
+static void test_parallel_for(void) {
+    scheduler_set_workers(4);
+    ThreadPool *pool = scheduler_pool();
+    assert(thread_pool_size(pool) == 4);
+
+    SumContext sum;
+    atomic_init(&sum.sum, 0);
+    atomic_init(&sum.pieces, 0);
+    parallel_for(pool, 0, 1000000, 1000, sum_range, &sum);
+    assert(atomic_load(&sum.sum) == 999999LL * 1000000LL / 2);
+    assert(atomic_load(&sum.pieces) >= 1000);
+
+    /* Empty and single-piece ranges run inline */
+    atomic_store(&sum.sum, 0);
+    parallel_for(pool, 5, 5, 0, sum_range, &sum);
+    parallel_for(pool, 1, 4, 0, sum_range, &sum);
+    assert(atomic_load(&sum.sum) == 6);
+
+    scheduler_shutdown();
+    printf("test_parallel_for passed.\n");
+}
+
+/* ========================================================================= */
+/* Scaling                                                                   */
+/* ========================================================================= */
+
+#define SCALING_ITEMS 512
+
+static double results[SCALING_ITEMS];
+
+/* A fixed amount of floating-point work per item, no sharing */
+static void heavy_range(size_t begin, size_t end, void *context) {
+    (void)context;
+    for (size_t i = begin; i < end; i++) {
+        double x = (double)i;
+        for (int k = 0; k < 20000; k++) x = sin(x) + sqrt(x * x + 1.0);
+        results[i] = x;
+    }
+}
+
+static double time_with_workers(size_t workers) {
+    ThreadPool *pool = thread_pool_create(workers);
+    heavy_range(0, 8, NULL);        /* warm up */
+    double start = now_seconds();
+    parallel_for(pool, 0, SCALING_ITEMS, 4, heavy_range, NULL);
+    double elapsed = now_seconds() - start;
+    thread_pool_destroy(pool);
+    return elapsed;
+}
+
+/**
+ * @brief Speedup on an embarrassingly parallel loop, with up to 16 workers.
+ * The results must match; the timings are only reported, since wall-clock
+ * speedup depends on the machine's load.
+ */
+static void test_scaling(void) {
+    size_t cpus = thread_pool_cpu_count();
+    size_t workers = cpus > 16 ? 16 : cpus;
+    double serial = time_with_workers(1);
+    double check = results[SCALING_ITEMS - 1];
+    double parallel = time_with_workers(workers);
+    assert(results[SCALING_ITEMS - 1] == check);
+
+    double speedup = serial / parallel;
+    printf("  1 worker %.3fs, %zu workers %.3fs: speedup %.2fx on %zu CPUs\n",
+           serial, workers, parallel, speedup, cpus);
+    printf("test_scaling passed.\n");
+}
+
+int main(void) {
+    test_recursive_fork_join();
+    test_external_submission();
+    test_parallel_for();
+    test_scaling();
+    printf("All concurrency tests passed.\n");
+    return 0;
+}
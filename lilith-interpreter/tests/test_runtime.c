@@ -0,0 +1,711 @@
+#include "parser/parser.h"
+#include "lexer/lexer.h"
+#include "runtime/interpreter.h"
+#include "runtime/gc.h"
+#include "runtime/slab.h"
+#include "concurrency/scheduler.h"
+#include "async/async_runtime.h"
+#include "simd/simd.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static double now_seconds(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* Run `source` under the given engine and fetch a global afterwards. */
+static Value run_and_get(const char *source, Engine engine, const char *name, int *threw) {
+    Lexer *lexer = lexer_create(source, "test_runtime.lilith");
+    AstNode *ast = parser_parse(lexer);
+    assert(ast != NULL);
+
+    Interpreter interp;
+    interpreter_init(&interp);
+    interp.engine = engine;
+    interpreter_run(&interp, ast);
+    *threw = interp.throw_flag;
+
+    Value value = NIL_VAL;
+    env_get(interp.globals, obj_string_intern(name, strlen(name)), &value);
+    interpreter_free(&interp);
+    ast_free(ast);
+    lexer_destroy(lexer);
+    return value;
+}
+
+/* Both engines must agree on the final value of `name`. */
+static void expect_number(const char *source, const char *name, double expected) {
+    Engine engines[] = { ENGINE_AST, ENGINE_VM };
+    for (size_t i = 0; i < 2; i++) {
+        int threw = 0;
+        Value value = run_and_get(source, engines[i], name, &threw);
+        assert(!threw);
+        assert(IS_NUMBER(value));
+        assert(AS_NUMBER(value) == expected);
+    }
+}
+
+static void test_arithmetic_and_loops(void) {
+    expect_number("{[ i [=] 0 s [=] 0 <+((i << 10)) [[ s [=] s ++ i i [=] i ++ 1 ]] +> ]}", "s", 45);
+    printf("test_arithmetic_and_loops passed.\n");
+}
+
+static void test_recursion(void) {
+    expect_number("{[ (| fib ((n)) [[ [?((n << 2)) [[ )- n -( ]] ?] )- fib((n -- 1)) ++ fib((n -- 2)) -( ]] |)"
+                  "   r [=] fib((15)) ]}", "r", 610);
+    printf("test_recursion passed.\n");
+}
+
+/* Deep enough to spill the scope stack into more than one segment */
+static void test_deep_recursion(void) {
+    expect_number("{[ (| sum ((n)) [[ [?((n << 1)) [[ )- 0 -( ]] ?] )- n ++ sum((n -- 1)) -( ]] |)"
+                  "   r [=] sum((3000)) ++ sum((3000)) ]}", "r", 9003000);
+    printf("test_deep_recursion passed.\n");
+}
+
+static void test_break_continue_finally(void) {
+    expect_number("{[ n [=] 0"
+                  "   <:((x [%] [< 1,, 2,, 3,, 4,, 5 >]))"
+                  "   [[ {? [[ [?((x == 2)) [[ ]-? ]] ?] [?((x == 4)) [[ ]-! ]] ?] ]]"
+                  "         [:~ [[ n [=] n ++ x ]] ~:] ?} ]] :> ]}", "n", 10);
+    printf("test_break_continue_finally passed.\n");
+}
+
+static void test_try_catch(void) {
+    expect_number("{[ r [=] 0 {? [[ q [=] 1 // 0 ]] [! e [/] [[ r [=] 7 ]] !] ?} ]}", "r", 7);
+    printf("test_try_catch passed.\n");
+}
+
+static void test_comprehension_and_lambda(void) {
+    expect_number("{[ sq [=] (:< ((v)) [[ v ** v ]] >:)"
+                  "   xs [=] [< sq((x)) [:< x [%] [< 1,, 2,, 3 >] >:] [?: x >> 1 :?] >]"
+                  "   r [=] xs[0] ++ xs[1] ]}", "r", 13);
+    printf("test_comprehension_and_lambda passed.\n");
+}
+
+static void test_closures(void) {
+    expect_number("{[ (| make ((start)) [[ count [=] start"
+                  "     (| inc (( )) [[ count [=] count ++ 1 )- count -( ]] |) )- inc -( ]] |)"
+                  "   c [=] make((10)) c(( )) r [=] c(( )) ]}", "r", 12);
+    expect_number("{[ total [=] 1 (| bump ((n)) [[ total [=] total ++ n ]] |)"
+                  "   bump((2)) bump((3)) ]}", "total", 6);
+    printf("test_closures passed.\n");
+}
+
+/* Garbage from a long loop is collected while everything still reachable,
+   including values only natives and the engines' stacks hold, survives. */
+static void test_gc_under_pressure(void) {
+    const char *source =
+        "{[ keep [=] [< [< 0,, 0 >] >]"
+        "   (| make ((n)) [[ )- [< n,, n ++ 1,, str((n)) >] -( ]] |)"
+        "   i [=] 0 total [=] 0"
+        "   <+((i << 100000)) [[ xs [=] make((i)) s [=] \"k\" ++ str((i))"
+        "     [?((i %% 10000 == 0)) [[ list..push((keep,, xs)) ]] ?] i [=] i ++ 1 ]] +>"
+        "   <:((x [%] keep)) [[ total [=] total ++ x[1] ]] :> ]}";
+    Engine engines[] = { ENGINE_AST, ENGINE_VM };
+    for (size_t i = 0; i < 2; i++) {
+        Lexer *lexer = lexer_create(source, "test_runtime.lilith");
+        AstNode *ast = parser_parse(lexer);
+        assert(ast != NULL);
+
+        Interpreter interp;
+        interpreter_init(&interp);
+        interp.engine = engines[i];
+        interpreter_run(&interp, ast);
+        assert(!interp.throw_flag);
+        assert(gc_bytes_allocated() < 4 * 1024 * 1024);
+
+        Value total = NIL_VAL;
+        env_get(interp.globals, obj_string_intern("total", 5), &total);
+        assert(IS_NUMBER(total) && AS_NUMBER(total) == 450010);
+        interpreter_free(&interp);
+        ast_free(ast);
+        lexer_destroy(lexer);
+    }
+    printf("test_gc_under_pressure passed.\n");
+}
+
+/* Young values stored into objects that minor collections already promoted
+   must survive later minor collections. */
+static void test_old_to_young_stores(void) {
+    expect_number("{[ {| Box [[ (| init ((self)) [[ self.v [=] [< 0 >] ]] |) ]] |}"
+                  "   b [=] Box(( )) xs [=] [< 0,, 0 >] i [=] 0"
+                  "   <+((i << 50000)) [[ b.v [=] [< i,, str((i)) >] xs[1] [=] [< i >] i [=] i ++ 1 ]] +>"
+                  "   v [=] b.v a [=] xs[1] r [=] v[0] ++ a[0] ]}", "r", 99998);
+    printf("test_old_to_young_stores passed.\n");
+}
+
+/* A large old heap keeps being rewired while major cycles mark it in steps
+   of a microsecond or so. */
+static void test_incremental_marking(void) {
+    unsigned pause = gc_pause_target();
+    gc_set_pause_target(1);
+    expect_number("{[ keep [=] [< [< 0,, \"\" >] >] i [=] 0"
+                  "   <+((i << 20000)) [[ list..push((keep,, [< i,, str((i)) >])) i [=] i ++ 1 ]] +>"
+                  "   i [=] 0"
+                  "   <+((i << 200000)) [[ j [=] i %% 20000 keep[j] [=] [< j ++ 1,, str((i)) >] i [=] i ++ 1 ]] +>"
+                  "   total [=] 0 <:((x [%] keep)) [[ total [=] total ++ x[0] ]] :> ]}", "total", 200029999);
+    gc_set_pause_target(pause);
+    printf("test_incremental_marking passed.\n");
+}
+
+/* Growing a block keeps its bytes, across size classes and out to malloc */
+static void test_slab_realloc(void) {
+    char *p = (char *)slab_alloc(10);
+    memcpy(p, "lilith!!!", 10);
+    p = (char *)slab_realloc(p, 10, 12);
+    assert(strcmp(p, "lilith!!!") == 0);
+    p = (char *)slab_realloc(p, 12, 200);
+    assert(strcmp(p, "lilith!!!") == 0);
+    p = (char *)slab_realloc(p, 200, SLAB_MAX_SIZE * 4);
+    assert(strcmp(p, "lilith!!!") == 0);
+    slab_free(p, SLAB_MAX_SIZE * 4);
+
+    /* Freed blocks are reused by the next request of the same class */
+    void *a = slab_alloc(24);
+    slab_free(a, 24);
+    void *b = slab_alloc(30);
+#ifdef LILITH_SLAB_ALLOC
+    assert(a == b);
+#endif
+    slab_free(b, 30);
+    printf("test_slab_realloc passed.\n");
+}
+
+/* Each worker fills its own slot, allocating enough to collect while the
+   others run; a worker's error reaches the block. */
+static void test_parallel_block(void) {
+    scheduler_set_workers(4);
+    expect_number("{[ data [=] [< 0,, 0,, 0,, 0,, 0,, 0 >] base [=] 1000"
+                  "   <| ((6)) [[ id [=] thread_id(()) parts [=] [< 0 >] k [=] 0"
+                  "       <+((k << 3000)) [[ list..push((parts,, [< k,, str((k)) >])) k [=] k ++ 1 ]] +>"
+                  "       data[id] [=] len((parts)) ++ id ++ base ]] |>"
+                  "   total [=] 0 <:((x [%] data)) [[ total [=] total ++ x ]] :> ]}", "total", 24021);
+    expect_number("{[ caught [=] 0"
+                  "   {? [[ <| ((3)) [[ [?((thread_id(()) == 2)) [[ x [=] 1 // 0 ]] ?] ]] |> ]]"
+                  "      [! e [/] [[ caught [=] 1 ]] !] ?} ]}", "caught", 1);
+    scheduler_shutdown();
+    printf("test_parallel_block passed.\n");
+}
+
+/* Callbacks run on pool workers and allocate enough to collect; results
+   keep input order, and the first failing item's error is raised. */
+static void test_par_natives(void) {
+    scheduler_set_workers(4);
+    expect_number("{[ xs [=] [< 0 >] i [=] 1 <+((i << 2000)) [[ list..push((xs,, i)) i [=] i ++ 1 ]] +>"
+                  "   ys [=] par..map(((:< ((v)) [[ )- [< v,, str((v)) >] -( ]] >:),, xs))"
+                  "   ok [=] 1 i [=] 0"
+                  "   <+((i << 2000)) [[ y [=] ys[i] [?((y[0] != i)) [[ ok [=] 0 ]] ?] i [=] i ++ 1 ]] +>"
+                  "   s [=] par..reduce(((:< ((a,, b)) [[ a ++ b ]] >:),, xs,, 5))"
+                  "   r [=] ok ** s ]}", "r", 1999005);
+    expect_number("{[ w [=] par..reduce(((:< ((a,, b)) [[ a ++ b ]] >:),, par..map((str,, [< 1,, 2,, 3,, 4,, 5 >])),, \"\"))"
+                  "   hits [=] [< 0,, 0,, 0,, 0,, 0,, 0 >]"
+                  "   par..for((6,, (:< ((i)) [[ hits[i] [=] i ++ 1 ]] >:)))"
+                  "   r [=] num((w)) ++ par..reduce(((:< ((a,, b)) [[ a ++ b ]] >:),, hits,, 0)) ]}", "r", 12366);
+    expect_number("{[ r [=] 0"
+                  "   {? [[ par..map(((:< ((v)) [[ [?((v == 3)) [[ q [=] v // 0 ]] ?] )- v -( ]] >:),, [< 1,, 2,, 3,, 4 >])) ]]"
+                  "      [! e [/] [[ r [=] 1 ]] !] ?} ]}", "r", 1);
+    scheduler_shutdown();
+    printf("test_par_natives passed.\n");
+}
+
+/* Large pure comprehensions run on the pool; results keep source order and
+   the loop variable ends as after a sequential run, even on error. */
+static void test_parallel_comprehension(void) {
+    scheduler_set_workers(4);
+    const char *setup = "xs [=] [< 0 >] i [=] 1 <+((i << 3000)) [[ list..push((xs,, i)) i [=] i ++ 1 ]] +>";
+    char source[1024];
+    snprintf(source, sizeof(source),
+             "{[ %s ys [=] [< [< v ** v,, str((v)) >] [:< v [%%] xs >:] [?: v %%%% 3 == 0 :?] >]"
+             "   y [=] ys[999] s [=] ys[5] r [=] len((ys)) ++ y[0] ++ num((s[1])) ++ v ]}", setup);
+    expect_number(source, "r", 8986023);
+    snprintf(source, sizeof(source),
+             "{[ %s (| f ((n)) [[ zs [=] [< z ** z [:< z [%%] n >:] >] )- zs[2999] ++ z -( ]] |)"
+             "   r [=] f((xs)) ]}", setup);
+    expect_number(source, "r", 8997000);
+    snprintf(source, sizeof(source),
+             "{[ %s ys [=] [< v [:< v [%%] xs >:] [?: v << 1000 :?] >] r [=] 0"
+             "   {? [[ zs [=] [< ys[w] [:< w [%%] xs >:] >] ]] [! e [/] [[ r [=] w ]] !] ?} ]}", setup);
+    expect_number(source, "r", 1000);
+    scheduler_shutdown();
+    printf("test_parallel_comprehension passed.\n");
+}
+
+/* compute_async and async functions run on pool workers, allocating while
+   the caller does; awaiting yields the result or raises the call's error.
+   A future nobody awaits is waited for when the program ends. */
+static void test_futures(void) {
+    scheduler_set_workers(4);
+    expect_number("{[ (| build ((n)) [[ xs [=] [< 0 >] i [=] 1"
+                  "       <+((i << n)) [[ list..push((xs,, [< i,, str((i)) >])) i [=] i ++ 1 ]] +> )- xs -( ]] |)"
+                  "   (| ~ total ((xs)) [[ t [=] 0 <:((x [%] xs)) [[ [?((x != 0)) [[ t [=] t ++ x[0] ]] ?] ]] :> )- t -( ]] |)"
+                  "   fs [=] [< compute_async((build,, 3000)),, compute_async((build,, 2000)) >]"
+                  "   mine [=] build((4000))"
+                  "   a [=] ~(fs[0])~ b [=] ~(fs[1])~"
+                  "   ta [=] total((a)) r [=] ~(ta)~ ++ ~(total((b)))~ ++ len((mine)) ++ ~(7)~"
+                  "   unused [=] compute_async((build,, 500)) ]}", "r", 6501507);
+    expect_number("{[ (| boom ((x)) [[ )- x // missing -( ]] |)"
+                  "   f [=] compute_async((boom,, 1)) r [=] 0"
+                  "   {? [[ v [=] ~(f)~ ]] [! e [/] [[ r [=] 1 ]] !] ?}"
+                  "   {? [[ v [=] ~(f)~ ]] [! e [/] [[ r [=] r ++ 1 ]] !] ?} ]}", "r", 2);
+    scheduler_shutdown();
+    printf("test_futures passed.\n");
+}
+
+/* Async functions run as coroutines on the event loop: naps overlap, so
+   they wake in the order of their deadlines rather than the order they
+   started in, and awaiting inside one parks it until a coroutine or pool
+   future completes. */
+static void test_event_loop(void) {
+    scheduler_set_workers(4);
+    expect_number("{[ (| ~ nap ((i)) [[ os..sleep((0.2)) )- i -( ]] |)"
+                  "   fs [=] [< nap((0)) >] i [=] 1"
+                  "   <+((i << 1000)) [[ list..push((fs,, nap((i)))) i [=] i ++ 1 ]] +>"
+                  "   r [=] 0 <:((f [%] fs)) [[ r [=] r ++ ~(f)~ ]] :> ]}", "r", 499500);
+    expect_number("{[ (| ~ nap ((i,, secs,, log)) [[ os..sleep((secs)) list..push((log,, i)) )- i -( ]] |)"
+                  "   log [=] [< 0 >] fs [=] [< nap((1,, 0.5,, log)),, nap((2,, 0.3,, log)),, nap((3,, 0.1,, log)) >]"
+                  "   r [=] 0 <:((f [%] fs)) [[ r [=] r ++ ~(f)~ ]] :>"
+                  "   r [=] r ** 1000 ++ log[1] ** 100 ++ log[2] ** 10 ++ log[3] ]}", "r", 6321);
+    expect_number("{[ (| ~ chain ((n)) [[ [?((n == 0)) [[ )- 0 -( ]] ?]"
+                  "       os..sleep((0.001)) )- 1 ++ ~(chain((n -- 1)))~ -( ]] |)"
+                  "   (| sq ((x)) [[ )- x ** x -( ]] |)"
+                  "   (| ~ both (()) [[ )- ~(compute_async((sq,, 9)))~ ++ ~(os..run((\"exit 3\")))~ -( ]] |)"
+                  "   r [=] ~(chain((40)))~ ++ ~(both(()))~ ]}", "r", 124);
+    expect_number("{[ (| ~ bad (()) [[ os..sleep((0.001)) )- 1 // missing -( ]] |) r [=] 0"
+                  "   {? [[ v [=] ~(bad(()))~ ]] [! e [/] [[ r [=] 1 ]] !] ?} ]}", "r", 1);
+    async_shutdown();
+    scheduler_shutdown();
+    printf("test_event_loop passed.\n");
+}
+
+/* A generator runs its body only as far as each step needs: pipelines
+   stream item by item, breaking out abandons the rest of the body, and
+   errors surface in the loop that consumes it. */
+static void test_generators(void) {
+    const char *upto = "(| upto ((n)) [[ i [=] 0 <+((i << n)) [[ )-? i ?-( i [=] i ++ 1 ]] +> ]] |)";
+    char source[1024];
+    snprintf(source, sizeof(source), "{[ %s (| squares ((src)) [[ <:((v [%%] src)) [[ )-? v ** v ?-( ]] :> ]] |)"
+             "   r [=] 0 <:((x [%%] squares((upto((100000)))))) [[ r [=] r ++ x ]] :> ]}", upto);
+    expect_number(source, "r", 333328333350000.0);
+    snprintf(source, sizeof(source), "{[ %s xs [=] [< y ++ 1 [:< y [%%] upto((5)) >:] >] r [=] len((xs)) ++ xs[4] ]}", upto);
+    expect_number(source, "r", 10);
+    expect_number("{[ (| forever (()) [[ k [=] 0 <+((#true)) [[ )-? k ?-( k [=] k ++ 1 ]] +> ]] |)"
+                  "   j [=] 0 <+((j << 2000)) [[ <:((w [%] forever(()))) [[ [?((w == 3)) [[ ]-! ]] ?] ]] :> j [=] j ++ 1 ]] +>"
+                  "   r [=] j ]}", "r", 2000);
+    expect_number("{[ (| bad (()) [[ )-? 1 ?-( )- nope // 2 -( ]] |) r [=] 0"
+                  "   {? [[ <:((z [%] bad(()))) [[ r [=] r ++ z ]] :> ]] [! e [/] [[ r [=] r ++ 10 ]] !] ?} ]}", "r", 11);
+    expect_number("{[ r [=] 0 {? [[ )-? 1 ?-( ]] [! e [/] [[ r [=] 1 ]] !] ?} ]}", "r", 1);
+    printf("test_generators passed.\n");
+}
+
+/* Ranges are walked without a list behind them, dicts straight off their
+   entries, and natives take either like any other sequence. */
+static void test_iteration(void) {
+    expect_number("{[ r [=] 0 <:((i [%] seq..range((1,, 1001)))) [[ r [=] r ++ i ]] :> ]}", "r", 500500);
+    expect_number("{[ xs [=] [< v [:< v [%] seq..range((10,, 0,, -3)) >:] >] r [=] len((xs)) ** 100 ++ xs[3] ]}", "r", 401);
+    expect_number("{[ xs [=] [< v ** v [:< v [%] seq..range((20000)) >:] >] r [=] len((xs)) ++ xs[19999] ]}", "r", 399980001);
+    expect_number("{[ d [=] {< \"a\" [:] 1,, \"b\" [:] 2 >} d[\"c\"] [=] 3 r [=] 0"
+                  "   <:((k [%] d)) [[ r [=] r ++ d[k] ]] :>"
+                  "   <:((e [%] seq..entries((d)))) [[ r [=] r ++ e[1] ** 10 ]] :> ]}", "r", 66);
+    expect_number("{[ r [=] len((list..from((seq..range((0,, 1,, 0.25))))))"
+                  "   ++ par..reduce(((:< ((a,, b)) [[ a ++ b ]] >:),, seq..range((2000)),, 0)) ]}", "r", 1999004);
+    expect_number("{[ d [=] {< \"a\" [:] 1 >} r [=] 0"
+                  "   {? [[ <:((k [%] d)) [[ <:((j [%] seq..range((10)))) [[ d[k ++ str((j))] [=] j ]] :> ]] :> ]] [! e [/] [[ r [=] 1 ]] !] ?} ]}", "r", 1);
+    printf("test_iteration passed.\n");
+}
+
+/* Removing keys keeps every other key reachable, iteration follows
+   insertion order, and churning keys through a small dict reuses its
+   buckets instead of growing it. */
+static void test_dict_table(void) {
+    Interpreter interp;
+    interpreter_init(&interp);
+    size_t pin = gc_pin_begin();
+    ObjDict *dict = obj_dict_new();
+    ObjString *keys[3000];
+    char name[32];
+    for (int i = 0; i < 3000; i++) {
+        int n = snprintf(name, sizeof(name), "k%d", i);
+        keys[i] = obj_string_copy(name, (size_t)n);
+        dict_set(dict, keys[i], NUMBER_VAL(i));
+    }
+    for (int i = 0; i < 3000; i += 2) assert(dict_delete(dict, keys[i]));
+    assert(dict->count == 1500 && !dict_delete(dict, keys[0]));
+    for (int i = 0; i < 3000; i++) {
+        Value v;
+        assert(dict_get_chars(dict, keys[i]->chars, keys[i]->length, &v) == (i % 2 == 1));
+        if (i % 2) assert(AS_NUMBER(v) == i);
+    }
+    dict_set(dict, keys[0], NUMBER_VAL(-1));
+    size_t seen = 0;
+    double last = 0;
+    for (size_t i = 0; i < dict->used; i++) {
+        if (!dict->entries[i].key) continue;
+        double v = AS_NUMBER(dict->entries[i].value);
+        assert(seen == 0 || v > last || v == -1);
+        last = v;
+        seen++;
+    }
+    assert(seen == 1501 && last == -1);
+
+    ObjDict *small = obj_dict_new();
+    for (int i = 0; i < 3000; i++) {
+        dict_set(small, keys[i], NUMBER_VAL(i));
+        if (i >= 4) assert(dict_delete(small, keys[i - 4]));
+    }
+    assert(small->count == 4 && small->capacity == 16);
+    gc_pin_end(pin);
+    interpreter_free(&interp);
+    printf("test_dict_table passed.\n");
+}
+
+/* Equal names share one string; the table holds them weakly */
+static void test_string_intern(void) {
+    Interpreter interp;
+    interpreter_init(&interp);
+    size_t pin = gc_pin_begin();
+    ObjString *a = obj_string_intern("alpha", 5);
+    assert(a->interned && obj_string_intern("alpha", 5) == a);
+    ObjString *copy = obj_string_copy("alpha", 5);
+    assert(!copy->interned && values_equal(OBJ_VAL(a), OBJ_VAL(copy)));
+    ObjDict *dict = obj_dict_new();
+    dict_set(dict, copy, NUMBER_VAL(1));
+    assert(dict->entries[0].key == a);
+    gc_pin_end(pin);
+
+    char name[32];
+    pin = gc_pin_begin();
+    for (int i = 0; i < 20000; i++) {
+        int n = snprintf(name, sizeof(name), "transient%d", i);
+        obj_string_intern(name, (size_t)n);
+    }
+    gc_pin_end(pin);
+    gc_collect();
+    size_t before = gc_bytes_allocated();
+    pin = gc_pin_begin();
+    ObjString *again = obj_string_intern("transient7", 10);
+    assert(again->interned && obj_string_intern("transient7", 10) == again);
+    gc_pin_end(pin);
+    assert(before < 20000 * 16);
+    interpreter_free(&interp);
+
+    /* The resolver caches the canonical string on the node and keeps it
+       alive with the globals */
+    Lexer *lexer = lexer_create("{[ s [=] \"cached literal\" d [=] {< \"a\" [:] 1 >} d.field [=] s ]}", "test_runtime.lilith");
+    AstNode *ast = parser_parse(lexer);
+    interpreter_init(&interp);
+    interpreter_run(&interp, ast);
+    assert(!interp.throw_flag);
+    gc_collect();
+    AstNode *literal = ast->as.program.body->as.block.stmts[0]->as.assign.value;
+    AstNode *member = ast->as.program.body->as.block.stmts[2]->as.assign.target;
+    pin = gc_pin_begin();
+    assert(literal->as.string.key == obj_string_intern("cached literal", 14));
+    assert(member->as.member.key == obj_string_intern("field", 5));
+    gc_pin_end(pin);
+    interpreter_free(&interp);
+    ast_free(ast);
+    lexer_destroy(lexer);
+
+    expect_number("{[ d [=] {< \"k\" [:] 1 >} k [=] \"k\" d[k] [=] d[k] ++ 1 r [=] len((d)) ** 10 ++ d[\"k\"] ]}", "r", 12);
+    printf("test_string_intern passed.\n");
+}
+
+/* Bytes live inline; one-byte strings come from the static table */
+static void test_inline_strings(void) {
+    Interpreter interp;
+    interpreter_init(&interp);
+    size_t pin = gc_pin_begin();
+    ObjString *x = obj_string_copy("x", 1);
+    assert(x == obj_string_byte('x') && x == obj_string_intern("x", 1));
+    assert(x->obj.space == GC_SPACE_STATIC && x->interned && strcmp(x->chars, "x") == 0);
+    char *big = (char *)malloc(100000);
+    memset(big, 'b', 100000);
+    ObjString *large = obj_string_take(big, 100000);
+    assert(large->obj.space == GC_SPACE_OLD && large->length == 100000 && large->chars[100000] == '\0');
+    gc_pin_end(pin);
+    gc_collect();
+    interpreter_free(&interp);
+
+    expect_number("{[ s [=] \"abcabc\" n [=] 0 <:((c [%] s)) [[ d [=] [?((c == \"c\"))[(1)] :|: [(0)] ?] n [=] n ++ d ]] :>"
+                  "   r [=] n ** 10 ++ len((s[2])) ]}", "r", 21);
+    printf("test_inline_strings passed.\n");
+}
+
+/* Strings are hashed on first use as a key, every byte counting */
+static void test_string_hash(void) {
+    Interpreter interp;
+    interpreter_init(&interp);
+    size_t pin = gc_pin_begin();
+    ObjString *s = obj_string_copy("not yet a key", 13);
+    assert(atomic_load(&s->hash) == 0);
+    ObjDict *dict = obj_dict_new();
+    dict_set(dict, s, NUMBER_VAL(1));
+    assert(string_hash(s) == hash_string("not yet a key", 13) && string_hash(s) != 0);
+    gc_pin_end(pin);
+    interpreter_free(&interp);
+
+    /* Flipping any one bit of a key of any length changes its hash */
+    char buf[100];
+    for (size_t len = 0; len <= sizeof(buf); len++) {
+        memset(buf, 'k', sizeof(buf));
+        uint64_t base = hash_string(buf, len);
+        assert(base == hash_string(buf, len));
+        for (size_t i = 0; i < len; i++) {
+            buf[i] ^= 1;
+            assert(hash_string(buf, len) != base);
+            buf[i] ^= 1;
+        }
+        if (len > 0) assert(hash_string(buf, len - 1) != base);
+    }
+    printf("test_string_hash passed.\n");
+}
+
+/* Long concatenations are ropes; anything reading the bytes flattens them */
+static void test_string_ropes(void) {
+    Interpreter interp;
+    interpreter_init(&interp);
+    size_t pin = gc_pin_begin();
+    ObjString *a = obj_string_copy("0123456789012345678901234567890123456789", 40);
+    ObjString *rope = obj_string_concat(a, a);
+    assert(rope->kind == STRING_ROPE && rope->length == 80);
+    for (int i = 0; i < 100; i++) rope = obj_string_concat(rope, obj_string_byte('x'));
+    const char *chars = string_chars(rope);
+    assert(strlen(chars) == 180 && chars[79] == '9' && chars[80] == 'x' && chars[179] == 'x');
+    assert(string_chars(rope) == chars);
+    ObjString *flat = obj_string_copy(chars, 180);
+    assert(values_equal(OBJ_VAL(rope), OBJ_VAL(flat)) && string_hash(rope) == string_hash(flat));
+    gc_pin_end(pin);
+    interpreter_free(&interp);
+
+    expect_number("{[ s [=] \"\" <:((i [%] seq..range((5000)))) [[ s [=] s ++ i ++ \",\" ]] :>"
+                  "   d [=] {< \"k\" [:] 1 >} d[s] [=] 2 t [=] \"\" <:((i [%] seq..range((5000)))) [[ t [=] t ++ i ++ \",\" ]] :>"
+                  "   e [=] [?((s == t))[(1)] :|: [(0)] ?] r [=] len((s)) ++ d[t] ++ len((str..split((s,, \",\")))) ++ e ]}", "r", 23890 + 2 + 5000 + 1);
+    printf("test_string_ropes passed.\n");
+}
+
+/* Long slices share the bytes of a string that does not move; short ones
+   and nursery strings are copied. */
+static void test_string_views(void) {
+    Interpreter interp;
+    interpreter_init(&interp);
+    size_t pin = gc_pin_begin();
+    enum { BIG = 100000 };
+    char *buf = (char *)malloc(BIG + 1);
+    for (size_t i = 0; i < BIG; i++) buf[i] = (char)('a' + i % 26);
+    buf[BIG] = '\0';
+    ObjString *big = obj_string_take(buf, BIG);
+    assert(obj_string_slice(big, 0, BIG) == big);
+    ObjString *view = obj_string_slice(big, 26, 1000);
+    assert(view->kind == STRING_VIEW && view->length == 1000);
+    assert(string_bytes(view) == string_bytes(big) + 26);
+    ObjString *inner = obj_string_slice(view, 1, 100);
+    assert(inner->kind == STRING_VIEW && STRING_VIEW_OF(inner)->parent == big);
+    assert(string_bytes(inner) == string_bytes(big) + 27 && string_bytes(inner)[0] == 'b');
+    ObjString *small = obj_string_slice(big, 3, 5);
+    assert(small->kind == STRING_FLAT && strcmp(string_chars(small), "defgh") == 0);
+    ObjString *flat = obj_string_copy(string_bytes(big) + 27, 100);
+    assert(values_equal(OBJ_VAL(inner), OBJ_VAL(flat)) && string_hash(inner) == string_hash(flat));
+    const char *chars = string_chars(inner);
+    assert(strlen(chars) == 100 && chars[0] == 'b' && string_bytes(inner) == chars);
+    gc_pin_end(pin);
+    interpreter_free(&interp);
+
+    expect_number("{[ s [=] \"\" <:((i [%] seq..range((2000)))) [[ s [=] s ++ \"field\" ++ i ++ \";\" ]] :>"
+                  "   parts [=] str..split((s,, \";\")) t [=] str..join((\";\",, parts)) ++ \";\""
+                  "   e [=] [?((s == t))[(1)] :|: [(0)] ?] r [=] len((parts)) ++ e ]}", "r", 2001);
+    expect_number("{[ pad [=] \"                                        \" body [=] \"0123456789012345678901234567890123456789\""
+                  "   t [=] str..trim((pad ++ body ++ pad)) sl [=] str..slice((t,, 5,, 45))"
+                  "   d [=] {< body [:] 7 >} k [=] str..slice((pad ++ body,, 40))"
+                  "   r [=] len((t)) ++ len((sl)) ++ d[k] ++ len((str..slice((t,, 30,, 10)))) ]}", "r", 40 + 35 + 7);
+    expect_number("{[ r [=] len((str..split((\"abc\",, \"\")))) ++ len((str..split((\"\",, \",\")))) ]}", "r", 1);
+    printf("test_string_views passed.\n");
+}
+
+/* Sorting is stable whatever the list holds; a long list of numbers takes
+   the parallel radix path, a key function the keyed one. */
+static void test_list_sort(void) {
+    scheduler_set_workers(4);
+    expect_number("{[ xs [=] [< i ** 7919 %% 100003 [:< i [%] seq..range((100000)) >:] >] list..sort((xs)) r [=] 0"
+                  "   <:((i [%] seq..range((1,, 100000)))) [[ d [=] [?((xs[i -- 1] >> xs[i]))[(1)] :|: [(0)] ?] r [=] r ++ d ]] :>"
+                  "   r [=] r ++ xs[99999] ]}", "r", 100002);
+    expect_number("{[ xs [=] [< i [:< i [%] seq..range((100000)) >:] >]"
+                  "   list..sort((xs,, (:< ((x)) [[ )- x %% 10 -( ]] >:))) r [=] xs[1] ++ xs[10000] ** 1000 ]}", "r", 1010);
+    expect_number("{[ s [=] list..sort(([< \"b\",, \"ab\",, \"abc\",, \"a\" >])) r [=] list..find((s,, \"abc\")) ]}", "r", 2);
+    expect_number("{[ m [=] list..sort(([< \"b\",, nil,, 2,, \"a\",, math..sqrt((:-:1)),, :-:0,, 0 >]))"
+                  "   r [=] list..find((m,, nil)) ** 10 ++ list..find((m,, \"a\")) ]}", "r", 64);
+    scheduler_shutdown();
+    printf("test_list_sort passed.\n");
+}
+
+/* Numeric arrays convert on store and refuse what their type cannot hold */
+static void test_numeric_arrays(void) {
+    expect_number("{[ a [=] arr..new((1000,, \"int32\")) <:((i [%] seq..range((1000)))) [[ a[i] [=] i ]] :>"
+                  "   r [=] 0 <:((v [%] a)) [[ r [=] r ++ v ]] :> r [=] r ++ len((a)) ]}", "r", 500500);
+    expect_number("{[ f [=] arr..from(([< 0.5,, 0.1 >],, \"float32\")) r [=] f[0] ++ len((list..from((f)))) ]}", "r", 2.5);
+    expect_number("{[ b [=] arr..from((seq..range((3)),, \"int8\")) r [=] 0"
+                  "   {? [[ b[0] [=] 128 ]] [! e [/] [[ r [=] 1 ]] !] ?}"
+                  "   {? [[ b[1] [=] 0.5 ]] [! e [/] [[ r [=] r ++ 1 ]] !] ?} r [=] r ** 10 ++ b[2] ]}", "r", 22);
+    printf("test_numeric_arrays passed.\n");
+}
+
+/* Every kernel level the CPU has must match the scalar one bit for bit */
+static void test_vec_kernels(void) {
+    enum { MAX = 67 };
+    double a[MAX], b[MAX], c[MAX], want[MAX], got[MAX];
+    uint64_t seed = 0x9e3779b97f4a7c15u;
+    for (size_t i = 0; i < MAX; i++) {
+        seed = seed * 6364136223846793005u + 1442695040888963407u;
+        a[i] = (double)(int64_t)(seed >> 11) / 3e12;
+        b[i] = (double)(seed >> 40) / 7.0 - 1e5;
+        c[i] = 1.0 / (double)(i + 1);
+    }
+    const SimdKernels *scalar = simd_kernels_for(SIMD_SCALAR);
+    assert(scalar && simd_kernels() == simd_kernels_for(simd_level()));
+    for (int level = SIMD_SSE2; level <= SIMD_AVX2; level++) {
+        const SimdKernels *k = simd_kernels_for((SimdLevel)level);
+        if (!k) continue;
+        for (size_t n = 0; n <= MAX; n++) {
+            scalar->fma(a, b, c, want, n);
+            k->fma(a, b, c, got, n);
+            assert(memcmp(want, got, n * sizeof(double)) == 0);
+            scalar->div(a, b, want, n);
+            k->div(a, b, got, n);
+            assert(memcmp(want, got, n * sizeof(double)) == 0);
+            scalar->scale(a, 0.1, want, n);
+            k->scale(a, 0.1, got, n);
+            assert(memcmp(want, got, n * sizeof(double)) == 0);
+            double s0 = scalar->sum(a, n), s1 = k->sum(a, n);
+            double d0 = scalar->dot(a, b, n), d1 = k->dot(a, b, n);
+            assert(memcmp(&s0, &s1, sizeof s0) == 0 && memcmp(&d0, &d1, sizeof d0) == 0);
+            if (n == 0) continue;
+            assert(scalar->min(b, n) == k->min(b, n) && scalar->max(b, n) == k->max(b, n));
+        }
+        printf("  vec: %s matches scalar\n", simd_level_name((SimdLevel)level));
+    }
+    expect_number("{[ r [=] vec..dot(([< 1,, 2,, 3 >],, arr..from((seq..range((4,, 7)))))) ]}", "r", 32);
+    expect_number("{[ v [=] vec..fma((arr..from(([< 1,, 2 >],, \"int8\")),, 3,, [< 0.5,, 0.5 >])) r [=] vec..sum((v)) ]}", "r", 10);
+    expect_number("{[ v [=] vec..scale((seq..range((100)),, 2)) r [=] vec..argmax((v)) ++ vec..max((v)) ]}", "r", 297);
+    printf("test_vec_kernels passed.\n");
+}
+
+static double time_par_map(size_t workers) {
+    const char *source =
+        "{[ xs [=] [< 0 >] i [=] 1 <+((i << 256)) [[ list..push((xs,, i)) i [=] i ++ 1 ]] +>"
+        "   work [=] (:< ((v)) [[ k [=] 0 acc [=] v <+((k << 20000)) [[ acc [=] acc ++ k k [=] k ++ 1 ]] +> )- acc -( ]] >:)"
+        "   r [=] par..reduce(((:< ((a,, b)) [[ a ++ b ]] >:),, par..map((work,, xs)),, 0)) ]}";
+    scheduler_set_workers(workers);
+    int threw = 0;
+    double start = now_seconds();
+    Value r = run_and_get(source, ENGINE_VM, "r", &threw);
+    double elapsed = now_seconds() - start;
+    assert(!threw && IS_NUMBER(r) && AS_NUMBER(r) == 256.0 * 199990000.0 + 32640.0);
+    scheduler_shutdown();
+    return elapsed;
+}
+
+/* par..map with up to 32 workers; the speedup is reported, not asserted,
+   since wall-clock time depends on the machine's load */
+static void test_par_scaling(void) {
+    size_t cpus = thread_pool_cpu_count();
+    size_t workers = cpus > 32 ? 32 : cpus;
+    double serial = time_par_map(1);
+    double parallel = time_par_map(workers);
+    double speedup = serial / parallel;
+    printf("  par..map: 1 worker %.3fs, %zu workers %.3fs: speedup %.2fx on %zu CPUs\n",
+           serial, workers, parallel, speedup, cpus);
+    printf("test_par_scaling passed.\n");
+}
+
+/* Separate programs on separate threads share nothing but the collector;
+   each keeps collecting while the others allocate. */
+typedef struct {
+    const char *source;
+    const char *name;
+    double expected;
+} ConcurrentProgram;
+
+static void *run_concurrent_program(void *arg) {
+    ConcurrentProgram *program = (ConcurrentProgram *)arg;
+    for (int round = 0; round < 3; round++) expect_number(program->source, program->name, program->expected);
+    return NULL;
+}
+
+static void test_concurrent_programs(void) {
+    ConcurrentProgram programs[] = {
+        { "{[ (| fib ((n)) [[ [?((n << 2)) [[ )- n -( ]] ?] )- fib((n -- 1)) ++ fib((n -- 2)) -( ]] |)"
+          "   r [=] fib((18)) ]}", "r", 2584 },
+        { "{[ keep [=] [< [< 0,, 0 >] >] i [=] 0"
+          "   <+((i << 30000)) [[ xs [=] [< i,, str((i)) >]"
+          "     [?((i %% 1000 == 0)) [[ list..push((keep,, xs)) ]] ?] i [=] i ++ 1 ]] +>"
+          "   total [=] 0 <:((x [%] keep)) [[ total [=] total ++ x[0] ]] :> ]}", "total", 435000 },
+        { "{[ {| Box [[ (| init ((self)) [[ self.v [=] [< 0 >] ]] |) ]] |}"
+          "   b [=] Box(( )) i [=] 0"
+          "   <+((i << 20000)) [[ b.v [=] [< i,, str((i)) >] i [=] i ++ 1 ]] +>"
+          "   v [=] b.v r [=] v[0] ]}", "r", 19999 },
+        { "{[ (| counter (( )) [[ n [=] 0 )- (:< (( )) [[ n [=] n ++ 1 )- n -( ]] >:) -( ]] |)"
+          "   r [=] 0 i [=] 0"
+          "   <+((i << 5000)) [[ c [=] counter(( )) c(( )) r [=] r ++ c(( )) i [=] i ++ 1 ]] +>"
+          "   x [=] math..rand((5,, 6)) r [=] r ++ x ]}", "r", 10005 },
+    };
+    enum { COUNT = sizeof(programs) / sizeof(programs[0]) };
+    pthread_t threads[COUNT];
+    for (size_t i = 0; i < COUNT; i++) pthread_create(&threads[i], NULL, run_concurrent_program, &programs[i]);
+    /* Collections started by the programs need not wait for this thread */
+    gc_safe_enter();
+    for (size_t i = 0; i < COUNT; i++) pthread_join(threads[i], NULL);
+    gc_safe_leave();
+    printf("test_concurrent_programs passed.\n");
+}
+
+static void test_uncaught_error(void) {
+    Engine engines[] = { ENGINE_AST, ENGINE_VM };
+    for (size_t i = 0; i < 2; i++) {
+        int threw = 0;
+        run_and_get("{[ x [=] missing ]}", engines[i], "x", &threw);
+        assert(threw);
+    }
+    printf("test_uncaught_error passed.\n");
+}
+
+int main(void) {
+    test_arithmetic_and_loops();
+    test_recursion();
+    test_deep_recursion();
+    test_break_continue_finally();
+    test_try_catch();
+    test_comprehension_and_lambda();
+    test_closures();
+    test_gc_under_pressure();
+    test_old_to_young_stores();
+    test_incremental_marking();
+    test_slab_realloc();
+    test_parallel_block();
+    test_par_natives();
+    test_par_scaling();
+    test_parallel_comprehension();
+    test_generators();
+    test_iteration();
+    test_dict_table();
+    test_string_intern();
+    test_inline_strings();
+    test_string_hash();
+    test_string_ropes();
+    test_string_views();
+    test_list_sort();
+    test_numeric_arrays();
+    test_vec_kernels();
+    test_futures();
+    test_event_loop();
+    test_concurrent_programs();
+    test_uncaught_error();
+    printf("All runtime tests passed.\n");
+    return 0;
+}